@@ -41,6 +41,7 @@ const std::string kCmdNamePersist = "persist";
 const std::string kCmdNameKeys = "keys";
 const std::string kCmdNameRename = "rename";
 const std::string kCmdNameRenameNX = "renamenx";
+const std::string kCmdNameDbsize = "dbsize";
 
 // raft cmd
 const std::string kCmdNameRaftCluster = "raft.cluster";
@@ -92,6 +93,7 @@ const std::string kSubCmdNameDebugOOM = "oom";
 const std::string kSubCmdNameDebugSegfault = "segfault";
 const std::string kCmdNameInfo = "info";
 const std::string kCmdNameSort = "sort";
+const std::string kCmdNameReshard = "reshard";
 
 // hash cmd
 const std::string kCmdNameHSet = "hset";
@@ -113,6 +115,7 @@ const std::string kCmdNameHExists = "hexists";
 
 // set cmd
 const std::string kCmdNameSIsMember = "sismember";
+const std::string kCmdNameSMIsMember = "smismember";
 const std::string kCmdNameSAdd = "sadd";
 const std::string kCmdNameSUnionStore = "sunionstore";
 const std::string kCmdNameSInter = "sinter";
@@ -157,6 +160,7 @@ const std::string kCmdNameZRemrangebyrank = "zremrangebyrank";
 const std::string kCmdNameZRevrangebyscore = "zrevrangebyscore";
 const std::string kCmdNameZCard = "zcard";
 const std::string kCmdNameZScore = "zscore";
+const std::string kCmdNameZMScore = "zmscore";
 const std::string kCmdNameZRange = "zrange";
 const std::string kCmdNameZRangebylex = "zrangebylex";
 const std::string kCmdNameZRevrangebylex = "zrevrangebylex";
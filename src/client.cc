@@ -481,6 +481,117 @@ bool PClient::SendPacket() {
   return true;
 }
 
+void PClient::FlushReply() {
+  if (!message_.empty()) {
+    std::string str;
+    message_.swap(str);
+    g_pikiwidb->SendPacket2Client(shared_from_this(), std::move(str));
+  }
+}
+
+void PClient::StreamReply(std::unique_ptr<storage::ElementReader> reader) {
+  auto stream = std::make_unique<ReplyStream>(this, GetCurrentDB(), std::move(reader));
+  if (!stream->Continue()) {
+    std::lock_guard<std::mutex> lock(reply_stream_mutex_);
+    reply_stream_ = std::move(stream);
+  }
+}
+
+void PClient::ResumeReplyWhenWritable() {
+  {
+    std::lock_guard<std::mutex> lock(reply_stream_mutex_);
+    if (!reply_stream_) {
+      return;
+    }
+  }
+  std::weak_ptr<PClient> weak_client = shared_from_this();
+  auto resume = [weak_client] {
+    if (auto client = weak_client.lock()) {
+      g_pikiwidb->SubmitSlow(std::make_shared<CmdThreadPoolTask>(client, true));
+    }
+  };
+  // a closed client is never called back, its stream goes with it
+  if (g_pikiwidb->NotifySendBelow(shared_from_this(), ReplyStream::kResumeLimit, resume)) {
+    resume();
+  }
+}
+
+void PClient::ResumeReply() {
+  ReplyStream* stream = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(reply_stream_mutex_);
+    stream = reply_stream_.get();
+  }
+  if (stream == nullptr) {
+    return;
+  }
+  auto& db = PSTORE.GetBackend(stream->DBIndex());
+  db->LockShared();
+  bool ended = stream->Continue();
+  db->UnLockShared();
+  if (!ended) {
+    ResumeReplyWhenWritable();
+    return;
+  }
+  std::shared_ptr<CmdThreadPoolTask> deferred_task;
+  {
+    std::lock_guard<std::mutex> lock(reply_stream_mutex_);
+    reply_stream_.reset();
+    deferred_task.swap(deferred_task_);
+  }
+  if (deferred_task) {
+    g_pikiwidb->SubmitFast(deferred_task);
+  }
+}
+
+bool PClient::DeferAfterReply(const std::shared_ptr<CmdThreadPoolTask>& task) {
+  std::lock_guard<std::mutex> lock(reply_stream_mutex_);
+  if (!reply_stream_) {
+    return false;
+  }
+  deferred_task_ = task;
+  return true;
+}
+
+storage::Status ReplyStream::Begin(uint64_t count) {
+  client_->AppendArrayLenUint64(count);
+  return storage::Status::OK();
+}
+
+storage::Status ReplyStream::Append(const storage::Slice& element) {
+  client_->AppendStringLenUint64(element.size());
+  client_->AppendContent(element.data(), element.size());
+  return storage::Status::OK();
+}
+
+storage::Status ReplyStream::AppendScore(double score) {
+  char buf[32];
+  int64_t len = pstd::D2string(buf, sizeof(buf), score);
+  return Append(storage::Slice(buf, len));
+}
+
+bool ReplyStream::Continue() {
+  auto client = client_->shared_from_this();
+  while (client_->State() == ClientState::kOK) {
+    storage::Status s = reader_->Read(this, kChunkSize);
+    if (!s.ok()) {
+      WARN("client {} closed, its reply of {} was cut short: {}", client_->GetConnId(), client_->CmdName(),
+           s.ToString());
+      client_->Clear();
+      client_->Close();
+      return true;
+    }
+    client_->FlushReply();
+    if (reader_->Done()) {
+      return true;
+    }
+    if (g_pikiwidb->PendingSendSize(client) > kPendingLimit) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool PClient::SendPacket(std::string&& msg) {
   g_pikiwidb->SendPacket2Client(shared_from_this(), std::move(msg));
   SendOver();
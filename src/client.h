@@ -11,6 +11,8 @@
 #pragma once
 
 #include <chrono>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <span>
 #include <unordered_map>
@@ -117,6 +119,10 @@ class CmdRes {
   inline void AppendArrayLenUint64(uint64_t ori) { RedisAppendLenUint64(message_, ori, "*"); }
   inline void AppendInteger(int64_t ori) { RedisAppendLen(message_, ori, ":"); }
   inline void AppendContent(const std::string& value) { RedisAppendContent(message_, value); }
+  inline void AppendContent(const char* data, size_t size) {
+    message_.append(data, size);
+    message_.append(CRLF);
+  }
   inline void AppendStringRaw(const std::string& value) { message_.append(value); }
   inline void SetLineString(const std::string& value) { message_ = value + CRLF; }
 
@@ -156,6 +162,8 @@ enum class ClientState {
 
 class DB;
 struct PSlaveInfo;
+class CmdThreadPoolTask;
+class ReplyStream;
 
 class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
  public:
@@ -179,6 +187,21 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
     reset();
   }
 
+  // Hands the reply built so far over to the socket while the command is still running
+  void FlushReply();
+
+  // Sends the elements of reader as the reply of the command, see ReplyStream. Called by
+  // the command, with the shared lock of the db held.
+  void StreamReply(std::unique_ptr<storage::ElementReader> reader);
+  // Called by the worker once the command, or a part of its reply, went to the socket. A
+  // streamed reply not sent whole yet goes on in a task once the client read enough of it.
+  void ResumeReplyWhenWritable();
+  // Sends the streamed reply on, in the task of ResumeReplyWhenWritable. The command the
+  // client sent meanwhile is submitted once the reply ended.
+  void ResumeReply();
+  // true if a streamed reply is still being sent, task then runs once it ended
+  bool DeferAfterReply(const std::shared_ptr<CmdThreadPoolTask>& task);
+
   // active close
   void Close();
 
@@ -333,6 +356,11 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
   int8_t net_thread_index_ = 0;
   net::SocketAddr addr_;
 
+  // The streamed reply not sent whole yet and the command sent meanwhile
+  std::mutex reply_stream_mutex_;
+  std::unique_ptr<ReplyStream> reply_stream_;
+  std::shared_ptr<CmdThreadPoolTask> deferred_task_;
+
   static thread_local PClient* s_current;
 
   /*
@@ -341,4 +369,35 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
   std::unordered_map<std::string, CommandStatistics> cmdstat_map_;
   std::shared_ptr<TimeStat> time_stat_;
 };
+
+// Sends the elements of a storage reader to a client as one array of bulk strings. The
+// reply goes to the socket every kChunkSize bytes, as long as the client has at most
+// kPendingLimit bytes left to read. Past that the stream stops and lets the worker thread
+// and the db lock go, it goes on in a new task once the socket wrote down to kResumeLimit.
+// Only the reader and its snapshot are kept in between, so a reply of any size takes a
+// bounded amount of memory however slowly the client reads. A read failing midway leaves
+// the reply cut short, the client is closed then.
+class ReplyStream : public storage::ElementSink {
+ public:
+  static constexpr size_t kChunkSize = 64 * 1024;
+  static constexpr size_t kPendingLimit = 4 * 1024 * 1024;
+  static constexpr size_t kResumeLimit = 1024 * 1024;
+
+  ReplyStream(PClient* client, int db_index, std::unique_ptr<storage::ElementReader> reader)
+      : client_(client), db_index_(db_index), reader_(std::move(reader)) {}
+
+  storage::Status Begin(uint64_t count) override;
+  storage::Status Append(const storage::Slice& element) override;
+  storage::Status AppendScore(double score) override;
+
+  // Sends the reply on, with the shared lock of the db held. true once it ended, false
+  // when the client has to read first.
+  bool Continue();
+  int DBIndex() const { return db_index_; }
+
+ private:
+  PClient* client_;
+  const int db_index_;
+  std::unique_ptr<storage::ElementReader> reader_;
+};
 }  // namespace pikiwidb
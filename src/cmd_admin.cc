@@ -78,22 +78,45 @@ FlushdbCmd::FlushdbCmd(const std::string& name, int16_t arity)
 
 bool FlushdbCmd::DoInitial(PClient* client) { return true; }
 
+// Moves the directories of a db aside, before the db is reopened empty, and returns them
+// for deletion. The instances may live in the data dirs besides the db path.
+static std::vector<std::string> MoveDBDirsForDeleting(int db_index) {
+  std::vector<std::string> dirs{g_config.db_path.ToString() + std::to_string(db_index)};
+  for (const auto& data_path : PSTORE.GetBackend(db_index)->GetStorage()->GetDataPaths()) {
+    auto dir = data_path.back() == '/' ? data_path.substr(0, data_path.size() - 1) : data_path;
+    if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+      dirs.push_back(std::move(dir));
+    }
+  }
+  for (auto& dir : dirs) {
+    auto path_temp = dir + "_deleting/";
+    pstd::RenameFile(dir, path_temp);
+    dir = std::move(path_temp);
+  }
+  return dirs;
+}
+
 void FlushdbCmd::DoCmd(PClient* client) {
   int currentDBIndex = client->GetCurrentDB();
   PSTORE.GetBackend(currentDBIndex).get()->Lock();
   DEFER { PSTORE.GetBackend(currentDBIndex).get()->UnLock(); };
+  if (PSTORE.GetBackend(currentDBIndex)->IsResharding()) {
+    client->SetRes(CmdRes::kErrOther, "flushdb is not allowed while resharding");
+    return;
+  }
 
-  std::string db_path = g_config.db_path.ToString() + std::to_string(currentDBIndex);
-  std::string path_temp = db_path;
-  path_temp.append("_deleting/");
-  pstd::RenameFile(db_path, path_temp);
+  auto paths_temp = MoveDBDirsForDeleting(currentDBIndex);
 
   auto s = PSTORE.GetBackend(currentDBIndex)->Open();
   if (!s.ok()) {
     client->SetRes(CmdRes::kErrOther, "flushdb failed");
     return;
   }
-  auto f = std::async(std::launch::async, [&path_temp]() { pstd::DeleteDir(path_temp); });
+  auto f = std::async(std::launch::async, [&paths_temp]() {
+    for (const auto& path_temp : paths_temp) {
+      pstd::DeleteDir(path_temp);
+    }
+  });
   client->SetRes(CmdRes::kOK);
 }
 
@@ -104,17 +127,32 @@ FlushallCmd::FlushallCmd(const std::string& name, int16_t arity)
 bool FlushallCmd::DoInitial(PClient* client) { return true; }
 
 void FlushallCmd::DoCmd(PClient* client) {
+  // a resharding job is only started under the shared lock, so it is checked with
+  // every db locked
   for (size_t i = 0; i < g_config.databases; ++i) {
     PSTORE.GetBackend(i).get()->Lock();
-    std::string db_path = g_config.db_path.ToString() + std::to_string(i);
-    std::string path_temp = db_path;
-    path_temp.append("_deleting/");
-    pstd::RenameFile(db_path, path_temp);
+  }
+  DEFER {
+    for (size_t i = 0; i < g_config.databases; ++i) {
+      PSTORE.GetBackend(i).get()->UnLock();
+    }
+  };
+  for (size_t i = 0; i < g_config.databases; ++i) {
+    if (PSTORE.GetBackend(i)->IsResharding()) {
+      client->SetRes(CmdRes::kErrOther, "flushall is not allowed while resharding");
+      return;
+    }
+  }
+  for (size_t i = 0; i < g_config.databases; ++i) {
+    auto paths_temp = MoveDBDirsForDeleting(static_cast<int>(i));
 
     auto s = PSTORE.GetBackend(i)->Open();
     assert(s.ok());
-    auto f = std::async(std::launch::async, [&path_temp]() { pstd::DeleteDir(path_temp); });
-    PSTORE.GetBackend(i).get()->UnLock();
+    auto f = std::async(std::launch::async, [&paths_temp]() {
+      for (const auto& path_temp : paths_temp) {
+        pstd::DeleteDir(path_temp);
+      }
+    });
   }
   client->SetRes(CmdRes::kOK);
 }
@@ -168,11 +206,14 @@ const std::string InfoCmd::kCPUSection = "cpu";
 const std::string InfoCmd::kDataSection = "data";
 const std::string InfoCmd::kCommandStatsSection = "commandstats";
 const std::string InfoCmd::kRaftSection = "raft";
+const std::string InfoCmd::kCompressionSection = "compression";
+const std::string InfoCmd::kKeyspaceSection = "keyspace";
 
 InfoCmd::InfoCmd(const std::string& name, int16_t arity) : BaseCmd(name, arity, kCmdFlagsAdmin, kAclCategoryAdmin) {}
 
 bool InfoCmd::DoInitial(PClient* client) {
   size_t argc = client->argv_.size();
+  rescan_keyspace_ = false;
   if (argc == 1) {
     info_section_ = kInfo;
     return true;
@@ -189,6 +230,13 @@ bool InfoCmd::DoInitial(PClient* client) {
       client->SetRes(CmdRes::kErrOther, "the cmd is not supported");
       return false;
     }
+  } else if (argc == 3 && argv_ == kKeyspaceSection) {
+    if (client->argv_[2] != "1" && client->argv_[2] != "0") {
+      client->SetRes(CmdRes::kSyntaxErr);
+      return false;
+    }
+    info_section_ = kInfoKeyspace;
+    rescan_keyspace_ = client->argv_[2] == "1";
   } else {
     client->SetRes(CmdRes::kSyntaxErr);
     return false;
@@ -208,6 +256,7 @@ void InfoCmd::DoCmd(PClient* client) {
       info.append("\r\n");
       InfoCPU(info);
       info.append("\r\n");
+      InfoKeyspace(client, info);
       break;
     case kInfoAll:
       InfoServer(info);
@@ -220,6 +269,7 @@ void InfoCmd::DoCmd(PClient* client) {
       info.append("\r\n");
       InfoCPU(info);
       info.append("\r\n");
+      InfoKeyspace(client, info);
       break;
     case kInfoServer:
       InfoServer(info);
@@ -239,6 +289,12 @@ void InfoCmd::DoCmd(PClient* client) {
     case kInfoRaft:
       InfoRaft(info);
       break;
+    case kInfoCompression:
+      InfoCompression(client, info);
+      break;
+    case kInfoKeyspace:
+      InfoKeyspace(client, info);
+      break;
     default:
       break;
   }
@@ -341,6 +397,48 @@ void InfoCmd::InfoStats(std::string& info) {
 
   tmp_stream << "is_bgsaving:" << (PREPL.IsBgsaving() ? "Yes" : "No") << "\r\n";
   tmp_stream << "slow_logs_count:" << PSlowLog::Instance().GetLogsCount() << "\r\n";
+
+  pstd::lock::LockStats lock_stats;
+  for (size_t i = 0; i < g_config.databases; ++i) {
+    auto db_stats = PSTORE.GetBackend(i)->GetStorage()->GetKeyLockStats();
+    lock_stats.waits += db_stats.waits;
+    lock_stats.wait_micros += db_stats.wait_micros;
+    lock_stats.max_wait_micros = std::max(lock_stats.max_wait_micros, db_stats.max_wait_micros);
+  }
+  tmp_stream << "keylock_waits:" << lock_stats.waits << "\r\n";
+  tmp_stream << "keylock_wait_micros:" << lock_stats.wait_micros << "\r\n";
+  tmp_stream << "keylock_max_wait_micros:" << lock_stats.max_wait_micros << "\r\n";
+
+  // the I/O of the instances in every data dir, summed over the dbs
+  auto data_dirs = g_config.GetDataDirs();
+  std::vector<storage::DataPathIOStats> dir_stats(data_dirs.size() + 1);
+  dir_stats[0].path = g_config.db_path.ToString();
+  for (size_t k = 0; k < data_dirs.size(); ++k) {
+    dir_stats[k + 1].path = data_dirs[k].first;
+  }
+  for (size_t i = 0; i < g_config.databases; ++i) {
+    auto& db = PSTORE.GetBackend(i);
+    const auto& db_data_paths = db->GetDataPaths();
+    for (const auto& stats : db->GetStorage()->GetDataPathIOStats()) {
+      auto iter = std::find_if(db_data_paths.begin(), db_data_paths.end(),
+                               [&](const auto& data_path) { return data_path.first == stats.path; });
+      // the instances outside the configured data dirs are counted in the db path
+      auto& sum = dir_stats[iter == db_data_paths.end() ? 0 : iter - db_data_paths.begin() + 1];
+      sum.instances += stats.instances;
+      sum.read_bytes += stats.read_bytes;
+      sum.wal_bytes += stats.wal_bytes;
+      sum.flush_bytes += stats.flush_bytes;
+      sum.compaction_bytes += stats.compaction_bytes;
+    }
+  }
+  for (size_t k = 0; k < dir_stats.size(); ++k) {
+    const auto& stats = dir_stats[k];
+    tmp_stream << "data_dir" << k << ":path=" << stats.path << ",instances=" << stats.instances
+               << ",read_bytes=" << stats.read_bytes
+               << ",write_bytes=" << stats.wal_bytes + stats.flush_bytes + stats.compaction_bytes
+               << ",wal_bytes=" << stats.wal_bytes << ",flush_bytes=" << stats.flush_bytes
+               << ",compaction_bytes=" << stats.compaction_bytes << "\r\n";
+  }
   info.append(tmp_stream.str());
 }
 
@@ -373,6 +471,100 @@ void InfoCmd::InfoData(std::string& message) {
   message += ROCKSDB_VERSION + std::string(":") + ROCKSDB_NAMESPACE::GetRocksVersionAsString() + "\r\n";
 }
 
+/*
+ * INFO compression
+ * The raw size of the keys and values in the sst files of the current db against the
+ * size of their data blocks, for every column family and level of every instance.
+ * Reply:
+ *   #instance: 0Compression
+ *   instance: 0hash_data_cf_raw_bytes:1048576
+ *   instance: 0hash_data_cf_data_bytes:262144
+ *   instance: 0hash_data_cf_compression_ratio:4.00
+ *   instance: 0hash_data_cf_compression_ratio_level6:4.00
+ */
+void InfoCmd::InfoCompression(PClient* client, std::string& info) {
+  PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->GetCompressionInfo(info);
+}
+
+/*
+ * INFO keyspace [1]
+ * The key counts every db with keys keeps up to date on its writes, followed by the
+ * counts of every type. The counts
+ * of the last exact scan of the current db are appended when there is one,
+ * INFO keyspace 1 starts a new scan in the background.
+ * Reply:
+ *   # Keyspace
+ *   db0:keys=3,expires=1,avg_ttl=95,invalid_keys=0
+ *   db0_strings:keys=2,expires=1,avg_ttl=95,invalid_keys=0
+ *   db0_hashes:keys=1,expires=0,avg_ttl=0,invalid_keys=0
+ *   ...
+ *   db0_exact_scan:start_time=2024-01-01 12:00:00,duration=1,keys=3,expires=1,invalid_keys=0
+ */
+void InfoCmd::InfoKeyspace(PClient* client, std::string& info) {
+  static const std::vector<std::string> kTypeNames = {"strings", "hashes", "lists", "zsets", "sets"};
+  auto format_key_info = [](const storage::KeyInfo& key_info) {
+    return "keys=" + std::to_string(key_info.keys) + ",expires=" + std::to_string(key_info.expires) +
+           ",avg_ttl=" + std::to_string(key_info.avg_ttl) + ",invalid_keys=" + std::to_string(key_info.invalid_keys);
+  };
+  auto sum_key_infos = [](const std::vector<storage::KeyInfo>& key_infos) {
+    storage::KeyInfo total;
+    double ttl_sum = 0;
+    for (const auto& key_info : key_infos) {
+      total.keys += key_info.keys;
+      total.expires += key_info.expires;
+      total.invalid_keys += key_info.invalid_keys;
+      ttl_sum += static_cast<double>(key_info.avg_ttl) * static_cast<double>(key_info.expires);
+    }
+    total.avg_ttl = total.expires == 0 ? 0 : static_cast<uint64_t>(ttl_sum / static_cast<double>(total.expires));
+    return total;
+  };
+
+  if (rescan_keyspace_) {
+    PSTORE.GetBackend(client->GetCurrentDB())->StartKeyScan();
+  }
+
+  info.append("# Keyspace\r\n");
+  for (int i = 0; i < static_cast<int>(pikiwidb::g_config.databases.load()); ++i) {
+    auto& db = PSTORE.GetBackend(i);
+    std::vector<storage::KeyInfo> key_infos;
+    // the current db is locked by the command already
+    bool other_db = i != client->GetCurrentDB();
+    if (other_db) {
+      db->LockShared();
+    }
+    auto s = db->GetStorage()->GetApproximateKeyNum(&key_infos);
+    if (other_db) {
+      db->UnLockShared();
+    }
+    if (!s.ok()) {
+      info.append("db" + std::to_string(i) + ":error=" + s.ToString() + "\r\n");
+      continue;
+    }
+    auto total = sum_key_infos(key_infos);
+    if (total.keys == 0 && total.invalid_keys == 0) {
+      continue;
+    }
+    std::string db_name = "db" + std::to_string(i);
+    info.append(db_name + ":" + format_key_info(total) + "\r\n");
+    for (size_t type = 0; type < key_infos.size() && type < kTypeNames.size(); ++type) {
+      info.append(db_name + "_" + kTypeNames[type] + ":" + format_key_info(key_infos[type]) + "\r\n");
+    }
+  }
+
+  auto scan_info = PSTORE.GetBackend(client->GetCurrentDB())->GetKeyScanInfo();
+  std::string scan_name = "db" + std::to_string(client->GetCurrentDB()) + "_exact_scan:";
+  if (scan_info.scanning) {
+    info.append(scan_name + "scanning\r\n");
+  } else if (scan_info.start_time != 0) {
+    char start_time[32];
+    struct tm tm_buf;
+    strftime(start_time, sizeof(start_time), "%Y-%m-%d %H:%M:%S", localtime_r(&scan_info.start_time, &tm_buf));
+    auto total = sum_key_infos(scan_info.key_infos);
+    info.append(scan_name + "start_time=" + start_time + ",duration=" + std::to_string(scan_info.duration) + "," +
+                format_key_info(total) + "\r\n");
+  }
+}
+
 double InfoCmd::MethodofTotalTimeCalculation(const uint64_t time_consuming) {
   return static_cast<double>(time_consuming) / 1000.0;
 }
@@ -644,6 +836,86 @@ void SortCmd::InitialArgument() {
   get_patterns_.clear();
   ret_.clear();
 }
+ReshardCmd::ReshardCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsWrite, kAclCategoryWrite | kAclCategoryAdmin) {}
+
+bool ReshardCmd::DoInitial(PClient* client) {
+  const char* sub_cmd = client->argv_[1].data();
+  if ((strcasecmp(sub_cmd, "info") == 0 || strcasecmp(sub_cmd, "status") == 0 || strcasecmp(sub_cmd, "balance") == 0) &&
+      client->argv_.size() == 2) {
+    return true;
+  }
+  if (strcasecmp(sub_cmd, "migrate") == 0 && client->argv_.size() >= 4) {
+    return true;
+  }
+  client->SetRes(CmdRes::kSyntaxErr);
+  return false;
+}
+
+void ReshardCmd::DoCmd(PClient* client) {
+  auto& db = PSTORE.GetBackend(client->GetCurrentDB());
+  const char* sub_cmd = client->argv_[1].data();
+  if (strcasecmp(sub_cmd, "info") == 0) {
+    const auto& slot_indexer = db->GetStorage()->GetSlotIndexer();
+    std::vector<uint32_t> owned_slots(g_config.db_instance_num.load(), 0);
+    for (uint32_t slot = 0; slot < slot_indexer.GetSlotNum(); ++slot) {
+      ++owned_slots[slot_indexer.GetSlotOwner(slot)];
+    }
+    std::string info = "slot_num:" + std::to_string(slot_indexer.GetSlotNum()) + "\r\n";
+    for (size_t index = 0; index < owned_slots.size(); ++index) {
+      info += "instance" + std::to_string(index) + "_slots:" + std::to_string(owned_slots[index]) + "\r\n";
+    }
+    client->AppendString(info);
+    return;
+  }
+  if (strcasecmp(sub_cmd, "status") == 0) {
+    auto reshard_info = db->GetReshardInfo();
+    std::string info = "job:" + reshard_info.job + "\r\n";
+    info += "running:" + std::to_string(reshard_info.running ? 1 : 0) + "\r\n";
+    info += "start_time:" + std::to_string(reshard_info.start_time) + "\r\n";
+    info += "duration:" + std::to_string(reshard_info.duration) + "\r\n";
+    info += "result:" + reshard_info.result + "\r\n";
+    client->AppendString(info);
+    return;
+  }
+
+  // the job itself runs in the background, RESHARD STATUS reports how it ended
+  if (g_config.use_raft.load(std::memory_order_relaxed)) {
+    client->SetRes(CmdRes::kErrOther, "slot migration is not supported with raft");
+    return;
+  }
+  rocksdb::Status s;
+  if (strcasecmp(sub_cmd, "balance") == 0) {
+    s = db->StartBalanceSlots();
+  } else {
+    int64_t dst_index = 0;
+    if (pstd::String2int(client->argv_[2], &dst_index) == 0) {
+      client->SetRes(CmdRes::kInvalidInt);
+      return;
+    }
+    if (dst_index < 0 || static_cast<size_t>(dst_index) >= g_config.db_instance_num.load()) {
+      client->SetRes(CmdRes::kErrOther, "invalid instance index");
+      return;
+    }
+    uint32_t slot_num = db->GetStorage()->GetSlotIndexer().GetSlotNum();
+    std::vector<uint32_t> slots;
+    for (size_t i = 3; i < client->argv_.size(); ++i) {
+      int64_t slot = 0;
+      if (pstd::String2int(client->argv_[i], &slot) == 0 || slot < 0 || slot >= slot_num) {
+        client->SetRes(CmdRes::kInvalidInt);
+        return;
+      }
+      slots.push_back(static_cast<uint32_t>(slot));
+    }
+    s = db->StartMigrateSlots(slots, static_cast<int32_t>(dst_index));
+  }
+  if (!s.ok()) {
+    client->SetRes(CmdRes::kErrOther, s.ToString());
+    return;
+  }
+  client->SetRes(CmdRes::kOK);
+}
+
 MonitorCmd::MonitorCmd(const std::string& name, int arity)
     : BaseCmd(name, arity, kCmdFlagsReadonly | kCmdFlagsAdmin, kAclCategoryAdmin) {}
 
@@ -136,7 +136,9 @@ class InfoCmd : public BaseCmd {
     kInfo,
     kInfoAll,
     kInfoCommandStats,
-    kInfoRaft
+    kInfoRaft,
+    kInfoCompression,
+    kInfoKeyspace
   };
 
   InfoSection info_section_;
@@ -148,6 +150,8 @@ class InfoCmd : public BaseCmd {
   const static std::string kDataSection;
   const static std::string kCommandStatsSection;
   const static std::string kRaftSection;
+  const static std::string kCompressionSection;
+  const static std::string kKeyspaceSection;
 
   const std::unordered_map<std::string, InfoSection> sectionMap = {{kAllSection, kInfoAll},
                                                                    {kServerSection, kInfoServer},
@@ -155,7 +159,11 @@ class InfoCmd : public BaseCmd {
                                                                    {kCPUSection, kInfoCPU},
                                                                    {kDataSection, kInfoData},
                                                                    {kRaftSection, kInfoRaft},
-                                                                   {kCommandStatsSection, kInfoCommandStats}};
+                                                                   {kCommandStatsSection, kInfoCommandStats},
+                                                                   {kCompressionSection, kInfoCompression},
+                                                                   {kKeyspaceSection, kInfoKeyspace}};
+  // INFO keyspace 1 starts an exact key scan of the current db
+  bool rescan_keyspace_ = false;
 
   void InfoServer(std::string& info);
   void InfoStats(std::string& info);
@@ -163,6 +171,8 @@ class InfoCmd : public BaseCmd {
   void InfoRaft(std::string& info);
   void InfoData(std::string& info);
   void InfoCommandStats(PClient* client, std::string& info);
+  void InfoCompression(PClient* client, std::string& info);
+  void InfoKeyspace(PClient* client, std::string& info);
   std::string FormatCommandStatLine(const CommandStatistics& stats);
   double MethodofTotalTimeCalculation(const uint64_t time_consuming);
   double MethodofCommandStatistics(const uint64_t time_consuming, const uint64_t frequency);
@@ -225,6 +235,26 @@ class MonitorCmd : public BaseCmd {
   void DoCmd(PClient* client) override;
 };
 
+/*
+ * RESHARD INFO
+ * RESHARD STATUS
+ * RESHARD BALANCE
+ * RESHARD MIGRATE instance slot [slot ...]
+ * Moves slots, with their keys, between the RocksDB instances of the current db.
+ * BALANCE and MIGRATE start a background job, STATUS reports whether it is still
+ * running and how the last one ended.
+ */
+class ReshardCmd : public BaseCmd {
+ public:
+  ReshardCmd(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+};
+
 class SortCmd : public BaseCmd {
  public:
   SortCmd(const std::string& name, int16_t arity);
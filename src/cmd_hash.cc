@@ -168,42 +168,12 @@ bool HGetAllCmd::DoInitial(PClient* client) {
 }
 
 void HGetAllCmd::DoCmd(PClient* client) {
-  int64_t total_fv = 0;
-  int64_t cursor = 0;
-  int64_t next_cursor = 0;
-  size_t raw_limit = g_config.max_client_response_size.load();
-  std::string raw;
-  std::vector<storage::FieldValue> fvs;
-  storage::Status s;
-
-  do {
-    fvs.clear();
-    s = PSTORE.GetBackend(client->GetCurrentDB())
-            ->GetStorage()
-            ->HScan(client->Key(), cursor, "*", PIKIWIDB_SCAN_STEP_LENGTH, &fvs, &next_cursor);
-    if (!s.ok()) {
-      raw.clear();
-      total_fv = 0;
-      break;
-    } else {
-      for (const auto& fv : fvs) {
-        client->RedisAppendLenUint64(raw, fv.field.size(), "$");
-        client->RedisAppendContent(raw, fv.field);
-        client->RedisAppendLenUint64(raw, fv.value.size(), "$");
-        client->RedisAppendContent(raw, fv.value);
-      }
-      if (raw.size() >= raw_limit) {
-        client->SetRes(CmdRes::kErrOther, "Response exceeds the max-client-response-size limit");
-        return;
-      }
-      total_fv += static_cast<int64_t>(fvs.size());
-      cursor = next_cursor;
-    }
-  } while (cursor != 0);
-
-  if (s.ok() || s.IsNotFound()) {
-    client->AppendArrayLen(total_fv * 2);
-    client->AppendStringRaw(raw);
+  std::unique_ptr<storage::ElementReader> reader;
+  storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->HGetall(client->Key(), &reader);
+  if (s.ok()) {
+    client->StreamReply(std::move(reader));
+  } else if (s.IsNotFound()) {
+    client->AppendArrayLen(0);
   } else if (s.IsInvalidArgument()) {
     client->SetRes(CmdRes::kMultiKey);
   } else {
@@ -292,10 +262,12 @@ bool HScanCmd::DoInitial(PClient* client) {
 void HScanCmd::DoCmd(PClient* client) {
   const auto& argv = client->argv_;
   // parse arguments
-  int64_t cursor{};
+  // the cursors of stateless-scan-cursors are tokens, numbered cursors are integers
+  const std::string& cursor = argv[2];
+  int64_t number{};
   int64_t count{10};
   std::string pattern{"*"};
-  if (pstd::String2int(argv[2], &cursor) == 0) {
+  if (!g_config.stateless_scan_cursors.load() && pstd::String2int(cursor, &number) == 0) {
     client->SetRes(CmdRes::kInvalidCursor, kCmdNameHScan);
     return;
   }
@@ -319,7 +291,7 @@ void HScanCmd::DoCmd(PClient* client) {
 
   // execute command
   std::vector<storage::FieldValue> fvs;
-  int64_t next_cursor{};
+  std::string next_cursor;
   auto status = PSTORE.GetBackend(client->GetCurrentDB())
                     ->GetStorage()
                     ->HScan(client->Key(), cursor, pattern, count, &fvs, &next_cursor);
@@ -334,7 +306,7 @@ void HScanCmd::DoCmd(PClient* client) {
 
   // reply to client
   client->AppendArrayLen(2);
-  client->AppendString(std::to_string(next_cursor));
+  client->AppendString(next_cursor);
   client->AppendArrayLenUint64(fvs.size() * 2);
   for (const auto& [field, value] : fvs) {
     client->AppendString(field);
@@ -279,4 +279,23 @@ void RenameNXCmd::DoCmd(PClient* client) {
   }
 }
 
+DbsizeCmd::DbsizeCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsReadonly, kAclCategoryRead | kAclCategoryKeyspace) {}
+
+bool DbsizeCmd::DoInitial(PClient* client) { return true; }
+
+void DbsizeCmd::DoCmd(PClient* client) {
+  std::vector<storage::KeyInfo> key_infos;
+  rocksdb::Status s = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->GetApproximateKeyNum(&key_infos);
+  if (!s.ok()) {
+    client->SetRes(CmdRes::kErrOther, s.ToString());
+    return;
+  }
+  uint64_t keys = 0;
+  for (const auto& key_info : key_infos) {
+    keys += key_info.keys;
+  }
+  client->AppendInteger(static_cast<int64_t>(keys));
+}
+
 }  // namespace pikiwidb
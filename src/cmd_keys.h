@@ -157,4 +157,16 @@ class RenameNXCmd : public BaseCmd {
   void DoCmd(PClient* client) override;
 };
 
+// The approximate number of keys of the current db, see Storage::GetApproximateKeyNum
+class DbsizeCmd : public BaseCmd {
+ public:
+  DbsizeCmd(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+};
+
 }  // namespace pikiwidb
@@ -180,24 +180,24 @@ bool LRangeCmd::DoInitial(PClient* client) {
 }
 
 void LRangeCmd::DoCmd(PClient* client) {
-  std::vector<std::string> ret;
   int64_t start_index = 0;
   int64_t end_index = 0;
   if (pstd::String2int(client->argv_[2], &start_index) == 0 || pstd::String2int(client->argv_[3], &end_index) == 0) {
     client->SetRes(CmdRes::kInvalidInt);
     return;
   }
+  std::unique_ptr<storage::ElementReader> reader;
   storage::Status s =
-      PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->LRange(client->Key(), start_index, end_index, &ret);
-  if (!s.ok() && !s.IsNotFound()) {
-    if (s.IsInvalidArgument()) {
-      client->SetRes(CmdRes::kMultiKey);
-    } else {
-      client->SetRes(CmdRes::kSyntaxErr, "lrange cmd error");
-    }
-    return;
+      PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->LRange(client->Key(), start_index, end_index, &reader);
+  if (s.ok()) {
+    client->StreamReply(std::move(reader));
+  } else if (s.IsNotFound()) {
+    client->AppendArrayLen(0);
+  } else if (s.IsInvalidArgument()) {
+    client->SetRes(CmdRes::kMultiKey);
+  } else {
+    client->SetRes(CmdRes::kSyntaxErr, "lrange cmd error");
   }
-  client->AppendStringVector(ret);
 }
 
 LRemCmd::LRemCmd(const std::string& name, int16_t arity)
@@ -10,6 +10,7 @@
 #include "cmd_set.h"
 #include <memory>
 #include <utility>
+#include "config.h"
 #include "pstd/pstd_string.h"
 #include "store.h"
 
@@ -33,6 +34,30 @@ void SIsMemberCmd::DoCmd(PClient* client) {
   client->AppendInteger(reply_Num);
 }
 
+SMIsMemberCmd::SMIsMemberCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsReadonly, kAclCategoryRead | kAclCategorySet) {}
+
+bool SMIsMemberCmd::DoInitial(PClient* client) {
+  client->SetKey(client->argv_[1]);
+  return true;
+}
+
+void SMIsMemberCmd::DoCmd(PClient* client) {
+  std::vector<std::string> members(client->argv_.begin() + 2, client->argv_.end());
+  std::vector<int32_t> rets;
+  auto s = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->SMIsmember(client->Key(), members, &rets);
+  if (s.ok() || s.IsNotFound()) {
+    client->AppendArrayLenUint64(rets.size());
+    for (auto ret : rets) {
+      client->AppendInteger(ret);
+    }
+  } else if (s.IsInvalidArgument()) {
+    client->SetRes(CmdRes::kMultiKey);
+  } else {
+    client->SetRes(CmdRes::kErrOther, s.ToString());
+  }
+}
+
 SAddCmd::SAddCmd(const std::string& name, int16_t arity)
     : BaseCmd(name, arity, kCmdFlagsWrite, kAclCategoryWrite | kAclCategorySet) {}
 
@@ -325,17 +350,17 @@ bool SMembersCmd::DoInitial(PClient* client) {
 }
 
 void SMembersCmd::DoCmd(PClient* client) {
-  std::vector<std::string> delete_members;
-  storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->SMembers(client->Key(), &delete_members);
-  if (!s.ok()) {
-    if (s.IsInvalidArgument()) {
-      client->SetRes(CmdRes::kMultiKey);
-    } else {
-      client->SetRes(CmdRes::kSyntaxErr, "smembers cmd error");
-    }
-    return;
+  std::unique_ptr<storage::ElementReader> reader;
+  storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->SMembers(client->Key(), &reader);
+  if (s.ok()) {
+    client->StreamReply(std::move(reader));
+  } else if (s.IsNotFound()) {
+    client->AppendArrayLen(0);
+  } else if (s.IsInvalidArgument()) {
+    client->SetRes(CmdRes::kMultiKey);
+  } else {
+    client->SetRes(CmdRes::kSyntaxErr, "smembers cmd error");
   }
-  client->AppendStringVector(delete_members);
 }
 
 SDiffCmd::SDiffCmd(const std::string& name, int16_t arity)
@@ -402,10 +427,12 @@ bool SScanCmd::DoInitial(PClient* client) {
 void SScanCmd::DoCmd(PClient* client) {
   const auto& argv = client->argv_;
   // parse arguments
-  int64_t cursor = 0;
+  // the cursors of stateless-scan-cursors are tokens, numbered cursors are integers
+  const std::string& cursor = argv[2];
+  int64_t number = 0;
   int64_t count = 10;
   std::string pattern{"*"};
-  if (pstd::String2int(argv[2], &cursor) == 0) {
+  if (!g_config.stateless_scan_cursors.load() && pstd::String2int(cursor, &number) == 0) {
     client->SetRes(CmdRes::kInvalidCursor, kCmdNameSScan);
     return;
   }
@@ -429,7 +456,7 @@ void SScanCmd::DoCmd(PClient* client) {
 
   // execute command
   std::vector<std::string> members;
-  int64_t next_cursor{};
+  std::string next_cursor;
   auto status = PSTORE.GetBackend(client->GetCurrentDB())
                     ->GetStorage()
                     ->SScan(client->Key(), cursor, pattern, count, &members, &next_cursor);
@@ -444,7 +471,7 @@ void SScanCmd::DoCmd(PClient* client) {
 
   // reply to client
   client->AppendArrayLen(2);
-  client->AppendString(std::to_string(next_cursor));
+  client->AppendString(next_cursor);
   client->AppendArrayLenUint64(members.size());
   for (const auto& member : members) {
     client->AppendString(member);
@@ -24,6 +24,17 @@ class SIsMemberCmd : public BaseCmd {
   void DoCmd(PClient *client) override;
 };
 
+class SMIsMemberCmd : public BaseCmd {
+ public:
+  SMIsMemberCmd(const std::string &name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient *client) override;
+
+ private:
+  void DoCmd(PClient *client) override;
+};
+
 class SAddCmd : public BaseCmd {
  public:
   SAddCmd(const std::string &name, int16_t arity);
@@ -68,6 +68,7 @@ void CmdTableManager::InitCmdTable() {
   ADD_COMMAND(Flushall, 1);
   ADD_COMMAND(Select, 2);
   ADD_COMMAND(Shutdown, 1);
+  ADD_COMMAND(Reshard, -2);
 
   // info
   ADD_COMMAND(Info, -1);
@@ -90,6 +91,7 @@ void CmdTableManager::InitCmdTable() {
   ADD_COMMAND(Keys, 2);
   ADD_COMMAND(Rename, 3);
   ADD_COMMAND(RenameNX, 3);
+  ADD_COMMAND(Dbsize, 1);
 
   // kv
   ADD_COMMAND(Get, 2);
@@ -135,6 +137,7 @@ void CmdTableManager::InitCmdTable() {
 
   // set
   ADD_COMMAND(SIsMember, 3);
+  ADD_COMMAND(SMIsMember, -3);
   ADD_COMMAND(SAdd, -3);
   ADD_COMMAND(SUnionStore, -3);
   ADD_COMMAND(SRem, -3);
@@ -179,6 +182,7 @@ void CmdTableManager::InitCmdTable() {
   ADD_COMMAND(ZRevrangebyscore, -4);
   ADD_COMMAND(ZCard, 2);
   ADD_COMMAND(ZScore, 3);
+  ADD_COMMAND(ZMScore, -3);
   ADD_COMMAND(ZRange, -4);
   ADD_COMMAND(ZRangebylex, -3);
   ADD_COMMAND(ZRevrangebylex, -3);
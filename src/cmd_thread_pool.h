@@ -28,13 +28,17 @@ namespace pikiwidb {
 */
 class CmdThreadPoolTask {
  public:
-  explicit CmdThreadPoolTask(std::shared_ptr<PClient> client) : client_(std::move(client)) {}
+  explicit CmdThreadPoolTask(std::shared_ptr<PClient> client, bool resume_reply = false)
+      : client_(std::move(client)), resume_reply_(resume_reply) {}
   void Run(BaseCmd *cmd);
   const std::string &CmdName();
   std::shared_ptr<PClient> Client();
+  // Whether the task sends the streamed reply of the client on, instead of running its command
+  bool ResumesReply() const { return resume_reply_; }
 
  private:
   std::shared_ptr<PClient> client_;
+  bool resume_reply_ = false;
 };
 
 class CmdWorkThreadPoolWorker;
@@ -22,6 +22,14 @@ void CmdWorkThreadPoolWorker::Work() {
       if (task->Client()->State() != ClientState::kOK) {  // the client is closed
         continue;
       }
+      if (task->ResumesReply()) {
+        task->Client()->ResumeReply();
+        continue;
+      }
+      // a command sent while the reply of the last one is still streamed waits for it
+      if (task->Client()->DeferAfterReply(task)) {
+        continue;
+      }
       auto [cmdPtr, ret] = cmd_table_manager_.GetCommand(task->CmdName(), task->Client().get());
 
       if (!cmdPtr) {
@@ -58,6 +66,7 @@ void CmdWorkThreadPoolWorker::Work() {
       (*cmdstat_map)[task->CmdName()].cmd_time_consuming_.fetch_add(task->Client()->GetTimeStat()->GetTotalTime());
 
       g_pikiwidb->PushWriteTask(task->Client());
+      task->Client()->ResumeReplyWhenWritable();
     }
     self_task_.clear();
   }
@@ -673,9 +673,28 @@ void ZRangeCmd::DoCmd(PClient* client) {
     }
   }
 
+  storage::Status s;
+  // a plain range by rank goes to the reply as it is read, the others are read whole
+  // before REV and LIMIT apply
+  if (!by_score && !by_lex && !is_rev && offset == 0 && count < 0) {
+    std::unique_ptr<storage::ElementReader> reader;
+    s = PSTORE.GetBackend(client->GetCurrentDB())
+            ->GetStorage()
+            ->ZRange(client->Key(), start, stop, with_scores, &reader);
+    if (s.ok()) {
+      client->StreamReply(std::move(reader));
+    } else if (s.IsNotFound()) {
+      client->AppendArrayLen(0);
+    } else if (s.IsInvalidArgument()) {
+      client->SetRes(CmdRes::kMultiKey);
+    } else {
+      client->SetRes(CmdRes::kErrOther, s.ToString());
+    }
+    return;
+  }
+
   std::vector<storage::ScoreMember> score_members;
   std::vector<std::string> lex_members;
-  storage::Status s;
   if (!is_rev) {
     if (by_score) {
       s = PSTORE.GetBackend(client->GetCurrentDB())
@@ -770,6 +789,37 @@ void ZScoreCmd::DoCmd(PClient* client) {
   }
 }
 
+ZMScoreCmd::ZMScoreCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsReadonly, kAclCategoryRead | kAclCategorySortedSet) {}
+
+bool ZMScoreCmd::DoInitial(PClient* client) {
+  client->SetKey(client->argv_[1]);
+  return true;
+}
+
+void ZMScoreCmd::DoCmd(PClient* client) {
+  std::vector<std::string> members(client->argv_.begin() + 2, client->argv_.end());
+  std::vector<storage::ScoreStatus> sss;
+  auto s = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage()->ZMScore(client->Key(), members, &sss);
+  if (s.ok() || s.IsNotFound()) {
+    client->AppendArrayLenUint64(sss.size());
+    for (const auto& ss : sss) {
+      if (ss.status.ok()) {
+        char buf[32];
+        int64_t len = pstd::D2string(buf, sizeof(buf), ss.score);
+        client->AppendStringLen(len);
+        client->AppendContent(buf);
+      } else {
+        client->AppendStringLen(-1);
+      }
+    }
+  } else if (s.IsInvalidArgument()) {
+    client->SetRes(CmdRes::kMultiKey);
+  } else {
+    client->SetRes(CmdRes::kErrOther, s.ToString());
+  }
+}
+
 ZRangebylexCmd::ZRangebylexCmd(const std::string& name, int16_t arity)
     : BaseCmd(name, arity, kCmdFlagsWrite, kAclCategoryWrite | kAclCategorySortedSet) {}
 
@@ -160,6 +160,17 @@ class ZScoreCmd : public BaseCmd {
   void DoCmd(PClient *client) override;
 };
 
+class ZMScoreCmd : public BaseCmd {
+ public:
+  ZMScoreCmd(const std::string &name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient *client) override;
+
+ private:
+  void DoCmd(PClient *client) override;
+};
+
 class ZRangebylexCmd : public BaseCmd {
  public:
   ZRangebylexCmd(const std::string &name, int16_t arity);
@@ -7,12 +7,14 @@
   Responsible for managing the runtime configuration information of PikiwiDB.
  */
 
+#include <cstdlib>
 #include <string>
 #include <system_error>
 #include <vector>
 
 #include "config.h"
 #include "pstd/pstd_string.h"
+#include "rocksdb/filter_policy.h"
 #include "store.h"
 
 namespace pikiwidb {
@@ -22,6 +24,7 @@ constexpr uint16_t PORT_LIMIT_MIN = 1;
 constexpr int DBNUMBER_MAX = 16;
 constexpr int THREAD_MAX = 129;
 constexpr int ROCKSDB_INSTANCE_NUMBER_MAX = 10;
+constexpr uint32_t kMaxDataDirWeight = 100;
 
 PConfig g_config;
 
@@ -52,6 +55,97 @@ static Status CheckLogLevel(const std::string& value) {
   return Status::OK();
 }
 
+static bool ParseCompression(const std::string& value, rocksdb::CompressionType* type) {
+  static const std::vector<std::pair<std::string, rocksdb::CompressionType>> kCompressionTypes = {
+      {"no", rocksdb::kNoCompression},   {"snappy", rocksdb::kSnappyCompression}, {"zlib", rocksdb::kZlibCompression},
+      {"lz4", rocksdb::kLZ4Compression}, {"lz4hc", rocksdb::kLZ4HCCompression},   {"zstd", rocksdb::kZSTD},
+  };
+  for (const auto& [name, compression] : kCompressionTypes) {
+    if (pstd::StringEqualCaseInsensitive(value, name)) {
+      *type = compression;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool ParseCompressionPerLevel(const std::string& value, std::vector<rocksdb::CompressionType>* levels) {
+  levels->clear();
+  for (const auto& level : SplitString(value, ':')) {
+    rocksdb::CompressionType type;
+    if (!ParseCompression(level, &type)) {
+      return false;
+    }
+    levels->push_back(type);
+  }
+  return !levels->empty();
+}
+
+static bool ParseCFCompressionPerLevel(
+    const std::string& value, std::unordered_map<std::string, std::vector<rocksdb::CompressionType>>* cf_levels) {
+  cf_levels->clear();
+  for (const auto& cf_value : SplitString(value, ',')) {
+    auto pos = cf_value.find('=');
+    if (pos == std::string::npos || pos == 0) {
+      return false;
+    }
+    if (!ParseCompressionPerLevel(cf_value.substr(pos + 1), &(*cf_levels)[cf_value.substr(0, pos)])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static Status CheckCompressionPerLevel(const std::string& value) {
+  std::vector<rocksdb::CompressionType> levels;
+  if (!ParseCompressionPerLevel(value, &levels)) {
+    return Status::InvalidArgument("The levels must be no / snappy / zlib / lz4 / lz4hc / zstd separated by ':'.");
+  }
+  return Status::OK();
+}
+
+static Status CheckCFCompressionPerLevel(const std::string& value) {
+  std::unordered_map<std::string, std::vector<rocksdb::CompressionType>> cf_levels;
+  if (!ParseCFCompressionPerLevel(value, &cf_levels)) {
+    return Status::InvalidArgument("The value must be <cf name>=<levels> separated by ','.");
+  }
+  return Status::OK();
+}
+
+static bool ParseDataDirs(const std::string& value, std::vector<std::pair<std::string, uint32_t>>* data_dirs) {
+  data_dirs->clear();
+  for (const auto& dir_value : SplitString(value, ',')) {
+    auto pos = dir_value.rfind('=');
+    std::string dir = dir_value.substr(0, pos);
+    uint32_t weight = 1;
+    if (pos != std::string::npos) {
+      char* end = nullptr;
+      auto parsed = std::strtoul(dir_value.c_str() + pos + 1, &end, 10);
+      if (*end != '\0' || parsed == 0 || parsed > kMaxDataDirWeight) {
+        return false;
+      }
+      weight = static_cast<uint32_t>(parsed);
+    }
+    if (dir.empty()) {
+      return false;
+    }
+    if (dir.back() != '/') {
+      dir.push_back('/');
+    }
+    data_dirs->emplace_back(std::move(dir), weight);
+  }
+  return true;
+}
+
+static Status CheckDataDirs(const std::string& value) {
+  std::vector<std::pair<std::string, uint32_t>> data_dirs;
+  if (!ParseDataDirs(value, &data_dirs)) {
+    return Status::InvalidArgument("The value must be <dir>[=<weight 1-" + std::to_string(kMaxDataDirWeight) +
+                                   ">] separated by ','.");
+  }
+  return Status::OK();
+}
+
 Status BaseValue::Set(const std::string& value, bool init_stage) {
   if (!init_stage && !rewritable_) {
     return Status::NotSupported("Dynamic modification is not supported.");
@@ -110,6 +204,7 @@ PConfig::PConfig() {
   AddNumber("raft-port-offset", true, &raft_port_offset);
   AddNumber("timeout", true, &timeout);
   AddString("db-path", false, {&db_path});
+  AddStringWithFunc("data-dirs", &CheckDataDirs, false, {&data_dirs});
   AddStringWithFunc("loglevel", &CheckLogLevel, false, {&log_level});
   AddString("logfile", false, {&log_dir});
   AddNumberWithLimit<size_t>("databases", false, &databases, 1, DBNUMBER_MAX);
@@ -126,6 +221,9 @@ PConfig::PConfig() {
   AddString("runid", false, {&run_id});
   AddNumber("small-compaction-threshold", true, &small_compaction_threshold);
   AddNumber("small-compaction-duration-threshold", true, &small_compaction_duration_threshold);
+  AddNumber("active-expire-keys-per-second", false, &active_expire_keys_per_second);
+  AddBool("stateless-scan-cursors", &CheckYesNo, false, &stateless_scan_cursors);
+  AddString("scan-cursor-secret", false, {&scan_cursor_secret});
   AddBool("use-raft", &CheckYesNo, false, &use_raft);
 
   // rocksdb config
@@ -139,6 +237,31 @@ PConfig::PConfig() {
   AddBool("rocksdb-enable-pipelined-write", CheckYesNo, false, &rocksdb_enable_pipelined_write);
   AddNumber("rocksdb-level0-slowdown-writes-trigger", false, &rocksdb_level0_slowdown_writes_trigger);
   AddNumber("rocksdb-level0-stop-writes-trigger", false, &rocksdb_level0_stop_writes_trigger);
+  AddBool("rocksdb-async-io", CheckYesNo, false, &rocksdb_async_io);
+  AddNumber("rocksdb-block-cache-size", true, &rocksdb_block_cache_size);
+  AddNumberWithLimit<int>("rocksdb-block-cache-shard-bits", false, &rocksdb_block_cache_shard_bits, -1, 19);
+  AddBool("rocksdb-use-hyper-clock-cache", CheckYesNo, false, &rocksdb_use_hyper_clock_cache);
+  AddNumber("rocksdb-block-size", false, &rocksdb_block_size);
+  AddNumberWithLimit<int>("rocksdb-bloom-bits-per-key", false, &rocksdb_bloom_bits_per_key, 1, 64);
+  AddBool("rocksdb-use-ribbon-filter", CheckYesNo, false, &rocksdb_use_ribbon_filter);
+  AddBool("rocksdb-partition-index-filters", CheckYesNo, false, &rocksdb_partition_index_filters);
+  AddBool("rocksdb-cache-index-and-filter-blocks", CheckYesNo, false, &rocksdb_cache_index_and_filter_blocks);
+  AddBool("rocksdb-pin-l0-filter-and-index-blocks-in-cache", CheckYesNo, false,
+          &rocksdb_pin_l0_filter_and_index_blocks_in_cache);
+  AddBool("rocksdb-optimize-filters-for-hits", CheckYesNo, false, &rocksdb_optimize_filters_for_hits);
+  AddBool("rocksdb-enable-blob-files", CheckYesNo, false, &rocksdb_enable_blob_files);
+  AddNumber("rocksdb-min-blob-size", false, &rocksdb_min_blob_size);
+  AddNumber("rocksdb-blob-file-size", false, &rocksdb_blob_file_size);
+  AddBool("rocksdb-enable-blob-gc", CheckYesNo, false, &rocksdb_enable_blob_gc);
+  AddNumberWithLimit<int>("rocksdb-blob-gc-age-cutoff-percent", false, &rocksdb_blob_gc_age_cutoff_percent, 0, 100);
+  AddNumberWithLimit<int>("rocksdb-blob-gc-force-threshold-percent", false, &rocksdb_blob_gc_force_threshold_percent,
+                          0, 100);
+  AddStringWithFunc("rocksdb-compression-per-level", &CheckCompressionPerLevel, false,
+                    {&rocksdb_compression_per_level});
+  AddStringWithFunc("rocksdb-cf-compression-per-level", &CheckCFCompressionPerLevel, false,
+                    {&rocksdb_cf_compression_per_level});
+  AddNumber("rocksdb-zstd-max-dict-bytes", false, &rocksdb_zstd_max_dict_bytes);
+  AddNumber("rocksdb-zstd-max-train-bytes", false, &rocksdb_zstd_max_train_bytes);
   AddNumber("rocksdb-level0-slowdown-writes-trigger", false, &rocksdb_level0_slowdown_writes_trigger);
 }
 
@@ -194,7 +317,15 @@ Status PConfig::Set(std::string key, const std::string& value, bool init_stage)
   if (iter == config_map_.end()) {
     return Status::NotFound("Non-existent configuration items.");
   }
-  return iter->second->Set(value, init_stage);
+  auto s = iter->second->Set(value, init_stage);
+  if (s.ok() && key == "rocksdb-block-cache-size") {
+    // the shared block cache is resized in place
+    std::lock_guard<std::mutex> lock(block_cache_mutex_);
+    if (block_cache_) {
+      block_cache_->SetCapacity(rocksdb_block_cache_size.load());
+    }
+  }
+  return s;
 }
 
 rocksdb::Options PConfig::GetRocksDBOptions() {
@@ -211,11 +342,72 @@ rocksdb::Options PConfig::GetRocksDBOptions() {
   options.enable_pipelined_write = rocksdb_enable_pipelined_write;
   options.level0_slowdown_writes_trigger = rocksdb_level0_slowdown_writes_trigger;
   options.level0_stop_writes_trigger = rocksdb_level0_stop_writes_trigger;
+  options.optimize_filters_for_hits = rocksdb_optimize_filters_for_hits;
+
+  ParseCompressionPerLevel(rocksdb_compression_per_level.ToString(), &options.compression_per_level);
+  // only the bottommost level, which holds most of the data and is rewritten least
+  // often, pays for training a dictionary, the upper levels compress without one
+  if (rocksdb_zstd_max_dict_bytes != 0) {
+    options.bottommost_compression = rocksdb::kZSTD;
+    options.bottommost_compression_opts.enabled = true;
+    options.bottommost_compression_opts.max_dict_bytes = rocksdb_zstd_max_dict_bytes;
+    options.bottommost_compression_opts.zstd_max_train_bytes = rocksdb_zstd_max_train_bytes;
+  }
+
+  // the column families that keep small values only turn blob files off again in storage::Redis::Open
+  options.enable_blob_files = rocksdb_enable_blob_files;
+  options.min_blob_size = rocksdb_min_blob_size;
+  options.blob_file_size = rocksdb_blob_file_size;
+  options.blob_compression_type = options.compression;
+  options.enable_blob_garbage_collection = rocksdb_enable_blob_gc;
+  options.blob_garbage_collection_age_cutoff = rocksdb_blob_gc_age_cutoff_percent / 100.0;
+  options.blob_garbage_collection_force_threshold = rocksdb_blob_gc_force_threshold_percent / 100.0;
+  // the meta filter reads the blobs of the strings it checks for expiration
+  options.blob_compaction_readahead_size = 2 << 20;
   return options;
 }
 
+std::vector<std::pair<std::string, uint32_t>> PConfig::GetDataDirs() {
+  std::vector<std::pair<std::string, uint32_t>> dirs;
+  ParseDataDirs(data_dirs.ToString(), &dirs);
+  return dirs;
+}
+
+std::unordered_map<std::string, std::vector<rocksdb::CompressionType>> PConfig::GetRocksDBCFCompressionPerLevel() {
+  std::unordered_map<std::string, std::vector<rocksdb::CompressionType>> cf_levels;
+  ParseCFCompressionPerLevel(rocksdb_cf_compression_per_level.ToString(), &cf_levels);
+  return cf_levels;
+}
+
 rocksdb::BlockBasedTableOptions PConfig::GetRocksDBBlockBasedTableOptions() {
   rocksdb::BlockBasedTableOptions options;
+  {
+    std::lock_guard<std::mutex> lock(block_cache_mutex_);
+    if (!block_cache_) {
+      if (rocksdb_use_hyper_clock_cache) {
+        // 0 lets the cache size its table from the entries it sees
+        rocksdb::HyperClockCacheOptions cache_options(rocksdb_block_cache_size, 0, rocksdb_block_cache_shard_bits);
+        block_cache_ = cache_options.MakeSharedCache();
+      } else {
+        block_cache_ = rocksdb::NewLRUCache(rocksdb_block_cache_size, rocksdb_block_cache_shard_bits);
+      }
+    }
+    options.block_cache = block_cache_;
+  }
+  options.block_size = rocksdb_block_size;
+
+  if (rocksdb_use_ribbon_filter) {
+    options.filter_policy.reset(rocksdb::NewRibbonFilterPolicy(rocksdb_bloom_bits_per_key));
+  } else {
+    options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(rocksdb_bloom_bits_per_key));
+  }
+  if (rocksdb_partition_index_filters) {
+    options.index_type = rocksdb::BlockBasedTableOptions::kTwoLevelIndexSearch;
+    options.partition_filters = true;
+  }
+  options.cache_index_and_filter_blocks = rocksdb_cache_index_and_filter_blocks;
+  options.pin_l0_filter_and_index_blocks_in_cache = rocksdb_pin_l0_filter_and_index_blocks_in_cache;
+  options.pin_top_level_index_and_filter = rocksdb_pin_l0_filter_and_index_blocks_in_cache;
   return options;
 }
 
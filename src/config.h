@@ -14,12 +14,14 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "rocksdb/cache.h"
 #include "rocksdb/options.h"
 #include "rocksdb/table.h"
 
@@ -239,6 +241,18 @@ class PConfig {
   std::atomic_uint64_t small_compaction_threshold = 604800;
   std::atomic_uint64_t small_compaction_duration_threshold = 259200;
 
+  // Keys deleted per second by the active expire cycle of each rocksdb instance,
+  // 0 leaves expired keys to lazy deletion and compaction.
+  std::atomic_uint64_t active_expire_keys_per_second = 1000;
+
+  // SCAN, HSCAN, SSCAN and ZSCAN return tokens carrying the point the scan resumes at instead
+  // of the numbered cursors of the cursor cache. Tokens are not integers, clients parsing
+  // cursors as integers need it off.
+  std::atomic_bool stateless_scan_cursors = false;
+  // The key the tokens are signed with. Nodes sharing it take the tokens of each other, empty
+  // signs them with a random key kept in each db path.
+  AtomicString scan_cursor_secret;
+
   // Decide whether PikiwiDB runs as a daemon process.
   std::atomic_bool daemonize = false;
 
@@ -264,6 +278,14 @@ class PConfig {
   // The path to store the data
   AtomicString db_path = "./db/";
 
+  /*
+   * Directories the RocksDB instances are spread over, as <dir>[=<weight>]
+   * separated by ','. The instances are dealt out by weight, 1 by default,
+   * and stay where they were placed, db_path keeps the placement and the
+   * instances created before the directories were configured.
+   */
+  AtomicString data_dirs;
+
   // The log directory, default print to stdout
   AtomicString log_dir = "stdout";
 
@@ -329,10 +351,67 @@ class PConfig {
   // 86400 * 3 = 259200
   std::atomic_uint64_t rocksdb_periodic_second = 259200;
 
+  // read the blocks of batched lookups (MGET, EXISTS) asynchronously
+  std::atomic_bool rocksdb_async_io = false;
+
+  /*
+   * Block based table options, every column family of every database
+   * shares one block cache. Only the capacity of the block cache can
+   * be changed with CONFIG SET, see PConfig::GetRocksDBBlockBasedTableOptions.
+   */
+  std::atomic_uint64_t rocksdb_block_cache_size = 1UL << 30;
+  // -1 lets RocksDB pick the number of shards from the capacity
+  std::atomic_int rocksdb_block_cache_shard_bits = -1;
+  std::atomic_bool rocksdb_use_hyper_clock_cache = false;
+  std::atomic<size_t> rocksdb_block_size = 4 << 10;
+  std::atomic_int rocksdb_bloom_bits_per_key = 10;
+  std::atomic_bool rocksdb_use_ribbon_filter = false;
+  std::atomic_bool rocksdb_partition_index_filters = false;
+  std::atomic_bool rocksdb_cache_index_and_filter_blocks = false;
+  std::atomic_bool rocksdb_pin_l0_filter_and_index_blocks_in_cache = false;
+  std::atomic_bool rocksdb_optimize_filters_for_hits = false;
+
+  /*
+   * Key-value separation, values of at least rocksdb_min_blob_size bytes in the
+   * meta (strings) and hash data column families are written to blob files, so
+   * compactions move only the references to them. The blobs of the oldest
+   * rocksdb_blob_gc_age_cutoff_percent of the blob files are relocated by the
+   * compactions, and files with at least rocksdb_blob_gc_force_threshold_percent
+   * garbage are compacted on purpose.
+   */
+  std::atomic_bool rocksdb_enable_blob_files = false;
+  std::atomic_uint64_t rocksdb_min_blob_size = 4 << 10;
+  std::atomic_uint64_t rocksdb_blob_file_size = 256 << 20;
+  std::atomic_bool rocksdb_enable_blob_gc = true;
+  std::atomic_int rocksdb_blob_gc_age_cutoff_percent = 25;
+  std::atomic_int rocksdb_blob_gc_force_threshold_percent = 100;
+
+  /*
+   * Compression of each level, the algorithms (no, snappy, zlib, lz4, lz4hc
+   * or zstd) of L0, L1 ... separated by ':', the last one is used for the
+   * deeper levels. rocksdb_cf_compression_per_level gives single column
+   * families their own levels, as <cf name>=<levels> separated by ','.
+   * The bottommost level compresses with zstd and a dictionary of up to
+   * rocksdb_zstd_max_dict_bytes trained on rocksdb_zstd_max_train_bytes of
+   * samples, 0 turns it off and leaves that level to the per level setting.
+   * A column family in rocksdb_cf_compression_per_level follows its own
+   * levels down to the bottommost one, without the dictionary.
+   */
+  AtomicString rocksdb_compression_per_level = "no:no:lz4:lz4:lz4:zstd:zstd";
+  AtomicString rocksdb_cf_compression_per_level;
+  std::atomic_uint32_t rocksdb_zstd_max_dict_bytes = 16 << 10;
+  std::atomic_uint32_t rocksdb_zstd_max_train_bytes = 100 * (16 << 10);
+
   rocksdb::Options GetRocksDBOptions();
 
   rocksdb::BlockBasedTableOptions GetRocksDBBlockBasedTableOptions();
 
+  // the levels of rocksdb_cf_compression_per_level by column family name
+  std::unordered_map<std::string, std::vector<rocksdb::CompressionType>> GetRocksDBCFCompressionPerLevel();
+
+  // the directories of data_dirs, ending with '/', with their weights
+  std::vector<std::pair<std::string, uint32_t>> GetDataDirs();
+
  private:
   // Some functions and variables set up for internal work.
 
@@ -416,5 +495,10 @@ class PConfig {
 
   // The file name of the config
   std::string config_file_name_;
+
+  // The block cache shared by all the databases, created by the first
+  // call to GetRocksDBBlockBasedTableOptions
+  std::mutex block_cache_mutex_;
+  std::shared_ptr<rocksdb::Cache> block_cache_;
 };
 }  // namespace pikiwidb
@@ -19,10 +19,38 @@ extern pikiwidb::PConfig g_config;
 
 namespace pikiwidb {
 
+static std::vector<std::pair<std::string, uint32_t>> DataPathsOf(int db_index) {
+  auto data_paths = g_config.GetDataDirs();
+  for (auto& [data_path, weight] : data_paths) {
+    data_path += std::to_string(db_index) + '/';
+  }
+  return data_paths;
+}
+
 DB::DB(int db_index, const std::string& db_path)
-    : db_index_(db_index), db_path_(db_path + std::to_string(db_index_) + '/') {}
+    : db_index_(db_index), db_path_(db_path + std::to_string(db_index_) + '/'), data_paths_(DataPathsOf(db_index)) {}
 
-DB::~DB() { INFO("DB{} is closing...", db_index_); }
+DB::~DB() {
+  INFO("DB{} is closing...", db_index_);
+  if (reshard_thread_.joinable()) {
+    {
+      std::shared_lock lock(storage_mutex_);
+      if (storage_) {
+        storage_->StopMigration();
+      }
+    }
+    reshard_thread_.join();
+  }
+  if (key_scan_thread_.joinable()) {
+    {
+      std::shared_lock lock(storage_mutex_);
+      if (storage_) {
+        storage_->StopScanKeyNum();
+      }
+    }
+    key_scan_thread_.join();
+  }
+}
 
 rocksdb::Status DB::Open() {
   storage::StorageOptions storage_options;
@@ -44,10 +72,17 @@ rocksdb::Status DB::Open() {
       raft->DoSnapshot(std::forward<decltype(self_snapshot_index)>(self_snapshot_index),
                        std::forward<decltype(is_sync)>(is_sync));
     };
+    storage_options.can_write_function = [&r = PRAFT]() { return r.IsInitialized() && r.IsLeader(); };
   }
 
   storage_options.db_instance_num = g_config.db_instance_num.load();
   storage_options.db_id = db_index_;
+  storage_options.async_io = g_config.rocksdb_async_io.load();
+  storage_options.active_expire_keys_per_second = g_config.active_expire_keys_per_second.load();
+  storage_options.stateless_scan_cursors = g_config.stateless_scan_cursors.load();
+  storage_options.scan_cursor_secret = g_config.scan_cursor_secret.ToString();
+  storage_options.cf_compression_per_level = g_config.GetRocksDBCFCompressionPerLevel();
+  storage_options.data_paths = data_paths_;
 
   std::unique_ptr<storage::Storage> old_storage = std::move(storage_);
   if (old_storage != nullptr) {
@@ -55,6 +90,7 @@ rocksdb::Status DB::Open() {
     old_storage.reset();
   }
   storage_ = std::make_unique<storage::Storage>();
+  ++storage_version_;
 
   if (auto s = storage_->Open(storage_options, db_path_); !s.ok()) {
     ERROR("Storage open failed! {}", s.ToString());
@@ -66,6 +102,63 @@ rocksdb::Status DB::Open() {
   return rocksdb::Status::OK();
 }
 
+rocksdb::Status DB::RunExclusive(const std::function<rocksdb::Status()>& func) {
+  storage_mutex_.unlock_shared();
+  storage_mutex_.lock();
+  auto s = func();
+  storage_mutex_.unlock();
+  storage_mutex_.lock_shared();
+  return s;
+}
+
+rocksdb::Status DB::StartReshard(const std::string& job,
+                                 std::function<rocksdb::Status(const storage::ExclusiveRunner&)> func) {
+  std::lock_guard lock(reshard_mutex_);
+  if (resharding_.load()) {
+    return rocksdb::Status::Busy("a slot migration is running");
+  }
+  if (reshard_thread_.joinable()) {
+    reshard_thread_.join();
+  }
+  // set before the caller gives up its shared lock, so FLUSHDB and FLUSHALL see it
+  resharding_.store(true);
+  reshard_info_.job = job;
+  reshard_info_.start_time = time(nullptr);
+  reshard_info_.duration = 0;
+  reshard_info_.running = true;
+  reshard_info_.result.clear();
+  reshard_thread_ = std::thread([this, func = std::move(func)]() {
+    rocksdb::Status s;
+    {
+      std::shared_lock storage_lock(storage_mutex_);
+      s = func([this](const auto& exclusive_func) { return RunExclusive(exclusive_func); });
+    }
+    std::lock_guard lock(reshard_mutex_);
+    reshard_info_.running = false;
+    reshard_info_.duration = time(nullptr) - reshard_info_.start_time;
+    reshard_info_.result = s.ok() ? "ok" : s.ToString();
+    resharding_.store(false);
+  });
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status DB::StartMigrateSlots(const std::vector<uint32_t>& slots, int32_t dst_index) {
+  return StartReshard("migrate", [this, slots, dst_index](const storage::ExclusiveRunner& run_exclusive) {
+    return storage_->MigrateSlots(slots, dst_index, run_exclusive);
+  });
+}
+
+rocksdb::Status DB::StartBalanceSlots() {
+  return StartReshard("balance", [this](const storage::ExclusiveRunner& run_exclusive) {
+    return storage_->BalanceSlots(run_exclusive);
+  });
+}
+
+ReshardInfo DB::GetReshardInfo() {
+  std::lock_guard lock(reshard_mutex_);
+  return reshard_info_;
+}
+
 void DB::CreateCheckpoint(const std::string& checkpoint_path, bool sync) {
   auto checkpoint_sub_path = checkpoint_path + '/' + std::to_string(db_index_);
   if (0 != pstd::CreatePath(checkpoint_sub_path)) {
@@ -95,25 +188,17 @@ void DB::LoadDBFromCheckpoint(const std::string& checkpoint_path, bool sync [[ma
     }
   }
 
-  std::lock_guard<std::shared_mutex> lock(storage_mutex_);
-  opened_ = false;
-  // close the old storage, then open the new storage
-  std::unique_ptr<storage::Storage> old_storage = std::move(storage_);
-  if (old_storage != nullptr) {
-    old_storage->Close();
-    old_storage.reset();
-  }
-  storage_ = std::make_unique<storage::Storage>();
-  auto result = storage_->LoadCheckpoint(checkpoint_sub_path, db_path_);
-
-  for (auto& r : result) {
-    r.get();
-  }
-
   storage::StorageOptions storage_options;
   storage_options.options = g_config.GetRocksDBOptions();
+  storage_options.table_options = g_config.GetRocksDBBlockBasedTableOptions();
   storage_options.db_instance_num = g_config.db_instance_num.load();
   storage_options.db_id = db_index_;
+  storage_options.async_io = g_config.rocksdb_async_io.load();
+  storage_options.active_expire_keys_per_second = g_config.active_expire_keys_per_second.load();
+  storage_options.stateless_scan_cursors = g_config.stateless_scan_cursors.load();
+  storage_options.scan_cursor_secret = g_config.scan_cursor_secret.ToString();
+  storage_options.cf_compression_per_level = g_config.GetRocksDBCFCompressionPerLevel();
+  storage_options.data_paths = data_paths_;
 
   // options for CF
   storage_options.options.ttl = g_config.rocksdb_ttl_second.load(std::memory_order_relaxed);
@@ -125,6 +210,23 @@ void DB::LoadDBFromCheckpoint(const std::string& checkpoint_path, bool sync [[ma
     };
     storage_options.do_snapshot_function =
         std::bind(&pikiwidb::PRaft::DoSnapshot, &pikiwidb::PRAFT, std::placeholders::_1, std::placeholders::_2);
+    storage_options.can_write_function = [&r = PRAFT]() { return r.IsInitialized() && r.IsLeader(); };
+  }
+
+  std::lock_guard<std::shared_mutex> lock(storage_mutex_);
+  opened_ = false;
+  // close the old storage, then open the new storage
+  std::unique_ptr<storage::Storage> old_storage = std::move(storage_);
+  if (old_storage != nullptr) {
+    old_storage->Close();
+    old_storage.reset();
+  }
+  storage_ = std::make_unique<storage::Storage>();
+  ++storage_version_;
+  auto result = storage_->LoadCheckpoint(storage_options, checkpoint_sub_path, db_path_);
+
+  for (auto& r : result) {
+    r.get();
   }
 
   if (auto s = storage_->Open(storage_options, db_path_); !s.ok()) {
@@ -140,4 +242,54 @@ void DB::LoadDBFromCheckpoint(const std::string& checkpoint_path, bool sync [[ma
   opened_ = true;
   INFO("DB{} load a checkpoint from {} success!", db_index_, checkpoint_path);
 }
+bool DB::StartKeyScan() {
+  std::lock_guard lock(key_scan_mutex_);
+  if (key_scan_info_.scanning) {
+    return false;
+  }
+  if (key_scan_thread_.joinable()) {
+    key_scan_thread_.join();
+  }
+  key_scan_info_.scanning = true;
+  key_scan_thread_ = std::thread([this]() {
+    auto start_time = time(nullptr);
+    std::vector<storage::KeyInfo> key_infos(5);
+    rocksdb::Status s;
+    uint64_t storage_version = 0;
+    for (size_t index = 0; s.ok(); ++index) {
+      std::shared_lock storage_lock(storage_mutex_);
+      if (index == 0) {
+        storage_version = storage_version_;
+      } else if (storage_version != storage_version_) {
+        s = rocksdb::Status::Aborted("the db was reopened");
+        break;
+      }
+      if (index >= storage_->GetInstanceNum()) {
+        break;
+      }
+      std::vector<storage::KeyInfo> inst_key_infos;
+      s = storage_->GetKeyNum(index, &inst_key_infos);
+      if (s.ok() && inst_key_infos.size() == key_infos.size()) {
+        std::transform(inst_key_infos.begin(), inst_key_infos.end(), key_infos.begin(), key_infos.begin(),
+                       std::plus<>{});
+      }
+    }
+    std::lock_guard lock(key_scan_mutex_);
+    key_scan_info_.scanning = false;
+    if (!s.ok()) {
+      WARN("DB{} key scan failed: {}", db_index_, s.ToString());
+      return;
+    }
+    key_scan_info_.key_infos = std::move(key_infos);
+    key_scan_info_.start_time = start_time;
+    key_scan_info_.duration = time(nullptr) - start_time;
+  });
+  return true;
+}
+
+KeyScanInfo DB::GetKeyScanInfo() {
+  std::lock_guard lock(key_scan_mutex_);
+  return key_scan_info_;
+}
+
 }  // namespace pikiwidb
@@ -10,8 +10,15 @@
 
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "pstd/log.h"
 #include "pstd/noncopyable.h"
@@ -19,6 +26,29 @@
 
 namespace pikiwidb {
 
+// The result of the last exact key scan of a db, see DB::StartKeyScan()
+struct KeyScanInfo {
+  std::vector<storage::KeyInfo> key_infos;
+  // Unix time the scan started at, 0 if the db was never scanned
+  time_t start_time = 0;
+  // Seconds the scan took
+  int64_t duration = 0;
+  bool scanning = false;
+};
+
+// The state of the last slot resharding job of a db, see DB::StartMigrateSlots()
+struct ReshardInfo {
+  // "migrate" or "balance", empty if no job was started
+  std::string job;
+  // Unix time the job started at
+  time_t start_time = 0;
+  // Seconds the job took
+  int64_t duration = 0;
+  bool running = false;
+  // The result of the finished job, "ok" or the error
+  std::string result;
+};
+
 class DB {
  public:
   DB(int db_index, const std::string& db_path);
@@ -42,9 +72,33 @@ class DB {
 
   int GetDbIndex() { return db_index_; }
 
+  // The directories of the data-dirs config holding this db, with their weights
+  const std::vector<std::pair<std::string, uint32_t>>& GetDataPaths() const { return data_paths_; }
+
+  // Slot resharding between the RocksDB instances in the background, see
+  // storage::Storage::MigrateSlots. The job holds the shared lock and trades it for the
+  // exclusive lock while the slots are switched over. FLUSHDB and FLUSHALL are refused
+  // until it finishes. Returns Busy if a job is already running.
+  rocksdb::Status StartMigrateSlots(const std::vector<uint32_t>& slots, int32_t dst_index);
+
+  rocksdb::Status StartBalanceSlots();
+
+  ReshardInfo GetReshardInfo();
+
+  // REQUIRED: the caller holds the exclusive lock, so that no job starts meanwhile
+  bool IsResharding() const { return resharding_.load(); }
+
+  // Counts the keys of every type by a scan of the whole db in the background, for
+  // INFO keyspace 1. The shared lock is taken for one instance at a time. Returns
+  // false if a scan is already running.
+  bool StartKeyScan();
+
+  KeyScanInfo GetKeyScanInfo();
+
  private:
   const int db_index_ = 0;
   const std::string db_path_;
+  const std::vector<std::pair<std::string, uint32_t>> data_paths_;
   /**
    * If you want to change the pointer that points to storage,
    * you must first acquire a mutex lock.
@@ -54,6 +108,23 @@ class DB {
   std::shared_mutex storage_mutex_;
   std::unique_ptr<storage::Storage> storage_;
   bool opened_ = false;
+  // Counts the storages opened, a key scan gives up when the storage is replaced under it
+  uint64_t storage_version_ = 0;
+
+  std::mutex reshard_mutex_;
+  std::atomic<bool> resharding_ = false;
+  ReshardInfo reshard_info_;
+  std::thread reshard_thread_;
+
+  std::mutex key_scan_mutex_;
+  KeyScanInfo key_scan_info_;
+  std::thread key_scan_thread_;
+
+  // Runs func with the exclusive lock, the caller holds the shared lock
+  rocksdb::Status RunExclusive(const std::function<rocksdb::Status()>& func);
+  // Runs func as the resharding job named job on reshard_thread_
+  rocksdb::Status StartReshard(const std::string& job,
+                               std::function<rocksdb::Status(const storage::ExclusiveRunner&)> func);
 };
 
 }  // namespace pikiwidb
@@ -59,6 +59,12 @@ class EventServer final {
   // Send message to the client
   void SendPacket(const T &conn, std::string &&msg);
 
+  // Bytes sent to the client and not yet written to its socket
+  size_t PendingSendSize(const T &conn);
+
+  // See ThreadManager::NotifySendBelow
+  bool NotifySendBelow(const T &conn, size_t limit, std::function<void()> callback);
+
   // Server Active close the connection
   void CloseConnection(const T &conn);
 
@@ -200,6 +206,30 @@ void EventServer<T>::SendPacket(const T &conn, std::string &&msg) {
   threadsManager_[thIndex]->SendPacket(conn, std::move(msg));
 }
 
+template <typename T>
+requires HasSetFdFunction<T>
+size_t EventServer<T>::PendingSendSize(const T &conn) {
+  int thIndex;
+  if constexpr (IsPointer_v<T>) {
+    thIndex = conn->GetThreadIndex();
+  } else {
+    thIndex = conn.GetThreadIndex();
+  }
+  return threadsManager_[thIndex]->PendingSendSize(conn);
+}
+
+template <typename T>
+requires HasSetFdFunction<T>
+bool EventServer<T>::NotifySendBelow(const T &conn, size_t limit, std::function<void()> callback) {
+  int thIndex;
+  if constexpr (IsPointer_v<T>) {
+    thIndex = conn->GetThreadIndex();
+  } else {
+    thIndex = conn.GetThreadIndex();
+  }
+  return threadsManager_[thIndex]->NotifySendBelow(conn, limit, std::move(callback));
+}
+
 template <typename T>
 requires HasSetFdFunction<T>
 void EventServer<T>::CloseConnection(const T &conn) {
@@ -48,6 +48,13 @@ class NetEvent {
   // Send data
   virtual bool SendPacket(std::string &&msg) = 0;
 
+  // Bytes given to SendPacket and not yet written to the socket
+  virtual size_t PendingSendSize() { return 0; }
+
+  // true if at most limit bytes are not yet written to the socket. Otherwise false, and
+  // callback is called once, from the write thread, when the socket wrote down to limit.
+  virtual bool NotifySendBelow(size_t limit, std::function<void()> callback) { return true; }
+
   virtual void Close() = 0;
 
   inline int Fd() const { return fd_.load(); }
@@ -14,22 +14,33 @@ int StreamSocket::OnReadable(const std::shared_ptr<Connection> &conn, std::strin
 
 // return bytes that have not yet been sent
 int StreamSocket::OnWritable() {
-  std::lock_guard<std::mutex> lock(sendMutex_);
-  size_t ret = ::write(Fd(), sendData_.c_str() + sendPos_, sendData_.size() - sendPos_);
-  if (ret == -1) {
-    if (EAGAIN == errno || EWOULDBLOCK == errno) {
-      return NE_OK;
+  std::function<void()> onSendBelow;
+  int unsent = 0;
+  {
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    size_t ret = ::write(Fd(), sendData_.c_str() + sendPos_, sendData_.size() - sendPos_);
+    if (ret == -1) {
+      if (EAGAIN == errno || EWOULDBLOCK == errno) {
+        return NE_OK;
+      }
+      ERROR("StreamSocket fd: {} write error: {}", Fd(), errno);
+      return NE_ERROR;
+    }
+    sendPos_ += ret;
+    if (sendPos_ == sendData_.size()) {
+      sendPos_ = 0;
+      sendData_.clear();
+    }
+    unsent = static_cast<int>(sendData_.size() - sendPos_);
+    if (onSendBelow_ && static_cast<size_t>(unsent) <= notifyLimit_) {
+      onSendBelow.swap(onSendBelow_);
     }
-    ERROR("StreamSocket fd: {} write error: {}", Fd(), errno);
-    return NE_ERROR;
   }
-  sendPos_ += ret;
-  if (sendPos_ == sendData_.size()) {
-    sendPos_ = 0;
-    sendData_.clear();
-    return 0;
+  // called unlocked, it may send more
+  if (onSendBelow) {
+    onSendBelow();
   }
-  return static_cast<int>(sendData_.size() - sendPos_);
+  return unsent;
 }
 
 bool StreamSocket::SendPacket(std::string &&msg) {
@@ -38,6 +49,21 @@ bool StreamSocket::SendPacket(std::string &&msg) {
   return true;
 }
 
+size_t StreamSocket::PendingSendSize() {
+  std::lock_guard<std::mutex> lock(sendMutex_);
+  return sendData_.size() - sendPos_;
+}
+
+bool StreamSocket::NotifySendBelow(size_t limit, std::function<void()> callback) {
+  std::lock_guard<std::mutex> lock(sendMutex_);
+  if (sendData_.size() - sendPos_ <= limit) {
+    return true;
+  }
+  notifyLimit_ = limit;
+  onSendBelow_ = std::move(callback);
+  return false;
+}
+
 // Read data from the socket
 int StreamSocket::Read(std::string *readBuff) {
   char readBuffer[readBuffSize_];
@@ -11,6 +11,7 @@
 #include <netinet/in.h>
 #include <atomic>
 #include <cstring>
+#include <functional>
 #include <memory>
 #include <mutex>
 
@@ -30,6 +31,10 @@ class StreamSocket : public BaseSocket {
 
   bool SendPacket(std::string &&msg) override;
 
+  size_t PendingSendSize() override;
+
+  bool NotifySendBelow(size_t limit, std::function<void()> callback) override;
+
   int Read(std::string *readBuff);
 
  private:
@@ -39,6 +44,9 @@ class StreamSocket : public BaseSocket {
 
   std::string sendData_;  // send data buff
   size_t sendPos_ = 0;    // send data buff pos
+
+  size_t notifyLimit_ = 0;              // unsent bytes onSendBelow_ waits for
+  std::function<void()> onSendBelow_;  // armed by NotifySendBelow
 };
 
 }  // namespace net
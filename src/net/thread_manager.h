@@ -80,6 +80,12 @@ class ThreadManager {
   // Send message to the client
   void SendPacket(const T &conn, std::string &&msg);
 
+  // Bytes sent to the client and not yet written to its socket
+  size_t PendingSendSize(const T &conn);
+
+  // See NetEvent::NotifySendBelow, false without calling callback if the connection is closed
+  bool NotifySendBelow(const T &conn, size_t limit, std::function<void()> callback);
+
  private:
   // Create read thread
   bool CreateReadThread(const std::shared_ptr<NetEvent> &listen, const std::shared_ptr<Timer> &timer);
@@ -262,6 +268,40 @@ void ThreadManager<T>::SendPacket(const T &conn, std::string &&msg) {
   }
 }
 
+template <typename T>
+requires HasSetFdFunction<T>
+size_t ThreadManager<T>::PendingSendSize(const T &conn) {
+  std::shared_lock lock(mutex_);
+  uint64_t connId = 0;
+  if constexpr (IsPointer_v<T>) {
+    connId = conn->GetConnId();
+  } else {
+    connId = conn.GetConnId();
+  }
+  auto iter = connections_.find(connId);
+  if (iter == connections_.end()) {
+    return 0;
+  }
+  return iter->second.second->netEvent_->PendingSendSize();
+}
+
+template <typename T>
+requires HasSetFdFunction<T>
+bool ThreadManager<T>::NotifySendBelow(const T &conn, size_t limit, std::function<void()> callback) {
+  std::shared_lock lock(mutex_);
+  uint64_t connId = 0;
+  if constexpr (IsPointer_v<T>) {
+    connId = conn->GetConnId();
+  } else {
+    connId = conn.GetConnId();
+  }
+  auto iter = connections_.find(connId);
+  if (iter == connections_.end()) {
+    return false;
+  }
+  return iter->second.second->netEvent_->NotifySendBelow(limit, std::move(callback));
+}
+
 template <typename T>
 requires HasSetFdFunction<T>
 bool ThreadManager<T>::CreateReadThread(const std::shared_ptr<NetEvent> &listen, const std::shared_ptr<Timer> &timer) {
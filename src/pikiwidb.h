@@ -57,6 +57,15 @@ class PikiwiDB final {
     event_server_->SendPacket(client, std::move(msg));
   }
 
+  inline size_t PendingSendSize(const std::shared_ptr<pikiwidb::PClient>& client) {
+    return event_server_->PendingSendSize(client);
+  }
+
+  inline bool NotifySendBelow(const std::shared_ptr<pikiwidb::PClient>& client, size_t limit,
+                              std::function<void()> callback) {
+    return event_server_->NotifySendBelow(client, limit, std::move(callback));
+  }
+
   inline void CloseConnection(const std::shared_ptr<pikiwidb::PClient>& client) {
     event_server_->CloseConnection(client);
   }
@@ -5,175 +5,100 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
-#ifndef __STDC_FORMAT_MACROS
-#  define __STDC_FORMAT_MACROS
-#endif
-
 #include "lock_mgr.h"
 
-#include <atomic>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <functional>
-#include <memory>
-#include <unordered_set>
-#include <vector>
-
-#include "mutex.h"
+#include <thread>
 
 namespace pstd::lock {
 
-struct LockMapStripe {
-  explicit LockMapStripe(const std::shared_ptr<MutexFactory>& factory) {
-    stripe_mutex = factory->AllocateMutex();
-    stripe_cv = factory->AllocateCondVar();
-    assert(stripe_mutex);
-    assert(stripe_cv);
-  }
-
-  // Mutex must be held before modifying keys map
-  std::shared_ptr<Mutex> stripe_mutex;
+// Number of times a contended slot is polled before the locker goes to sleep,
+// record locks are held for a few microseconds so a short spin usually wins.
+static constexpr int kSpinCount = 64;
 
-  // Condition Variable per stripe for waiting on a lock
-  std::shared_ptr<CondVar> stripe_cv;
-
-  // Locked keys
-  std::unordered_set<std::string> keys;
-};
-
-// Map of #num_stripes LockMapStripes
-struct LockMap {
-  explicit LockMap(size_t num_stripes, const std::shared_ptr<MutexFactory>& factory) : num_stripes_(num_stripes) {
-    lock_map_stripes_.reserve(num_stripes);
-    for (size_t i = 0; i < num_stripes; i++) {
-      auto stripe = std::make_shared<LockMapStripe>(factory);
-      lock_map_stripes_.push_back(stripe);
-    }
+static size_t RoundUpToPowerOfTwo(size_t num) {
+  size_t power = 1;
+  while (power < num) {
+    power <<= 1;
   }
-
-  ~LockMap() = default;
-
-  // Number of sepearate LockMapStripes to create, each with their own Mutex
-  const size_t num_stripes_;
-
-  // Count of keys that are currently locked.
-  // (Only maintained if LockMgr::max_num_locks_ is positive.)
-  std::atomic<int64_t> lock_cnt{0};
-
-  std::vector<std::shared_ptr<LockMapStripe>> lock_map_stripes_;
-
-  size_t GetStripe(const std::string& key) const;
-};
-
-size_t LockMap::GetStripe(const std::string& key) const {
-  assert(num_stripes_ > 0);
-  size_t stripe = std::hash<std::string>{}(key) % num_stripes_;
-  return stripe;
+  return power;
 }
 
-LockMgr::LockMgr(size_t default_num_stripes, int64_t max_num_locks, const std::shared_ptr<MutexFactory>& mutex_factory)
-    : default_num_stripes_(default_num_stripes),
-      max_num_locks_(max_num_locks),
-      mutex_factory_(mutex_factory),
-      lock_map_(std::make_shared<LockMap>(default_num_stripes, mutex_factory)) {}
+LockMgr::LockMgr(size_t num_slots)
+    : slots_mask_(RoundUpToPowerOfTwo(std::max<size_t>(num_slots, 1)) - 1),
+      slots_(std::make_unique<std::atomic<uint32_t>[]>(slots_mask_ + 1)) {}
 
 LockMgr::~LockMgr() = default;
 
-Status LockMgr::TryLock(const std::string& key) {
-#ifdef LOCKLESS
-  return Status::OK();
-#else
-  size_t stripe_num = lock_map_->GetStripe(key);
-  assert(lock_map_->lock_map_stripes_.size() > stripe_num);
-  auto stripe = lock_map_->lock_map_stripes_.at(stripe_num);
+size_t LockMgr::GetSlot(std::string_view key) const { return std::hash<std::string_view>{}(key) & slots_mask_; }
 
-  return Acquire(stripe, key);
-#endif
+Status LockMgr::TryLock(std::string_view key) {
+  LockSlot(GetSlot(key));
+  return Status::OK();
 }
 
-// Helper function for TryLock().
-Status LockMgr::Acquire(const std::shared_ptr<LockMapStripe>& stripe, const std::string& key) {
-  Status result;
+void LockMgr::UnLock(std::string_view key) { UnLockSlot(GetSlot(key)); }
 
-  // we wait indefinitely to acquire the lock
-  result = stripe->stripe_mutex->Lock();
+void LockMgr::SortSlots(std::vector<size_t>* slots) {
+  std::sort(slots->begin(), slots->end());
+  slots->erase(std::unique(slots->begin(), slots->end()), slots->end());
+}
 
-  if (!result.ok()) {
-    // failed to acquire mutex
-    return result;
+void LockMgr::LockSlots(const std::vector<size_t>& slots) {
+  assert(std::is_sorted(slots.begin(), slots.end()));
+  for (auto slot : slots) {
+    LockSlot(slot);
   }
+}
 
-  // Acquire lock if we are able to
-  result = AcquireLocked(stripe, key);
-
-  if (!result.ok()) {
-    // If we weren't able to acquire the lock, we will keep retrying
-    do {
-      result = stripe->stripe_cv->Wait(stripe->stripe_mutex);
-      if (result.ok()) {
-        result = AcquireLocked(stripe, key);
-      }
-    } while (!result.ok());
+void LockMgr::UnLockSlots(const std::vector<size_t>& slots) {
+  for (auto iter = slots.rbegin(); iter != slots.rend(); ++iter) {
+    UnLockSlot(*iter);
   }
-
-  stripe->stripe_mutex->UnLock();
-
-  return result;
 }
 
-// Try to lock this key after we have acquired the mutex.
-// REQUIRED:  Stripe mutex must be held.
-Status LockMgr::AcquireLocked(const std::shared_ptr<LockMapStripe>& stripe, const std::string& key) {
-  Status result;
-  // Check if this key is already locked
-  if (stripe->keys.find(key) != stripe->keys.end()) {
-    // Lock already held
-    result = Status::Busy("LockTimeout");
-  } else {  // Lock not held.
-    // Check lock limit
-    if (max_num_locks_ > 0 && lock_map_->lock_cnt.load(std::memory_order_acquire) >= max_num_locks_) {
-      result = Status::Busy("LockLimit");
-    } else {
-      // acquire lock
-      stripe->keys.insert(key);
+// Helper function for LockSlot(), called when the slot was found locked.
+void LockMgr::LockSlotSlow(size_t slot) {
+  auto& word = slots_[slot];
+  auto start = std::chrono::steady_clock::now();
 
-      // Maintain lock count if there is a limit on the number of locks
-      if (max_num_locks_ != 0) {
-        lock_map_->lock_cnt++;
-      }
+  bool acquired = false;
+  for (int spin = 0; spin < kSpinCount && !acquired; ++spin) {
+    uint32_t expected = kUnlocked;
+    if (word.load(std::memory_order_relaxed) == kUnlocked) {
+      acquired = word.compare_exchange_weak(expected, kLocked, std::memory_order_acquire, std::memory_order_relaxed);
+    } else {
+      std::this_thread::yield();
     }
   }
 
-  return result;
-}
-
-void LockMgr::UnLockKey(const std::string& key, const std::shared_ptr<LockMapStripe>& stripe) {
-#ifdef LOCKLESS
-#else
-  auto stripe_iter = stripe->keys.find(key);
-  if (stripe_iter != stripe->keys.end()) {
-    // Found the key locked.  unlock it.
-    stripe->keys.erase(stripe_iter);
-    if (max_num_locks_ > 0) {
-      // Maintain lock count if there is a limit on the number of locks.
-      assert(lock_map_->lock_cnt.load(std::memory_order_relaxed) > 0);
-      lock_map_->lock_cnt--;
+  // Mark the slot contended before sleeping so the holder knows to wake us up,
+  // a slot taken this way stays contended until it is released.
+  if (!acquired) {
+    while (word.exchange(kContended, std::memory_order_acquire) != kUnlocked) {
+      word.wait(kContended, std::memory_order_relaxed);
     }
-  } else {
-    // This key is either not locked or locked by someone else.
   }
-#endif
-}
-
-void LockMgr::UnLock(const std::string& key) {
-  // Lock the mutex for the stripe that this key hashes to
-  size_t stripe_num = lock_map_->GetStripe(key);
-  assert(lock_map_->lock_map_stripes_.size() > stripe_num);
-  auto stripe = lock_map_->lock_map_stripes_.at(stripe_num);
 
-  stripe->stripe_mutex->Lock();
-  UnLockKey(key, stripe);
-  stripe->stripe_mutex->UnLock();
+  auto wait_micros = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+  waits_.fetch_add(1, std::memory_order_relaxed);
+  wait_micros_.fetch_add(wait_micros, std::memory_order_relaxed);
+  uint64_t max_wait = max_wait_micros_.load(std::memory_order_relaxed);
+  while (wait_micros > max_wait &&
+         !max_wait_micros_.compare_exchange_weak(max_wait, wait_micros, std::memory_order_relaxed)) {
+  }
+}
 
-  // Signal waiting threads to retry locking
-  stripe->stripe_cv->NotifyAll();
+LockStats LockMgr::GetStats() const {
+  LockStats stats;
+  stats.waits = waits_.load(std::memory_order_relaxed);
+  stats.wait_micros = wait_micros_.load(std::memory_order_relaxed);
+  stats.max_wait_micros = max_wait_micros_.load(std::memory_order_relaxed);
+  return stats;
 }
+
 }  // namespace pstd::lock
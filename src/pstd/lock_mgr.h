@@ -7,47 +7,103 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
-#include <string>
+#include <string_view>
+#include <vector>
 
 #include "mutex.h"
 #include "noncopyable.h"
 
 namespace pstd::lock {
-struct LockMap;
-struct LockMapStripe;
 
+// Lock wait metrics of a LockMgr, only the acquisitions that found their slot
+// locked are counted so the uncontended path stays a single atomic operation.
+struct LockStats {
+  uint64_t waits = 0;
+  uint64_t wait_micros = 0;
+  uint64_t max_wait_micros = 0;
+};
+
+// Keys are hashed into a fixed array of slots and a slot is a lock word, so
+// locking an uncontended key is one compare-and-swap and unlocking is one
+// exchange. Different keys hashing into the same slot serialize, callers that
+// lock several keys at once must go through LockSlots() which locks every slot
+// once, in ascending order, so two multi-key lockers can not deadlock.
 class LockMgr : public pstd::noncopyable {
  public:
-  LockMgr(size_t default_num_stripes, int64_t max_num_locks, const std::shared_ptr<MutexFactory>& factory);
+  static constexpr size_t kDefaultNumSlots = 1 << 16;
+
+  // num_slots is rounded up to a power of two.
+  explicit LockMgr(size_t num_slots = kDefaultNumSlots);
 
   ~LockMgr();
 
-  // Attempt to lock key.  If OK status is returned, the caller is responsible
-  // for calling UnLock() on this key.
-  Status TryLock(const std::string& key);
+  // Lock key, waiting until it is released by its holder. The returned status is
+  // always OK, the caller is responsible for calling UnLock() on this key.
+  Status TryLock(std::string_view key);
 
   // Unlock a key locked by TryLock().
-  void UnLock(const std::string& key);
+  void UnLock(std::string_view key);
+
+  size_t GetSlot(std::string_view key) const;
+
+  // Returns the sorted and deduplicated slots of keys, the order LockSlots() expects.
+  template <typename Keys>
+  std::vector<size_t> GetSlots(const Keys& keys) const {
+    std::vector<size_t> slots;
+    slots.reserve(keys.size());
+    for (const auto& key : keys) {
+      slots.push_back(GetSlot(std::string_view(key.data(), key.size())));
+    }
+    SortSlots(&slots);
+    return slots;
+  }
+
+  void LockSlot(size_t slot) {
+#ifndef LOCKLESS
+    uint32_t expected = kUnlocked;
+    if (!slots_[slot].compare_exchange_strong(expected, kLocked, std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+      LockSlotSlow(slot);
+    }
+#endif
+  }
+
+  void UnLockSlot(size_t slot) {
+#ifndef LOCKLESS
+    if (slots_[slot].exchange(kUnlocked, std::memory_order_release) == kContended) {
+      slots_[slot].notify_one();
+    }
+#endif
+  }
+
+  // REQUIRED: slots is sorted and deduplicated, see GetSlots().
+  void LockSlots(const std::vector<size_t>& slots);
+
+  void UnLockSlots(const std::vector<size_t>& slots);
+
+  size_t NumSlots() const { return slots_mask_ + 1; }
+
+  LockStats GetStats() const;
 
  private:
-  // Default number of lock map stripes
-  const size_t default_num_stripes_ [[maybe_unused]];
-
-  // Limit on number of keys locked per column family
-  const int64_t max_num_locks_;
-
-  // Used to allocate mutexes/condvars to use when locking keys
-  std::shared_ptr<MutexFactory> mutex_factory_;
+  // Slot states, kContended means the holder must wake a waiter on unlock.
+  static constexpr uint32_t kUnlocked = 0;
+  static constexpr uint32_t kLocked = 1;
+  static constexpr uint32_t kContended = 2;
 
-  // Map to locked key info
-  std::shared_ptr<LockMap> lock_map_;
+  static void SortSlots(std::vector<size_t>* slots);
 
-  Status Acquire(const std::shared_ptr<LockMapStripe>& stripe, const std::string& key);
+  void LockSlotSlow(size_t slot);
 
-  Status AcquireLocked(const std::shared_ptr<LockMapStripe>& stripe, const std::string& key);
+  const size_t slots_mask_;
+  std::unique_ptr<std::atomic<uint32_t>[]> slots_;
 
-  void UnLockKey(const std::string& key, const std::shared_ptr<LockMapStripe>& stripe);
+  std::atomic<uint64_t> waits_{0};
+  std::atomic<uint64_t> wait_micros_{0};
+  std::atomic<uint64_t> max_wait_micros_{0};
 };
 
 }  // namespace pstd::lock
@@ -13,67 +13,15 @@ namespace pstd::lock {
 
 MultiScopeRecordLock::MultiScopeRecordLock(const std::shared_ptr<LockMgr>& lock_mgr,
                                            const std::vector<std::string>& keys)
-    : lock_mgr_(lock_mgr), keys_(keys) {
-  std::string pre_key;
-  std::sort(keys_.begin(), keys_.end());
-  if (!keys_.empty() && keys_[0].empty()) {
-    lock_mgr_->TryLock(pre_key);
-  }
-
-  for (const auto& key : keys_) {
-    if (pre_key != key) {
-      lock_mgr_->TryLock(key);
-      pre_key = key;
-    }
-  }
+    : lock_mgr_(lock_mgr), slots_(lock_mgr_->GetSlots(keys)) {
+  lock_mgr_->LockSlots(slots_);
 }
-MultiScopeRecordLock::~MultiScopeRecordLock() {
-  std::string pre_key;
-  if (!keys_.empty() && keys_[0].empty()) {
-    lock_mgr_->UnLock(pre_key);
-  }
 
-  for (const auto& key : keys_) {
-    if (pre_key != key) {
-      lock_mgr_->UnLock(key);
-      pre_key = key;
-    }
-  }
-}
+MultiScopeRecordLock::~MultiScopeRecordLock() { lock_mgr_->UnLockSlots(slots_); }
 
-void MultiRecordLock::Lock(const std::vector<std::string>& keys) {
-  std::vector<std::string> internal_keys = keys;
-  std::sort(internal_keys.begin(), internal_keys.end());
-  // init to be ""
-  std::string pre_key;
-  // consider internal_keys "" "" "a"
-  if (!internal_keys.empty()) {
-    lock_mgr_->TryLock(internal_keys.front());
-    pre_key = internal_keys.front();
-  }
-
-  for (const auto& key : internal_keys) {
-    if (pre_key != key) {
-      lock_mgr_->TryLock(key);
-      pre_key = key;
-    }
-  }
-}
+void MultiRecordLock::Lock(const std::vector<std::string>& keys) { lock_mgr_->LockSlots(lock_mgr_->GetSlots(keys)); }
 
 void MultiRecordLock::Unlock(const std::vector<std::string>& keys) {
-  std::vector<std::string> internal_keys = keys;
-  std::sort(internal_keys.begin(), internal_keys.end());
-  std::string pre_key;
-  if (!internal_keys.empty()) {
-    lock_mgr_->UnLock(internal_keys.front());
-    pre_key = internal_keys.front();
-  }
-
-  for (const auto& key : internal_keys) {
-    if (pre_key != key) {
-      lock_mgr_->UnLock(key);
-      pre_key = key;
-    }
-  }
+  lock_mgr_->UnLockSlots(lock_mgr_->GetSlots(keys));
 }
 }  // namespace pstd::lock
@@ -22,14 +22,15 @@ using Slice = rocksdb::Slice;
 
 class ScopeRecordLock final : public pstd::noncopyable {
  public:
-  ScopeRecordLock(const std::shared_ptr<LockMgr>& lock_mgr, const Slice& key) : lock_mgr_(lock_mgr), key_(key) {
-    lock_mgr_->TryLock(key_.ToString());
+  ScopeRecordLock(const std::shared_ptr<LockMgr>& lock_mgr, const Slice& key)
+      : lock_mgr_(lock_mgr), slot_(lock_mgr_->GetSlot(std::string_view(key.data(), key.size()))) {
+    lock_mgr_->LockSlot(slot_);
   }
-  ~ScopeRecordLock() { lock_mgr_->UnLock(key_.ToString()); }
+  ~ScopeRecordLock() { lock_mgr_->UnLockSlot(slot_); }
 
  private:
   std::shared_ptr<LockMgr> const lock_mgr_;
-  Slice key_;
+  const size_t slot_;
 };
 
 class MultiScopeRecordLock final : public pstd::noncopyable {
@@ -39,7 +40,8 @@ class MultiScopeRecordLock final : public pstd::noncopyable {
 
  private:
   std::shared_ptr<LockMgr> const lock_mgr_;
-  std::vector<std::string> keys_;
+  // the slots of the keys, sorted and deduplicated
+  std::vector<size_t> slots_;
 };
 
 class MultiRecordLock : public noncopyable {
@@ -11,10 +11,11 @@ namespace pstd {
 
 thread_local bool ThreadPool::working_ = true;
 
-ThreadPool::ThreadPool() : waiters_(0), shutdown_(false) {
+ThreadPool::ThreadPool() : waiters_(0), liveThreads_(0), shutdown_(false) {
   monitor_ = std::thread([this]() { this->MonitorRoutine(); });
   maxIdleThread_ = std::max(1U, std::thread::hardware_concurrency());
   pendingStopSignal_ = 0;
+  maxThread_ = kMaxThreads;
 }
 
 ThreadPool::~ThreadPool() { JoinAll(); }
@@ -25,6 +26,12 @@ void ThreadPool::SetMaxIdleThread(unsigned int m) {
   }
 }
 
+void ThreadPool::SetMaxThread(unsigned int m) {
+  if (0 < m && m <= kMaxThreads) {
+    maxThread_ = m;
+  }
+}
+
 void ThreadPool::JoinAll() {
   decltype(worker_threads_) tmp;
 
@@ -55,6 +62,7 @@ void ThreadPool::JoinAll() {
 void ThreadPool::CreateWorker() {
   std::thread t([this]() { this->WorkerRoutine(); });
   worker_threads_.push_back(std::move(t));
+  ++liveThreads_;
 }
 
 void ThreadPool::WorkerRoutine() {
@@ -83,6 +91,8 @@ void ThreadPool::WorkerRoutine() {
 
   // if reach here, this thread is recycled by monitor thread
   --pendingStopSignal_;
+  std::unique_lock<std::mutex> guard(mutex_);
+  --liveThreads_;
 }
 
 void ThreadPool::MonitorRoutine() {
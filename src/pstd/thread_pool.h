@@ -31,6 +31,8 @@ class ThreadPool final {
 
   void JoinAll();
   void SetMaxIdleThread(unsigned int m);
+  // Caps the number of worker threads, tasks wait in the queue once all of them are busy
+  void SetMaxThread(unsigned int m);
 
  private:
   void CreateWorker();
@@ -40,6 +42,7 @@ class ThreadPool final {
   std::thread monitor_;
   std::atomic<unsigned> maxIdleThread_;
   std::atomic<unsigned> pendingStopSignal_;
+  std::atomic<unsigned> maxThread_;
 
   static thread_local bool working_;
   std::deque<std::thread> worker_threads_;
@@ -47,6 +50,7 @@ class ThreadPool final {
   std::mutex mutex_;
   std::condition_variable cond_;
   unsigned waiters_;
+  unsigned liveThreads_;
   bool shutdown_;
   std::deque<std::function<void()>> tasks_;
 
@@ -67,7 +71,7 @@ auto ThreadPool::ExecuteTask(F&& f, Args&&... args) -> std::future<std::invoke_r
     }
 
     tasks_.emplace_back([=]() { (*task)(); });
-    if (waiters_ == 0) {
+    if (waiters_ == 0 && liveThreads_ < maxThread_) {
       CreateWorker();
     }
 
@@ -7,21 +7,51 @@
 #define __SLOT_INDEXER_H__
 
 #include <stdint.h>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "rocksdb/status.h"
+
 namespace storage {
+
 // Manage slots to rocksdb indexes
-// TODO(wangshaoyi): temporarily mock return
+//
+// A key belongs to the slot GetSlotID(key) % slot_num and a slot belongs to one
+// instance. A new map gives slot s to instance s % inst_num and its slot_num is
+// a multiple of inst_num, so it routes every key as slot_id % inst_num did
+// before the map was persisted. Slots are moved between instances by
+// Storage::MigrateSlots, the map is saved in the db path after every move and
+// keeps its slot_num for the lifetime of the data.
 class SlotIndexer {
  public:
-  explicit SlotIndexer(int32_t inst_num) : inst_num_(inst_num) { assert(inst_num > 0); }
+  // Lower bound of the slot_num of a new map
+  static constexpr uint32_t kMinSlotNum = 1024;
+
+  explicit SlotIndexer(int32_t inst_num);
   SlotIndexer() = delete;
-  ~SlotIndexer() {}
-  uint32_t GetInstanceID(uint32_t slot_id) { return slot_id % inst_num_; }
-  void ReshardSlots(const std::vector<uint32_t>& slots) {}
+  ~SlotIndexer() = default;
+
+  uint32_t GetSlot(uint32_t slot_id) const { return slot_id % slot_num_; }
+  uint32_t GetInstanceID(uint32_t slot_id) const {
+    return owners_[GetSlot(slot_id)].load(std::memory_order_acquire);
+  }
+  uint32_t GetSlotOwner(uint32_t slot) const { return owners_[slot].load(std::memory_order_acquire); }
+  uint32_t GetSlotNum() const { return slot_num_; }
+  std::vector<uint32_t> GetSlotsOf(uint32_t inst_id) const;
+
+  // Hands slots over to inst_id, the caller persists the map with Save().
+  void ReshardSlots(const std::vector<uint32_t>& slots, uint32_t inst_id);
+
+  // Replaces the map with the one saved in path, the map is left unchanged on error.
+  rocksdb::Status Load(const std::string& path);
+  rocksdb::Status Save(const std::string& path) const;
 
  private:
-  int32_t inst_num_ = 3;
+  uint32_t slot_num_ = 0;
+  std::unique_ptr<std::atomic<uint32_t>[]> owners_;
 };
 }  // namespace storage
 
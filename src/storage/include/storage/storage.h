@@ -14,6 +14,8 @@
 #include <map>
 #include <queue>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -26,7 +28,9 @@
 #include "rocksdb/table.h"
 
 #include "pstd/env.h"
+#include "pstd/lock_mgr.h"
 #include "pstd/pstd_mutex.h"
+#include "pstd/thread_pool.h"
 #include "src/base_data_value_format.h"
 #include "storage/slot_indexer.h"
 
@@ -57,13 +61,17 @@ using Env = rocksdb::Env;
 using LogIndex = int64_t;
 
 class Redis;
+class MemberIterator;
 enum class OptionType;
 
 template <typename T1, typename T2>
-class LRUCache;
+class ShardedLRUCache;
 
 using AppendLogFunction = std::function<void(const pikiwidb::Binlog&, std::promise<Status>&&)>;
+// Runs its argument while every other access to the storage is blocked
+using ExclusiveRunner = std::function<Status(const std::function<Status()>&)>;
 using DoSnapshotFunction = std::function<void(LogIndex, bool)>;
+using CanWriteFunction = std::function<bool()>;
 
 struct StorageOptions {
   mutable rocksdb::Options options;
@@ -74,6 +82,8 @@ struct StorageOptions {
   size_t small_compaction_threshold = 5000;
   size_t small_compaction_duration_threshold = 10000;
   size_t db_instance_num = 3;  // default = 3
+  // Let batched lookups (MGET, EXISTS ...) read the SST blocks of one level in parallel
+  bool async_io = false;
   int db_id = 0;
   AppendLogFunction append_log_function = nullptr;
   DoSnapshotFunction do_snapshot_function = nullptr;
@@ -81,9 +91,36 @@ struct StorageOptions {
   uint32_t raft_timeout_s = std::numeric_limits<uint32_t>::max();
   int64_t max_gap = 1000;
   uint64_t mem_manager_size = 100000000;
+  // Keys deleted per second by the active expire cycle of each instance, 0 turns the cycle off
+  uint64_t active_expire_keys_per_second = 0;
+  // Tells whether this node may write, in raft mode only the leader runs the active expire cycle
+  CanWriteFunction can_write_function = nullptr;
+  // Compression of the levels of single column families by name, overrides options.compression_per_level
+  std::unordered_map<std::string, std::vector<rocksdb::CompressionType>> cf_compression_per_level;
+  // Directories the instances are spread over, with their weights, an empty list keeps every
+  // instance in the db path. The placement is saved in the db path, see Storage::Open
+  std::vector<std::pair<std::string, uint32_t>> data_paths;
+  // The string cursors of SCAN, HSCAN, SSCAN and ZSCAN are tokens carrying the point the
+  // scan resumes at, which survive the eviction of the cursor cache and restarts, instead
+  // of numbered ones. The int64_t cursors stay numbered
+  bool stateless_scan_cursors = false;
+  // The key the tokens are signed with, nodes sharing it take the tokens of each other. Empty
+  // signs them with a random key kept in the db path
+  std::string scan_cursor_secret;
   Status ResetOptions(const OptionType& option_type, const std::unordered_map<std::string, std::string>& options_map);
 };
 
+// The file I/O of the instances placed in one data path
+struct DataPathIOStats {
+  std::string path;
+  size_t instances = 0;
+  // Bytes read from the sst files by the reads and the compactions
+  uint64_t read_bytes = 0;
+  uint64_t wal_bytes = 0;
+  uint64_t flush_bytes = 0;
+  uint64_t compaction_bytes = 0;
+};
+
 struct KeyValue {
   std::string key;
   std::string value;
@@ -118,6 +155,12 @@ struct ValueStatus {
   bool operator==(const ValueStatus& vs) const { return (vs.value == value && vs.status == status && vs.ttl == ttl); }
 };
 
+struct ScoreStatus {
+  double score = 0;
+  Status status;
+  bool operator==(const ScoreStatus& ss) const { return (ss.score == score && ss.status == status); }
+};
+
 struct FieldValue {
   std::string field;
   std::string value;
@@ -141,6 +184,32 @@ struct ScoreMember {
   bool operator==(const ScoreMember& sm) const { return (sm.score == score && sm.member == member); }
 };
 
+// Receives the elements of a collection as they are read, so that a read of a
+// large collection never holds it whole. Begin is called once with the number of
+// elements, before any of them, and a status other than ok from any of the calls
+// stops the read and is returned from it.
+class ElementSink {
+ public:
+  virtual ~ElementSink() = default;
+  virtual Status Begin(uint64_t count) = 0;
+  virtual Status Append(const Slice& element) = 0;
+  // Appends a score as an element, written the way the replies write doubles
+  virtual Status AppendScore(double score) = 0;
+};
+
+// Reads the elements of a collection from the snapshot taken when it was opened, a piece
+// at a time, so that its owner can stop in between for as long as it needs. Nothing is
+// locked between the pieces. The first Read calls Begin on the sink. Once the storage
+// the reader was opened on is closed, Read returns Aborted.
+class ElementReader {
+ public:
+  virtual ~ElementReader() = default;
+  // Emits elements into sink until at least max_bytes of them went to it or the last one did
+  virtual Status Read(ElementSink* sink, size_t max_bytes) = 0;
+  // Whether the last element was emitted
+  virtual bool Done() const = 0;
+};
+
 enum BeforeOrAfter { Before, After };
 
 enum class OptionType {
@@ -179,13 +248,22 @@ class Storage {
 
   Status CreateCheckpointInternal(const std::string& checkpoint_path, int db_index);
 
-  std::vector<std::future<Status>> LoadCheckpoint(const std::string& checkpoint_path, const std::string& db_path);
+  // The instances are loaded into their data paths, storage_options must be the ones the
+  // storage is opened with afterwards
+  std::vector<std::future<Status>> LoadCheckpoint(const StorageOptions& storage_options,
+                                                  const std::string& checkpoint_path, const std::string& db_path);
 
   Status LoadCheckpointInternal(const std::string& dump_path, const std::string& db_path, int index);
 
-  Status LoadCursorStartKey(const DataType& dtype, int64_t cursor, char* type, std::string* start_key);
+  Status LoadCursorStartKey(const DataType& dtype, const std::string& pattern, const std::string& cursor, char* type,
+                            std::string* start_key);
 
-  Status StoreCursorStartKey(const DataType& dtype, int64_t cursor, char type, const std::string& next_key);
+  // Returns the token of next_key with stateless, the numbered cursor given otherwise
+  std::string StoreCursorStartKey(const DataType& dtype, const std::string& pattern, int64_t cursor, bool stateless,
+                                  char type, const std::string& next_key);
+
+  std::string ScanKeys(const DataType& dtype, const std::string& cursor, bool stateless, const std::string& pattern,
+                       int64_t count, std::vector<std::string>* keys);
 
   std::unique_ptr<Redis>& GetDBInstance(const Slice& key);
 
@@ -343,6 +421,15 @@ class Storage {
   // reply is twice the size of the hash.
   Status HGetall(const Slice& key, std::vector<FieldValue>* fvs);
 
+  // Emits the fields and values of the hash stored at key into sink, every field
+  // followed by its value. Returns NotFound, without calling sink, if the key does
+  // not exist.
+  Status HGetall(const Slice& key, ElementSink* sink);
+
+  // Opens a reader of the fields and values of the hash stored at key, emitted as
+  // by the sink version. Returns NotFound if the key does not exist.
+  Status HGetall(const Slice& key, std::unique_ptr<ElementReader>* reader);
+
   Status HGetallWithTTL(const Slice& key, std::vector<FieldValue>* fvs, int64_t* ttl);
 
   // Returns all field names in the hash stored at key.
@@ -396,6 +483,8 @@ class Storage {
   // See SCAN for HSCAN documentation.
   Status HScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                std::vector<FieldValue>* field_values, int64_t* next_cursor);
+  Status HScan(const Slice& key, const std::string& cursor, const std::string& pattern, int64_t count,
+               std::vector<FieldValue>* field_values, std::string* next_cursor);
 
   // Iterate over a Hash table of fields
   // return next_field that the user need to use as the start_field argument
@@ -439,6 +528,8 @@ class Storage {
   // This command is equal to SDIFF, but instead of returning the resulting set,
   // it is stored in destination.
   // If destination already exists, it is overwritten.
+  // The result is written to destination in batches while it is computed,
+  // value_to_dest is left empty.
   //
   // For example:
   //   destination = {};
@@ -463,6 +554,8 @@ class Storage {
   // This command is equal to SINTER, but instead of returning the resulting
   // set, it is stored in destination.
   // If destination already exists, it is overwritten.
+  // The result is written to destination in batches while it is computed,
+  // value_to_dest is left empty.
   //
   // For example:
   //   destination = {}
@@ -477,10 +570,22 @@ class Storage {
   // Returns if member is a member of the set stored at key.
   Status SIsmember(const Slice& key, const Slice& member, int32_t* ret);
 
+  // Returns whether each member is a member of the set stored at key,
+  // rets[i] is 1 if members[i] is a member of the set, 0 otherwise
+  Status SMIsmember(const Slice& key, const std::vector<std::string>& members, std::vector<int32_t>* rets);
+
   // Returns all the members of the set value stored at key.
   // This has the same effect as running SINTER with one argument key.
   Status SMembers(const Slice& key, std::vector<std::string>* members);
 
+  // Emits the members of the set stored at key into sink. Returns NotFound,
+  // without calling sink, if the key does not exist.
+  Status SMembers(const Slice& key, ElementSink* sink);
+
+  // Opens a reader of the members of the set stored at key. Returns NotFound if the
+  // key does not exist.
+  Status SMembers(const Slice& key, std::unique_ptr<ElementReader>* reader);
+
   Status SMembersWithTTL(const Slice& key, std::vector<std::string>* members, int64_t* ttl);
 
   // Remove the specified members from the set stored at key. Specified members
@@ -524,6 +629,8 @@ class Storage {
   // This command is equal to SUNION, but instead of returning the resulting
   // set, it is stored in destination.
   // If destination already exists, it is overwritten.
+  // The result is written to destination in batches while it is computed,
+  // value_to_dest is left empty.
   //
   // For example:
   //   key1 = {a, b}
@@ -537,6 +644,8 @@ class Storage {
   // See SCAN for SSCAN documentation.
   Status SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                std::vector<std::string>* members, int64_t* next_cursor);
+  Status SScan(const Slice& key, const std::string& cursor, const std::string& pattern, int64_t count,
+               std::vector<std::string>* members, std::string* next_cursor);
 
   // Lists Commands
 
@@ -555,6 +664,14 @@ class Storage {
   // (the head of the list), 1 being the next element and so on.
   Status LRange(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret);
 
+  // Emits the elements of the list stored at key in [start, stop] into sink.
+  // Returns NotFound, without calling sink, if the key does not exist.
+  Status LRange(const Slice& key, int64_t start, int64_t stop, ElementSink* sink);
+
+  // Opens a reader of the elements of the list stored at key in [start, stop].
+  // Returns NotFound if the key does not exist.
+  Status LRange(const Slice& key, int64_t start, int64_t stop, std::unique_ptr<ElementReader>* reader);
+
   Status LRangeWithTTL(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret, int64_t* ttl);
 
   // Removes the first count occurrences of elements equal to value from the
@@ -717,6 +834,16 @@ class Storage {
   // array with (value, score) arrays/tuples).
   Status ZRange(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members);
 
+  // Emits the members of the sorted set stored at key ranked in [start, stop] into
+  // sink, each one followed by its score if with_scores. Returns NotFound, without
+  // calling sink, if the key does not exist.
+  Status ZRange(const Slice& key, int32_t start, int32_t stop, bool with_scores, ElementSink* sink);
+
+  // Opens a reader of the members of the sorted set stored at key ranked in [start, stop],
+  // emitted as by the sink version. Returns NotFound if the key does not exist.
+  Status ZRange(const Slice& key, int32_t start, int32_t stop, bool with_scores,
+                std::unique_ptr<ElementReader>* reader);
+
   Status ZRangeWithTTL(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members,
                        int64_t* ttl);
 
@@ -869,6 +996,10 @@ class Storage {
   // returned.
   Status ZScore(const Slice& key, const Slice& member, double* ret);
 
+  // Returns the scores associated with the specified members in the sorted set
+  // stored at key, sss[i].status is NotFound if members[i] does not exist
+  Status ZMScore(const Slice& key, const std::vector<std::string>& members, std::vector<ScoreStatus>* sss);
+
   // Computes the union of numkeys sorted sets given by the specified keys, and
   // stores the result in destination. It is mandatory to provide the number of
   // input keys (numkeys) before passing the input keys and the other (optional)
@@ -956,6 +1087,8 @@ class Storage {
   // See SCAN for ZSCAN documentation.
   Status ZScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                std::vector<ScoreMember>* score_members, int64_t* next_cursor);
+  Status ZScan(const Slice& key, const std::string& cursor, const std::string& pattern, int64_t count,
+               std::vector<ScoreMember>* score_members, std::string* next_cursor);
 
   // Keys Commands
 
@@ -975,9 +1108,12 @@ class Storage {
 
   // Iterate over a collection of elements
   // return an updated cursor that the user need to use as the cursor argument
-  // in the next call
+  // in the next call, 0 once the iteration is over. The string cursors are tokens
+  // with stateless_scan_cursors, see StorageOptions
   int64_t Scan(const DataType& dtype, int64_t cursor, const std::string& pattern, int64_t count,
                std::vector<std::string>* keys);
+  std::string Scan(const DataType& dtype, const std::string& cursor, const std::string& pattern, int64_t count,
+                   std::vector<std::string>* keys);
 
   // Iterate over a collection of elements by specified range
   // return a next_key that the user need to use as the key_start argument
@@ -1025,6 +1161,12 @@ class Storage {
   // return >=1 if the timueout was set
   int32_t Persist(const Slice& key);
 
+  // Deletes up to limit keys of every instance whose expire time has passed, found
+  // through the expire index. The keys are deleted the way DEL does, so the deletes
+  // reach the raft followers like any other write.
+  // expired is set to the number of deleted keys
+  Status ActiveExpireCycle(size_t limit, size_t* expired);
+
   // Returns the remaining time to live of a key that has a timeout.
   // return -3 operation exception errors happen in database
   // return -2 if the key does not exist
@@ -1097,22 +1239,78 @@ class Storage {
   uint64_t GetProperty(const std::string& property);
 
   Status GetKeyNum(std::vector<KeyInfo>* key_infos);
+  // GetKeyNum() of the instance index alone
+  Status GetKeyNum(size_t index, std::vector<KeyInfo>* key_infos);
+  size_t GetInstanceNum() const { return insts_.size(); }
+  // The key counts of GetKeyNum() as kept up to date by the writes, without a scan
+  // of the keys. Expired keys are counted until the active expiration or a compaction
+  // deletes them. After an unclean close they converge once the background recount is done.
+  Status GetApproximateKeyNum(std::vector<KeyInfo>* key_infos);
   Status StopScanKeyNum();
 
   rocksdb::DB* GetDBByIndex(int index);
 
   Status SetOptions(const OptionType& option_type, const std::unordered_map<std::string, std::string>& options);
   void GetRocksDBInfo(std::string& info);
+  // The compression ratio of every column family of every instance
+  void GetCompressionInfo(std::string& info);
+  // The record lock wait metrics summed over the instances
+  pstd::lock::LockStats GetKeyLockStats() const;
+  // The directories holding the instances, the db path first
+  std::vector<std::string> GetDataPaths() const;
+  // The file I/O of the instances summed by data path
+  std::vector<DataPathIOStats> GetDataPathIOStats() const;
   Status OnBinlogWrite(const pikiwidb::Binlog& log, LogIndex log_idx);
 
   LogIndex GetSmallestFlushedLogIndex() const;
 
+  // Moves slots, with their keys, to the instance dst_index while the instances keep serving.
+  // The keys are copied from snapshots of their instances, the keys written meanwhile are
+  // copied again in rounds until few are left, those are copied and the slots switched over
+  // inside run_exclusive, then the keys left behind are deleted. Only one migration runs at
+  // a time, Busy is returned otherwise.
+  Status MigrateSlots(const std::vector<uint32_t>& slots, int32_t dst_index, const ExclusiveRunner& run_exclusive);
+  // Migrates slots from the instances owning the most of them to the ones owning the fewest
+  // until every instance owns slot_num / instance_num of them, give or take one.
+  Status BalanceSlots(const ExclusiveRunner& run_exclusive);
+  // Makes the running migration give up before its next key, the keys it copied are dropped
+  Status StopMigration();
+  const SlotIndexer& GetSlotIndexer() const { return *slot_indexer_; }
+  // The key the scan cursor tokens are signed with, see ScanCursor
+  const std::string& GetScanCursorSecret() const { return scan_cursor_secret_; }
+
  private:
   std::vector<std::unique_ptr<Redis>> insts_;
   std::unique_ptr<SlotIndexer> slot_indexer_;
+  std::string slot_map_path_;
+  // The data path holding each instance
+  std::vector<std::string> inst_data_paths_;
+  std::string db_path_;
+
+  // The state of the running slot migration, migrating_ is set while there is one
+  struct SlotMigration;
+  pstd::Mutex migrate_mutex_;
+  std::atomic<bool> migrating_ = false;
+  std::atomic<bool> migration_exit_ = false;
+  std::unique_ptr<SlotMigration> migration_;
+  // Records key as written if its slot is being migrated
+  void TrackMigratingKey(uint32_t slot_id, const std::string& key);
+  // Routes key like GetDBInstance for commands that only read it, they are not tracked
+  std::unique_ptr<Redis>& GetReadDBInstance(const Slice& key);
+  std::unique_ptr<Redis>& GetReadDBInstance(const std::string& key);
+  // Records that keys of the instance were changed without going through the slot routing
+  void TrackUntrackedWrite();
+  bool IsOwnedBy(const std::string& key, size_t index) const;
+  // Runs the per-instance part of whole-keyspace commands (KEYS, SCAN, DBSIZE ...)
+  pstd::ThreadPool scan_pool_;
+  // Runs the per-instance part of multi-key commands (MGET, MSET, DEL ...), kept apart from
+  // scan_pool_ so that they do not queue behind a long KEYS or SCAN, capped at one thread per instance
+  pstd::ThreadPool multi_key_pool_;
   std::atomic<bool> is_opened_ = false;
 
-  std::unique_ptr<LRUCache<std::string, std::string>> cursors_store_;
+  std::unique_ptr<ShardedLRUCache<std::string, std::string>> cursors_store_;
+  bool stateless_scan_cursors_ = false;
+  std::string scan_cursor_secret_;
 
   // Storage start the background thread for compaction task
   pthread_t bg_tasks_thread_id_ = 0;
@@ -1123,10 +1321,59 @@ class Storage {
   std::atomic<int> current_task_type_ = kNone;
   std::atomic<bool> bg_tasks_should_exit_ = false;
 
+  // Storage runs the active expire cycle of all the instances in its own thread
+  std::thread active_expire_thread_;
+  pstd::Mutex active_expire_mutex_;
+  pstd::CondVar active_expire_cond_var_;
+  bool active_expire_should_exit_ = false;
+  CanWriteFunction can_write_function_;
+  void RunActiveExpire(uint64_t keys_per_second);
+  void StopActiveExpire();
+
   // For scan keys in data base
   std::atomic<bool> scan_keynum_exit_ = false;
   size_t db_instance_num_ = 3;
   int db_id_ = 0;
+
+  // Splits the positions of keys by the instance owning them, write is false for the commands
+  // that only read them
+  std::vector<std::vector<size_t>> GroupKeysByInstance(const std::vector<std::string>& keys, bool write = true);
+
+  // Calls func(instance index, key positions) for every instance owning some of the keys,
+  // the instances run in parallel on multi_key_pool_ when more than one of them is involved
+  Status ForEachInstanceGroup(const std::vector<std::vector<size_t>>& groups,
+                              const std::function<Status(size_t, const std::vector<size_t>&)>& func);
+
+  Status MGetInternal(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss, bool with_ttl);
+
+  // Calls func(instance index) for every instance, the instances run in parallel on scan_pool_
+  Status ForEachInstance(const std::function<Status(size_t)>& func);
+
+  // Collects, from every instance in parallel, up to limit keys of type matching pattern from
+  // start_key on, and merges them into *keys in key order. Each instance stops after limit keys,
+  // so the first limit keys of *keys are the first limit keys of the whole keyspace.
+  Status CollectKeys(char type, const std::string& pattern, const std::string& start_key, size_t limit,
+                     std::vector<std::string>* keys);
+
+  // Opens a member iterator over every key, a missing key leaves its iterator
+  // empty and any other error fails the whole command
+  Status OpenMemberIterators(DataType type, const std::vector<std::string>& keys,
+                             std::vector<std::unique_ptr<MemberIterator>>* iters);
+
+  enum MergeOperation { kMergeInter, kMergeUnion, kMergeDiff };
+  // Hands the members of the SINTER, SUNION or SDIFF of keys to emit one by one in
+  // member order. The sets are merged through per key iterators, none of them is
+  // loaded as a whole.
+  Status SetsMerge(MergeOperation op, const std::vector<std::string>& keys,
+                   const std::function<Status(const Slice&)>& emit);
+  Status SetsMergeStore(MergeOperation op, const Slice& destination, const std::vector<std::string>& keys,
+                        int32_t* ret);
+  // Same as SetsMerge for the intersection or union of zsets, each member is handed to
+  // emit with the aggregate of its weighted scores
+  Status ZSetsMerge(MergeOperation op, const std::vector<std::string>& keys, const std::vector<double>& weights,
+                    AGGREGATE agg, const std::function<Status(const Slice&, double)>& emit);
+  Status ZSetsMergeStore(MergeOperation op, const Slice& destination, const std::vector<std::string>& keys,
+                         const std::vector<double>& weights, AGGREGATE agg, int32_t* ret);
 };
 
 }  //  namespace storage
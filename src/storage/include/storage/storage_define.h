@@ -45,7 +45,8 @@ enum ColumnFamilyIndex {
   kListsDataCF = 3,
   kZsetsDataCF = 4,
   kZsetsScoreCF = 5,
-  kColumnFamilyNum = 6,
+  kExpireIndexCF = 6,
+  kColumnFamilyNum = 7,
 };
 
 const static char kNeedTransformCharacter = '\u0000';
@@ -80,6 +81,7 @@ inline char* EncodeUserKey(const Slice& user_key, char* dst_ptr, size_t nzero) {
   }
   if (pos != user_key.size()) {
     memcpy(dst_ptr, user_data + pos, user_key.size() - pos);
+    dst_ptr += user_key.size() - pos;
   }
 
   memcpy(dst_ptr, kEncodedKeyDelim, 2);
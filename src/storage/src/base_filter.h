@@ -6,8 +6,12 @@
 #ifndef SRC_BASE_FILTER_H_
 #define SRC_BASE_FILTER_H_
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "pstd/log.h"
@@ -17,7 +21,9 @@
 #include "src/base_key_format.h"
 #include "src/base_meta_value_format.h"
 #include "src/base_value_format.h"
+#include "src/bitmap_fragment_format.h"
 #include "src/debug.h"
+#include "src/key_count_db.h"
 #include "src/lists_meta_value_format.h"
 #include "src/strings_value_format.h"
 #include "src/zsets_data_key_format.h"
@@ -26,9 +32,23 @@ namespace storage {
 
 class BaseMetaFilter : public rocksdb::CompactionFilter {
  public:
-  BaseMetaFilter() = default;
+  // key_count_db takes away the key counts of the metas dropped, when there is one
+  explicit BaseMetaFilter(KeyCountDB* const* key_count_db = nullptr) : key_count_db_(key_count_db) {}
   bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
               bool* value_changed) const override {
+    if (!Drop(key, value)) {
+      return false;
+    }
+    if (key_count_db_ != nullptr && *key_count_db_ != nullptr) {
+      (*key_count_db_)->CountDrop(key, value);
+    }
+    return true;
+  }
+
+  const char* Name() const override { return "BaseMetaFilter"; }
+
+ private:
+  bool Drop(const rocksdb::Slice& key, const rocksdb::Slice& value) const {
     int64_t unix_time;
     rocksdb::Env::Default()->GetCurrentTime(&unix_time);
     auto cur_time = static_cast<int32_t>(unix_time);
@@ -87,34 +107,138 @@ class BaseMetaFilter : public rocksdb::CompactionFilter {
     }
   }
 
-  const char* Name() const override { return "BaseMetaFilter"; }
+  KeyCountDB* const* key_count_db_ = nullptr;
 };
 
 class BaseMetaFilterFactory : public rocksdb::CompactionFilterFactory {
  public:
-  BaseMetaFilterFactory() = default;
+  explicit BaseMetaFilterFactory(KeyCountDB* const* key_count_db = nullptr) : key_count_db_(key_count_db) {}
   std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
       const rocksdb::CompactionFilter::Context& context) override {
-    return std::unique_ptr<rocksdb::CompactionFilter>(new BaseMetaFilter());
+    return std::unique_ptr<rocksdb::CompactionFilter>(new BaseMetaFilter(key_count_db_));
   }
   const char* Name() const override { return "BaseMetaFilterFactory"; }
+
+ private:
+  KeyCountDB* const* key_count_db_ = nullptr;
 };
 
-class BaseDataFilter : public rocksdb::CompactionFilter {
+// Serves the meta lookups of one compaction filter. The data keys reach a filter in
+// user key order, which is also the order of their meta keys, so instead of a point
+// read per user key the lookups walk one forward iterator over the meta cf, with
+// readahead and without filling the block cache. The iterator sees the meta cf as it
+// was when it was created, it is renewed every kMetaCursorRenewLookups lookups or
+// kMetaCursorRenewMicros, whichever comes first, so that its view stays recent and a
+// long compaction does not pin old memtables and files.
+class MetaCursor {
  public:
-  BaseDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type)
-      : db_(db), cf_handles_ptr_(cf_handles_ptr), type_(type) {}
+  static const int kMetaCursorMaxSteps = 16;
+  static const uint64_t kMetaCursorRenewLookups = 4096;
+  static const uint64_t kMetaCursorRenewMicros = 100 * 1000;
+  static const size_t kMetaCursorReadahead = 2 * 1024 * 1024;
 
-  bool Filter(int level, const Slice& key, const rocksdb::Slice& value, std::string* new_value,
-              bool* value_changed) const override {
-    UNUSED(level);
-    UNUSED(value);
-    UNUSED(new_value);
-    UNUSED(value_changed);
-    ParsedBaseDataKey parsed_base_data_key(key);
-    TRACE("[DataFilter], key: %s, data = %s, version = %llu", parsed_base_data_key.Key().ToString().c_str(),
-          parsed_base_data_key.Data().ToString().c_str(), parsed_base_data_key.Version());
+  MetaCursor(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* meta_cf) : db_(db), meta_cf_(meta_cf) {
+    read_options_.fill_cache = false;
+    read_options_.readahead_size = kMetaCursorReadahead;
+  }
 
+  // Same results as rocksdb::DB::Get on the meta cf at the time the iterator was renewed
+  rocksdb::Status Get(const rocksdb::Slice& meta_key, std::string* meta_value) {
+    uint64_t now = rocksdb::Env::Default()->NowMicros();
+    if (!iter_ || ++lookups_ >= kMetaCursorRenewLookups || now - created_micros_ >= kMetaCursorRenewMicros) {
+      iter_.reset(db_->NewIterator(read_options_, meta_cf_));
+      lookups_ = 0;
+      created_micros_ = now;
+      iter_->Seek(meta_key);
+    } else if (!iter_->Valid() || iter_->key().compare(meta_key) > 0) {
+      iter_->Seek(meta_key);
+    } else {
+      // the next meta key is usually close, step to it before falling back to a seek
+      for (int step = 0; iter_->Valid() && iter_->key().compare(meta_key) < 0; ++step) {
+        if (step == kMetaCursorMaxSteps) {
+          iter_->Seek(meta_key);
+          break;
+        }
+        iter_->Next();
+      }
+    }
+    if (!iter_->status().ok()) {
+      rocksdb::Status s = iter_->status();
+      iter_.reset();
+      return s;
+    }
+    if (iter_->Valid() && iter_->key() == meta_key) {
+      meta_value->assign(iter_->value().data(), iter_->value().size());
+      return rocksdb::Status::OK();
+    }
+    return rocksdb::Status::NotFound();
+  }
+
+ private:
+  rocksdb::DB* db_ = nullptr;
+  rocksdb::ColumnFamilyHandle* meta_cf_ = nullptr;
+  rocksdb::ReadOptions read_options_;
+  std::unique_ptr<rocksdb::Iterator> iter_;
+  uint64_t lookups_ = 0;
+  uint64_t created_micros_ = 0;
+};
+
+// The versions of the user keys a running store writes in several batches before their
+// meta points at them. The data filters keep the data keys of these versions whatever the
+// meta says. The list is only kept in memory, it is empty again after a restart.
+class PendingVersions {
+ public:
+  void Add(const std::string& meta_key, uint64_t version) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    versions_.emplace(meta_key, version);
+    size_.store(versions_.size(), std::memory_order_release);
+  }
+
+  void Remove(const std::string& meta_key, uint64_t version) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    versions_.erase({meta_key, version});
+    size_.store(versions_.size(), std::memory_order_release);
+  }
+
+  bool Contains(const std::string& meta_key, uint64_t version) const {
+    if (size_.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return versions_.count({meta_key, version}) != 0;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::set<std::pair<std::string, uint64_t>> versions_;
+  std::atomic<size_t> size_ = 0;
+};
+
+// Shared by the compaction filters of the data cfs, which decide from the data key and
+// the meta of its user key alone. The meta is looked up once per user key through a
+// MetaCursor. Its view may lag behind the meta cf (a PERSIST, a longer TTL or a key
+// recreated since the iterator was renewed), so a data key is only dropped once a point
+// read of the meta agrees. The data keys of pending_versions are kept.
+class BaseDataKeyFilter : public rocksdb::CompactionFilter {
+ public:
+  BaseDataKeyFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type,
+                    const PendingVersions* pending_versions = nullptr)
+      : db_(db), cf_handles_ptr_(cf_handles_ptr), type_(type), pending_versions_(pending_versions) {}
+
+  // The decision never depends on the value, values kept in blob files are not read
+  Decision FilterBlobByKey(int level, const rocksdb::Slice& key, std::string* new_value,
+                           std::string* skip_until) const override {
+    UNUSED(skip_until);
+    bool value_changed = false;
+    return Filter(level, key, rocksdb::Slice(), new_value, &value_changed) ? Decision::kRemove : Decision::kKeep;
+  }
+
+ protected:
+  // Takes the version and the etime of meta_value, false if it is not the meta of data of this filter
+  virtual bool ParseMeta(std::string* meta_value, uint64_t* version, uint64_t* etime) const = 0;
+
+  // Whether the data key of data_version belongs to a deleted, expired or replaced version of its user key
+  bool DropByMeta(const rocksdb::Slice& key, uint64_t data_version) const {
     const char* ptr = key.data();
     int key_size = key.size();
     ptr = SeekUserkeyDelim(ptr + kPrefixReserveLength, key_size - kPrefixReserveLength);
@@ -122,46 +246,85 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
     meta_key_enc.append(kSuffixReserveLength, kNeedTransformCharacter);
 
     if (meta_key_enc != cur_key_) {
-      cur_meta_etime_ = 0;
-      cur_meta_version_ = 0;
-      meta_not_found_ = true;
       cur_key_ = meta_key_enc;
-      std::string meta_value;
-      // destroyed when close the database, Reserve Current key value
-      if (cf_handles_ptr_->empty()) {
+      meta_confirmed_ = false;
+      if (!LoadMeta(false)) {
         return false;
       }
-      Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[0], cur_key_, &meta_value);
-      if (s.ok()) {
-        /*
-         * The elimination policy for keys of the Data type is that if the key
-         * type obtained from MetaCF is inconsistent with the key type in Data,
-         * it needs to be eliminated
-         */
-        auto type = static_cast<enum DataType>(static_cast<uint8_t>(meta_value[0]));
-        if (type != type_) {
-          return true;
-        } else if (type == DataType::kHashes || type == DataType::kSets || type == DataType::kZSets) {
-          ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
-          meta_not_found_ = false;
-          cur_meta_version_ = parsed_base_meta_value.Version();
-          cur_meta_etime_ = parsed_base_meta_value.Etime();
-        } else {
-          return true;
-        }
-      } else if (s.IsNotFound()) {
-        meta_not_found_ = true;
-      } else {
-        cur_key_ = "";
-        TRACE("Reserve[Get meta_key faild]");
+    }
+    if (!Outdated(data_version)) {
+      return false;
+    }
+    // A store publishes its meta before it leaves pending_versions_, so a version found
+    // neither there nor, read afterwards, in the meta is not written any more. The meta
+    // is read again for every version, a store may have finished since the last read.
+    if (pending_versions_ != nullptr && pending_versions_->Contains(cur_key_, data_version)) {
+      meta_confirmed_ = false;
+      return false;
+    }
+    if (!meta_confirmed_ || confirmed_version_ != data_version) {
+      meta_confirmed_ = true;
+      confirmed_version_ = data_version;
+      if (!LoadMeta(true) || !Outdated(data_version)) {
         return false;
       }
     }
+    return true;
+  }
+
+  rocksdb::DB* db_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+  enum DataType type_ = DataType::kNones;
+  const PendingVersions* pending_versions_ = nullptr;
+
+ private:
+  enum MetaState { kMetaNotFound, kMetaMismatch, kMetaFound };
+
+  // Reads the meta of cur_key_, through the cursor or with a point read, false (with
+  // cur_key_ forgotten) when the lookup failed and the key has to be kept
+  bool LoadMeta(bool point_read) const {
+    meta_state_ = kMetaNotFound;
+    cur_meta_version_ = 0;
+    cur_meta_etime_ = 0;
+    // destroyed when close the database, Reserve Current key value
+    if (cf_handles_ptr_->empty()) {
+      cur_key_.clear();
+      return false;
+    }
+    std::string meta_value;
+    rocksdb::Status s;
+    if (point_read) {
+      s = db_->Get(rocksdb::ReadOptions(), (*cf_handles_ptr_)[0], cur_key_, &meta_value);
+    } else {
+      if (!meta_cursor_) {
+        meta_cursor_ = std::make_unique<MetaCursor>(db_, (*cf_handles_ptr_)[0]);
+      }
+      s = meta_cursor_->Get(cur_key_, &meta_value);
+    }
+    if (s.ok()) {
+      /*
+       * The elimination policy for keys of the Data type is that if the key
+       * type obtained from MetaCF is inconsistent with the key type in Data,
+       * it needs to be eliminated
+       */
+      meta_state_ = ParseMeta(&meta_value, &cur_meta_version_, &cur_meta_etime_) ? kMetaFound : kMetaMismatch;
+    } else if (!s.IsNotFound()) {
+      cur_key_.clear();
+      TRACE("Reserve[Get meta_key faild]");
+      return false;
+    }
+    return true;
+  }
 
-    if (meta_not_found_) {
+  bool Outdated(uint64_t data_version) const {
+    if (meta_state_ == kMetaNotFound) {
       TRACE("Drop[Meta key not exist]");
       return true;
     }
+    if (meta_state_ == kMetaMismatch) {
+      TRACE("Drop[Meta type mismatch]");
+      return true;
+    }
 
     int64_t unix_time;
     rocksdb::Env::Default()->GetCurrentTime(&unix_time);
@@ -170,36 +333,71 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
       return true;
     }
 
-    if (cur_meta_version_ > parsed_base_data_key.Version()) {
+    if (cur_meta_version_ > data_version) {
       TRACE("Drop[data_key_version < cur_meta_version]");
       return true;
-    } else {
-      TRACE("Reserve[data_key_version == cur_meta_version]");
-      return false;
     }
+    TRACE("Reserve[data_key_version == cur_meta_version]");
+    return false;
   }
 
-  const char* Name() const override { return "BaseDataFilter"; }
-
- private:
-  rocksdb::DB* db_ = nullptr;
-  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
-  rocksdb::ReadOptions default_read_options_;
+  mutable std::unique_ptr<MetaCursor> meta_cursor_;
   mutable std::string cur_key_;
-  mutable bool meta_not_found_ = false;
+  mutable bool meta_confirmed_ = false;
+  mutable uint64_t confirmed_version_ = 0;
+  mutable MetaState meta_state_ = kMetaNotFound;
   mutable uint64_t cur_meta_version_ = 0;
   mutable uint64_t cur_meta_etime_ = 0;
-  enum DataType type_ = DataType::kNones;
+};
+
+class BaseDataFilter : public BaseDataKeyFilter {
+ public:
+  BaseDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type,
+                 const PendingVersions* pending_versions = nullptr)
+      : BaseDataKeyFilter(db, cf_handles_ptr, type, pending_versions) {}
+
+  bool Filter(int level, const Slice& key, const rocksdb::Slice& value, std::string* new_value,
+              bool* value_changed) const override {
+    UNUSED(level);
+    UNUSED(value);
+    UNUSED(new_value);
+    UNUSED(value_changed);
+    ParsedBaseDataKey parsed_base_data_key(key);
+    TRACE("[DataFilter], key: %s, data = %s, version = %llu", parsed_base_data_key.Key().ToString().c_str(),
+          parsed_base_data_key.Data().ToString().c_str(), parsed_base_data_key.Version());
+    return DropByMeta(key, parsed_base_data_key.Version());
+  }
+
+  const char* Name() const override { return "BaseDataFilter"; }
+
+ protected:
+  bool ParseMeta(std::string* meta_value, uint64_t* version, uint64_t* etime) const override {
+    auto type = static_cast<enum DataType>(static_cast<uint8_t>((*meta_value)[0]));
+    BitmapFragmentsMeta bitmap_meta;
+    if (type_ == DataType::kHashes && bitmap_meta.DecodeStringsValue(*meta_value)) {
+      // the fragments of a bitmap share the hashes data cf
+      *version = bitmap_meta.Version();
+      *etime = ParsedStringsValue(*meta_value).Etime();
+      return true;
+    }
+    if (type != type_ || (type != DataType::kHashes && type != DataType::kSets && type != DataType::kZSets)) {
+      return false;
+    }
+    ParsedBaseMetaValue parsed_base_meta_value(meta_value);
+    *version = parsed_base_meta_value.Version();
+    *etime = parsed_base_meta_value.Etime();
+    return true;
+  }
 };
 
 class BaseDataFilterFactory : public rocksdb::CompactionFilterFactory {
  public:
   BaseDataFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr,
-                        enum DataType type)
-      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type) {}
+                        enum DataType type, const PendingVersions* pending_versions = nullptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type), pending_versions_(pending_versions) {}
   std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
       const rocksdb::CompactionFilter::Context& context) override {
-    return std::make_unique<BaseDataFilter>(BaseDataFilter(*db_ptr_, cf_handles_ptr_, type_));
+    return std::make_unique<BaseDataFilter>(*db_ptr_, cf_handles_ptr_, type_, pending_versions_);
   }
   const char* Name() const override { return "BaseDataFilterFactory"; }
 
@@ -207,6 +405,7 @@ class BaseDataFilterFactory : public rocksdb::CompactionFilterFactory {
   rocksdb::DB** db_ptr_ = nullptr;
   std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
   enum DataType type_ = DataType::kNones;
+  const PendingVersions* pending_versions_ = nullptr;
 };
 
 using HashesMetaFilter = BaseMetaFilter;
@@ -42,6 +42,7 @@ class InternalValue {
     }
   }
   void SetEtime(uint64_t etime = 0) { etime_ = etime; }
+  uint64_t Etime() const { return etime_; }
   void setCtime(uint64_t ctime) { ctime_ = ctime; }
   Status SetRelativeTimestamp(uint64_t ttl) {
     int64_t unix_time;
@@ -27,6 +27,8 @@ class Batch {
 
   virtual void Put(ColumnFamilyIndex cf_idx, const Slice& key, const Slice& val) = 0;
   virtual void Delete(ColumnFamilyIndex cf_idx, const Slice& key) = 0;
+  // Deletes the keys in [begin, end) of the column family with one range tombstone
+  virtual void DeleteRange(ColumnFamilyIndex cf_idx, const Slice& begin, const Slice& end) = 0;
   virtual Status Commit() = 0;
   int32_t Count() const { return cnt_; }
 
@@ -50,6 +52,10 @@ class RocksBatch : public Batch {
     batch_.Delete(handles_[cf_idx], key);
     cnt_++;
   }
+  void DeleteRange(ColumnFamilyIndex cf_idx, const Slice& begin, const Slice& end) override {
+    batch_.DeleteRange(handles_[cf_idx], begin, end);
+    cnt_++;
+  }
   Status Commit() override { return db_->Write(options_, &batch_); }
 
  private:
@@ -84,6 +90,15 @@ class BinlogBatch : public Batch {
     cnt_++;
   }
 
+  void DeleteRange(ColumnFamilyIndex cf_idx, const Slice& begin, const Slice& end) override {
+    auto entry = binlog_.add_entries();
+    entry->set_cf_idx(cf_idx);
+    entry->set_op_type(pikiwidb::OperateType::kDeleteRange);
+    entry->set_key(begin.ToString());
+    entry->set_value(end.ToString());
+    cnt_++;
+  }
+
   Status Commit() override {
     // FIXME(longfar): We should make sure that in non-RAFT mode, the code doesn't run here
     std::promise<Status> promise;
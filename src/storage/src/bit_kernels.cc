@@ -0,0 +1,406 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/bit_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__)
+#  include <immintrin.h>
+#  define BIT_KERNELS_X86 1
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#  define BIT_KERNELS_NEON 1
+#endif
+
+namespace storage {
+
+namespace {
+
+/*
+ * Scalar kernels, on 8 byte words. They also finish the tails of the vector
+ * kernels.
+ */
+inline uint64_t LoadWord(const unsigned char* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+inline void StoreWord(unsigned char* p, uint64_t word) { memcpy(p, &word, sizeof(word)); }
+
+int64_t ScalarPopCount(const unsigned char* data, size_t bytes) {
+  int64_t count = 0;
+  size_t i = 0;
+  for (; i + 8 <= bytes; i += 8) {
+    count += __builtin_popcountll(LoadWord(data + i));
+  }
+  for (; i < bytes; ++i) {
+    count += __builtin_popcount(data[i]);
+  }
+  return count;
+}
+
+size_t ScalarFindFirstNot(const unsigned char* data, size_t bytes, unsigned char skip) {
+  uint64_t skip_word = 0x0101010101010101ULL * skip;
+  size_t i = 0;
+  for (; i + 8 <= bytes && LoadWord(data + i) == skip_word; i += 8) {
+  }
+  for (; i < bytes && data[i] == skip; ++i) {
+  }
+  return i;
+}
+
+template <typename Op>
+inline void ScalarCombine(unsigned char* dest, const unsigned char* src, size_t bytes, Op op) {
+  size_t i = 0;
+  for (; i + 8 <= bytes; i += 8) {
+    StoreWord(dest + i, op(LoadWord(dest + i), LoadWord(src + i)));
+  }
+  for (; i < bytes; ++i) {
+    dest[i] = static_cast<unsigned char>(op(dest[i], src[i]));
+  }
+}
+
+void ScalarAnd(unsigned char* dest, const unsigned char* src, size_t bytes) {
+  ScalarCombine(dest, src, bytes, [](uint64_t a, uint64_t b) { return a & b; });
+}
+
+void ScalarOr(unsigned char* dest, const unsigned char* src, size_t bytes) {
+  ScalarCombine(dest, src, bytes, [](uint64_t a, uint64_t b) { return a | b; });
+}
+
+void ScalarXor(unsigned char* dest, const unsigned char* src, size_t bytes) {
+  ScalarCombine(dest, src, bytes, [](uint64_t a, uint64_t b) { return a ^ b; });
+}
+
+void ScalarNot(unsigned char* dest, size_t bytes) {
+  ScalarCombine(dest, dest, bytes, [](uint64_t a, uint64_t) { return ~a; });
+}
+
+void ScalarMax(unsigned char* dest, const unsigned char* src, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    dest[i] = std::max(dest[i], src[i]);
+  }
+}
+
+// 2^-exponent is the double of biased exponent 1023 - exponent and zero mantissa
+const uint64_t kDoubleExponentBias = 1023;
+const int kDoubleMantissaBits = 52;
+const unsigned char kMaxInverseExponent = 63;
+
+inline double InversePow2(unsigned char exponent) {
+  uint64_t bits = (kDoubleExponentBias - std::min(exponent, kMaxInverseExponent)) << kDoubleMantissaBits;
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+double ScalarInversePow2Sum(const unsigned char* data, size_t bytes, size_t* zeros) {
+  double sum = 0;
+  size_t zero = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    sum += InversePow2(data[i]);
+    zero += data[i] == 0;
+  }
+  *zeros = zero;
+  return sum;
+}
+
+const BitKernels kScalarKernels = {"scalar",  ScalarPopCount, ScalarFindFirstNot, ScalarAnd,           ScalarOr,
+                                   ScalarXor, ScalarNot,      ScalarMax,          ScalarInversePow2Sum};
+
+#if defined(BIT_KERNELS_X86)
+
+/*
+ * AVX2 kernels, on 32 byte vectors. The population count looks the bits of
+ * every nibble up with vpshufb and sums the bytes with vpsadbw.
+ */
+__attribute__((target("avx2"))) int64_t Avx2PopCount(const unsigned char* data, size_t bytes) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1,
+                                          2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i total = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+    __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+  }
+  int64_t count = _mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) + _mm256_extract_epi64(total, 2) +
+                  _mm256_extract_epi64(total, 3);
+  return count + ScalarPopCount(data + i, bytes - i);
+}
+
+__attribute__((target("avx2"))) size_t Avx2FindFirstNot(const unsigned char* data, size_t bytes, unsigned char skip) {
+  const __m256i skip_vec = _mm256_set1_epi8(static_cast<char>(skip));
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    auto equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, skip_vec)));
+    if (equal != 0xffffffffU) {
+      return i + __builtin_ctz(~equal);
+    }
+  }
+  return i + ScalarFindFirstNot(data + i, bytes - i, skip);
+}
+
+#  define AVX2_COMBINE(Name, intrinsic, scalar)                                                              \
+    __attribute__((target("avx2"))) void Name(unsigned char* dest, const unsigned char* src, size_t bytes) { \
+      size_t i = 0;                                                                                          \
+      for (; i + 32 <= bytes; i += 32) {                                                                     \
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));                          \
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));                           \
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), intrinsic(a, b));                          \
+      }                                                                                                      \
+      scalar(dest + i, src + i, bytes - i);                                                                  \
+    }
+
+AVX2_COMBINE(Avx2And, _mm256_and_si256, ScalarAnd)
+AVX2_COMBINE(Avx2Or, _mm256_or_si256, ScalarOr)
+AVX2_COMBINE(Avx2Xor, _mm256_xor_si256, ScalarXor)
+AVX2_COMBINE(Avx2Max, _mm256_max_epu8, ScalarMax)
+
+__attribute__((target("avx2"))) void Avx2Not(unsigned char* dest, size_t bytes) {
+  const __m256i ones = _mm256_set1_epi8(static_cast<char>(0xff));
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_xor_si256(v, ones));
+  }
+  ScalarNot(dest + i, bytes - i);
+}
+
+// 2^-e of the 4 exponent bytes at the bottom of exponents
+__attribute__((target("avx2"))) inline __m256d Avx2InversePow2(__m128i exponents) {
+  __m256i biased = _mm256_sub_epi64(_mm256_set1_epi64x(kDoubleExponentBias), _mm256_cvtepu8_epi64(exponents));
+  return _mm256_castsi256_pd(_mm256_slli_epi64(biased, kDoubleMantissaBits));
+}
+
+__attribute__((target("avx2"))) double Avx2InversePow2Sum(const unsigned char* data, size_t bytes, size_t* zeros) {
+  const __m256i max_exponent = _mm256_set1_epi8(kMaxInverseExponent);
+  __m256d sum0 = _mm256_setzero_pd();
+  __m256d sum1 = _mm256_setzero_pd();
+  size_t zero = 0;
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i v = _mm256_min_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), max_exponent);
+    zero += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+    __m128i low = _mm256_castsi256_si128(v);
+    __m128i high = _mm256_extracti128_si256(v, 1);
+    sum0 = _mm256_add_pd(sum0, Avx2InversePow2(low));
+    sum1 = _mm256_add_pd(sum1, Avx2InversePow2(_mm_srli_si128(low, 4)));
+    sum0 = _mm256_add_pd(sum0, Avx2InversePow2(_mm_srli_si128(low, 8)));
+    sum1 = _mm256_add_pd(sum1, Avx2InversePow2(_mm_srli_si128(low, 12)));
+    sum0 = _mm256_add_pd(sum0, Avx2InversePow2(high));
+    sum1 = _mm256_add_pd(sum1, Avx2InversePow2(_mm_srli_si128(high, 4)));
+    sum0 = _mm256_add_pd(sum0, Avx2InversePow2(_mm_srli_si128(high, 8)));
+    sum1 = _mm256_add_pd(sum1, Avx2InversePow2(_mm_srli_si128(high, 12)));
+  }
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, _mm256_add_pd(sum0, sum1));
+  double sum = ScalarInversePow2Sum(data + i, bytes - i, zeros);
+  *zeros += zero;
+  return sum + lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+const BitKernels kAvx2Kernels = {"avx2",  Avx2PopCount, Avx2FindFirstNot, Avx2And,           Avx2Or,
+                                 Avx2Xor, Avx2Not,      Avx2Max,          Avx2InversePow2Sum};
+
+/*
+ * AVX-512 kernels, on 64 byte vectors with VPOPCNTDQ for the population count,
+ * the tails are read with byte masks. BITOP and the HyperLogLog merge are bound
+ * by the memory bandwidth, they keep the AVX2 kernels, which do not lower the
+ * clock of older cpus.
+ */
+#  define AVX512_TARGET __attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+
+AVX512_TARGET inline __mmask64 Avx512TailMask(size_t bytes) {
+  return bytes >= 64 ? ~__mmask64{0} : (__mmask64{1} << bytes) - 1;
+}
+
+AVX512_TARGET int64_t Avx512PopCount(const unsigned char* data, size_t bytes) {
+  __m512i total = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(data + i)));
+  }
+  if (i < bytes) {
+    __m512i v = _mm512_maskz_loadu_epi8(Avx512TailMask(bytes - i), data + i);
+    total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+  }
+  alignas(64) int64_t lanes[8];
+  _mm512_store_si512(lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+AVX512_TARGET size_t Avx512FindFirstNot(const unsigned char* data, size_t bytes, unsigned char skip) {
+  const __m512i skip_vec = _mm512_set1_epi8(static_cast<char>(skip));
+  size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    __mmask64 differ = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(data + i), skip_vec);
+    if (differ != 0) {
+      return i + __builtin_ctzll(differ);
+    }
+  }
+  if (i < bytes) {
+    __mmask64 mask = Avx512TailMask(bytes - i);
+    __mmask64 differ = _mm512_mask_cmpneq_epi8_mask(mask, _mm512_maskz_loadu_epi8(mask, data + i), skip_vec);
+    if (differ != 0) {
+      return i + __builtin_ctzll(differ);
+    }
+  }
+  return bytes;
+}
+
+// 2^-e of the 8 exponent bytes at data
+AVX512_TARGET inline __m512d Avx512InversePow2(const unsigned char* data) {
+  __m512i exponents = _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)));
+  exponents = _mm512_min_epu64(exponents, _mm512_set1_epi64(kMaxInverseExponent));
+  __m512i biased = _mm512_sub_epi64(_mm512_set1_epi64(kDoubleExponentBias), exponents);
+  return _mm512_castsi512_pd(_mm512_slli_epi64(biased, kDoubleMantissaBits));
+}
+
+AVX512_TARGET double Avx512InversePow2Sum(const unsigned char* data, size_t bytes, size_t* zeros) {
+  __m512d sum0 = _mm512_setzero_pd();
+  __m512d sum1 = _mm512_setzero_pd();
+  size_t zero = 0;
+  size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    zero += __builtin_popcountll(_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i), _mm512_setzero_si512()));
+    for (size_t j = 0; j < 64; j += 16) {
+      sum0 = _mm512_add_pd(sum0, Avx512InversePow2(data + i + j));
+      sum1 = _mm512_add_pd(sum1, Avx512InversePow2(data + i + j + 8));
+    }
+  }
+  double sum = ScalarInversePow2Sum(data + i, bytes - i, zeros);
+  *zeros += zero;
+  return sum + _mm512_reduce_add_pd(_mm512_add_pd(sum0, sum1));
+}
+
+const BitKernels kAvx512Kernels = {"avx512", Avx512PopCount, Avx512FindFirstNot, Avx2And,
+                                   Avx2Or,   Avx2Xor,        Avx2Not,            Avx2Max,
+                                   Avx512InversePow2Sum};
+
+bool SupportsAvx2() { return __builtin_cpu_supports("avx2"); }
+
+bool SupportsAvx512() {
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+         __builtin_cpu_supports("avx512vpopcntdq");
+}
+
+#elif defined(BIT_KERNELS_NEON)
+
+/*
+ * NEON kernels, on 16 byte vectors. NEON is part of every aarch64 cpu.
+ */
+int64_t NeonPopCount(const unsigned char* data, size_t bytes) {
+  uint64x2_t total = vdupq_n_u64(0);
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    uint8x16_t counts = vcntq_u8(vld1q_u8(data + i));
+    total = vpadalq_u32(total, vpaddlq_u16(vpaddlq_u8(counts)));
+  }
+  return static_cast<int64_t>(vaddvq_u64(total)) + ScalarPopCount(data + i, bytes - i);
+}
+
+size_t NeonFindFirstNot(const unsigned char* data, size_t bytes, unsigned char skip) {
+  const uint8x16_t skip_vec = vdupq_n_u8(skip);
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    uint8x16_t equal = vceqq_u8(vld1q_u8(data + i), skip_vec);
+    if (vminvq_u8(equal) != 0xff) {
+      break;
+    }
+  }
+  return i + ScalarFindFirstNot(data + i, bytes - i, skip);
+}
+
+#  define NEON_COMBINE(Name, intrinsic, scalar)                               \
+    void Name(unsigned char* dest, const unsigned char* src, size_t bytes) {  \
+      size_t i = 0;                                                           \
+      for (; i + 16 <= bytes; i += 16) {                                      \
+        vst1q_u8(dest + i, intrinsic(vld1q_u8(dest + i), vld1q_u8(src + i))); \
+      }                                                                       \
+      scalar(dest + i, src + i, bytes - i);                                   \
+    }
+
+NEON_COMBINE(NeonAnd, vandq_u8, ScalarAnd)
+NEON_COMBINE(NeonOr, vorrq_u8, ScalarOr)
+NEON_COMBINE(NeonXor, veorq_u8, ScalarXor)
+NEON_COMBINE(NeonMax, vmaxq_u8, ScalarMax)
+
+void NeonNot(unsigned char* dest, size_t bytes) {
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    vst1q_u8(dest + i, vmvnq_u8(vld1q_u8(dest + i)));
+  }
+  ScalarNot(dest + i, bytes - i);
+}
+
+// 2^-e of the 2 exponents
+inline float64x2_t NeonInversePow2(uint64x2_t exponents) {
+  uint64x2_t biased = vsubq_u64(vdupq_n_u64(kDoubleExponentBias), exponents);
+  return vreinterpretq_f64_u64(vshlq_n_u64(biased, kDoubleMantissaBits));
+}
+
+// Adds 2^-e of the 4 exponents to sum
+inline float64x2_t NeonAddInversePow2(float64x2_t sum, uint32x4_t exponents) {
+  sum = vaddq_f64(sum, NeonInversePow2(vmovl_u32(vget_low_u32(exponents))));
+  return vaddq_f64(sum, NeonInversePow2(vmovl_high_u32(exponents)));
+}
+
+double NeonInversePow2Sum(const unsigned char* data, size_t bytes, size_t* zeros) {
+  const uint8x16_t max_exponent = vdupq_n_u8(kMaxInverseExponent);
+  const uint8x16_t one = vdupq_n_u8(1);
+  float64x2_t sum0 = vdupq_n_f64(0);
+  float64x2_t sum1 = vdupq_n_f64(0);
+  size_t zero = 0;
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    uint8x16_t v = vminq_u8(vld1q_u8(data + i), max_exponent);
+    zero += vaddvq_u8(vandq_u8(vceqzq_u8(v), one));
+    uint16x8_t low = vmovl_u8(vget_low_u8(v));
+    uint16x8_t high = vmovl_high_u8(v);
+    sum0 = NeonAddInversePow2(sum0, vmovl_u16(vget_low_u16(low)));
+    sum1 = NeonAddInversePow2(sum1, vmovl_high_u16(low));
+    sum0 = NeonAddInversePow2(sum0, vmovl_u16(vget_low_u16(high)));
+    sum1 = NeonAddInversePow2(sum1, vmovl_high_u16(high));
+  }
+  double sum = ScalarInversePow2Sum(data + i, bytes - i, zeros);
+  *zeros += zero;
+  return sum + vaddvq_f64(vaddq_f64(sum0, sum1));
+}
+
+const BitKernels kNeonKernels = {"neon",  NeonPopCount, NeonFindFirstNot, NeonAnd,           NeonOr,
+                                 NeonXor, NeonNot,      NeonMax,          NeonInversePow2Sum};
+
+#endif
+
+}  // namespace
+
+std::vector<const BitKernels*> SupportedBitKernels() {
+  std::vector<const BitKernels*> kernels{&kScalarKernels};
+#if defined(BIT_KERNELS_X86)
+  if (SupportsAvx2()) {
+    kernels.push_back(&kAvx2Kernels);
+  }
+  if (SupportsAvx512()) {
+    kernels.push_back(&kAvx512Kernels);
+  }
+#elif defined(BIT_KERNELS_NEON)
+  kernels.push_back(&kNeonKernels);
+#endif
+  return kernels;
+}
+
+const BitKernels& GetBitKernels() {
+  static const BitKernels* kernels = SupportedBitKernels().back();
+  return *kernels;
+}
+
+}  // namespace storage
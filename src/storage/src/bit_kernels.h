@@ -0,0 +1,42 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace storage {
+
+// The byte kernels of BITCOUNT, BITPOS, BITOP and of the HyperLogLog registers.
+// Every set does the same work, with the instructions of one cpu feature level.
+struct BitKernels {
+  const char* name;
+  // Number of bits set in data
+  int64_t (*pop_count)(const unsigned char* data, size_t bytes);
+  // Index of the first byte of data other than skip, bytes if there is none
+  size_t (*find_first_not)(const unsigned char* data, size_t bytes, unsigned char skip);
+  // dest[i] = dest[i] op src[i] for i < bytes
+  void (*and_bytes)(unsigned char* dest, const unsigned char* src, size_t bytes);
+  void (*or_bytes)(unsigned char* dest, const unsigned char* src, size_t bytes);
+  void (*xor_bytes)(unsigned char* dest, const unsigned char* src, size_t bytes);
+  // dest[i] = ~dest[i] for i < bytes
+  void (*not_bytes)(unsigned char* dest, size_t bytes);
+  // dest[i] = max(dest[i], src[i]) for i < bytes, the union of two HyperLogLogs
+  void (*max_bytes)(unsigned char* dest, const unsigned char* src, size_t bytes);
+  // Sum of 2^-data[i] for i < bytes, and the number of zero bytes in *zeros, for
+  // the harmonic mean of HyperLogLog registers. Bytes above 63 count as 63.
+  double (*inverse_pow2_sum)(const unsigned char* data, size_t bytes, size_t* zeros);
+};
+
+// The kernels of the widest instruction set the cpu supports: AVX-512 (with
+// VPOPCNTDQ and BW), AVX2, NEON, or the portable scalar ones. Chosen at the first call.
+const BitKernels& GetBitKernels();
+
+// Every kernel set the cpu supports, the scalar one first
+std::vector<const BitKernels*> SupportedBitKernels();
+
+}  // namespace storage
@@ -0,0 +1,104 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BITMAP_FRAGMENT_FORMAT_H_
+#define SRC_BITMAP_FRAGMENT_FORMAT_H_
+
+#include <string>
+
+#include "src/coding.h"
+#include "src/strings_value_format.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+// Bytes of bitmap held by one fragment.
+const size_t kBitmapFragmentBytes = 4 * 1024;
+
+// A bitmap that SETBIT or BITOP makes longer than this many bytes is stored in
+// fragments, a shorter one stays a plain string.
+const size_t kBitmapFragmentThreshold = 64 * 1024;
+
+/*
+ * A bitmap stored in fragments keeps a strings value under its key, with
+ * kStringsBitmapFragments in the first reserve byte and this user value:
+ * | version | length |
+ * |    8B   |   8B   |
+ *
+ * length is the size of the bitmap in bytes. The fragment of index i holds the
+ * bytes [i * kBitmapFragmentBytes, (i + 1) * kBitmapFragmentBytes) of the bitmap
+ * as the user value of the data key | key | version | index (8B, big endian) |
+ * in the hashes data cf. A fragment may be shorter than that, its missing bytes
+ * are zero, and a fragment of zero bytes is not stored at all.
+ */
+class BitmapFragmentsMeta {
+ public:
+  BitmapFragmentsMeta() = default;
+  BitmapFragmentsMeta(uint64_t version, uint64_t length) : version_(version), length_(length) {}
+
+  // Tells whether the strings value stored at a key holds the meta of a bitmap in fragments
+  static bool IsFragments(const Slice& strings_value) {
+    return strings_value.size() >= kStringsValueSuffixLength + kTypeLength &&
+           static_cast<DataType>(static_cast<uint8_t>(strings_value[0])) == DataType::kStrings &&
+           static_cast<StringsEncoding>(
+               strings_value[strings_value.size() - kStringsValueSuffixLength]) == kStringsBitmapFragments;
+  }
+
+  // Decodes the meta held by the strings value stored at a key, false if it holds none
+  bool DecodeStringsValue(const Slice& strings_value) {
+    return IsFragments(strings_value) &&
+           Decode(Slice(strings_value.data() + kTypeLength,
+                        strings_value.size() - kTypeLength - kStringsValueSuffixLength));
+  }
+
+  bool Decode(const Slice& user_value) {
+    if (user_value.size() != 2 * sizeof(uint64_t)) {
+      return false;
+    }
+    version_ = DecodeFixed64(user_value.data());
+    length_ = DecodeFixed64(user_value.data() + sizeof(uint64_t));
+    return true;
+  }
+
+  std::string Encode() const {
+    char buf[2 * sizeof(uint64_t)];
+    EncodeFixed64(buf, version_);
+    EncodeFixed64(buf + sizeof(uint64_t), length_);
+    return std::string(buf, sizeof(buf));
+  }
+
+  uint64_t Version() const { return version_; }
+
+  uint64_t Length() const { return length_; }
+
+  void SetLength(uint64_t length) { length_ = length; }
+
+  // Number of fragments covering the bitmap
+  uint64_t FragmentNum() const { return (length_ + kBitmapFragmentBytes - 1) / kBitmapFragmentBytes; }
+
+  // The data key part of the fragment of index, sorting as the indexes do
+  static std::string EncodeIndex(uint64_t index) {
+    std::string buf(sizeof(uint64_t), '\0');
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      buf[i] = static_cast<char>((index >> (56 - 8 * i)) & 0xff);
+    }
+    return buf;
+  }
+
+  static uint64_t DecodeIndex(const Slice& data) {
+    uint64_t index = 0;
+    for (size_t i = 0; i < sizeof(uint64_t) && i < data.size(); ++i) {
+      index = (index << 8) | static_cast<uint8_t>(data[i]);
+    }
+    return index;
+  }
+
+ private:
+  uint64_t version_ = 0;
+  uint64_t length_ = 0;
+};
+
+}  // namespace storage
+#endif  // SRC_BITMAP_FRAGMENT_FORMAT_H_
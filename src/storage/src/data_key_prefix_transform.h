@@ -0,0 +1,60 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_DATA_KEY_PREFIX_TRANSFORM_H_
+#define SRC_DATA_KEY_PREFIX_TRANSFORM_H_
+
+#include "rocksdb/slice_transform.h"
+
+#include "storage/storage_define.h"
+
+namespace storage {
+/* data key pattern
+ * | reserve1 | key | version | data | reserve2 |
+ * |    8B    |     |    8B   |      |   16B    |
+ *
+ * The prefix of a data key is everything up to and including the version, so all the
+ * members of one collection version share a prefix. The user key is encoded with every
+ * \0 escaped as \0\1 and terminated by \0\0, the first \0\0 pair ends the key.
+ */
+class DataKeyPrefixTransformImpl : public rocksdb::SliceTransform {
+ public:
+  DataKeyPrefixTransformImpl() = default;
+
+  const char* Name() const override { return "pikiwidb.DataKeyPrefixTransform"; }
+
+  rocksdb::Slice Transform(const rocksdb::Slice& key) const override {
+    return {key.data(), PrefixLength(key)};
+  }
+
+  bool InDomain(const rocksdb::Slice& key) const override { return PrefixLength(key) != 0; }
+
+  bool InRange(const rocksdb::Slice& dst) const override {
+    return dst.size() >= kPrefixReserveLength + kEncodedKeyDelimSize + kVersionLength &&
+           PrefixLength(dst) == dst.size();
+  }
+
+  bool SameResultWhenAppended(const rocksdb::Slice& prefix) const override { return InRange(prefix); }
+
+  // Returns the length of the prefix of key, 0 if key is too short to hold one.
+  static size_t PrefixLength(const rocksdb::Slice& key) {
+    if (key.size() < kPrefixReserveLength + kEncodedKeyDelimSize + kVersionLength) {
+      return 0;
+    }
+    const char* ptr = key.data();
+    size_t limit = key.size() - kVersionLength;
+    bool zero_ahead = false;
+    for (size_t idx = kPrefixReserveLength; idx < limit; ++idx) {
+      if (ptr[idx] == kNeedTransformCharacter && zero_ahead) {
+        return idx + 1 + kVersionLength;
+      }
+      zero_ahead = ptr[idx] == kNeedTransformCharacter;
+    }
+    return 0;
+  }
+};
+
+}  //  namespace storage
+#endif  //  SRC_DATA_KEY_PREFIX_TRANSFORM_H_
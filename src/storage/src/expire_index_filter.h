@@ -0,0 +1,76 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_EXPIRE_INDEX_FILTER_H_
+#define SRC_EXPIRE_INDEX_FILTER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/compaction_filter.h"
+#include "rocksdb/db.h"
+#include "src/base_key_format.h"
+#include "src/debug.h"
+#include "src/expire_index_format.h"
+
+namespace storage {
+
+// Drops the expire index entries that no longer match the etime of their key, they are
+// left behind when a key is overwritten or deleted without going through the expire
+// commands. Entries that are still due are kept for the active expire cycle.
+class ExpireIndexFilter : public rocksdb::CompactionFilter {
+ public:
+  ExpireIndexFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr)
+      : db_(db), cf_handles_ptr_(cf_handles_ptr) {
+    read_options_.fill_cache = false;
+  }
+
+  bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
+              bool* value_changed) const override {
+    if (db_ == nullptr || cf_handles_ptr_ == nullptr || cf_handles_ptr_->empty()) {
+      return false;
+    }
+    ParsedExpireIndexKey parsed_index_key(key);
+    BaseMetaKey base_meta_key(parsed_index_key.Key());
+    std::string meta_value;
+    rocksdb::Status s = db_->Get(read_options_, (*cf_handles_ptr_)[kMetaCF], base_meta_key.Encode(), &meta_value);
+    if (s.IsNotFound()) {
+      DEBUG("[ExpireIndexFilter] Drop[Meta key not exist], key: {}", parsed_index_key.Key().ToString());
+      return true;
+    }
+    if (s.ok() && MetaValueEtime(meta_value) != parsed_index_key.Etime()) {
+      DEBUG("[ExpireIndexFilter] Drop[Etime changed], key: {}, etime: {}", parsed_index_key.Key().ToString(),
+            parsed_index_key.Etime());
+      return true;
+    }
+    return false;
+  }
+
+  const char* Name() const override { return "ExpireIndexFilter"; }
+
+ private:
+  rocksdb::DB* db_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+  rocksdb::ReadOptions read_options_;
+};
+
+class ExpireIndexFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  ExpireIndexFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr) {}
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override {
+    return std::make_unique<ExpireIndexFilter>(*db_ptr_, cf_handles_ptr_);
+  }
+  const char* Name() const override { return "ExpireIndexFilterFactory"; }
+
+ private:
+  rocksdb::DB** db_ptr_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+};
+
+}  //  namespace storage
+#endif  //  SRC_EXPIRE_INDEX_FILTER_H_
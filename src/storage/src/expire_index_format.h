@@ -0,0 +1,85 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_EXPIRE_INDEX_FORMAT_H_
+#define SRC_EXPIRE_INDEX_FORMAT_H_
+
+#include <string>
+
+#include "src/base_meta_value_format.h"
+#include "src/lists_meta_value_format.h"
+#include "src/strings_value_format.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * expire index key, stored in kExpireIndexCF with an empty value. format:
+ * | etime | key |
+ * |  8B   |     |
+ * etime is encoded big endian so that the index is ordered by (etime, key).
+ */
+class ExpireIndexKey {
+ public:
+  ExpireIndexKey(uint64_t etime, const Slice& key) : etime_(etime), key_(key) {}
+
+  // Encodes the etime part alone, it bounds a scan over all the keys expiring before etime.
+  static std::string EncodeEtime(uint64_t etime) {
+    std::string dst(sizeof(uint64_t), '\0');
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      dst[i] = static_cast<char>((etime >> (8 * (sizeof(uint64_t) - 1 - i))) & 0xff);
+    }
+    return dst;
+  }
+
+  std::string Encode() const {
+    std::string dst = EncodeEtime(etime_);
+    dst.append(key_.data(), key_.size());
+    return dst;
+  }
+
+ private:
+  uint64_t etime_ = 0;
+  Slice key_;
+};
+
+class ParsedExpireIndexKey {
+ public:
+  explicit ParsedExpireIndexKey(const Slice& index_key) {
+    const auto* ptr = reinterpret_cast<const uint8_t*>(index_key.data());
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      etime_ = (etime_ << 8) | ptr[i];
+    }
+    key_ = Slice(index_key.data() + sizeof(uint64_t), index_key.size() - sizeof(uint64_t));
+  }
+
+  uint64_t Etime() const { return etime_; }
+
+  Slice Key() const { return key_; }
+
+ private:
+  uint64_t etime_ = 0;
+  Slice key_;
+};
+
+// Reads the etime of a meta value of any type, 0 means the key never expires.
+inline uint64_t MetaValueEtime(const Slice& meta_value) {
+  auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+  switch (type) {
+    case DataType::kStrings:
+      return ParsedStringsValue(meta_value).Etime();
+    case DataType::kLists:
+      return ParsedListsMetaValue(meta_value).Etime();
+    case DataType::kHashes:
+    case DataType::kSets:
+    case DataType::kZSets:
+      return ParsedBaseMetaValue(meta_value).Etime();
+    default:
+      return 0;
+  }
+}
+
+}  //  namespace storage
+#endif  //  SRC_EXPIRE_INDEX_FORMAT_H_
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "rocksdb/utilities/stackable_db.h"
+#include "rocksdb/write_batch.h"
+
+#include "src/base_meta_value_format.h"
+#include "src/lists_meta_value_format.h"
+#include "src/strings_value_format.h"
+
+namespace storage {
+
+/*
+ * Counts of the meta entries by type, indexed by DataType. A key is counted in
+ * keys from its write until its delete, expired keys included, and in
+ * invalid_keys while it is an empty collection.
+ */
+struct KeyCounts {
+  static constexpr size_t kTypeNum = static_cast<size_t>(DataType::kZSets) + 1;
+
+  struct TypeCount {
+    int64_t keys = 0;
+    int64_t expires = 0;
+    int64_t invalid_keys = 0;
+    // Sum of the etime of the expiring keys, for their average ttl
+    int64_t etime_sum = 0;
+  };
+  std::array<TypeCount, kTypeNum> types;
+
+  // What a meta value is counted as, type is kTypeNum for a value counted nowhere
+  struct MetaCount {
+    size_t type = kTypeNum;
+    uint64_t etime = 0;
+    bool empty = false;
+  };
+
+  static MetaCount Of(const rocksdb::Slice& meta_value) {
+    MetaCount meta_count;
+    if (meta_value.empty()) {
+      return meta_count;
+    }
+    auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+    if (type == DataType::kStrings) {
+      meta_count.etime = ParsedStringsValue(meta_value).Etime();
+    } else if (type == DataType::kLists) {
+      ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+      meta_count.etime = parsed_lists_meta_value.Etime();
+      meta_count.empty = parsed_lists_meta_value.Count() == 0;
+    } else if (static_cast<size_t>(type) < kTypeNum) {
+      ParsedBaseMetaValue parsed_base_meta_value(meta_value);
+      meta_count.etime = parsed_base_meta_value.Etime();
+      meta_count.empty = parsed_base_meta_value.Count() == 0;
+    } else {
+      return meta_count;
+    }
+    meta_count.type = static_cast<size_t>(type);
+    return meta_count;
+  }
+
+  // Counts a meta value, a negative sign takes it away again
+  void Add(const MetaCount& meta_count, int64_t sign = 1) {
+    if (meta_count.type >= kTypeNum) {
+      return;
+    }
+    auto& count = types[meta_count.type];
+    if (meta_count.empty) {
+      count.invalid_keys += sign;
+      return;
+    }
+    count.keys += sign;
+    if (meta_count.etime != 0) {
+      count.expires += sign;
+      count.etime_sum += sign * static_cast<int64_t>(meta_count.etime);
+    }
+  }
+  void Add(const rocksdb::Slice& meta_value, int64_t sign = 1) { Add(Of(meta_value), sign); }
+
+  void Merge(const KeyCounts& other) {
+    for (size_t i = 0; i < kTypeNum; ++i) {
+      types[i].keys += other.types[i].keys;
+      types[i].expires += other.types[i].expires;
+      types[i].invalid_keys += other.types[i].invalid_keys;
+      types[i].etime_sum += other.types[i].etime_sum;
+    }
+  }
+
+  std::string Encode() const {
+    std::ostringstream out;
+    for (const auto& count : types) {
+      out << count.keys << ' ' << count.expires << ' ' << count.invalid_keys << ' ' << count.etime_sum << ' ';
+    }
+    return out.str();
+  }
+
+  bool Decode(const std::string& value) {
+    std::istringstream in(value);
+    for (auto& count : types) {
+      if (!(in >> count.keys >> count.expires >> count.invalid_keys >> count.etime_sum)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+/*
+ * Keeps the KeyCounts of an instance up to date on every write. The meta cf is the
+ * default column family, for each of its keys a write batch touches the value before
+ * the batch is taken away and the value after it is added. The callers hold the
+ * record locks of the keys they write, so nothing changes them in between.
+ *
+ * The value before is the one the calling thread read last, the callers read the meta
+ * of a key under its record lock before writing it. A generation per stripe of keys,
+ * bumped by every write, tells whether that read is still current. Only the blind
+ * writes (SET, MSET ...) look the value up, from the memtables and the block cache
+ * first. The metas the compaction filter drops are taken away through CountDrop().
+ */
+class KeyCountDB : public rocksdb::StackableDB {
+ public:
+  explicit KeyCountDB(rocksdb::DB* db) : rocksdb::StackableDB(db) {}
+
+  using rocksdb::StackableDB::Delete;
+  using rocksdb::StackableDB::DeleteRange;
+  using rocksdb::StackableDB::Get;
+  using rocksdb::StackableDB::Put;
+  using rocksdb::StackableDB::SingleDelete;
+
+  rocksdb::Status Get(const rocksdb::ReadOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                      const rocksdb::Slice& key, rocksdb::PinnableSlice* value, std::string* timestamp) override {
+    // a read at a snapshot may be older than the generation taken now
+    bool meta = column_family != nullptr && column_family->GetID() == 0 && options.snapshot == nullptr &&
+                timestamp == nullptr;
+    uint64_t generation = meta ? generations_[Stripe(key)].load() : 0;
+    rocksdb::Status s = rocksdb::StackableDB::Get(options, column_family, key, value, timestamp);
+    if (meta && (s.ok() || s.IsNotFound())) {
+      auto& reads = ThreadReads();
+      if (reads.size() >= kMaxThreadReads) {
+        reads.clear();
+      }
+      reads[key.ToString()] = ReadValue{this, generation, s.ok() ? KeyCounts::Of(*value) : KeyCounts::MetaCount()};
+    }
+    return s;
+  }
+
+  // The single key writes go through Write() as well
+  rocksdb::Status Put(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                      const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+    rocksdb::WriteBatch batch;
+    batch.Put(column_family, key, value);
+    return Write(options, &batch);
+  }
+  rocksdb::Status Delete(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                         const rocksdb::Slice& key) override {
+    rocksdb::WriteBatch batch;
+    batch.Delete(column_family, key);
+    return Write(options, &batch);
+  }
+  rocksdb::Status SingleDelete(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                               const rocksdb::Slice& key) override {
+    rocksdb::WriteBatch batch;
+    batch.SingleDelete(column_family, key);
+    return Write(options, &batch);
+  }
+  rocksdb::Status DeleteRange(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                              const rocksdb::Slice& begin_key, const rocksdb::Slice& end_key) override {
+    rocksdb::WriteBatch batch;
+    batch.DeleteRange(column_family, begin_key, end_key);
+    return Write(options, &batch);
+  }
+
+  rocksdb::Status Write(const rocksdb::WriteOptions& options, rocksdb::WriteBatch* updates) override {
+    MetaWrites meta_writes;
+    rocksdb::Status s = updates->Iterate(&meta_writes);
+    if (!s.ok() || meta_writes.writes.empty()) {
+      return s.ok() ? rocksdb::StackableDB::Write(options, updates) : s;
+    }
+
+    KeyCounts delta;
+    KeyCounts::MetaCount before;
+    for (const auto& [key, write] : meta_writes.writes) {
+      s = CountBefore(key, &before);
+      if (!s.ok()) {
+        return s;
+      }
+      delta.Add(before, -1);
+      if (write.type == MetaWrite::kPut) {
+        delta.Add(write.value);
+      }
+    }
+    std::shared_lock<std::shared_mutex> recount_lock(recount_mutex_);
+    s = rocksdb::StackableDB::Write(options, updates);
+    if (!s.ok()) {
+      return s;
+    }
+    for (const auto& [key, write] : meta_writes.writes) {
+      ++generations_[Stripe(key)];
+    }
+    AddDelta(delta);
+    return s;
+  }
+
+  // Takes away a meta value the compaction filter drops, unless a later write replaced it
+  // already and took it away then
+  void CountDrop(const rocksdb::Slice& key, const rocksdb::Slice& value) {
+    std::string current;
+    if (!db_->Get(rocksdb::ReadOptions(), DefaultColumnFamily(), key, &current).ok() || current != value) {
+      return;
+    }
+    KeyCounts delta;
+    delta.Add(value, -1);
+    std::shared_lock<std::shared_mutex> recount_lock(recount_mutex_);
+    ++generations_[Stripe(key)];
+    AddDelta(delta);
+  }
+
+  // A recount scans the meta cf at the snapshot BeginRecount() returns, the writes from then
+  // on are kept apart and added to what the scan counts by EndRecount()
+  const rocksdb::Snapshot* BeginRecount() {
+    std::unique_lock<std::shared_mutex> recount_lock(recount_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    recounting_ = true;
+    recount_delta_ = KeyCounts();
+    return db_->GetSnapshot();
+  }
+
+  // counts is the result of the scan, nullptr when it was given up
+  void EndRecount(const rocksdb::Snapshot* snapshot, const KeyCounts* counts) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (counts != nullptr) {
+        counts_ = *counts;
+        counts_.Merge(recount_delta_);
+      }
+      recounting_ = false;
+    }
+    db_->ReleaseSnapshot(snapshot);
+  }
+
+  KeyCounts GetKeyCounts() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_;
+  }
+
+  void SetKeyCounts(const KeyCounts& counts) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counts_ = counts;
+  }
+
+ private:
+  struct MetaWrite {
+    enum Type { kPut, kDelete };
+    Type type = kPut;
+    std::string value;
+  };
+
+  // The last write of every meta key of a batch
+  class MetaWrites : public rocksdb::WriteBatch::Handler {
+   public:
+    rocksdb::Status PutCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+      if (column_family_id == 0) {
+        writes[key.ToString()] = MetaWrite{MetaWrite::kPut, value.ToString()};
+      }
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status DeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) override {
+      if (column_family_id == 0) {
+        writes[key.ToString()] = MetaWrite{MetaWrite::kDelete, std::string()};
+      }
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status SingleDeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) override {
+      return DeleteCF(column_family_id, key);
+    }
+    rocksdb::Status DeleteRangeCF(uint32_t column_family_id, const rocksdb::Slice& begin_key,
+                                  const rocksdb::Slice& end_key) override {
+      // the meta cf is never range deleted, the data cfs hold no key counts
+      return rocksdb::Status::OK();
+    }
+
+    std::map<std::string, MetaWrite> writes;
+  };
+
+  struct ReadValue {
+    const KeyCountDB* db = nullptr;
+    uint64_t generation = 0;
+    // what the value read is counted as, counted nowhere when it was not found
+    KeyCounts::MetaCount meta_count;
+  };
+
+  static constexpr size_t kGenerationStripes = 1024;
+  static constexpr size_t kMaxThreadReads = 256;
+
+  static size_t Stripe(const rocksdb::Slice& key) {
+    return std::hash<std::string_view>()(std::string_view(key.data(), key.size())) % kGenerationStripes;
+  }
+
+  // The meta values the calling thread read, by meta key
+  static std::unordered_map<std::string, ReadValue>& ThreadReads() {
+    static thread_local std::unordered_map<std::string, ReadValue> reads;
+    return reads;
+  }
+
+  // What the value a write of key replaces is counted as, from the read of the caller if
+  // it is still current
+  rocksdb::Status CountBefore(const std::string& key, KeyCounts::MetaCount* before) {
+    auto& reads = ThreadReads();
+    auto iter = reads.find(key);
+    if (iter != reads.end()) {
+      bool current = iter->second.db == this && iter->second.generation == generations_[Stripe(key)].load();
+      *before = iter->second.meta_count;
+      reads.erase(iter);
+      if (current) {
+        return rocksdb::Status::OK();
+      }
+    }
+    *before = KeyCounts::MetaCount();
+    std::string value;
+    bool value_found = false;
+    if (!db_->KeyMayExist(rocksdb::ReadOptions(), DefaultColumnFamily(), key, &value, &value_found)) {
+      return rocksdb::Status::OK();
+    }
+    if (!value_found) {
+      rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), DefaultColumnFamily(), key, &value);
+      if (!s.ok()) {
+        return s.IsNotFound() ? rocksdb::Status::OK() : s;
+      }
+    }
+    *before = KeyCounts::Of(value);
+    return rocksdb::Status::OK();
+  }
+
+  void AddDelta(const KeyCounts& delta) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counts_.Merge(delta);
+    if (recounting_) {
+      recount_delta_.Merge(delta);
+    }
+  }
+
+  std::array<std::atomic<uint64_t>, kGenerationStripes> generations_{};
+
+  // Held shared by the writes, exclusively while a recount takes its snapshot
+  std::shared_mutex recount_mutex_;
+  std::mutex mutex_;
+  KeyCounts counts_;
+  bool recounting_ = false;
+  KeyCounts recount_delta_;
+};
+
+}  // namespace storage
@@ -0,0 +1,259 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_LISTS_CHUNK_FORMAT_H_
+#define SRC_LISTS_CHUNK_FORMAT_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "pstd/pstd_coding.h"
+#include "src/coding.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+// A chunk stops accepting pushes once it reaches either limit.
+const size_t kListsChunkMaxElements = 128;
+const size_t kListsChunkMaxBytes = 8 * 1024;
+
+// Chunks opened at the head or the tail of a list are this far apart, so that a chunk
+// split by LINSERT can take an id between its neighbours without renumbering them.
+const uint64_t kListsChunkIdGap = 1ULL << 16;
+
+// The chunks whose ids agree above kListsIndexGroupShift are counted by one group of the
+// chunk index of the list. A group is a data key of the list whose version has
+// kListsIndexVersionFlag set, so it is out of the prefix the chunks are iterated in.
+const uint32_t kListsIndexGroupShift = 24;
+const uint64_t kListsIndexVersionFlag = 1ULL << 63;
+
+/*
+ * list chunk, stored as the user value of a list data value when the list
+ * uses the chunked encoding. format:
+ * | count | element len | element | ... | element len | element |
+ * |  4B   |   varint32  |         |     |   varint32  |         |
+ */
+class ListsChunk {
+ public:
+  ListsChunk() = default;
+
+  // Reads the element count from the chunk header without decoding the elements.
+  static uint32_t Count(const Slice& payload) {
+    return payload.size() < sizeof(uint32_t) ? 0 : DecodeFixed32(payload.data());
+  }
+
+  bool Decode(const Slice& payload) {
+    Clear();
+    if (payload.size() < sizeof(uint32_t)) {
+      return false;
+    }
+    uint32_t count = DecodeFixed32(payload.data());
+    const char* ptr = payload.data() + sizeof(uint32_t);
+    const char* limit = payload.data() + payload.size();
+    elements_.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t len = 0;
+      ptr = pstd::GetVarint32Ptr(ptr, limit, &len);
+      if (ptr == nullptr || len > static_cast<size_t>(limit - ptr)) {
+        Clear();
+        return false;
+      }
+      elements_.emplace_back(ptr, len);
+      bytes_ += len;
+      ptr += len;
+    }
+    return true;
+  }
+
+  std::string Encode() const {
+    std::string payload;
+    payload.reserve(sizeof(uint32_t) + bytes_ + elements_.size() * 2);
+    char count_buf[sizeof(uint32_t)];
+    EncodeFixed32(count_buf, static_cast<uint32_t>(elements_.size()));
+    payload.append(count_buf, sizeof(count_buf));
+    for (const auto& element : elements_) {
+      pstd::PutVarint32(&payload, static_cast<uint32_t>(element.size()));
+      payload.append(element);
+    }
+    return payload;
+  }
+
+  size_t Size() const { return elements_.size(); }
+
+  bool Empty() const { return elements_.empty(); }
+
+  bool Full() const { return elements_.size() >= kListsChunkMaxElements || bytes_ >= kListsChunkMaxBytes; }
+
+  // An insertion in the middle of the list may grow a chunk past the limits,
+  // such a chunk is split in two before it is written back.
+  bool Oversized() const {
+    return elements_.size() > 1 && (elements_.size() > kListsChunkMaxElements || bytes_ > kListsChunkMaxBytes);
+  }
+
+  // A chunk emptied down to a quarter of the limits by LREM is merged into a neighbour
+  // when the two fit in one chunk.
+  bool Underfull() const {
+    return elements_.size() < kListsChunkMaxElements / 4 && bytes_ < kListsChunkMaxBytes / 4;
+  }
+
+  bool FitsWith(const ListsChunk& other) const {
+    return elements_.size() + other.elements_.size() <= kListsChunkMaxElements &&
+           bytes_ + other.bytes_ <= kListsChunkMaxBytes;
+  }
+
+  const std::string& Element(size_t pos) const { return elements_[pos]; }
+
+  void Set(size_t pos, const Slice& value) {
+    bytes_ = bytes_ - elements_[pos].size() + value.size();
+    elements_[pos].assign(value.data(), value.size());
+  }
+
+  void Insert(size_t pos, const Slice& value) {
+    bytes_ += value.size();
+    elements_.emplace(elements_.begin() + pos, value.data(), value.size());
+  }
+
+  void Erase(size_t pos) {
+    bytes_ -= elements_[pos].size();
+    elements_.erase(elements_.begin() + pos);
+  }
+
+  void PushFront(const Slice& value) { Insert(0, value); }
+
+  void PushBack(const Slice& value) {
+    bytes_ += value.size();
+    elements_.emplace_back(value.data(), value.size());
+  }
+
+  // Appends the elements of other behind the elements of this chunk.
+  void Append(const ListsChunk& other) {
+    for (const auto& element : other.elements_) {
+      PushBack(element);
+    }
+  }
+
+  // Removes n elements from the front (or the back) of the chunk.
+  void EraseFront(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      bytes_ -= elements_[i].size();
+    }
+    elements_.erase(elements_.begin(), elements_.begin() + n);
+  }
+
+  void EraseBack(size_t n) {
+    for (size_t i = elements_.size() - n; i < elements_.size(); ++i) {
+      bytes_ -= elements_[i].size();
+    }
+    elements_.resize(elements_.size() - n);
+  }
+
+  // Moves the second half of the elements into *right.
+  void SplitInto(ListsChunk* right) {
+    right->Clear();
+    size_t mid = elements_.size() / 2;
+    for (size_t i = mid; i < elements_.size(); ++i) {
+      right->PushBack(elements_[i]);
+    }
+    EraseBack(elements_.size() - mid);
+  }
+
+  void Clear() {
+    elements_.clear();
+    bytes_ = 0;
+  }
+
+ private:
+  std::vector<std::string> elements_;
+  size_t bytes_ = 0;
+};
+
+/*
+ * list chunk index group, the element count of each chunk of the group by chunk id,
+ * behind the total of the group. format:
+ * | total | chunk id | count | ... | chunk id | count |
+ * |  8B   |    8B    |  4B   |     |    8B    |  4B   |
+ */
+class ListsIndexGroup {
+ public:
+  ListsIndexGroup() = default;
+
+  // Reads the total of the group from its header without decoding the counts.
+  static uint64_t Total(const Slice& payload) {
+    return payload.size() < sizeof(uint64_t) ? 0 : DecodeFixed64(payload.data());
+  }
+
+  bool Decode(const Slice& payload) {
+    Clear();
+    if (payload.size() < sizeof(uint64_t) || (payload.size() - sizeof(uint64_t)) % kEntryLength != 0) {
+      return false;
+    }
+    for (const char* ptr = payload.data() + sizeof(uint64_t); ptr < payload.data() + payload.size();
+         ptr += kEntryLength) {
+      Set(DecodeFixed64(ptr), DecodeFixed32(ptr + sizeof(uint64_t)));
+    }
+    return total_ == DecodeFixed64(payload.data());
+  }
+
+  std::string Encode() const {
+    std::string payload(sizeof(uint64_t) + counts_.size() * kEntryLength, '\0');
+    char* dst = payload.data();
+    EncodeFixed64(dst, total_);
+    dst += sizeof(uint64_t);
+    for (const auto& [chunk_id, count] : counts_) {
+      EncodeFixed64(dst, chunk_id);
+      EncodeFixed32(dst + sizeof(uint64_t), count);
+      dst += kEntryLength;
+    }
+    return payload;
+  }
+
+  // Sets the element count of a chunk, a chunk of no elements leaves the group.
+  void Set(uint64_t chunk_id, uint32_t count) {
+    auto iter = counts_.find(chunk_id);
+    if (iter != counts_.end()) {
+      total_ -= iter->second;
+      if (count == 0) {
+        counts_.erase(iter);
+        return;
+      }
+      iter->second = count;
+    } else if (count != 0) {
+      counts_.emplace(chunk_id, count);
+    }
+    total_ += count;
+  }
+
+  // Finds the chunk holding the element at pos, counted from the first element of the group.
+  bool Locate(uint64_t pos, uint64_t* chunk_id, uint32_t* offset) const {
+    for (const auto& [id, count] : counts_) {
+      if (pos < count) {
+        *chunk_id = id;
+        *offset = static_cast<uint32_t>(pos);
+        return true;
+      }
+      pos -= count;
+    }
+    return false;
+  }
+
+  uint64_t Total() const { return total_; }
+
+  bool Empty() const { return counts_.empty(); }
+
+  void Clear() {
+    counts_.clear();
+    total_ = 0;
+  }
+
+ private:
+  static constexpr size_t kEntryLength = sizeof(uint64_t) + sizeof(uint32_t);
+
+  std::map<uint64_t, uint32_t> counts_;
+  uint64_t total_ = 0;
+};
+
+}  //  namespace storage
+#endif  //  SRC_LISTS_CHUNK_FORMAT_H_
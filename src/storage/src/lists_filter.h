@@ -12,16 +12,18 @@
 
 #include "rocksdb/compaction_filter.h"
 #include "rocksdb/db.h"
+#include "src/base_filter.h"
 #include "src/debug.h"
+#include "src/lists_chunk_format.h"
 #include "src/lists_data_key_format.h"
 #include "src/lists_meta_value_format.h"
 
 namespace storage {
 
-class ListsDataFilter : public rocksdb::CompactionFilter {
+class ListsDataFilter : public BaseDataKeyFilter {
  public:
   ListsDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type)
-      : db_(db), cf_handles_ptr_(cf_handles_ptr), type_(type) {}
+      : BaseDataKeyFilter(db, cf_handles_ptr, type) {}
 
   bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
               bool* value_changed) const override {
@@ -34,74 +36,23 @@ class ListsDataFilter : public rocksdb::CompactionFilter {
     TRACE("[DataFilter], key: %s, index = %llu, data = %s, version = %llu",
           parsed_lists_data_key.key().ToString().c_str(), parsed_lists_data_key.index(), value.ToString().c_str(),
           parsed_lists_data_key.Version());
+    // the groups of the chunk index go with the version of the list they index
+    return DropByMeta(key, parsed_lists_data_key.Version() & ~kListsIndexVersionFlag);
+  }
 
-    const char* ptr = key.data();
-    int key_size = key.size();
-    ptr = SeekUserkeyDelim(ptr + kPrefixReserveLength, key_size - kPrefixReserveLength);
-    std::string meta_key_enc(key.data(), std::distance(key.data(), ptr));
-    meta_key_enc.append(kSuffixReserveLength, kNeedTransformCharacter);
-
-    if (meta_key_enc != cur_key_) {
-      cur_key_ = meta_key_enc;
-      cur_meta_etime_ = 0;
-      cur_meta_version_ = 0;
-      meta_not_found_ = true;
-      std::string meta_value;
-      // destroyed when close the database, Reserve Current key value
-      if (cf_handles_ptr_->empty()) {
-        return false;
-      }
-      rocksdb::Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[0], cur_key_, &meta_value);
-      if (s.ok()) {
-        auto type = static_cast<enum DataType>(static_cast<uint8_t>(meta_value[0]));
-        if (type != type_) {
-          return true;
-        }
-        ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-        meta_not_found_ = false;
-        cur_meta_version_ = parsed_lists_meta_value.Version();
-        cur_meta_etime_ = parsed_lists_meta_value.Etime();
-      } else if (s.IsNotFound()) {
-        meta_not_found_ = true;
-      } else {
-        cur_key_ = "";
-        TRACE("Reserve[Get meta_key faild]");
-        return false;
-      }
-    }
-
-    if (meta_not_found_) {
-      TRACE("Drop[Meta key not exist]");
-      return true;
-    }
-
-    int64_t unix_time;
-    rocksdb::Env::Default()->GetCurrentTime(&unix_time);
-    if (cur_meta_etime_ != 0 && cur_meta_etime_ < static_cast<uint64_t>(unix_time)) {
-      TRACE("Drop[Timeout]");
-      return true;
-    }
+  const char* Name() const override { return "ListsDataFilter"; }
 
-    if (cur_meta_version_ > parsed_lists_data_key.Version()) {
-      TRACE("Drop[list_data_key_version < cur_meta_version]");
-      return true;
-    } else {
-      TRACE("Reserve[list_data_key_version == cur_meta_version]");
+ protected:
+  bool ParseMeta(std::string* meta_value, uint64_t* version, uint64_t* etime) const override {
+    auto type = static_cast<enum DataType>(static_cast<uint8_t>((*meta_value)[0]));
+    if (type != type_) {
       return false;
     }
+    ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+    *version = parsed_lists_meta_value.Version();
+    *etime = parsed_lists_meta_value.Etime();
+    return true;
   }
-
-  const char* Name() const override { return "ListsDataFilter"; }
-
- private:
-  rocksdb::DB* db_ = nullptr;
-  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
-  rocksdb::ReadOptions default_read_options_;
-  mutable std::string cur_key_;
-  mutable bool meta_not_found_ = false;
-  mutable uint64_t cur_meta_version_ = 0;
-  mutable uint64_t cur_meta_etime_ = 0;
-  enum DataType type_ = DataType::kNones;
 };
 
 class ListsDataFilterFactory : public rocksdb::CompactionFilterFactory {
@@ -16,6 +16,15 @@ namespace storage {
 const uint64_t InitalLeftIndex = 9223372036854775807;
 const uint64_t InitalRightIndex = 9223372036854775808U;
 
+/*
+ * The first reserve byte of a list meta value records how the elements are laid out
+ * in the list data cf. kListsElementPerKey keeps one element per data key, where the
+ * left and right index bound the element indexes. kListsChunked packs the elements into
+ * chunks (see lists_chunk_format.h), the index of a data key is then a chunk id and the
+ * left and right index only bound the chunk ids.
+ */
+enum ListsEncoding : uint8_t { kListsElementPerKey = 0, kListsChunked = 1 };
+
 /*
  *| type  | list_size | version | left index | right index | reserve |  cdate | timestamp |
  *|  1B   |     8B    |    8B   |     8B     |      8B     |   16B   |    8B  |     8B    |
@@ -69,6 +78,8 @@ class ListsMetaValue : public InternalValue {
 
   void ModifyRightIndex(uint64_t index) { right_index_ += index; }
 
+  void SetEncoding(ListsEncoding encoding) { reserve_[0] = static_cast<char>(encoding); }
+
  private:
   uint64_t left_index_ = 0;
   uint64_t right_index_ = 0;
@@ -173,11 +184,23 @@ class ParsedListsMetaValue : public ParsedInternalValue {
     this->set_right_index(InitalRightIndex);
     this->SetEtime(0);
     this->SetCtime(0);
+    this->SetEncoding(kListsChunked);
     return this->UpdateVersion();
   }
 
   bool IsValid() override { return !IsStale() && Count() != 0; }
 
+  ListsEncoding Encoding() { return static_cast<ListsEncoding>(reserve_[0]); }
+
+  void SetEncoding(ListsEncoding encoding) {
+    reserve_[0] = static_cast<char>(encoding);
+    if (value_) {
+      char* dst = const_cast<char*>(value_->data()) + value_->size() - kListsMetaValueSuffixLength + kVersionLength +
+                  2 * kListValueIndexLength;
+      *dst = reserve_[0];
+    }
+  }
+
   uint64_t Count() { return count_; }
 
   void SetCount(uint64_t count) {
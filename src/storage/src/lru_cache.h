@@ -6,9 +6,14 @@
 #ifndef SRC_LRU_CACHE_H_
 #define SRC_LRU_CACHE_H_
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "rocksdb/status.h"
 
@@ -53,38 +58,42 @@ size_t HandleTable<T1, T2>::TableSize() {
 
 template <typename T1, typename T2>
 LRUHandle<T1, T2>* HandleTable<T1, T2>::Lookup(const T1& key) {
-  if (table_.find(key) != table_.end()) {
-    return table_[key];
-  } else {
-    return nullptr;
-  }
+  auto iter = table_.find(key);
+  return iter == table_.end() ? nullptr : iter->second;
 }
 
 template <typename T1, typename T2>
 LRUHandle<T1, T2>* HandleTable<T1, T2>::Remove(const T1& key) {
-  LRUHandle<T1, T2>* old = nullptr;
-  if (table_.find(key) != table_.end()) {
-    old = table_[key];
-    table_.erase(key);
+  auto iter = table_.find(key);
+  if (iter == table_.end()) {
+    return nullptr;
   }
+  LRUHandle<T1, T2>* old = iter->second;
+  table_.erase(iter);
   return old;
 }
 
 template <typename T1, typename T2>
 LRUHandle<T1, T2>* HandleTable<T1, T2>::Insert(const T1& key, LRUHandle<T1, T2>* const handle) {
-  LRUHandle<T1, T2>* old = nullptr;
-  if (table_.find(key) != table_.end()) {
-    old = table_[key];
-    table_.erase(key);
+  auto [iter, inserted] = table_.try_emplace(key, handle);
+  if (inserted) {
+    return nullptr;
   }
-  table_.insert({key, handle});
+  LRUHandle<T1, T2>* old = iter->second;
+  iter->second = handle;
   return old;
 }
 
+/*
+ * With shared_lookups the lookups only take the mutex in shared mode, so they run in
+ * parallel with each other, but they no longer move the entry they find to the head
+ * of the LRU list, only an insert does. That suits the caches whose lookups are
+ * followed by an insert of the same key anyway.
+ */
 template <typename T1, typename T2>
 class LRUCache {
  public:
-  LRUCache();
+  explicit LRUCache(bool shared_lookups = false);
   ~LRUCache();
 
   size_t Size();
@@ -113,7 +122,8 @@ class LRUCache {
   size_t usage_ = 0;
   size_t size_ = 0;
 
-  pstd::Mutex mutex_;
+  const bool shared_lookups_ = false;
+  pstd::RWMutex mutex_;
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
@@ -123,7 +133,7 @@ class LRUCache {
 };
 
 template <typename T1, typename T2>
-LRUCache<T1, T2>::LRUCache() {
+LRUCache<T1, T2>::LRUCache(bool shared_lookups) : shared_lookups_(shared_lookups) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
@@ -136,19 +146,19 @@ LRUCache<T1, T2>::~LRUCache() {
 
 template <typename T1, typename T2>
 size_t LRUCache<T1, T2>::Size() {
-  std::lock_guard l(mutex_);
+  std::shared_lock l(mutex_);
   return size_;
 }
 
 template <typename T1, typename T2>
 size_t LRUCache<T1, T2>::TotalCharge() {
-  std::lock_guard l(mutex_);
+  std::shared_lock l(mutex_);
   return usage_;
 }
 
 template <typename T1, typename T2>
 size_t LRUCache<T1, T2>::Capacity() {
-  std::lock_guard l(mutex_);
+  std::shared_lock l(mutex_);
   return capacity_;
 }
 
@@ -161,6 +171,15 @@ void LRUCache<T1, T2>::SetCapacity(size_t capacity) {
 
 template <typename T1, typename T2>
 rocksdb::Status LRUCache<T1, T2>::Lookup(const T1& key, T2* const value) {
+  if (shared_lookups_) {
+    std::shared_lock l(mutex_);
+    LRUHandle<T1, T2>* handle = handle_table_.Lookup(key);
+    if (!handle) {
+      return rocksdb::Status::NotFound();
+    }
+    *value = handle->value;
+    return rocksdb::Status::OK();
+  }
   std::lock_guard l(mutex_);
   LRUHandle<T1, T2>* handle = handle_table_.Lookup(key);
   if (handle) {
@@ -213,7 +232,7 @@ rocksdb::Status LRUCache<T1, T2>::Clear() {
 template <typename T1, typename T2>
 bool LRUCache<T1, T2>::LRUAndHandleTableConsistent() {
   size_t count = 0;
-  std::lock_guard l(mutex_);
+  std::shared_lock l(mutex_);
   LRUHandle<T1, T2>* handle = nullptr;
   LRUHandle<T1, T2>* current = lru_.prev;
   while (current != &lru_) {
@@ -293,5 +312,114 @@ bool LRUCache<T1, T2>::FinishErase(LRUHandle<T1, T2>* const e) {
   return erased;
 }
 
+/*
+ * Spreads the keys over 2^num_shard_bits LRUCaches by their hash, every shard has
+ * its own lock and an equal part of the capacity, so the operations on keys of
+ * different shards do not contend. The eviction order is kept per shard.
+ */
+template <typename T1, typename T2>
+class ShardedLRUCache {
+ public:
+  static const int kDefaultNumShardBits = 4;
+
+  explicit ShardedLRUCache(int num_shard_bits = kDefaultNumShardBits, bool shared_lookups = false);
+  ~ShardedLRUCache() = default;
+
+  size_t Size();
+  size_t TotalCharge();
+  size_t Capacity();
+  void SetCapacity(size_t capacity);
+
+  rocksdb::Status Lookup(const T1& key, T2* value);
+  rocksdb::Status Insert(const T1& key, const T2& value, size_t charge = 1);
+  rocksdb::Status Remove(const T1& key);
+  rocksdb::Status Clear();
+
+  // Just for test
+  bool LRUAndHandleTableConsistent();
+  size_t NumShards() const { return shards_.size(); }
+
+ private:
+  LRUCache<T1, T2>* GetShard(const T1& key) { return shards_[std::hash<T1>{}(key) & (shards_.size() - 1)].get(); }
+
+  std::atomic<size_t> capacity_ = 0;
+  std::vector<std::unique_ptr<LRUCache<T1, T2>>> shards_;
+};
+
+template <typename T1, typename T2>
+ShardedLRUCache<T1, T2>::ShardedLRUCache(int num_shard_bits, bool shared_lookups) {
+  assert(num_shard_bits >= 0 && num_shard_bits < 16);
+  shards_.reserve(size_t{1} << num_shard_bits);
+  for (size_t idx = 0; idx < (size_t{1} << num_shard_bits); ++idx) {
+    shards_.push_back(std::make_unique<LRUCache<T1, T2>>(shared_lookups));
+  }
+}
+
+template <typename T1, typename T2>
+size_t ShardedLRUCache<T1, T2>::Size() {
+  size_t size = 0;
+  for (auto& shard : shards_) {
+    size += shard->Size();
+  }
+  return size;
+}
+
+template <typename T1, typename T2>
+size_t ShardedLRUCache<T1, T2>::TotalCharge() {
+  size_t usage = 0;
+  for (auto& shard : shards_) {
+    usage += shard->TotalCharge();
+  }
+  return usage;
+}
+
+template <typename T1, typename T2>
+size_t ShardedLRUCache<T1, T2>::Capacity() {
+  return capacity_.load(std::memory_order_relaxed);
+}
+
+template <typename T1, typename T2>
+void ShardedLRUCache<T1, T2>::SetCapacity(size_t capacity) {
+  capacity_.store(capacity, std::memory_order_relaxed);
+  // round up, so that a small capacity still leaves room in every shard
+  size_t shard_capacity = (capacity + shards_.size() - 1) / shards_.size();
+  for (auto& shard : shards_) {
+    shard->SetCapacity(shard_capacity);
+  }
+}
+
+template <typename T1, typename T2>
+rocksdb::Status ShardedLRUCache<T1, T2>::Lookup(const T1& key, T2* const value) {
+  return GetShard(key)->Lookup(key, value);
+}
+
+template <typename T1, typename T2>
+rocksdb::Status ShardedLRUCache<T1, T2>::Insert(const T1& key, const T2& value, size_t charge) {
+  return GetShard(key)->Insert(key, value, charge);
+}
+
+template <typename T1, typename T2>
+rocksdb::Status ShardedLRUCache<T1, T2>::Remove(const T1& key) {
+  return GetShard(key)->Remove(key);
+}
+
+template <typename T1, typename T2>
+rocksdb::Status ShardedLRUCache<T1, T2>::Clear() {
+  for (auto& shard : shards_) {
+    shard->Clear();
+  }
+  return rocksdb::Status::OK();
+}
+
+template <typename T1, typename T2>
+bool ShardedLRUCache<T1, T2>::LRUAndHandleTableConsistent() {
+  for (auto& shard : shards_) {
+    if (!shard->LRUAndHandleTableConsistent()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 }  //  namespace storage
 #endif  // SRC_LRU_CACHE_H_
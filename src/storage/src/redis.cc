@@ -3,15 +3,24 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <algorithm>
+#include <iomanip>
+#include <limits>
 #include <sstream>
 
+#include <fmt/core.h>
 #include "pstd/log.h"
 #include "rocksdb/env.h"
 
+#include "src/base_data_value_format.h"
 #include "src/base_filter.h"
+#include "src/batch.h"
+#include "src/data_key_prefix_transform.h"
+#include "src/expire_index_filter.h"
 #include "src/lists_filter.h"
 #include "src/mutex.h"
 #include "src/redis.h"
+#include "src/scan_cursor.h"
 #include "src/strings_filter.h"
 #include "src/zsets_filter.h"
 
@@ -45,15 +54,33 @@ rocksdb::Comparator* ZSetsScoreKeyComparator() {
   return &zsets_score_key_compare;
 }
 
+std::shared_ptr<const rocksdb::SliceTransform> DataKeyPrefixTransform() {
+  static auto data_key_prefix_transform = std::make_shared<DataKeyPrefixTransformImpl>();
+  return data_key_prefix_transform;
+}
+
+// The collection commands seek to the prefix of one key version and stop at the first
+// key out of it, the prefix bloom lets those seeks skip the memtables and sst files
+// that hold nothing of the version, so lookups on absent collections stay cheap.
+static void SetDataKeyPrefixOptions(rocksdb::ColumnFamilyOptions* cf_ops) {
+  cf_ops->prefix_extractor = DataKeyPrefixTransform();
+  cf_ops->memtable_prefix_bloom_size_ratio = 0.1;
+  cf_ops->memtable_whole_key_filtering = true;
+}
+
 Redis::Redis(Storage* const s, int32_t index)
     : storage_(s),
       index_(index),
-      lock_mgr_(std::make_shared<LockMgr>(1000, 0, std::make_shared<MutexFactoryImpl>())),
+      lock_mgr_(std::make_shared<LockMgr>()),
       small_compaction_threshold_(5000),
       small_compaction_duration_threshold_(10000) {
-  statistics_store_ = std::make_unique<LRUCache<std::string, KeyStatistics>>();
-  scan_cursors_store_ = std::make_unique<LRUCache<std::string, std::string>>();
-  spop_counts_store_ = std::make_unique<LRUCache<std::string, size_t>>();
+  // the statistics and the spop counts are looked up right before the insert of the
+  // same key, which refreshes the entry, so their lookups can share the shard locks
+  statistics_store_ = std::make_unique<ShardedLRUCache<std::string, KeyStatistics>>(
+      ShardedLRUCache<std::string, KeyStatistics>::kDefaultNumShardBits, true);
+  scan_cursors_store_ = std::make_unique<ShardedLRUCache<std::string, std::string>>();
+  spop_counts_store_ = std::make_unique<ShardedLRUCache<std::string, size_t>>(
+      ShardedLRUCache<std::string, size_t>::kDefaultNumShardBits, true);
   default_compact_range_options_.exclusive_manual_compaction = false;
   default_compact_range_options_.change_level = true;
   spop_counts_store_->SetCapacity(1000);
@@ -62,7 +89,18 @@ Redis::Redis(Storage* const s, int32_t index)
 }
 
 Redis::~Redis() {
+  StopKeyRecount();
+  {
+    std::lock_guard<std::mutex> lock(open_readers_->mutex);
+    for (auto* reader : open_readers_->readers) {
+      reader->Abandon();
+    }
+    open_readers_->readers.clear();
+  }
   if (need_close_.load()) {
+    if (key_count_db_ != nullptr && key_counts_exact_) {
+      SaveKeyCounts();
+    }
     rocksdb::CancelAllBackgroundWork(db_, true);
     std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
     handles_.clear();
@@ -82,12 +120,18 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   raft_timeout_s_ = storage_options.raft_timeout_s;
   statistics_store_->SetCapacity(storage_options.statistics_max_size);
   small_compaction_threshold_ = storage_options.small_compaction_threshold;
+  async_io_ = storage_options.async_io;
 
   rocksdb::BlockBasedTableOptions table_ops(storage_options.table_options);
-  table_ops.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+  if (!table_ops.filter_policy) {
+    table_ops.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+  }
 
   // Set up separate configuration for RocksDB
   rocksdb::DBOptions db_ops(storage_options.options);
+  db_statistics_ = rocksdb::CreateDBStatistics();
+  db_statistics_->set_stats_level(rocksdb::StatsLevel::kExceptHistogramOrTimers);
+  db_ops.statistics = db_statistics_;
 
   /*
    * Because zset, set, the hash, list, stream type meta
@@ -96,7 +140,7 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
    */
   // meta & string column-family options
   rocksdb::ColumnFamilyOptions meta_cf_ops(storage_options.options);
-  meta_cf_ops.compaction_filter_factory = std::make_shared<MetaFilterFactory>();
+  meta_cf_ops.compaction_filter_factory = std::make_shared<MetaFilterFactory>(&key_count_db_);
   rocksdb::BlockBasedTableOptions meta_table_ops(table_ops);
 
   if (!storage_options.share_block_cache && (storage_options.block_cache_size > 0)) {
@@ -107,12 +151,13 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   // hash column-family options
   rocksdb::ColumnFamilyOptions hash_data_cf_ops(storage_options.options);
   hash_data_cf_ops.compaction_filter_factory =
-      std::make_shared<HashesDataFilterFactory>(&db_, &handles_, DataType::kHashes);
+      std::make_shared<HashesDataFilterFactory>(&db_, &handles_, DataType::kHashes, &pending_versions_);
   rocksdb::BlockBasedTableOptions hash_data_cf_table_ops(table_ops);
 
   if (!storage_options.share_block_cache && (storage_options.block_cache_size > 0)) {
     hash_data_cf_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
   }
+  SetDataKeyPrefixOptions(&hash_data_cf_ops);
   hash_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(hash_data_cf_table_ops));
 
   // list column-family options
@@ -125,26 +170,28 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   if (!storage_options.share_block_cache && (storage_options.block_cache_size > 0)) {
     list_data_cf_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
   }
+  SetDataKeyPrefixOptions(&list_data_cf_ops);
   list_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(list_data_cf_table_ops));
 
   // set column-family options
   rocksdb::ColumnFamilyOptions set_data_cf_ops(storage_options.options);
   set_data_cf_ops.compaction_filter_factory =
-      std::make_shared<SetsMemberFilterFactory>(&db_, &handles_, DataType::kSets);
+      std::make_shared<SetsMemberFilterFactory>(&db_, &handles_, DataType::kSets, &pending_versions_);
   rocksdb::BlockBasedTableOptions set_data_cf_table_ops(table_ops);
 
   if (!storage_options.share_block_cache && (storage_options.block_cache_size > 0)) {
     set_data_cf_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
   }
+  SetDataKeyPrefixOptions(&set_data_cf_ops);
   set_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(set_data_cf_table_ops));
 
   // zset column-family options
   rocksdb::ColumnFamilyOptions zset_data_cf_ops(storage_options.options);
   rocksdb::ColumnFamilyOptions zset_score_cf_ops(storage_options.options);
   zset_data_cf_ops.compaction_filter_factory =
-      std::make_shared<ZSetsDataFilterFactory>(&db_, &handles_, DataType::kZSets);
+      std::make_shared<ZSetsDataFilterFactory>(&db_, &handles_, DataType::kZSets, &pending_versions_);
   zset_score_cf_ops.compaction_filter_factory =
-      std::make_shared<ZSetsScoreFilterFactory>(&db_, &handles_, DataType::kZSets);
+      std::make_shared<ZSetsScoreFilterFactory>(&db_, &handles_, DataType::kZSets, &pending_versions_);
   zset_score_cf_ops.comparator = ZSetsScoreKeyComparator();
 
   rocksdb::BlockBasedTableOptions zset_meta_cf_table_ops(table_ops);
@@ -153,9 +200,27 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   if (!storage_options.share_block_cache && (storage_options.block_cache_size > 0)) {
     zset_data_cf_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
   }
+  SetDataKeyPrefixOptions(&zset_data_cf_ops);
   zset_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(zset_data_cf_table_ops));
   zset_score_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(zset_score_cf_table_ops));
 
+  // expire index column-family options, the index is only scanned in etime order by
+  // the active expire cycle, so it keeps its blocks out of the block cache
+  rocksdb::ColumnFamilyOptions expire_index_cf_ops(storage_options.options);
+  expire_index_cf_ops.compaction_filter_factory = std::make_shared<ExpireIndexFilterFactory>(&db_, &handles_);
+  rocksdb::BlockBasedTableOptions expire_index_cf_table_ops(table_ops);
+  expire_index_cf_table_ops.no_block_cache = true;
+  expire_index_cf_table_ops.block_cache.reset();
+  expire_index_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(expire_index_cf_table_ops));
+
+  // key-value separation is for the strings in the meta cf and the hash values, the
+  // other column families hold small members and keep their values inline
+  list_data_cf_ops.enable_blob_files = false;
+  set_data_cf_ops.enable_blob_files = false;
+  zset_data_cf_ops.enable_blob_files = false;
+  zset_score_cf_ops.enable_blob_files = false;
+  expire_index_cf_ops.enable_blob_files = false;
+
   if (append_log_function_) {
     // Add log index table property collector factory to each column family
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(meta);
@@ -164,6 +229,7 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(set_data);
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(zset_data);
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(zset_score);
+    ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(expire_index);
 
     // Add a listener on flush to purge log index collector
     db_ops.listeners.push_back(std::make_shared<LogIndexAndSequenceCollectorPurger>(
@@ -183,39 +249,141 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   // zset CF
   column_families.emplace_back("zset_data_cf", zset_data_cf_ops);
   column_families.emplace_back("zset_score_cf", zset_score_cf_ops);
+  // expire index CF
+  column_families.emplace_back("expire_index_cf", expire_index_cf_ops);
+
+  for (auto& column_family : column_families) {
+    auto iter = storage_options.cf_compression_per_level.find(column_family.name);
+    if (iter != storage_options.cf_compression_per_level.end()) {
+      column_family.options.compression_per_level = iter->second;
+      // the levels given for the column family win over the dictionary zstd of the bottommost level
+      column_family.options.bottommost_compression = rocksdb::kDisableCompressionOption;
+      column_family.options.bottommost_compression_opts.enabled = false;
+    }
+  }
 
-  auto s = rocksdb::DB::Open(db_ops, db_path, column_families, &handles_, &db_);
+  bool existing = rocksdb::Env::Default()->FileExists(db_path + "/CURRENT").ok();
+  rocksdb::DB* db = nullptr;
+  auto s = rocksdb::DB::Open(db_ops, db_path, column_families, &handles_, &db);
   if (!s.ok()) {
     return s;
   }
   assert(!handles_.empty());
+  key_count_db_ = new KeyCountDB(db);
+  db_ = key_count_db_;
+  s = CheckKeyFormat(db_path, existing);
+  if (!s.ok()) {
+    return s;
+  }
+  key_counts_path_ = db_path + "/KEY_COUNTS";
+  s = LoadKeyCounts();
+  if (!s.ok()) {
+    return s;
+  }
   return log_index_of_all_cfs_.Init(this);
 }
 
-Status Redis::GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
-                                std::string* start_point) {
-  std::string index_key;
-  index_key.append(1, DataTypeTag[type]);
-  index_key.append("_");
-  index_key.append(key.ToString());
-  index_key.append("_");
-  index_key.append(pattern.ToString());
-  index_key.append("_");
-  index_key.append(std::to_string(cursor));
-  return scan_cursors_store_->Lookup(index_key, start_point);
-}
-
-Status Redis::StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
-                                 const std::string& next_point) {
-  std::string index_key;
-  index_key.append(1, DataTypeTag[type]);
-  index_key.append("_");
-  index_key.append(key.ToString());
-  index_key.append("_");
-  index_key.append(pattern.ToString());
-  index_key.append("_");
-  index_key.append(std::to_string(cursor));
-  return scan_cursors_store_->Insert(index_key, next_point);
+// Key format 1 lost the bytes after the last \0 of a user key that held a \0 before
+// its last byte, the delimiter and reserve2 were written over them. Format 2 keeps
+// them. Both formats encode every other key the same way.
+static const std::string kKeyFormatFileName = "KEY_FORMAT";
+static constexpr uint64_t kKeyFormatVersion = 2;
+
+Status Redis::CheckKeyFormat(const std::string& db_path, bool existing) {
+  auto env = rocksdb::Env::Default();
+  std::string path = db_path + "/" + kKeyFormatFileName;
+  if (env->FileExists(path).ok()) {
+    std::string content;
+    Status s = rocksdb::ReadFileToString(env, path, &content);
+    if (!s.ok()) {
+      return s;
+    }
+    uint64_t version = std::strtoull(content.c_str(), nullptr, 10);
+    if (version > kKeyFormatVersion) {
+      return Status::NotSupported("key format " + std::to_string(version) + " of " + db_path + " is newer than " +
+                                  std::to_string(kKeyFormatVersion));
+    }
+    if (version == kKeyFormatVersion) {
+      return Status::OK();
+    }
+  }
+
+  if (existing) {
+    // The keys format 1 wrote for such user keys end their user key part before the
+    // reserve2 bytes. They can't be decoded back, their tail is gone, and format 1
+    // only reached them through the key they were cut to, so they are reported and
+    // left for the owner to delete.
+    rocksdb::ReadOptions read_options;
+    read_options.fill_cache = false;
+    uint64_t malformed = 0;
+    std::string sample;
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kMetaCF]));
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      Slice key = iter->key();
+      if (key.size() < kPrefixReserveLength + kEncodedKeyDelimSize + kSuffixReserveLength) {
+        continue;
+      }
+      const char* user_key_end = SeekUserkeyDelim(key.data() + kPrefixReserveLength,
+                                                  static_cast<int>(key.size() - kPrefixReserveLength));
+      if (user_key_end + kSuffixReserveLength != key.data() + key.size()) {
+        if (malformed++ == 0) {
+          ParsedBaseMetaKey parsed_key(key);
+          sample = parsed_key.Key().ToString();
+        }
+      }
+    }
+    if (!iter->status().ok()) {
+      return iter->status();
+    }
+    if (malformed != 0) {
+      WARN("{} keys of {} were written by key format 1 and cut after their last \\0, the first one reads as {}",
+           malformed, db_path, sample);
+    }
+  }
+
+  Status s = rocksdb::WriteStringToFile(env, std::to_string(kKeyFormatVersion) + "\n", path + ".tmp", true);
+  if (!s.ok()) {
+    return s;
+  }
+  return env->RenameFile(path + ".tmp", path);
+}
+
+static std::string ScanCursorScope(const DataType& type, const Slice& key, const Slice& pattern) {
+  std::string scope;
+  scope.append(1, DataTypeTag[type]);
+  scope.append("_");
+  scope.append(key.ToString());
+  scope.append("_");
+  scope.append(pattern.ToString());
+  scope.append("_");
+  return scope;
+}
+
+// A token carries its start point, a numbered cursor finds it in the cursor cache
+Status Redis::GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern,
+                                const std::string& cursor, std::string* start_point) {
+  std::string scope = ScanCursorScope(type, key, pattern);
+  char cursor_type = 0;
+  std::string_view pattern_view(pattern.data(), pattern.size());
+  if (ScanCursor::Decode(storage_->GetScanCursorSecret(), cursor, scope, pattern_view, &cursor_type, start_point)) {
+    return Status::OK();
+  }
+  int64_t number = 0;
+  if (!ScanCursor::ParseNumbered(cursor, &number)) {
+    return Status::NotFound();
+  }
+  return scan_cursors_store_->Lookup(scope + std::to_string(number), start_point);
+}
+
+std::string Redis::StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
+                                      bool stateless, const std::string& next_point) {
+  std::string scope = ScanCursorScope(type, key, pattern);
+  if (stateless) {
+    std::string_view pattern_view(pattern.data(), pattern.size());
+    return ScanCursor::Encode(storage_->GetScanCursorSecret(), DataTypeTag[type], scope, pattern_view, next_point);
+  }
+  scan_cursors_store_->Insert(scope + std::to_string(cursor), next_point);
+  return std::to_string(cursor);
 }
 
 Status Redis::SetMaxCacheStatisticKeys(size_t max_cache_statistic_keys) {
@@ -230,9 +398,91 @@ Status Redis::CompactRange(const rocksdb::Slice* begin, const rocksdb::Slice* en
   db_->CompactRange(default_compact_range_options_, handles_[kListsDataCF], begin, end);
   db_->CompactRange(default_compact_range_options_, handles_[kZsetsDataCF], begin, end);
   db_->CompactRange(default_compact_range_options_, handles_[kZsetsScoreCF], begin, end);
+  // the expire index is ordered by etime, only a full compaction covers it
+  if (begin == nullptr && end == nullptr) {
+    db_->CompactRange(default_compact_range_options_, handles_[kExpireIndexCF], begin, end);
+  }
   return Status::OK();
 }
 
+// The data keys of one version sort together in every data cf. The bytewise cfs hold
+// the little endian version, so the range ends at the successor of the version prefix,
+// the lists and zset score comparators order versions numerically, so the range ends
+// at the smallest key of the next version.
+void Redis::GetDataRanges(DataType type, const Slice& key, uint64_t version, std::vector<DataRange>* ranges) {
+  if (type == DataType::kLists) {
+    ListsDataKey begin_key(key, version, 0);
+    ListsDataKey end_key(key, version + 1, 0);
+    ranges->push_back({kListsDataCF, begin_key.Encode().ToString(), end_key.Encode().ToString()});
+    return;
+  }
+
+  ColumnFamilyIndex cf_idx;
+  if (type == DataType::kHashes) {
+    cf_idx = kHashesDataCF;
+  } else if (type == DataType::kSets) {
+    cf_idx = kSetsDataCF;
+  } else if (type == DataType::kZSets) {
+    cf_idx = kZsetsDataCF;
+  } else {
+    return;
+  }
+  BaseDataKey prefix_key(key, version, Slice());
+  std::string begin = prefix_key.EncodeSeekKey().ToString();
+  std::string end = begin;
+  while (!end.empty() && static_cast<uint8_t>(end.back()) == 0xff) {
+    end.pop_back();
+  }
+  if (end.empty()) {
+    return;
+  }
+  end.back() = static_cast<char>(static_cast<uint8_t>(end.back()) + 1);
+  ranges->push_back({cf_idx, std::move(begin), std::move(end)});
+
+  if (type == DataType::kZSets) {
+    double min_score = -std::numeric_limits<double>::infinity();
+    ZSetsScoreKey begin_score_key(key, version, min_score, Slice());
+    ZSetsScoreKey end_score_key(key, version + 1, min_score, Slice());
+    ranges->push_back({kZsetsScoreCF, begin_score_key.Encode().ToString(), end_score_key.Encode().ToString()});
+  }
+}
+
+// Below this many members the data keys of a deleted collection get point deletes, a range
+// tombstone costs every read and compaction over its range more than a few point deletes
+static const uint64_t kDataRangeDeleteMinCount = 64;
+
+void Redis::DeleteDataRange(Batch* batch, DataType type, const Slice& key, uint64_t version, uint64_t count) {
+  std::vector<DataRange> ranges;
+  GetDataRanges(type, key, version, &ranges);
+  for (const auto& range : ranges) {
+    if (count >= kDataRangeDeleteMinCount) {
+      batch->DeleteRange(range.cf_idx, range.begin, range.end);
+      continue;
+    }
+    rocksdb::ReadOptions read_options;
+    Slice upper_bound(range.end);
+    read_options.iterate_upper_bound = &upper_bound;
+    read_options.fill_cache = false;
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[range.cf_idx]));
+    uint64_t deleted = 0;
+    for (iter->Seek(range.begin); iter->Valid(); iter->Next()) {
+      // the count is only a hint, a range holding more keys than that still gets one tombstone
+      if (++deleted > kDataRangeDeleteMinCount) {
+        batch->DeleteRange(range.cf_idx, range.begin, range.end);
+        break;
+      }
+      batch->Delete(range.cf_idx, iter->key());
+    }
+  }
+}
+
+void Redis::DeleteBitmapFragments(Batch* batch, const Slice& key, const std::string& meta_value) {
+  BitmapFragmentsMeta bitmap_meta;
+  if (bitmap_meta.DecodeStringsValue(meta_value)) {
+    DeleteDataRange(batch, DataType::kHashes, key, bitmap_meta.Version(), bitmap_meta.FragmentNum());
+  }
+}
+
 Status Redis::SetSmallCompactionThreshold(uint64_t small_compaction_threshold) {
   small_compaction_threshold_ = small_compaction_threshold;
   return Status::OK();
@@ -307,7 +557,7 @@ void Redis::GetRocksDBInfo(std::string& info, const char* prefix) {
                 << "\r\n";
 
   auto write_stream_key_value = [&](const Slice& property, const char* metric) {
-    uint64_t value;
+    uint64_t value = 0;
     db_->GetAggregatedIntProperty(property, &value);
     string_stream << prefix << metric << ':' << value << "\r\n";
   };
@@ -368,9 +618,9 @@ void Redis::GetRocksDBInfo(std::string& info, const char* prefix) {
 
   // blob files
   write_stream_key_value(rocksdb::DB::Properties::kNumBlobFiles, "num_blob_files");
-  write_stream_key_value(rocksdb::DB::Properties::kBlobStats, "blob_stats");
   write_stream_key_value(rocksdb::DB::Properties::kTotalBlobFileSize, "total_blob_file_size");
   write_stream_key_value(rocksdb::DB::Properties::kLiveBlobFileSize, "live_blob_file_size");
+  write_stream_key_value(rocksdb::DB::Properties::kLiveBlobFileGarbageSize, "live_blob_file_garbage_size");
 
   // column family stats
   std::map<std::string, std::string> mapvalues;
@@ -379,6 +629,59 @@ void Redis::GetRocksDBInfo(std::string& info, const char* prefix) {
   info.append(string_stream.str());
 }
 
+// Compares the raw size of the keys and values in the sst files of each column family
+// with the size of their data blocks, overall and at every level holding files.
+void Redis::GetCompressionInfo(std::string& info, const char* prefix) {
+  std::ostringstream string_stream;
+  string_stream << "#" << prefix << "Compression"
+                << "\r\n";
+  string_stream << std::fixed << std::setprecision(2);
+
+  auto get_uint64 = [](const std::map<std::string, std::string>& properties, const std::string& name) -> uint64_t {
+    auto iter = properties.find(name);
+    return iter == properties.end() ? 0 : std::strtoull(iter->second.c_str(), nullptr, 10);
+  };
+
+  for (auto* handle : handles_) {
+    std::map<std::string, std::string> properties;
+    if (!db_->GetMapProperty(handle, rocksdb::DB::Properties::kAggregatedTableProperties, &properties)) {
+      continue;
+    }
+    const std::string& cf_name = handle->GetName();
+    uint64_t raw_size = get_uint64(properties, "raw_key_size") + get_uint64(properties, "raw_value_size");
+    uint64_t data_size = get_uint64(properties, "data_size");
+    string_stream << prefix << cf_name << "_raw_bytes:" << raw_size << "\r\n";
+    string_stream << prefix << cf_name << "_data_bytes:" << data_size << "\r\n";
+    string_stream << prefix << cf_name
+                  << "_compression_ratio:" << (data_size == 0 ? 0.0 : static_cast<double>(raw_size) / data_size)
+                  << "\r\n";
+
+    for (int level = 0; level < db_->NumberLevels(handle); ++level) {
+      std::string ratio;
+      if (!db_->GetProperty(handle, rocksdb::DB::Properties::kCompressionRatioAtLevelPrefix + std::to_string(level),
+                            &ratio) ||
+          std::strtod(ratio.c_str(), nullptr) < 0) {
+        // no file at the level
+        continue;
+      }
+      string_stream << prefix << cf_name << "_compression_ratio_level" << level << ':'
+                    << std::strtod(ratio.c_str(), nullptr) << "\r\n";
+    }
+  }
+  info.append(string_stream.str());
+}
+
+void Redis::GetIOStats(DataPathIOStats* stats) const {
+  if (!db_statistics_) {
+    return;
+  }
+  stats->read_bytes += db_statistics_->getTickerCount(rocksdb::LAST_LEVEL_READ_BYTES) +
+                       db_statistics_->getTickerCount(rocksdb::NON_LAST_LEVEL_READ_BYTES);
+  stats->wal_bytes += db_statistics_->getTickerCount(rocksdb::WAL_FILE_BYTES);
+  stats->flush_bytes += db_statistics_->getTickerCount(rocksdb::FLUSH_WRITE_BYTES);
+  stats->compaction_bytes += db_statistics_->getTickerCount(rocksdb::COMPACT_WRITE_BYTES);
+}
+
 void Redis::SetWriteWalOptions(const bool is_wal_disable) { default_write_options_.disableWAL = is_wal_disable; }
 
 Status Redis::GetProperty(const std::string& property, uint64_t* out) {
@@ -388,6 +691,56 @@ Status Redis::GetProperty(const std::string& property, uint64_t* out) {
   return Status::OK();
 }
 
+void Redis::MultiGetMeta(const std::vector<Slice>& keys, std::vector<std::string>* values,
+                         std::vector<Status>* statuses) {
+  std::vector<std::string> encoded_keys;
+  encoded_keys.reserve(keys.size());
+  for (const auto& key : keys) {
+    BaseMetaKey base_meta_key(key);
+    encoded_keys.push_back(base_meta_key.Encode().ToString());
+  }
+  rocksdb::ReadOptions read_options(default_read_options_);
+  read_options.async_io = async_io_;
+  read_options.optimize_multiget_for_io = async_io_;
+  MultiGetSorted(read_options, kMetaCF, encoded_keys, values, statuses);
+}
+
+void Redis::MultiGetSorted(const rocksdb::ReadOptions& read_options, ColumnFamilyIndex cf_index,
+                           const std::vector<std::string>& encoded_keys, std::vector<std::string>* values,
+                           std::vector<Status>* statuses) {
+  size_t num = encoded_keys.size();
+  values->assign(num, std::string());
+  statuses->assign(num, Status::OK());
+  if (num == 0) {
+    return;
+  }
+
+  // MultiGet skips sorting the keys itself when they come in comparator order, every
+  // column family looked up here uses the bytewise comparator
+  std::vector<size_t> order(num);
+  for (size_t i = 0; i < num; ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&encoded_keys](size_t lhs, size_t rhs) { return encoded_keys[lhs] < encoded_keys[rhs]; });
+  std::vector<Slice> sorted_keys;
+  sorted_keys.reserve(num);
+  for (auto idx : order) {
+    sorted_keys.emplace_back(encoded_keys[idx]);
+  }
+  std::vector<rocksdb::PinnableSlice> pinnable_values(num);
+  std::vector<Status> sorted_statuses(num);
+  db_->MultiGet(read_options, handles_[cf_index], num, sorted_keys.data(), pinnable_values.data(),
+                sorted_statuses.data(), true);
+
+  for (size_t i = 0; i < num; ++i) {
+    (*statuses)[order[i]] = sorted_statuses[i];
+    if (sorted_statuses[i].ok()) {
+      (*values)[order[i]].assign(pinnable_values[i].data(), pinnable_values[i].size());
+    }
+  }
+}
+
 Status Redis::ScanKeyNum(std::vector<KeyInfo>* key_infos) {
   key_infos->resize(5);
   rocksdb::Status s;
@@ -415,6 +768,130 @@ Status Redis::ScanKeyNum(std::vector<KeyInfo>* key_infos) {
   return Status::OK();
 }
 
+// the key counts are recounted twice a day
+static const int64_t kKeyRecountIntervalSeconds = 12 * 3600;
+// a recount looks at its exit flag every that many meta keys
+static const uint64_t kKeyRecountCheckKeys = 4096;
+
+Status Redis::LoadKeyCounts() {
+  auto env = rocksdb::Env::Default();
+  KeyCounts counts;
+  bool valid = false;
+  if (env->FileExists(key_counts_path_).ok()) {
+    std::string content;
+    Status s = rocksdb::ReadFileToString(env, key_counts_path_, &content);
+    if (!s.ok()) {
+      return s;
+    }
+    // a crash after the counts were saved replays writes they don't hold
+    std::istringstream in(content);
+    uint64_t sequence = 0;
+    std::string counts_value;
+    if (in >> sequence && std::getline(in, counts_value) && counts.Decode(counts_value)) {
+      valid = sequence == db_->GetLatestSequenceNumber();
+    } else {
+      counts = KeyCounts();
+    }
+  }
+  // until the recount is done, the counts are the ones saved before plus the writes since then
+  key_count_db_->SetKeyCounts(counts);
+  key_counts_exact_ = valid;
+  key_recount_thread_ = std::thread(&Redis::RunKeyRecount, this, !valid);
+  return Status::OK();
+}
+
+void Redis::RunKeyRecount(bool recount_now) {
+  while (true) {
+    if (recount_now && !RecountKeys()) {
+      return;
+    }
+    recount_now = true;
+    std::unique_lock<std::mutex> lock(key_recount_mutex_);
+    if (key_recount_cond_.wait_for(lock, std::chrono::seconds(kKeyRecountIntervalSeconds),
+                                   [this]() { return key_recount_exit_; })) {
+      return;
+    }
+  }
+}
+
+void Redis::StopKeyRecount() {
+  {
+    std::lock_guard<std::mutex> lock(key_recount_mutex_);
+    key_recount_exit_ = true;
+  }
+  key_recount_cond_.notify_all();
+  if (key_recount_thread_.joinable()) {
+    key_recount_thread_.join();
+  }
+}
+
+bool Redis::RecountKeys() {
+  auto env = rocksdb::Env::Default();
+  auto start_micros = env->NowMicros();
+  const rocksdb::Snapshot* snapshot = key_count_db_->BeginRecount();
+  rocksdb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  read_options.snapshot = snapshot;
+  KeyCounts counts;
+  uint64_t scanned = 0;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kMetaCF]));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    counts.Add(iter->value());
+    if (++scanned % kKeyRecountCheckKeys == 0) {
+      std::lock_guard<std::mutex> lock(key_recount_mutex_);
+      if (key_recount_exit_) {
+        break;
+      }
+    }
+  }
+  bool done = !iter->Valid() && iter->status().ok();
+  if (!iter->status().ok()) {
+    WARN("RocksDB{} recount its keys failed: {}", index_, iter->status().ToString());
+  }
+  iter.reset();
+  key_count_db_->EndRecount(snapshot, done ? &counts : nullptr);
+  if (done) {
+    key_counts_exact_ = true;
+    INFO("RocksDB{} recounted its keys in {} ms", index_, (env->NowMicros() - start_micros) / 1000);
+  }
+  std::lock_guard<std::mutex> lock(key_recount_mutex_);
+  return !key_recount_exit_;
+}
+
+void Redis::SaveKeyCounts() {
+  auto env = rocksdb::Env::Default();
+  std::string content = std::to_string(db_->GetLatestSequenceNumber()) + " " +
+                        key_count_db_->GetKeyCounts().Encode() + "\n";
+  Status s = rocksdb::WriteStringToFile(env, content, key_counts_path_ + ".tmp", true);
+  if (s.ok()) {
+    s = env->RenameFile(key_counts_path_ + ".tmp", key_counts_path_);
+  }
+  if (!s.ok()) {
+    WARN("RocksDB{} save the key counts to {} failed: {}", index_, key_counts_path_, s.ToString());
+  }
+}
+
+Status Redis::GetApproximateKeyNum(std::vector<KeyInfo>* key_infos) {
+  int64_t now = 0;
+  rocksdb::Env::Default()->GetCurrentTime(&now);
+  KeyCounts counts = key_count_db_->GetKeyCounts();
+
+  // in the order of ScanKeyNum()
+  key_infos->clear();
+  for (auto type : {DataType::kStrings, DataType::kHashes, DataType::kLists, DataType::kZSets, DataType::kSets}) {
+    const auto& count = counts.types[static_cast<size_t>(type)];
+    KeyInfo info;
+    info.keys = static_cast<uint64_t>(std::max<int64_t>(count.keys, 0));
+    info.expires = static_cast<uint64_t>(std::max<int64_t>(count.expires, 0));
+    info.invalid_keys = static_cast<uint64_t>(std::max<int64_t>(count.invalid_keys, 0));
+    if (count.expires > 0) {
+      info.avg_ttl = static_cast<uint64_t>(std::max<int64_t>(count.etime_sum / count.expires - now, 0));
+    }
+    key_infos->push_back(info);
+  }
+  return Status::OK();
+}
+
 void Redis::ScanDatabase() {
   ScanStrings();
   ScanHashes();
@@ -423,4 +900,418 @@ void Redis::ScanDatabase() {
   ScanSets();
 }
 
+Status Redis::NewMemberIterator(DataType type, const Slice& key, std::unique_ptr<MemberIterator>* iter) {
+  ColumnFamilyIndex cf_index;
+  switch (type) {
+    case DataType::kHashes:
+      cf_index = kHashesDataCF;
+      break;
+    case DataType::kSets:
+      cf_index = kSetsDataCF;
+      break;
+    case DataType::kZSets:
+      cf_index = kZsetsDataCF;
+      break;
+    default:
+      return Status::NotSupported("member iterator of type " + std::string(DataTypeToString(type)));
+  }
+
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot = db_->GetSnapshot();
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  BaseMetaKey base_meta_key(key);
+  Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+  if (s.ok()) {
+    if (IsStale(meta_value)) {
+      s = Status::NotFound();
+    } else if (!ExpectedMetaValue(type, meta_value)) {
+      s = Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
+                                              DataTypeStrings[static_cast<int>(type)],
+                                              DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
+    } else {
+      ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
+      BaseDataKey base_data_key(key, parsed_base_meta_value.Version(), Slice());
+      // the iterator owns the snapshot from here on
+      *iter = std::make_unique<MemberIterator>(db_, handles_[cf_index], snapshot,
+                                               base_data_key.EncodeSeekKey().ToString(),
+                                               parsed_base_meta_value.Count());
+      return s;
+    }
+  }
+  db_->ReleaseSnapshot(snapshot);
+  return s;
+}
+
+std::unique_ptr<Redis::MembersStoreWriter> Redis::NewMembersStoreWriter(DataType type, const Slice& destination) {
+  return std::make_unique<MembersStoreWriter>(this, type, destination);
+}
+
+MemberIterator::MemberIterator(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const rocksdb::Snapshot* snapshot,
+                               std::string prefix, int32_t count)
+    : db_(db), snapshot_(snapshot), prefix_(std::move(prefix)), count_(count) {
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot_;
+  iter_.reset(db_->NewIterator(read_options, handle));
+  iter_->Seek(prefix_);
+}
+
+MemberIterator::~MemberIterator() {
+  iter_.reset();
+  db_->ReleaseSnapshot(snapshot_);
+}
+
+Slice MemberIterator::member() const {
+  Slice key = iter_->key();
+  return Slice(key.data() + prefix_.size(), key.size() - prefix_.size() - kSuffixReserveLength);
+}
+
+void MemberIterator::SeekAtLeast(const Slice& target) {
+  if (!Valid() || member().compare(target) >= 0) {
+    return;
+  }
+  seek_key_.assign(prefix_);
+  seek_key_.append(target.data(), target.size());
+  iter_->Seek(seek_key_);
+  // a member that target extends with zero bytes sorts after the seek key
+  // because of the reserved suffix, step over such members
+  while (Valid() && member().compare(target) < 0) {
+    iter_->Next();
+  }
+}
+
+Status Redis::GetReaderMeta(const Slice& key, DataType type, const rocksdb::Snapshot** snapshot,
+                            std::string* meta_value) {
+  rocksdb::ReadOptions read_options;
+  *snapshot = db_->GetSnapshot();
+  read_options.snapshot = *snapshot;
+
+  BaseMetaKey base_meta_key(key);
+  Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  if (s.ok()) {
+    if (IsStale(*meta_value)) {
+      s = Status::NotFound("Stale");
+    } else if (!ExpectedMetaValue(type, *meta_value)) {
+      s = Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
+                                              DataTypeStrings[static_cast<int>(type)],
+                                              DataTypeStrings[static_cast<int>(GetMetaValueType(*meta_value))]));
+    }
+  }
+  if (!s.ok()) {
+    db_->ReleaseSnapshot(*snapshot);
+    *snapshot = nullptr;
+  }
+  return s;
+}
+
+Redis::CollectionReader::CollectionReader(Redis* redis, const rocksdb::Snapshot* snapshot, DataType type,
+                                          const Slice& key, int cf, uint64_t count, ReadFunction read_fn)
+    : redis_(redis),
+      db_(redis->db_),
+      open_readers_(redis->open_readers_),
+      snapshot_(snapshot),
+      type_(type),
+      key_(key.ToString()),
+      count_(count),
+      read_fn_(std::move(read_fn)) {
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot_;
+  iter_.reset(db_->NewIterator(read_options, redis->handles_[cf]));
+  std::lock_guard<std::mutex> lock(open_readers_->mutex);
+  open_readers_->readers.insert(this);
+}
+
+Redis::CollectionReader::~CollectionReader() {
+  std::lock_guard<std::mutex> lock(open_readers_->mutex);
+  if (!abandoned_) {
+    Abandon();
+    open_readers_->readers.erase(this);
+  }
+}
+
+void Redis::CollectionReader::Abandon() {
+  iter_.reset();
+  db_->ReleaseSnapshot(snapshot_);
+  snapshot_ = nullptr;
+  abandoned_ = true;
+}
+
+Status Redis::CollectionReader::Read(ElementSink* sink, size_t max_bytes) {
+  // the instance only closes under the exclusive lock of its db, which no read holds
+  if (abandoned_) {
+    return Status::Aborted("the storage of the reader was closed");
+  }
+  if (!begun_) {
+    begun_ = true;
+    done_ = count_ == 0;
+    Status s = sink->Begin(count_);
+    if (!s.ok() || done_) {
+      return s;
+    }
+  }
+  if (done_) {
+    return Status::OK();
+  }
+  KeyStatisticsDurationGuard guard(redis_, type_, key_);
+  return read_fn_(iter_.get(), sink, max_bytes, &done_);
+}
+
+Status Redis::CollectKeys(const rocksdb::Snapshot* snapshot, const std::function<bool(const std::string&)>& filter,
+                          std::vector<std::string>* keys) {
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  read_options.fill_cache = false;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kMetaCF]));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    std::string meta_key = iter->key().ToString();
+    ParsedBaseMetaKey parsed_meta_key(&meta_key);
+    std::string key = parsed_meta_key.Key().ToString();
+    if (filter(key)) {
+      keys->push_back(std::move(key));
+    }
+  }
+  return iter->status();
+}
+
+// Entries are written to the destination every kCopyKeyBatchSize puts while a key is copied
+static const int kCopyKeyBatchSize = 1024;
+
+Status Redis::CopyKeyTo(const rocksdb::Snapshot* snapshot, const std::string& key, Redis* dst) {
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  read_options.fill_cache = false;
+  BaseMetaKey base_meta_key(key);
+  std::string meta_value;
+  Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+  if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  }
+  bool exists = s.ok();
+  // an older copy may hold members that are gone by now
+  s = dst->PurgeKey(key);
+  if (!s.ok() || !exists) {
+    return s;
+  }
+
+  rocksdb::WriteBatch batch;
+  batch.Put(dst->handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  if (uint64_t etime = MetaValueEtime(meta_value); etime != 0) {
+    batch.Put(dst->handles_[kExpireIndexCF], ExpireIndexKey(etime, key).Encode(), Slice());
+  }
+
+  std::vector<DataRange> ranges;
+  auto type = GetMetaValueType(meta_value);
+  if (type == DataType::kLists) {
+    GetDataRanges(type, key, ParsedListsMetaValue(&meta_value).Version(), &ranges);
+  } else if (type == DataType::kHashes || type == DataType::kSets || type == DataType::kZSets) {
+    GetDataRanges(type, key, ParsedBaseMetaValue(&meta_value).Version(), &ranges);
+  } else if (BitmapFragmentsMeta bitmap_meta; bitmap_meta.DecodeStringsValue(meta_value)) {
+    GetDataRanges(DataType::kHashes, key, bitmap_meta.Version(), &ranges);
+  }
+  for (const auto& range : ranges) {
+    Slice lower_bound(range.begin);
+    Slice upper_bound(range.end);
+    read_options.iterate_lower_bound = &lower_bound;
+    read_options.iterate_upper_bound = &upper_bound;
+    read_options.total_order_seek = true;
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[range.cf_idx]));
+    for (iter->Seek(lower_bound); iter->Valid(); iter->Next()) {
+      batch.Put(dst->handles_[range.cf_idx], iter->key(), iter->value());
+      if (batch.Count() >= kCopyKeyBatchSize) {
+        s = dst->db_->Write(dst->default_write_options_, &batch);
+        if (!s.ok()) {
+          return s;
+        }
+        batch.Clear();
+      }
+    }
+    if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+  return dst->db_->Write(dst->default_write_options_, &batch);
+}
+
+Status Redis::PurgeKey(const std::string& key) {
+  BaseMetaKey base_meta_key(key);
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+  if (s.IsNotFound()) {
+    return Status::OK();
+  } else if (!s.ok()) {
+    return s;
+  }
+
+  auto batch = Batch::CreateBatch(this);
+  batch->Delete(kMetaCF, base_meta_key.Encode());
+  if (uint64_t etime = MetaValueEtime(meta_value); etime != 0) {
+    batch->Delete(kExpireIndexCF, ExpireIndexKey(etime, key).Encode());
+  }
+  auto type = GetMetaValueType(meta_value);
+  if (type == DataType::kLists) {
+    ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+    DeleteDataRange(batch.get(), type, key, parsed_lists_meta_value.Version(), parsed_lists_meta_value.Count());
+  } else if (type == DataType::kHashes || type == DataType::kSets || type == DataType::kZSets) {
+    ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
+    DeleteDataRange(batch.get(), type, key, parsed_base_meta_value.Version(), parsed_base_meta_value.Count());
+  } else {
+    DeleteBitmapFragments(batch.get(), key, meta_value);
+  }
+  return batch->Commit();
+}
+
+// Members are committed every kMembersStoreBatchSize writes while a key is stored
+static const int32_t kMembersStoreBatchSize = 1024;
+
+Redis::MembersStoreWriter::MembersStoreWriter(Redis* redis, DataType type, const Slice& destination)
+    : redis_(redis),
+      type_(type),
+      key_(destination.ToString()),
+      meta_key_(BaseMetaKey(destination).Encode().ToString()),
+      lock_(redis->lock_mgr_, key_) {}
+
+// A store that did not reach Finish drops the members it already committed
+Redis::MembersStoreWriter::~MembersStoreWriter() {
+  if (committed_ && !finished_) {
+    auto batch = Batch::CreateBatch(redis_);
+    redis_->DeleteDataRange(batch.get(), type_, key_, version_, count_);
+    Status s = batch->Commit();
+    if (!s.ok()) {
+      WARN("drop unfinished store of key {} failed: {}", key_, s.ToString());
+    }
+  }
+  if (started_) {
+    redis_->pending_versions_.Remove(meta_key_, version_);
+  }
+}
+
+Status Redis::MembersStoreWriter::Start() {
+  started_ = true;
+  BaseMetaKey base_meta_key(key_);
+  Status s = redis_->db_->Get(redis_->default_read_options_, redis_->handles_[kMetaCF], base_meta_key.Encode(),
+                              &old_meta_value_);
+  if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  }
+  if (s.IsNotFound()) {
+    old_meta_value_.clear();
+  } else if (!redis_->IsStale(old_meta_value_)) {
+    old_type_ = redis_->GetMetaValueType(old_meta_value_);
+    if (old_type_ == DataType::kHashes || old_type_ == DataType::kSets || old_type_ == DataType::kZSets) {
+      ParsedBaseMetaValue parsed_base_meta_value(&old_meta_value_);
+      old_count_ = parsed_base_meta_value.Count();
+    } else if (old_type_ == DataType::kLists) {
+      ParsedListsMetaValue parsed_lists_meta_value(&old_meta_value_);
+      old_count_ = parsed_lists_meta_value.Count();
+    }
+  }
+
+  // the members go under a version newer than the one of the old value, the meta
+  // is only switched to it by Finish
+  bool same_type = s.ok() && redis_->ExpectedMetaValue(type_, old_meta_value_);
+  if (same_type) {
+    meta_value_ = old_meta_value_;
+    ParsedBaseMetaValue parsed_base_meta_value(&meta_value_);
+    version_ = parsed_base_meta_value.InitialMetaValue();
+  } else {
+    char str[4];
+    EncodeFixed32(str, 0);
+    BaseMetaValue base_meta_value(type_, Slice(str, 4));
+    version_ = base_meta_value.UpdateVersion();
+    meta_value_ = base_meta_value.Encode().ToString();
+  }
+  batch_ = Batch::CreateBatch(redis_);
+  // the meta does not point at the members committed before Finish, the compaction
+  // keeps them while their version is pending
+  redis_->pending_versions_.Add(meta_key_, version_);
+  return Status::OK();
+}
+
+Status Redis::MembersStoreWriter::Add(const Slice& member) {
+  if (!started_) {
+    Status s = Start();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  SetsMemberKey sets_member_key(key_, version_, member);
+  BaseDataValue i_val(Slice{});
+  batch_->Put(kSetsDataCF, sets_member_key.Encode(), i_val.Encode());
+  return Added();
+}
+
+Status Redis::MembersStoreWriter::Add(const Slice& member, double score) {
+  if (!started_) {
+    Status s = Start();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  char score_buf[8];
+  const void* ptr_score = reinterpret_cast<const void*>(&score);
+  EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
+  ZSetsMemberKey zsets_member_key(key_, version_, member);
+  BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)));
+  batch_->Put(kZsetsDataCF, zsets_member_key.Encode(), zsets_member_i_val.Encode());
+
+  ZSetsScoreKey zsets_score_key(key_, version_, score, member);
+  BaseDataValue zsets_score_i_val(Slice{});
+  batch_->Put(kZsetsScoreCF, zsets_score_key.Encode(), zsets_score_i_val.Encode());
+  return Added();
+}
+
+Status Redis::MembersStoreWriter::Added() {
+  if (++count_ > INT32_MAX) {
+    return Status::InvalidArgument("member count overflow");
+  }
+  if (batch_->Count() < kMembersStoreBatchSize) {
+    return Status::OK();
+  }
+  committed_ = true;
+  Status s = batch_->Commit();
+  batch_ = Batch::CreateBatch(redis_);
+  return s;
+}
+
+Status Redis::MembersStoreWriter::Finish(int32_t* ret) {
+  *ret = 0;
+  if (!started_) {
+    Status s = Start();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  // the last batch publishes the new members and drops the data of the old value
+  if (!old_meta_value_.empty()) {
+    DataType replaced_type = redis_->GetMetaValueType(old_meta_value_);
+    if (replaced_type == DataType::kLists) {
+      ParsedListsMetaValue parsed_lists_meta_value(&old_meta_value_);
+      redis_->DeleteDataRange(batch_.get(), replaced_type, key_, parsed_lists_meta_value.Version(),
+                              parsed_lists_meta_value.Count());
+    } else if (replaced_type == DataType::kStrings) {
+      redis_->DeleteBitmapFragments(batch_.get(), key_, old_meta_value_);
+    } else {
+      ParsedBaseMetaValue parsed_base_meta_value(&old_meta_value_);
+      redis_->DeleteDataRange(batch_.get(), replaced_type, key_, parsed_base_meta_value.Version(),
+                              parsed_base_meta_value.Count());
+    }
+  }
+  ParsedBaseMetaValue parsed_base_meta_value(&meta_value_);
+  parsed_base_meta_value.SetCount(static_cast<int32_t>(count_));
+  BaseMetaKey base_meta_key(key_);
+  batch_->Put(kMetaCF, base_meta_key.Encode(), meta_value_);
+  committed_ = true;
+  Status s = batch_->Commit();
+  if (!s.ok()) {
+    return s;
+  }
+  finished_ = true;
+  if (old_count_ != 0) {
+    redis_->UpdateSpecificKeyStatistics(old_type_, key_, old_count_);
+  }
+  *ret = static_cast<int32_t>(count_);
+  return s;
+}
+
 }  // namespace storage
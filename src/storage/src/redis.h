@@ -6,22 +6,32 @@
 #ifndef SRC_REDIS_H_
 #define SRC_REDIS_H_
 
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "rocksdb/db.h"
 #include "rocksdb/slice.h"
+#include "rocksdb/statistics.h"
 #include "rocksdb/status.h"
 
 #include "log_index.h"
 #include "pstd/env.h"
 #include "pstd/log.h"
+#include "src/base_filter.h"
+#include "src/bitmap_fragment_format.h"
 #include "src/custom_comparator.h"
 #include "src/debug.h"
+#include "src/key_count_db.h"
 #include "src/lock_mgr.h"
 #include "src/lru_cache.h"
 #include "src/mutex_impl.h"
+#include "src/scope_record_lock.h"
 #include "src/type_iterator.h"
 #include "storage/storage.h"
 #include "storage/storage_define.h"
@@ -33,6 +43,9 @@ namespace storage {
 using Status = rocksdb::Status;
 using Slice = rocksdb::Slice;
 
+class Batch;
+class MemberIterator;
+
 class Redis {
  public:
   Redis(Storage* storage, int32_t index);
@@ -93,6 +106,7 @@ class Redis {
   };
 
   int GetIndex() const { return index_; }
+  std::shared_ptr<LockMgr> GetLockMgr() const { return lock_mgr_; }
 
   Status SetOptions(const OptionType& option_type, const std::unordered_map<std::string, std::string>& options);
   void SetWriteWalOptions(const bool is_wal_disable);
@@ -114,6 +128,9 @@ class Redis {
   void StartingPhaseEnd() { is_starting_ = false; }
 
   Status ScanKeyNum(std::vector<KeyInfo>* key_info);
+  // The key counts of ScanKeyNum() taken from the table properties of the meta cf and its
+  // memtables, keys rewritten since the last flush or not compacted yet count twice
+  Status GetApproximateKeyNum(std::vector<KeyInfo>* key_infos);
   Status ScanStringsKeyNum(KeyInfo* key_info);
   Status ScanHashesKeyNum(KeyInfo* key_info);
   Status ScanListsKeyNum(KeyInfo* key_info);
@@ -148,7 +165,11 @@ class Redis {
   Status GetSet(const Slice& key, const Slice& value, std::string* old_value);
   Status Incrby(const Slice& key, int64_t value, int64_t* ret);
   Status Incrbyfloat(const Slice& key, const Slice& value, std::string* ret);
+  Status MGet(const std::vector<Slice>& keys, std::vector<ValueStatus>* vss);
+  Status MGetWithTTL(const std::vector<Slice>& keys, std::vector<ValueStatus>* vss);
   Status MSet(const std::vector<KeyValue>& kvs);
+  // Same as MSet, the caller already holds the record locks of all the keys
+  Status MSetLocked(const std::vector<KeyValue>& kvs);
   Status MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret);
   Status Set(const Slice& key, const Slice& value);
   Status Setxx(const Slice& key, const Slice& value, int32_t* ret, int64_t ttl = 0);
@@ -165,11 +186,23 @@ class Redis {
   Status BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_t end_offset, int64_t* ret);
   Status PKSetexAt(const Slice& key, const Slice& value, uint64_t timestamp);
 
+  // Bitmaps stored in fragments, see bitmap_fragment_format.h
+  class BitmapReader;
+  class BitmapWriter;
+  // Opens a reader of the bytes of the string at key, a missing key reads as an empty bitmap
+  Status NewBitmapReader(const Slice& key, std::unique_ptr<BitmapReader>* reader);
+  std::unique_ptr<BitmapWriter> NewBitmapWriter(const Slice& destination);
+
   Status Exists(const Slice& key);
+  Status Exists(const std::vector<Slice>& keys, int64_t* count);
   Status Del(const Slice& key);
+  Status Del(const std::vector<std::string>& keys, int64_t* count);
   Status Expire(const Slice& key, int64_t timestamp);
   Status Expireat(const Slice& key, int64_t timestamp);
   Status Persist(const Slice& key);
+  // Deletes up to limit keys whose etime in the expire index is before now, through the
+  // same write path as DEL. Index entries that no longer match their key are removed too.
+  Status ActiveExpireCycle(uint64_t now, size_t limit, size_t* expired);
   Status TTL(const Slice& key, int64_t* timestamp);
   Status PKPatternMatchDel(const std::string& pattern, int32_t* ret);
   Status Rename(const std::string& key, const std::string& newkey);
@@ -178,11 +211,30 @@ class Redis {
   Status GetType(const Slice& key, enum DataType& type);
   Status IsExist(const Slice& key);
 
+  // Opens an iterator over the members of the set or zset (the fields of the hash) stored
+  // at key, they are visited in bytewise order on a snapshot taken when the iterator is opened
+  Status NewMemberIterator(DataType type, const Slice& key, std::unique_ptr<MemberIterator>* iter);
+  class MembersStoreWriter;
+  std::unique_ptr<MembersStoreWriter> NewMembersStoreWriter(DataType type, const Slice& destination);
+  // The ElementReader of HGetall, SMembers, LRange and ZRange
+  class CollectionReader;
+
+  // Slot migration, see Storage::MigrateSlots.
+  // Collects the keys of the meta cf that filter accepts, as of snapshot (the latest state if null).
+  Status CollectKeys(const rocksdb::Snapshot* snapshot, const std::function<bool(const std::string&)>& filter,
+                     std::vector<std::string>* keys);
+  // Copies the meta, data and expire index entries of key as of snapshot into dst, replacing what
+  // dst holds for key. The entries are written in batches, so dst must not serve key meanwhile.
+  Status CopyKeyTo(const rocksdb::Snapshot* snapshot, const std::string& key, Redis* dst);
+  // Deletes the meta, data and expire index entries of key, whether it is stale or not.
+  Status PurgeKey(const std::string& key);
+
   // Hash Commands
   Status HDel(const Slice& key, const std::vector<std::string>& fields, int32_t* ret);
   Status HExists(const Slice& key, const Slice& field);
   Status HGet(const Slice& key, const Slice& field, std::string* value);
   Status HGetall(const Slice& key, std::vector<FieldValue>* fvs);
+  Status HGetall(const Slice& key, std::unique_ptr<ElementReader>* reader);
   Status HGetallWithTTL(const Slice& key, std::vector<FieldValue>* fvs, int64_t* ttl);
   Status HIncrby(const Slice& key, const Slice& field, int64_t value, int64_t* ret);
   Status HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by, std::string* new_value);
@@ -194,8 +246,9 @@ class Redis {
   Status HSetnx(const Slice& key, const Slice& field, const Slice& value, int32_t* ret);
   Status HVals(const Slice& key, std::vector<std::string>* values);
   Status HStrlen(const Slice& key, const Slice& field, int32_t* len);
-  Status HScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
-               std::vector<FieldValue>* field_values, int64_t* next_cursor);
+  // cursor and next_cursor are numbered cursors, or tokens with stateless, see ScanCursor
+  Status HScan(const Slice& key, const std::string& cursor, bool stateless, const std::string& pattern, int64_t count,
+               std::vector<FieldValue>* field_values, std::string* next_cursor);
   Status HScanx(const Slice& key, const std::string& start_field, const std::string& pattern, int64_t count,
                 std::vector<FieldValue>* field_values, std::string* next_field);
   Status HRandField(const Slice& key, int64_t count, bool with_values, std::vector<std::string>* res);
@@ -208,6 +261,9 @@ class Redis {
   Status SetSmallCompactionThreshold(uint64_t small_compaction_threshold);
   Status SetSmallCompactionDurationThreshold(uint64_t small_compaction_duration_threshold);
   void GetRocksDBInfo(std::string& info, const char* prefix);
+  void GetCompressionInfo(std::string& info, const char* prefix);
+  // Adds the bytes the instance read from and wrote to its files to stats
+  void GetIOStats(DataPathIOStats* stats) const;
   auto GetWriteOptions() const -> const rocksdb::WriteOptions& { return default_write_options_; }
   auto GetColumnFamilyHandles() const -> const std::vector<rocksdb::ColumnFamilyHandle*>& { return handles_; }
   auto GetRaftTimeout() const -> uint32_t { return raft_timeout_s_; }
@@ -223,7 +279,9 @@ class Redis {
   Status SInterstore(const Slice& destination, const std::vector<std::string>& keys,
                      std::vector<std::string>& value_to_dest, int32_t* ret);
   Status SIsmember(const Slice& key, const Slice& member, int32_t* ret);
+  Status SMIsmember(const Slice& key, const std::vector<std::string>& members, std::vector<int32_t>* rets);
   Status SMembers(const Slice& key, std::vector<std::string>* members);
+  Status SMembers(const Slice& key, std::unique_ptr<ElementReader>* reader);
   Status SMembersWithTTL(const Slice& key, std::vector<std::string>* members, int64_t* ttl);
   Status SMove(const Slice& source, const Slice& destination, const Slice& member, int32_t* ret);
   Status SPop(const Slice& key, std::vector<std::string>* members, int64_t cnt);
@@ -232,8 +290,8 @@ class Redis {
   Status SUnion(const std::vector<std::string>& keys, std::vector<std::string>* members);
   Status SUnionstore(const Slice& destination, const std::vector<std::string>& keys,
                      std::vector<std::string>& value_to_dest, int32_t* ret);
-  Status SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
-               std::vector<std::string>* members, int64_t* next_cursor);
+  Status SScan(const Slice& key, const std::string& cursor, bool stateless, const std::string& pattern, int64_t count,
+               std::vector<std::string>* members, std::string* next_cursor);
   Status AddAndGetSpopCount(const std::string& key, uint64_t* count);
   Status ResetSpopCount(const std::string& key);
 
@@ -246,6 +304,7 @@ class Redis {
   Status LPush(const Slice& key, const std::vector<std::string>& values, uint64_t* ret);
   Status LPushx(const Slice& key, const std::vector<std::string>& values, uint64_t* len);
   Status LRange(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret);
+  Status LRange(const Slice& key, int64_t start, int64_t stop, std::unique_ptr<ElementReader>* reader);
   Status LRangeWithTTL(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret, int64_t* ttl);
   Status LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* ret);
   Status LSet(const Slice& key, int64_t index, const Slice& value);
@@ -261,6 +320,8 @@ class Redis {
   Status ZCount(const Slice& key, double min, double max, bool left_close, bool right_close, int32_t* ret);
   Status ZIncrby(const Slice& key, const Slice& member, double increment, double* ret);
   Status ZRange(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members);
+  Status ZRange(const Slice& key, int32_t start, int32_t stop, bool with_scores,
+                std::unique_ptr<ElementReader>* reader);
   Status ZRangeWithTTL(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members,
                        int64_t* ttl);
   Status ZRangebyscore(const Slice& key, double min, double max, bool left_close, bool right_close, int64_t count,
@@ -274,6 +335,7 @@ class Redis {
                           int64_t offset, std::vector<ScoreMember>* score_members);
   Status ZRevrank(const Slice& key, const Slice& member, int32_t* rank);
   Status ZScore(const Slice& key, const Slice& member, double* score);
+  Status ZMScore(const Slice& key, const std::vector<std::string>& members, std::vector<ScoreStatus>* sss);
   Status ZGetAll(const Slice& key, double weight, std::map<std::string, double>* value_to_dest);
   Status ZUnionstore(const Slice& destination, const std::vector<std::string>& keys, const std::vector<double>& weights,
                      AGGREGATE agg, std::map<std::string, double>& value_to_dest, int32_t* ret);
@@ -285,8 +347,8 @@ class Redis {
                    int32_t* ret);
   Status ZRemrangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                         int32_t* ret);
-  Status ZScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
-               std::vector<ScoreMember>* score_members, int64_t* next_cursor);
+  Status ZScan(const Slice& key, const std::string& cursor, bool stateless, const std::string& pattern, int64_t count,
+               std::vector<ScoreMember>* score_members, std::string* next_cursor);
   Status ZPopMax(const Slice& key, int64_t count, std::vector<ScoreMember>* score_members);
   Status ZPopMin(const Slice& key, int64_t count, std::vector<ScoreMember>* score_members);
 
@@ -383,25 +445,62 @@ class Redis {
   Storage* const storage_;
   std::shared_ptr<LockMgr> lock_mgr_;
   rocksdb::DB* db_ = nullptr;
+  // Tickers only, for the per data path I/O
+  std::shared_ptr<rocksdb::Statistics> db_statistics_;
+
+  // db_ itself, it counts the keys on every write. The counts are saved to
+  // key_counts_path_ on close, with the sequence number they are valid for.
+  KeyCountDB* key_count_db_ = nullptr;
+  std::string key_counts_path_;
+  // Takes the saved key counts if nothing was written after them. Otherwise it takes them
+  // as they are, or none, and starts the recount thread with a recount at once
+  Status LoadKeyCounts();
+  void SaveKeyCounts();
+
+  // Recounts the keys from a scan of the meta cf every kKeyRecountIntervalSeconds, which
+  // corrects what the compaction drops racing with writes leave behind
+  std::thread key_recount_thread_;
+  std::mutex key_recount_mutex_;
+  std::condition_variable key_recount_cond_;
+  bool key_recount_exit_ = false;
+  // false until the recount after an unclean close is done, the counts are not saved before
+  std::atomic<bool> key_counts_exact_ = true;
+  void RunKeyRecount(bool recount_now);
+  void StopKeyRecount();
+  // false when the recount was given up for the close
+  bool RecountKeys();
+
+  // Checks the key format version of the instance at db_path and records the current one
+  Status CheckKeyFormat(const std::string& db_path, bool existing);
 
   std::vector<rocksdb::ColumnFamilyHandle*> handles_;
   rocksdb::WriteOptions default_write_options_;
   rocksdb::ReadOptions default_read_options_;
   rocksdb::CompactRangeOptions default_compact_range_options_;
+  bool async_io_ = false;
+
+  // Looks up the meta values of keys with one batched MultiGet
+  void MultiGetMeta(const std::vector<Slice>& keys, std::vector<std::string>* values, std::vector<Status>* statuses);
+  // Looks up encoded_keys in one column family with a single MultiGet, the keys are
+  // handed to RocksDB in sorted order and the results are returned in the original one
+  void MultiGetSorted(const rocksdb::ReadOptions& read_options, ColumnFamilyIndex cf_index,
+                      const std::vector<std::string>& encoded_keys, std::vector<std::string>* values,
+                      std::vector<Status>* statuses);
 
   // For Scan
-  std::unique_ptr<LRUCache<std::string, std::string>> scan_cursors_store_;
-  std::unique_ptr<LRUCache<std::string, size_t>> spop_counts_store_;
+  std::unique_ptr<ShardedLRUCache<std::string, std::string>> scan_cursors_store_;
+  std::unique_ptr<ShardedLRUCache<std::string, size_t>> spop_counts_store_;
 
-  Status GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
+  Status GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern, const std::string& cursor,
                            std::string* start_point);
-  Status StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
-                            const std::string& next_point);
+  // Returns the token of next_point with stateless, the numbered cursor given otherwise
+  std::string StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
+                                 bool stateless, const std::string& next_point);
 
   // For Statistics
   std::atomic_uint64_t small_compaction_threshold_;
   std::atomic_uint64_t small_compaction_duration_threshold_;
-  std::unique_ptr<LRUCache<std::string, KeyStatistics>> statistics_store_;
+  std::unique_ptr<ShardedLRUCache<std::string, KeyStatistics>> statistics_store_;
 
   // For raft
   uint32_t raft_timeout_s_ = 10;
@@ -410,10 +509,242 @@ class Redis {
   LogIndexOfColumnFamilies log_index_of_all_cfs_;
   bool is_starting_{true};
 
+  // The key ranges holding the data keys of version of the collection key, one per data cf
+  struct DataRange {
+    ColumnFamilyIndex cf_idx;
+    std::string begin;
+    std::string end;
+  };
+  static void GetDataRanges(DataType type, const Slice& key, uint64_t version, std::vector<DataRange>* ranges);
+
+  // Drops every data key of version of the collection key, which holds count members, called
+  // once the version is deleted or replaced so that compaction reclaims the data keys without
+  // a meta lookup per key. Large collections get range tombstones, small ones point deletes.
+  void DeleteDataRange(Batch* batch, DataType type, const Slice& key, uint64_t version, uint64_t count);
+  // Same for the fragments of the bitmap whose meta is meta_value, other strings have no data keys
+  void DeleteBitmapFragments(Batch* batch, const Slice& key, const std::string& meta_value);
+
+  // For active expire, moves the expire index entry of key from old_etime to new_etime (0 means none)
+  void UpdateExpireIndex(Batch* batch, const Slice& key, uint64_t old_etime, uint64_t new_etime);
+  // Commits a rename of key to newkey on new_inst: newkey gets new_meta, key gets old_meta or is
+  // deleted when old_meta is null, and the expire index entry of etime moves along. Each meta goes
+  // in one batch with its index entry, one batch for both keys when new_inst is this instance.
+  Status CommitRename(const Slice& key, const std::string* old_meta, Redis* new_inst, const Slice& newkey,
+                      const Slice& new_meta, uint64_t etime);
+
+  // For Lists
+  Status ListsToChunked(Batch* batch, const Slice& key, std::string* meta_value,
+                        const std::vector<std::string>& elements);
+
+  // The versions written by the stores not finished yet, see PendingVersions
+  PendingVersions pending_versions_;
+
+  // The readers not destroyed yet, abandoned when the instance closes. Shared with the
+  // readers, which may outlive the instance.
+  struct OpenReaders {
+    std::mutex mutex;
+    std::set<CollectionReader*> readers;
+  };
+  std::shared_ptr<OpenReaders> open_readers_ = std::make_shared<OpenReaders>();
+  // Takes a snapshot for a reader and reads the meta of key on it. The snapshot is released
+  // again unless the meta is live and of type.
+  Status GetReaderMeta(const Slice& key, DataType type, const rocksdb::Snapshot** snapshot, std::string* meta_value);
+
+  // For Bitmaps
+  std::atomic<uint64_t> last_bitmap_version_ = 0;
+  // Versions of the bitmaps in fragments grow with the time in microseconds, and never
+  // repeat, the fragments of an older bitmap at the same key may not be compacted yet
+  uint64_t NewBitmapVersion();
+  // Sets *bytes to the stored bytes of the fragment of index, empty if it is not stored
+  Status GetBitmapFragment(const rocksdb::ReadOptions& read_options, const Slice& key, uint64_t version,
+                           uint64_t index, std::string* bytes);
+  // Calls func, in order, on the stored fragments of the bitmap overlapping its bytes [start, end],
+  // clipped to them, with the offset of their first byte. Iteration stops once func returns false.
+  Status ForEachBitmapFragment(const rocksdb::ReadOptions& read_options, const Slice& key,
+                               const BitmapFragmentsMeta& meta, uint64_t start, uint64_t end,
+                               const std::function<bool(uint64_t offset, const Slice& bytes)>& func);
+  // Replaces the meta of a bitmap in fragments held by value with the strings value of its bytes,
+  // for the commands reading a string as a whole. Other values are left as they are. The meta
+  // is read again with the fragments under one snapshot, so value becomes what key holds then:
+  // NotFound or WRONGTYPE once a concurrent write removed or replaced the bitmap.
+  Status ExpandBitmapFragments(const Slice& key, std::string* value);
+  // Moves the bitmap in fragments of meta_value from key to newkey of new_inst, its fragments are
+  // copied under a new version of newkey, without rebuilding the bitmap in memory
+  Status MoveBitmapFragments(const Slice& key, const std::string& meta_value, Redis* new_inst, const Slice& newkey);
+  Status SetBitInFragments(const Slice& key, std::string* meta_value, int64_t offset, int32_t on, int32_t* ret);
+  // Moves the bitmap held by value to fragments while it sets a bit in it
+  Status SetBitToFragments(const Slice& key, const std::string& value, uint64_t etime, int64_t offset, int32_t on);
+  // The BITPOS of bit in the bytes [start, end] of a bitmap in fragments, -1 if there is none
+  Status BitPosInFragments(const rocksdb::ReadOptions& read_options, const Slice& key,
+                           const BitmapFragmentsMeta& meta, int32_t bit, int64_t start, int64_t end, int64_t* pos);
+
   Status UpdateSpecificKeyStatistics(const DataType& dtype, const std::string& key, uint64_t count);
   Status UpdateSpecificKeyDuration(const DataType& dtype, const std::string& key, uint64_t duration);
   Status AddCompactKeyTaskIfNeeded(const DataType& dtype, const std::string& key, uint64_t count, uint64_t duration);
 };
 
+class MemberIterator {
+ public:
+  MemberIterator(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const rocksdb::Snapshot* snapshot,
+                 std::string prefix, int32_t count);
+  ~MemberIterator();
+
+  // Number of members of the key when the iterator was opened
+  int32_t Count() const { return count_; }
+  bool Valid() const { return iter_->Valid() && iter_->key().starts_with(prefix_); }
+  Slice member() const;
+  // The data value stored with the current member
+  Slice value() const { return iter_->value(); }
+  void Next() { iter_->Next(); }
+  // Moves forward to the first member not less than target, the iterator stays
+  // where it is if it already points at such a member
+  void SeekAtLeast(const Slice& target);
+  Status status() const { return iter_->status(); }
+
+ private:
+  rocksdb::DB* db_ = nullptr;
+  const rocksdb::Snapshot* snapshot_ = nullptr;
+  std::unique_ptr<rocksdb::Iterator> iter_;
+  std::string prefix_;
+  std::string seek_key_;
+  int32_t count_ = 0;
+};
+
+// Replaces the set or zset stored at destination with the members handed to Add, which
+// must not repeat. The members are written in batches while they are produced under a new
+// version of the key, the meta is only switched to that version by Finish, so readers see
+// the old value until then and a store that fails midway leaves it intact. The version is
+// pending until then, so that the compaction keeps the members committed meanwhile. The
+// destination stays locked for the lifetime of the writer.
+class Redis::MembersStoreWriter {
+ public:
+  MembersStoreWriter(Redis* redis, DataType type, const Slice& destination);
+  ~MembersStoreWriter();
+
+  // For sets
+  Status Add(const Slice& member);
+  // For zsets
+  Status Add(const Slice& member, double score);
+  // *ret is the number of members of the new key
+  Status Finish(int32_t* ret);
+
+ private:
+  Status Start();
+  Status Added();
+
+  Redis* const redis_;
+  const DataType type_;
+  std::string key_;
+  std::string meta_key_;
+  ScopeRecordLock lock_;
+  std::unique_ptr<Batch> batch_;
+  std::string old_meta_value_;
+  std::string meta_value_;
+  uint64_t version_ = 0;
+  bool started_ = false;
+  // whether a batch of members was committed
+  bool committed_ = false;
+  bool finished_ = false;
+  int64_t count_ = 0;
+  DataType old_type_ = DataType::kNones;
+  uint64_t old_count_ = 0;
+};
+
+// Reads the elements of a collection on a snapshot of its own. read_fn emits them from
+// the iterator, over cf on the snapshot, until at least max_bytes of them went to the
+// sink or the last one did, and sets *done then. The instance abandons its readers when
+// it closes, which releases their snapshot and fails their reads.
+class Redis::CollectionReader : public ElementReader {
+ public:
+  using ReadFunction =
+      std::function<Status(rocksdb::Iterator* iter, ElementSink* sink, size_t max_bytes, bool* done)>;
+
+  // Takes over snapshot, count is the number of elements passed to Begin
+  CollectionReader(Redis* redis, const rocksdb::Snapshot* snapshot, DataType type, const Slice& key, int cf,
+                   uint64_t count, ReadFunction read_fn);
+  ~CollectionReader() override;
+
+  Status Read(ElementSink* sink, size_t max_bytes) override;
+  bool Done() const override { return done_; }
+
+ private:
+  friend class Redis;
+  // Releases the iterator and the snapshot, with the mutex of the open readers held
+  void Abandon();
+
+  Redis* const redis_;
+  rocksdb::DB* const db_;
+  std::shared_ptr<OpenReaders> open_readers_;
+  const rocksdb::Snapshot* snapshot_ = nullptr;
+  std::unique_ptr<rocksdb::Iterator> iter_;
+  const DataType type_;
+  const std::string key_;
+  const uint64_t count_;
+  ReadFunction read_fn_;
+  bool begun_ = false;
+  bool done_ = false;
+  std::atomic<bool> abandoned_ = false;
+};
+
+// Reads a bitmap fragment by fragment, whether it is stored in fragments or as one
+// string, on a snapshot taken when the reader is opened.
+class Redis::BitmapReader {
+ public:
+  BitmapReader(Redis* redis, const Slice& key, const rocksdb::Snapshot* snapshot);
+  ~BitmapReader();
+
+  // Takes the value read at the key on the snapshot
+  Status Init(std::string* value);
+  // Length of the bitmap in bytes
+  uint64_t Length() const { return length_; }
+  bool IsFragments() const { return fragments_; }
+  // Sets *bytes to the bytes of the fragment of index, zero ones included, up to the end of the
+  // bitmap. The indexes must increase from one call to the next.
+  Status ReadFragment(uint64_t index, std::string* bytes);
+  // Sets *bytes to the whole bitmap, for the short ones
+  Status ReadAll(std::string* bytes);
+
+ private:
+  Redis* const redis_;
+  std::string key_;
+  const rocksdb::Snapshot* snapshot_ = nullptr;
+  uint64_t length_ = 0;
+  bool fragments_ = false;
+  // The bytes of a bitmap stored as one string
+  std::string value_;
+  BitmapFragmentsMeta meta_;
+  std::string prefix_;
+  std::unique_ptr<rocksdb::Iterator> iter_;
+};
+
+// Replaces the string at destination with a bitmap in fragments. The fragments handed to
+// Add are written in batches under a new version and the destination keeps its value until
+// Finish publishes the new meta. The version is pending until then, so that the compaction
+// keeps its fragments, and a writer destroyed before Finish deletes the ones it committed.
+// The destination stays locked for the lifetime of the writer.
+class Redis::BitmapWriter {
+ public:
+  BitmapWriter(Redis* redis, const Slice& destination);
+  ~BitmapWriter();
+
+  // The fragments come in increasing index order, the ones of zero bytes are skipped
+  Status Add(uint64_t index, const Slice& bytes);
+  // length is the size of the new bitmap in bytes
+  Status Finish(uint64_t length);
+
+ private:
+  Redis* const redis_;
+  std::string key_;
+  std::string meta_key_;
+  ScopeRecordLock lock_;
+  std::unique_ptr<Batch> batch_;
+  uint64_t version_ = 0;
+  // one past the index of the last fragment added
+  uint64_t end_index_ = 0;
+  // whether a batch of fragments was committed
+  bool committed_ = false;
+  bool finished_ = false;
+};
+
 }  //  namespace storage
 #endif  //  SRC_REDIS_H_
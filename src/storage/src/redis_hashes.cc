@@ -17,6 +17,7 @@
 #include "src/base_data_key_format.h"
 #include "src/base_data_value_format.h"
 #include "src/base_filter.h"
+#include "src/scan_cursor.h"
 #include "src/scope_record_lock.h"
 #include "src/scope_snapshot.h"
 #include "storage/util.h"
@@ -202,6 +203,50 @@ Status Redis::HGetall(const Slice& key, std::vector<FieldValue>* fvs) {
   return s;
 }
 
+Status Redis::HGetall(const Slice& key, std::unique_ptr<ElementReader>* reader) {
+  const rocksdb::Snapshot* snapshot = nullptr;
+  std::string meta_value;
+  Status s = GetReaderMeta(key, DataType::kHashes, &snapshot, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // the meta and the fields are read from one snapshot, so the count sent first is the
+  // number of fields that follow
+  ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
+  uint64_t rest = parsed_hashes_meta_value.Count();
+  HashesDataKey hashes_data_key(key, parsed_hashes_meta_value.Version(), "");
+  std::string prefix = hashes_data_key.EncodeSeekKey().ToString();
+  auto read_fn = [prefix, rest, seeked = false](rocksdb::Iterator* iter, ElementSink* sink, size_t max_bytes,
+                                               bool* done) mutable {
+    if (!seeked) {
+      seeked = true;
+      iter->Seek(prefix);
+    }
+    size_t bytes = 0;
+    for (; rest != 0 && bytes < max_bytes && iter->Valid() && iter->key().starts_with(prefix); iter->Next(), --rest) {
+      ParsedHashesDataKey parsed_hashes_data_key(iter->key());
+      ParsedBaseDataValue parsed_internal_value(iter->value());
+      Status s = sink->Append(parsed_hashes_data_key.field());
+      if (s.ok()) {
+        s = sink->Append(parsed_internal_value.UserValue());
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      bytes += parsed_hashes_data_key.field().size() + parsed_internal_value.UserValue().size();
+    }
+    *done = rest == 0;
+    if (*done || bytes >= max_bytes) {
+      return Status::OK();
+    }
+    return iter->status().ok() ? Status::Corruption("hash has fewer fields than its count") : iter->status();
+  };
+  *reader = std::make_unique<CollectionReader>(this, snapshot, DataType::kHashes, key, kHashesDataCF,
+                                               parsed_hashes_meta_value.Count() * 2, std::move(read_fn));
+  return Status::OK();
+}
+
 Status Redis::HGetallWithTTL(const Slice& key, std::vector<FieldValue>* fvs, int64_t* ttl) {
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
@@ -488,7 +533,6 @@ Status Redis::HMGet(const Slice& key, const std::vector<std::string>& fields, st
 
   uint64_t version = 0;
   bool is_stale = false;
-  std::string value;
   std::string meta_value;
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
@@ -509,18 +553,26 @@ Status Redis::HMGet(const Slice& key, const std::vector<std::string>& fields, st
     } else {
       ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
       version = parsed_hashes_meta_value.Version();
+      std::vector<std::string> data_keys;
+      data_keys.reserve(fields.size());
       for (const auto& field : fields) {
         HashesDataKey hashes_data_key(key, version, field);
-        s = db_->Get(read_options, handles_[kHashesDataCF], hashes_data_key.Encode(), &value);
-        if (s.ok()) {
-          ParsedBaseDataValue parsed_internal_value(&value);
+        data_keys.push_back(hashes_data_key.Encode().ToString());
+      }
+      std::vector<std::string> values;
+      std::vector<Status> statuses;
+      MultiGetSorted(read_options, kHashesDataCF, data_keys, &values, &statuses);
+      vss->reserve(fields.size());
+      for (size_t idx = 0; idx < fields.size(); ++idx) {
+        if (statuses[idx].ok()) {
+          ParsedBaseDataValue parsed_internal_value(&values[idx]);
           parsed_internal_value.StripSuffix();
-          vss->push_back({value, Status::OK()});
-        } else if (s.IsNotFound()) {
+          vss->push_back({std::move(values[idx]), Status::OK()});
+        } else if (statuses[idx].IsNotFound()) {
           vss->push_back({std::string(), Status::NotFound()});
         } else {
           vss->clear();
-          return s;
+          return statuses[idx];
         }
       }
     }
@@ -799,12 +851,13 @@ Status Redis::HStrlen(const Slice& key, const Slice& field, int32_t* len) {
   return s;
 }
 
-Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
-                    std::vector<FieldValue>* field_values, int64_t* next_cursor) {
-  *next_cursor = 0;
+Status Redis::HScan(const Slice& key, const std::string& cursor, bool stateless, const std::string& pattern,
+                    int64_t count, std::vector<FieldValue>* field_values, std::string* next_cursor) {
+  *next_cursor = "0";
   field_values->clear();
-  if (cursor < 0) {
-    *next_cursor = 0;
+  int64_t number = 0;
+  if (ScanCursor::ParseNumbered(cursor, &number) && number < 0) {
+    *next_cursor = "0";
     return Status::OK();
   }
 
@@ -821,7 +874,7 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
   Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
     if (IsStale(meta_value)) {
-      *next_cursor = 0;
+      *next_cursor = "0";
       return Status::NotFound();
     } else if (!ExpectedMetaValue(DataType::kHashes, meta_value)) {
       return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
@@ -834,7 +887,7 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
       uint64_t version = parsed_hashes_meta_value.Version();
       s = GetScanStartPoint(DataType::kHashes, key, pattern, cursor, &start_point);
       if (s.IsNotFound()) {
-        cursor = 0;
+        number = 0;
         if (isTailWildcard(pattern)) {
           start_point = pattern.substr(0, pattern.size() - 1);
         }
@@ -860,17 +913,16 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
       }
 
       if (iter->Valid() && (iter->key().compare(prefix) <= 0 || iter->key().starts_with(prefix))) {
-        *next_cursor = cursor + step_length;
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
         std::string next_field = parsed_hashes_data_key.field().ToString();
-        StoreScanNextPoint(DataType::kHashes, key, pattern, *next_cursor, next_field);
+        *next_cursor = StoreScanNextPoint(DataType::kHashes, key, pattern, number + step_length, stateless, next_field);
       } else {
-        *next_cursor = 0;
+        *next_cursor = "0";
       }
       delete iter;
     }
   } else {
-    *next_cursor = 0;
+    *next_cursor = "0";
     return s;
   }
   return Status::OK();
@@ -1105,14 +1157,26 @@ Status Redis::PKHRScanRange(const Slice& key, const Slice& field_start, const st
     } else {
       ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
       uint64_t version = parsed_hashes_meta_value.Version();
-      int32_t start_key_version = start_no_limit ? version + 1 : version;
-      std::string start_key_field = start_no_limit ? "" : field_start.ToString();
       HashesDataKey hashes_data_prefix(key, version, Slice());
-      HashesDataKey hashes_start_data_key(key, start_key_version, start_key_field);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
+      std::string start_key;
+      if (start_no_limit) {
+        // the successor of the version prefix sorts after every field of the version, it
+        // lies out of the prefix so the seek has to go in total order. The prefix starts
+        // with the zeroed reserve, so it never runs out of bytes to increment.
+        start_key = prefix;
+        while (static_cast<uint8_t>(start_key.back()) == 0xff) {
+          start_key.pop_back();
+        }
+        start_key.back() = static_cast<char>(static_cast<uint8_t>(start_key.back()) + 1);
+        read_options.total_order_seek = true;
+      } else {
+        HashesDataKey hashes_start_data_key(key, version, field_start);
+        start_key = hashes_start_data_key.Encode().ToString();
+      }
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
-      for (iter->SeekForPrev(hashes_start_data_key.Encode().ToString());
+      for (iter->SeekForPrev(start_key);
            iter->Valid() && remain > 0 && iter->key().starts_with(prefix); iter->Prev()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
         std::string field = parsed_hashes_data_key.field().ToString();
@@ -1148,7 +1212,6 @@ Status Redis::HashesRename(const Slice& key, Redis* new_inst, const Slice& newke
   MultiScopeRecordLock ml(lock_mgr_, keys);
 
   BaseMetaKey base_meta_key(key);
-  BaseMetaKey base_meta_newkey(newkey);
   s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (!s.ok() || !ExpectedMetaValue(DataType::kHashes, meta_value)) {
     return s;
@@ -1163,12 +1226,13 @@ Status Redis::HashesRename(const Slice& key, Redis* new_inst, const Slice& newke
   // copy a new hash with newkey
   ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
   statistic = parsed_hashes_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // HashesDel key
+  uint64_t etime = parsed_hashes_meta_value.Etime();
   parsed_hashes_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
 
   return s;
@@ -1206,12 +1270,13 @@ Status Redis::HashesRenamenx(const Slice& key, Redis* new_inst, const Slice& new
   ParsedHashesMetaValue parsed_hashes_new_meta_value(&new_meta_value);
   // copy a new hash with newkey
   statistic = parsed_hashes_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // HashesDel key
+  uint64_t etime = parsed_hashes_meta_value.Etime();
   parsed_hashes_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
 
   return s;
@@ -1223,6 +1288,7 @@ void Redis::ScanHashes() {
   ScopeSnapshot ss(db_, &snapshot);
   iterator_options.snapshot = snapshot;
   iterator_options.fill_cache = false;
+  iterator_options.total_order_seek = true;
   auto current_time = static_cast<int32_t>(time(nullptr));
 
   INFO("***************rocksdb instance: {} Hashes Meta Data***************", index_);
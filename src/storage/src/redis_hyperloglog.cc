@@ -7,50 +7,172 @@
 #include <algorithm>
 #include <cmath>
 #include <string>
+#include "src/bit_kernels.h"
 #include "src/storage_murmur3.h"
 
 namespace storage {
 
 const int32_t HLL_HASH_SEED = 313;
 
-HyperLogLog::HyperLogLog(uint8_t precision, std::string origin_register) {
+static const char kSparseMagic[] = "HYLS";
+static const size_t kSparseMagicLength = sizeof(kSparseMagic) - 1;
+static const size_t kSparseEntryLength = 3;
+static const uint32_t kRegisterBits = 6;
+static const uint32_t kRegisterMask = (1 << kRegisterBits) - 1;
+
+HyperLogLog::HyperLogLog(uint8_t precision) {
   b_ = precision;
   m_ = 1 << precision;
   alpha_ = Alpha();
-  register_ = std::make_unique<char[]>(m_);
-  for (uint32_t i = 0; i < m_; ++i) {
-    register_[i] = 0;
+}
+
+bool HyperLogLog::Merge(const Slice& value) {
+  if (value.empty()) {
+    return true;
+  }
+  if (value.size() == m_) {
+    if (IsSparse() && sparse_.empty()) {
+      dense_.assign(value.data(), value.size());
+    } else {
+      ToDense();
+      GetBitKernels().max_bytes(reinterpret_cast<unsigned char*>(dense_.data()),
+                                reinterpret_cast<const unsigned char*>(value.data()), m_);
+    }
+    return true;
+  }
+
+  if (!value.starts_with(Slice(kSparseMagic, kSparseMagicLength)) ||
+      (value.size() - kSparseMagicLength) % kSparseEntryLength != 0) {
+    return false;
   }
-  if (!origin_register.empty()) {
-    for (uint32_t i = 0; i < m_; ++i) {
-      register_[i] = origin_register[i];
+  Slice entries(value.data() + kSparseMagicLength, value.size() - kSparseMagicLength);
+  int64_t last_index = -1;
+  for (size_t pos = 0; pos < entries.size(); pos += kSparseEntryLength) {
+    auto p = reinterpret_cast<const uint8_t*>(entries.data() + pos);
+    uint32_t entry = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+    int64_t index = entry >> kRegisterBits;
+    if (index <= last_index || index >= m_ || (entry & kRegisterMask) == 0) {
+      return false;
     }
+    last_index = index;
   }
+  MergeSparse(entries);
+  return true;
 }
 
-HyperLogLog::~HyperLogLog() = default;
+// Merges validated sparse entries, walking them along the sorted registers
+void HyperLogLog::MergeSparse(const Slice& entries) {
+  auto p = reinterpret_cast<const uint8_t*>(entries.data());
+  size_t count = entries.size() / kSparseEntryLength;
+  auto entry_at = [p](size_t i) {
+    const uint8_t* q = p + i * kSparseEntryLength;
+    return (static_cast<uint32_t>(q[0]) << 16) | (static_cast<uint32_t>(q[1]) << 8) | q[2];
+  };
 
-std::string HyperLogLog::Add(const char* value, uint32_t len) {
+  if (!IsSparse()) {
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t entry = entry_at(i);
+      SetRegister(entry >> kRegisterBits, static_cast<uint8_t>(entry & kRegisterMask));
+    }
+    return;
+  }
+
+  std::vector<uint32_t> merged;
+  merged.reserve(sparse_.size() + count);
+  size_t i = 0;
+  size_t j = 0;
+  while (i < sparse_.size() || j < count) {
+    if (j == count || (i < sparse_.size() && (sparse_[i] >> kRegisterBits) < (entry_at(j) >> kRegisterBits))) {
+      merged.push_back(sparse_[i++]);
+    } else if (i == sparse_.size() || (entry_at(j) >> kRegisterBits) < (sparse_[i] >> kRegisterBits)) {
+      merged.push_back(entry_at(j++));
+    } else {
+      merged.push_back(std::max(sparse_[i++], entry_at(j++)));
+    }
+  }
+  sparse_.swap(merged);
+  if (sparse_.size() > kSparseMaxRegisters) {
+    ToDense();
+  }
+}
+
+bool HyperLogLog::Add(const char* value, uint32_t len) {
   uint32_t hash_value;
   MurmurHash3_x86_32(value, static_cast<int32_t>(len), HLL_HASH_SEED, static_cast<void*>(&hash_value));
   uint32_t index = hash_value & ((1 << b_) - 1);
   uint8_t rank = Nctz((hash_value >> b_), static_cast<int32_t>(32 - b_));
-  if (rank > register_[index]) {
-    register_[index] = static_cast<char>(rank);
+  return SetRegister(index, rank);
+}
+
+bool HyperLogLog::SetRegister(uint32_t index, uint8_t rank) {
+  if (!IsSparse()) {
+    if (rank <= static_cast<uint8_t>(dense_[index])) {
+      return false;
+    }
+    dense_[index] = static_cast<char>(rank);
+    return true;
+  }
+
+  uint32_t entry = (index << kRegisterBits) | rank;
+  auto iter = std::lower_bound(sparse_.begin(), sparse_.end(), index << kRegisterBits);
+  if (iter != sparse_.end() && (*iter >> kRegisterBits) == index) {
+    if (entry <= *iter) {
+      return false;
+    }
+    *iter = entry;
+    return true;
+  }
+  sparse_.insert(iter, entry);
+  if (sparse_.size() > kSparseMaxRegisters) {
+    ToDense();
+  }
+  return true;
+}
+
+void HyperLogLog::ToDense() {
+  if (!IsSparse()) {
+    return;
   }
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
+  dense_.assign(m_, 0);
+  for (auto entry : sparse_) {
+    dense_[entry >> kRegisterBits] = static_cast<char>(entry & kRegisterMask);
   }
-  return result;
+  std::vector<uint32_t>().swap(sparse_);
 }
 
+std::string HyperLogLog::Encode() const {
+  if (!IsSparse()) {
+    return dense_;
+  }
+  std::string value(kSparseMagic, kSparseMagicLength);
+  value.reserve(kSparseMagicLength + sparse_.size() * kSparseEntryLength);
+  for (auto entry : sparse_) {
+    value.push_back(static_cast<char>(entry >> 16));
+    value.push_back(static_cast<char>(entry >> 8));
+    value.push_back(static_cast<char>(entry));
+  }
+  return value;
+}
+
+// The harmonic mean of 2^register, sparse registers are summed from the entries
+// with the zero ones counted as 1 each
 double HyperLogLog::Estimate() const {
-  double estimate = FirstEstimate();
+  double sum = 0.0;
+  size_t zeros = 0;
+  if (IsSparse()) {
+    zeros = m_ - sparse_.size();
+    sum = static_cast<double>(zeros);
+    for (auto entry : sparse_) {
+      sum += std::ldexp(1.0, -static_cast<int>(entry & kRegisterMask));
+    }
+  } else {
+    sum = GetBitKernels().inverse_pow2_sum(reinterpret_cast<const unsigned char*>(dense_.data()), m_, &zeros);
+  }
+
+  double estimate = alpha_ * m_ * m_ / sum;
   if (estimate <= 2.5 * m_) {
-    uint32_t zeros = CountZero();
     if (zeros != 0) {
-      estimate = m_ * log(static_cast<double>(m_) / zeros);
+      estimate = m_ * log(static_cast<double>(m_) / static_cast<double>(zeros));
     }
   } else if (estimate > pow(2, 32) / 30.0) {
     estimate = log1p(estimate * -1 / pow(2, 32)) * pow(2, 32) * -1;
@@ -58,17 +180,6 @@ double HyperLogLog::Estimate() const {
   return estimate;
 }
 
-double HyperLogLog::FirstEstimate() const {
-  double estimate;
-  double sum = 0.0;
-  for (uint32_t i = 0; i < m_; i++) {
-    sum += 1.0 / (1 << register_[i]);
-  }
-
-  estimate = alpha_ * m_ * m_ / sum;
-  return estimate;
-}
-
 double HyperLogLog::Alpha() const {
   switch (m_) {
     case 16:
@@ -82,34 +193,9 @@ double HyperLogLog::Alpha() const {
   }
 }
 
-uint32_t HyperLogLog::CountZero() const {
-  uint32_t count = 0;
-  for (uint32_t i = 0; i < m_; i++) {
-    if (register_[i] == 0) {
-      count++;
-    }
-  }
-  return count;
-}
-
-std::string HyperLogLog::Merge(const HyperLogLog& hll) {
-  if (m_ != hll.m_) {
-    // TODO(shq) the number of registers doesn't match
-  }
-  for (uint32_t r = 0; r < m_; r++) {
-    if (register_[r] < hll.register_[r]) {
-      register_[r] = static_cast<char>(register_[r] | hll.register_[r]);
-    }
-  }
-
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
-  }
-  return result;
+// ::__builtin_ctz(x): 返回右起第一个‘1’之后的0的个数, x 为 0 时未定义
+uint8_t HyperLogLog::Nctz(uint32_t x, int b) {
+  return static_cast<uint8_t>(x == 0 ? b : std::min(b, ::__builtin_ctz(x))) + 1;
 }
 
-// ::__builtin_ctz(x): 返回右起第一个‘1’之后的0的个数
-uint8_t HyperLogLog::Nctz(uint32_t x, int b) { return static_cast<uint8_t>(std::min(b, ::__builtin_ctz(x))) + 1; }
-
 }  // namespace storage
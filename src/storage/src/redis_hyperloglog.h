@@ -7,31 +7,62 @@
 #define SRC_REDIS_HYPERLOGLOG_H_
 
 #include <cstdint>
-#include <iostream>
-#include <memory>
 #include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
 
 namespace storage {
 
+using Slice = rocksdb::Slice;
+
+/*
+ * A HyperLogLog of 1 << precision registers is stored as a string in one of
+ * two encodings. An empty string is an empty HyperLogLog.
+ *
+ * dense:  every register, one byte each
+ *
+ * sparse: | "HYLS" | entry | entry | ... |
+ *            4B      3B      3B
+ *
+ * A sparse entry is index << 6 | register, big endian, for every non-zero
+ * register in increasing index order, so precision is at most 18. A HyperLogLog
+ * turns dense when it gets more than kSparseMaxRegisters non-zero registers.
+ */
 class HyperLogLog {
  public:
-  HyperLogLog(uint8_t precision, std::string origin_register);
-  ~HyperLogLog();
+  explicit HyperLogLog(uint8_t precision);
+
+  // Non-zero registers a sparse HyperLogLog holds at most, 3000 bytes encoded
+  static const size_t kSparseMaxRegisters = 1000;
+
+  // Merges the registers of an encoded HyperLogLog into this one, false if value
+  // is not an encoded HyperLogLog of the same precision
+  bool Merge(const Slice& value);
+
+  // Adds an element, true if a register changed
+  bool Add(const char* value, uint32_t len);
 
   double Estimate() const;
-  double FirstEstimate() const;
-  uint32_t CountZero() const;
+
+  std::string Encode() const;
+
+  bool IsSparse() const { return dense_.empty(); }
+
+ private:
+  bool SetRegister(uint32_t index, uint8_t rank);
+  void MergeSparse(const Slice& entries);
+  void ToDense();
   double Alpha() const;
   uint8_t Nctz(uint32_t x, int b);
 
-  std::string Add(const char* value, uint32_t len);
-  std::string Merge(const HyperLogLog& hll);
-
- protected:
-  uint32_t m_ = 0;  // register bit width
-  uint32_t b_ = 0;  // regieter size
+  uint32_t m_ = 0;  // register size
+  uint32_t b_ = 0;  // register bit width
   double alpha_ = 0;
-  std::unique_ptr<char[]> register_;
+  // index << 6 | register of the non-zero registers by index, while sparse
+  std::vector<uint32_t> sparse_;
+  // every register, once dense
+  std::string dense_;
 };
 
 }  // namespace storage
@@ -3,12 +3,15 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <algorithm>
+#include <map>
 #include <memory>
 
 #include <fmt/core.h>
 #include "pstd/log.h"
 #include "src/base_data_value_format.h"
 #include "src/batch.h"
+#include "src/lists_chunk_format.h"
 #include "src/lists_filter.h"
 #include "src/redis.h"
 #include "src/scope_record_lock.h"
@@ -16,6 +19,360 @@
 #include "storage/util.h"
 
 namespace storage {
+// Meta value of a new and empty list, new lists always use the chunked encoding.
+static std::string NewListsMetaValue() {
+  char str[8];
+  EncodeFixed64(str, 0);
+  ListsMetaValue lists_meta_value(Slice(str, sizeof(uint64_t)));
+  lists_meta_value.SetEncoding(kListsChunked);
+  lists_meta_value.UpdateVersion();
+  return lists_meta_value.Encode().ToString();
+}
+
+// Encoded prefix shared by all the data keys of one version of a list,
+// iterators over the list data cf stop once they leave it.
+static std::string ListsDataPrefix(const Slice& key, uint64_t version) {
+  ListsDataKey lists_data_key(key, version, 0);
+  Slice encoded = lists_data_key.Encode();
+  return std::string(encoded.data(), encoded.size() - sizeof(uint64_t) - kSuffixReserveLength);
+}
+
+static uint64_t ListsDataIndex(const Slice& data_key) {
+  return DecodeFixed64(data_key.data() + data_key.size() - kSuffixReserveLength - sizeof(uint64_t));
+}
+
+// Number of elements held by one data key.
+static uint32_t ListsDataCount(ListsEncoding encoding, const Slice& data_value) {
+  if (encoding != kListsChunked) {
+    return 1;
+  }
+  ParsedBaseDataValue parsed_value(data_value);
+  return ListsChunk::Count(parsed_value.UserValue());
+}
+
+// Decodes one data key into *chunk, a data key of the element per key
+// encoding is read as a chunk holding a single element.
+static bool DecodeListsData(ListsEncoding encoding, const Slice& data_value, ListsChunk* chunk) {
+  ParsedBaseDataValue parsed_value(data_value);
+  if (encoding == kListsChunked) {
+    return chunk->Decode(parsed_value.UserValue());
+  }
+  chunk->Clear();
+  chunk->PushBack(parsed_value.UserValue());
+  return true;
+}
+
+// Gathers the element counts a command leaves in the chunks it rewrites, Flush then
+// writes the groups of the chunk index holding them to the command's batch.
+class ListsChunkIndex {
+ public:
+  ListsChunkIndex(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* data_cf, const Slice& key)
+      : db_(db), data_cf_(data_cf), key_(key.ToString()) {}
+
+  // Records that the chunk at data_key holds count elements now, none once it is deleted
+  void Set(const Slice& data_key, uint32_t count) { counts_[ListsDataIndex(data_key)] = count; }
+
+  // Lists of the element per key encoding have no chunk index, their counts are dropped
+  Status Flush(Batch* batch, ParsedListsMetaValue* meta) {
+    if (meta->Encoding() != kListsChunked) {
+      counts_.clear();
+      return Status::OK();
+    }
+    uint64_t index_version = meta->Version() | kListsIndexVersionFlag;
+    std::map<uint64_t, ListsIndexGroup> groups;
+    for (const auto& [chunk_id, count] : counts_) {
+      uint64_t group_id = chunk_id >> kListsIndexGroupShift;
+      auto iter = groups.find(group_id);
+      if (iter == groups.end()) {
+        iter = groups.emplace(group_id, ListsIndexGroup()).first;
+        ListsDataKey group_key(key_, index_version, group_id);
+        std::string group_value;
+        Status s = db_->Get(rocksdb::ReadOptions(), data_cf_, group_key.Encode(), &group_value);
+        if (s.ok()) {
+          if (!iter->second.Decode(ParsedBaseDataValue(Slice(group_value)).UserValue())) {
+            return Status::Corruption("invalid list chunk index");
+          }
+        } else if (!s.IsNotFound()) {
+          return s;
+        }
+      }
+      iter->second.Set(chunk_id, count);
+    }
+    for (const auto& [group_id, group] : groups) {
+      ListsDataKey group_key(key_, index_version, group_id);
+      if (group.Empty()) {
+        batch->Delete(kListsDataCF, group_key.Encode());
+      } else {
+        std::string payload = group.Encode();
+        BaseDataValue i_val(payload);
+        batch->Put(kListsDataCF, group_key.Encode(), i_val.Encode());
+      }
+    }
+    counts_.clear();
+    return Status::OK();
+  }
+
+ private:
+  rocksdb::DB* db_;
+  rocksdb::ColumnFamilyHandle* data_cf_;
+  std::string key_;
+  std::map<uint64_t, uint32_t> counts_;
+};
+
+// Deletes the chunk at data_key.
+static void DeleteListsData(Batch* batch, ListsChunkIndex* index, const Slice& data_key) {
+  batch->Delete(kListsDataCF, data_key);
+  index->Set(data_key, 0);
+}
+
+// Writes chunk back to data_key, the data key is deleted once its chunk is empty.
+static void PutListsData(Batch* batch, ListsChunkIndex* index, ListsEncoding encoding, const Slice& data_key,
+                         const ListsChunk& chunk) {
+  index->Set(data_key, static_cast<uint32_t>(chunk.Size()));
+  if (chunk.Empty()) {
+    batch->Delete(kListsDataCF, data_key);
+  } else if (encoding == kListsChunked) {
+    std::string payload = chunk.Encode();
+    BaseDataValue i_val(payload);
+    batch->Put(kListsDataCF, data_key, i_val.Encode());
+  } else {
+    BaseDataValue i_val(chunk.Element(0));
+    batch->Put(kListsDataCF, data_key, i_val.Encode());
+  }
+}
+
+// Positions iter on the head (or the tail) data key of the list.
+static void SeekListsEnd(rocksdb::Iterator* iter, const Slice& key, ParsedListsMetaValue* meta, bool head) {
+  if (head) {
+    ListsDataKey head_data_key(key, meta->Version(), meta->LeftIndex());
+    iter->Seek(head_data_key.Encode());
+  } else {
+    ListsDataKey tail_data_key(key, meta->Version(), meta->RightIndex());
+    iter->SeekForPrev(tail_data_key.Encode());
+  }
+}
+
+// Positions iter on the data key holding the element at pos (counted from the head)
+// and stores the offset of the element inside that data key. Lists of the element
+// per key encoding seek to the element directly. Chunked lists sum the totals of
+// their index groups from the nearer end, find the chunk in the group holding pos
+// and seek to it, the chunks themselves are not read on the way.
+static bool SeekListsElement(rocksdb::Iterator* iter, const Slice& key, ParsedListsMetaValue* meta,
+                             const std::string& prefix, uint64_t pos, uint32_t* offset) {
+  if (meta->Encoding() != kListsChunked) {
+    ListsDataKey lists_data_key(key, meta->Version(), meta->LeftIndex() + pos + 1);
+    iter->Seek(lists_data_key.Encode());
+    *offset = 0;
+    return iter->Valid() && iter->key().starts_with(prefix);
+  }
+
+  uint64_t index_version = meta->Version() | kListsIndexVersionFlag;
+  std::string index_prefix = ListsDataPrefix(key, index_version);
+  ListsIndexGroup group;
+  uint64_t chunk_id = 0;
+  bool found = false;
+  uint64_t count = meta->Count();
+  if (pos < count / 2) {
+    for (iter->Seek(index_prefix); iter->Valid() && iter->key().starts_with(index_prefix); iter->Next()) {
+      ParsedBaseDataValue parsed_value(iter->value());
+      uint64_t total = ListsIndexGroup::Total(parsed_value.UserValue());
+      if (pos < total) {
+        found = group.Decode(parsed_value.UserValue()) && group.Locate(pos, &chunk_id, offset);
+        break;
+      }
+      pos -= total;
+    }
+  } else {
+    uint64_t rpos = count - 1 - pos;
+    ListsDataKey last_group_key(key, index_version, UINT64_MAX);
+    for (iter->SeekForPrev(last_group_key.Encode()); iter->Valid() && iter->key().starts_with(index_prefix);
+         iter->Prev()) {
+      ParsedBaseDataValue parsed_value(iter->value());
+      uint64_t total = ListsIndexGroup::Total(parsed_value.UserValue());
+      if (rpos < total) {
+        found = group.Decode(parsed_value.UserValue()) && group.Locate(total - 1 - rpos, &chunk_id, offset);
+        break;
+      }
+      rpos -= total;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+  ListsDataKey chunk_key(key, meta->Version(), chunk_id);
+  iter->Seek(chunk_key.Encode());
+  return iter->Valid() && iter->key() == chunk_key.Encode();
+}
+
+// Normalizes [start, stop] as LRANGE does into the positions of the elements, false
+// if the range holds none.
+static bool NormalizeListsRange(ParsedListsMetaValue* meta, int64_t start, int64_t stop, int64_t* start_pos,
+                                int64_t* stop_pos) {
+  auto count = static_cast<int64_t>(meta->Count());
+  *start_pos = std::max<int64_t>(start >= 0 ? start : count + start, 0);
+  *stop_pos = std::min<int64_t>(stop >= 0 ? stop : count + stop, count - 1);
+  return *start_pos <= *stop_pos;
+}
+
+// Calls emit on each element at the positions [start_pos, stop_pos], stops at the
+// first status emit returns that is not ok.
+template <typename Emit>
+static Status ForEachListsElement(rocksdb::Iterator* iter, const Slice& key, ParsedListsMetaValue* meta,
+                                  int64_t start_pos, int64_t stop_pos, Emit&& emit) {
+  std::string prefix = ListsDataPrefix(key, meta->Version());
+  uint32_t offset = 0;
+  if (!SeekListsElement(iter, key, meta, prefix, start_pos, &offset)) {
+    return iter->status();
+  }
+  ListsChunk chunk;
+  uint64_t rest = stop_pos - start_pos + 1;
+  for (; rest != 0 && iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+    if (!DecodeListsData(meta->Encoding(), iter->value(), &chunk)) {
+      return Status::Corruption("invalid list chunk");
+    }
+    for (size_t idx = offset; idx < chunk.Size() && rest != 0; ++idx, --rest) {
+      Status s = emit(chunk.Element(idx));
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    offset = 0;
+  }
+  return iter->status();
+}
+
+// Reads the elements in [start, stop] (normalized as LRANGE does) into *ret.
+static Status RangeListsElements(rocksdb::Iterator* iter, const Slice& key, ParsedListsMetaValue* meta, int64_t start,
+                                 int64_t stop, std::vector<std::string>* ret) {
+  int64_t start_pos = 0;
+  int64_t stop_pos = 0;
+  if (!NormalizeListsRange(meta, start, stop, &start_pos, &stop_pos)) {
+    return Status::OK();
+  }
+  return ForEachListsElement(iter, key, meta, start_pos, stop_pos, [ret](const Slice& element) {
+    ret->push_back(element.ToString());
+    return Status::OK();
+  });
+}
+
+// Reads every element of a list still in the per-key encoding, see Redis::ListsToChunked.
+static Status ReadLegacyListsElements(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* data_cf, const Slice& key,
+                                      std::string* meta_value, std::vector<std::string>* elements) {
+  ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+  std::unique_ptr<rocksdb::Iterator> iter(db->NewIterator(rocksdb::ReadOptions(), data_cf));
+  Status s = RangeListsElements(iter.get(), key, &parsed_lists_meta_value, 0, -1, elements);
+  if (s.ok() && elements->size() != parsed_lists_meta_value.Count()) {
+    return Status::Corruption("list has fewer elements than its meta count");
+  }
+  return s;
+}
+
+// Pushes values to the head (or the tail) of the list one by one, chunked lists
+// fill up the chunk at that end before opening a new one.
+static Status PushListsElements(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* data_cf, Batch* batch,
+                                ListsChunkIndex* index, const Slice& key, ParsedListsMetaValue* meta,
+                                const std::vector<std::string>& values, bool head) {
+  uint64_t version = meta->Version();
+  if (meta->Encoding() != kListsChunked) {
+    for (const auto& value : values) {
+      uint64_t index = head ? meta->LeftIndex() : meta->RightIndex();
+      if (head) {
+        meta->ModifyLeftIndex(1);
+      } else {
+        meta->ModifyRightIndex(1);
+      }
+      meta->ModifyCount(1);
+      ListsDataKey lists_data_key(key, version, index);
+      BaseDataValue i_val(value);
+      batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
+    }
+    return Status::OK();
+  }
+
+  ListsChunk chunk;
+  std::string chunk_key;
+  if (meta->Count() != 0) {
+    std::unique_ptr<rocksdb::Iterator> iter(db->NewIterator(rocksdb::ReadOptions(), data_cf));
+    SeekListsEnd(iter.get(), key, meta, head);
+    if (iter->Valid() && iter->key().starts_with(ListsDataPrefix(key, version))) {
+      if (!DecodeListsData(kListsChunked, iter->value(), &chunk)) {
+        return Status::Corruption("invalid list chunk");
+      }
+      chunk_key = iter->key().ToString();
+    } else if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+
+  bool dirty = false;
+  for (const auto& value : values) {
+    if (chunk_key.empty() || chunk.Full()) {
+      if (dirty) {
+        PutListsData(batch, index, kListsChunked, chunk_key, chunk);
+      }
+      uint64_t chunk_id = head ? meta->LeftIndex() : meta->RightIndex();
+      if (head) {
+        meta->ModifyLeftIndex(kListsChunkIdGap);
+      } else {
+        meta->ModifyRightIndex(kListsChunkIdGap);
+      }
+      ListsDataKey lists_data_key(key, version, chunk_id);
+      chunk_key = lists_data_key.Encode().ToString();
+      chunk.Clear();
+    }
+    if (head) {
+      chunk.PushFront(value);
+    } else {
+      chunk.PushBack(value);
+    }
+    meta->ModifyCount(1);
+    dirty = true;
+  }
+  if (dirty) {
+    PutListsData(batch, index, kListsChunked, chunk_key, chunk);
+  }
+  return Status::OK();
+}
+
+// Removes up to count elements from the head (or the tail) of the list, the removed
+// elements are appended to *elements in pop order unless elements is nullptr.
+static Status PopListsElements(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* data_cf, Batch* batch,
+                               ListsChunkIndex* index, const Slice& key, ParsedListsMetaValue* meta, uint64_t count,
+                               bool head, std::vector<std::string>* elements) {
+  ListsEncoding encoding = meta->Encoding();
+  std::string prefix = ListsDataPrefix(key, meta->Version());
+  std::unique_ptr<rocksdb::Iterator> iter(db->NewIterator(rocksdb::ReadOptions(), data_cf));
+  ListsChunk chunk;
+  for (SeekListsEnd(iter.get(), key, meta, head); count != 0 && iter->Valid() && iter->key().starts_with(prefix);
+       head ? iter->Next() : iter->Prev()) {
+    if (!DecodeListsData(encoding, iter->value(), &chunk)) {
+      return Status::Corruption("invalid list chunk");
+    }
+    size_t num = std::min<uint64_t>(count, chunk.Size());
+    if (elements != nullptr) {
+      for (size_t idx = 0; idx < num; ++idx) {
+        elements->push_back(head ? chunk.Element(idx) : chunk.Element(chunk.Size() - 1 - idx));
+      }
+    }
+    if (head) {
+      chunk.EraseFront(num);
+    } else {
+      chunk.EraseBack(num);
+    }
+    PutListsData(batch, index, encoding, iter->key(), chunk);
+    count -= num;
+    meta->ModifyCount(-num);
+    if (encoding != kListsChunked) {
+      if (head) {
+        meta->ModifyLeftIndex(-num);
+      } else {
+        meta->ModifyRightIndex(-num);
+      }
+    }
+  }
+  return iter->status();
+}
+
 Status Redis::ScanListsKeyNum(KeyInfo* key_info) {
   uint64_t keys = 0;
   uint64_t expires = 0;
@@ -75,19 +432,22 @@ Status Redis::LIndex(const Slice& key, int64_t index, std::string* element) {
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      uint64_t version = parsed_lists_meta_value.Version();
-      uint64_t target_index =
-          index >= 0 ? parsed_lists_meta_value.LeftIndex() + index + 1 : parsed_lists_meta_value.RightIndex() + index;
-      if (parsed_lists_meta_value.LeftIndex() < target_index && target_index < parsed_lists_meta_value.RightIndex()) {
-        ListsDataKey lists_data_key(key, version, target_index);
-        s = db_->Get(read_options, handles_[kListsDataCF], lists_data_key.Encode(), element);
-        if (s.ok()) {
-          ParsedBaseDataValue parsed_value(element);
-          parsed_value.StripSuffix();
-        }
-      } else {
+      auto count = static_cast<int64_t>(parsed_lists_meta_value.Count());
+      if (index >= count || index < -count) {
         return Status::NotFound();
       }
+      uint64_t pos = index >= 0 ? index : count + index;
+      std::string prefix = ListsDataPrefix(key, parsed_lists_meta_value.Version());
+      std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kListsDataCF]));
+      uint32_t offset = 0;
+      if (!SeekListsElement(iter.get(), key, &parsed_lists_meta_value, prefix, pos, &offset)) {
+        return iter->status().ok() ? Status::NotFound() : iter->status();
+      }
+      ListsChunk chunk;
+      if (!DecodeListsData(parsed_lists_meta_value.Encoding(), iter->value(), &chunk) || offset >= chunk.Size()) {
+        return Status::Corruption("invalid list chunk");
+      }
+      *element = chunk.Element(offset);
     }
   }
   return s;
@@ -110,88 +470,98 @@ Status Redis::LInsert(const Slice& key, const BeforeOrAfter& before_or_after, co
                                      ", expect type: " + DataTypeStrings[static_cast<int>(DataType::kLists)] +
                                      "get type: " + DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     } else {
+      if (ParsedListsMetaValue(&meta_value).Encoding() != kListsChunked) {
+        std::vector<std::string> elements;
+        s = ReadLegacyListsElements(db_, handles_[kListsDataCF], key, &meta_value, &elements);
+        if (!s.ok()) {
+          return s;
+        }
+        auto pivot_iter = std::find(elements.begin(), elements.end(), pivot);
+        if (pivot_iter == elements.end()) {
+          *ret = -1;
+          return Status::NotFound();
+        }
+        elements.insert(before_or_after == Before ? pivot_iter : pivot_iter + 1, value);
+        s = ListsToChunked(batch.get(), key, &meta_value, elements);
+        if (!s.ok()) {
+          return s;
+        }
+        *ret = static_cast<int64_t>(elements.size());
+        return batch->Commit();
+      }
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      bool find_pivot = false;
-      uint64_t pivot_index = 0;
       uint64_t version = parsed_lists_meta_value.Version();
-      uint64_t current_index = parsed_lists_meta_value.LeftIndex() + 1;
-      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-      ListsDataKey start_data_key(key, version, current_index);
-      for (iter->Seek(start_data_key.Encode()); iter->Valid() && current_index < parsed_lists_meta_value.RightIndex();
-           iter->Next(), current_index++) {
-        ParsedBaseDataValue parsed_value(iter->value());
-        if (pivot == parsed_value.UserValue().ToString()) {
-          find_pivot = true;
-          pivot_index = current_index;
-          break;
+      std::string prefix = ListsDataPrefix(key, version);
+      std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(default_read_options_, handles_[kListsDataCF]));
+      ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+      ListsChunk chunk;
+      bool find_pivot = false;
+      size_t pivot_pos = 0;
+      for (SeekListsEnd(iter.get(), key, &parsed_lists_meta_value, true);
+           !find_pivot && iter->Valid() && iter->key().starts_with(prefix);) {
+        if (!DecodeListsData(kListsChunked, iter->value(), &chunk)) {
+          return Status::Corruption("invalid list chunk");
+        }
+        for (size_t idx = 0; idx < chunk.Size(); ++idx) {
+          if (chunk.Element(idx) == pivot) {
+            find_pivot = true;
+            pivot_pos = idx;
+            break;
+          }
+        }
+        if (!find_pivot) {
+          iter->Next();
         }
       }
-      delete iter;
       if (!find_pivot) {
+        if (!iter->status().ok()) {
+          return iter->status();
+        }
         *ret = -1;
         return Status::NotFound();
-      } else {
-        uint64_t target_index;
-        std::vector<std::string> list_nodes;
-        uint64_t mid_index = parsed_lists_meta_value.LeftIndex() +
-                             (parsed_lists_meta_value.RightIndex() - parsed_lists_meta_value.LeftIndex()) / 2;
-        if (pivot_index <= mid_index) {
-          target_index = (before_or_after == Before) ? pivot_index - 1 : pivot_index;
-          current_index = parsed_lists_meta_value.LeftIndex() + 1;
-          rocksdb::Iterator* first_half_iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-          ListsDataKey start_data_key(key, version, current_index);
-          for (first_half_iter->Seek(start_data_key.Encode()); first_half_iter->Valid() && current_index <= pivot_index;
-               first_half_iter->Next(), current_index++) {
-            ParsedBaseDataValue parsed_value(first_half_iter->value());
-            if (current_index == pivot_index) {
-              if (before_or_after == After) {
-                list_nodes.push_back(parsed_value.UserValue().ToString());
-              }
-              break;
-            }
-            list_nodes.push_back(parsed_value.UserValue().ToString());
-          }
-          delete first_half_iter;
+      }
 
-          current_index = parsed_lists_meta_value.LeftIndex();
-          for (const auto& node : list_nodes) {
-            ListsDataKey lists_data_key(key, version, current_index++);
-            BaseDataValue i_val(node);
-            batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
-          }
-          parsed_lists_meta_value.ModifyLeftIndex(1);
+      // only the chunk holding the pivot is rewritten, it is split in two once it outgrows the chunk limits
+      chunk.Insert(before_or_after == Before ? pivot_pos : pivot_pos + 1, value);
+      parsed_lists_meta_value.ModifyCount(1);
+      std::string chunk_key = iter->key().ToString();
+      uint64_t chunk_id = ListsDataIndex(chunk_key);
+      if (chunk.Oversized()) {
+        ListsChunk right_chunk;
+        chunk.SplitInto(&right_chunk);
+        iter->Next();
+        uint64_t next_chunk_id = (iter->Valid() && iter->key().starts_with(prefix))
+                                     ? ListsDataIndex(iter->key())
+                                     : parsed_lists_meta_value.RightIndex();
+        if (next_chunk_id - chunk_id > 1) {
+          ListsDataKey right_data_key(key, version, chunk_id + (next_chunk_id - chunk_id) / 2);
+          PutListsData(batch.get(), &index, kListsChunked, right_data_key.Encode(), right_chunk);
         } else {
-          target_index = (before_or_after == Before) ? pivot_index : pivot_index + 1;
-          current_index = pivot_index;
-          rocksdb::Iterator* after_half_iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-          ListsDataKey start_data_key(key, version, current_index);
-          for (after_half_iter->Seek(start_data_key.Encode());
-               after_half_iter->Valid() && current_index < parsed_lists_meta_value.RightIndex();
-               after_half_iter->Next(), current_index++) {
-            if (current_index == pivot_index && before_or_after == BeforeOrAfter::After) {
-              continue;
-            }
-            ParsedBaseDataValue parsed_value(after_half_iter->value());
-            list_nodes.push_back(parsed_value.UserValue().ToString());
+          // no free id left between the two chunks, move everything after the split
+          // point to new ids behind the tail
+          ListsDataKey right_data_key(key, version, parsed_lists_meta_value.RightIndex());
+          parsed_lists_meta_value.ModifyRightIndex(kListsChunkIdGap);
+          PutListsData(batch.get(), &index, kListsChunked, right_data_key.Encode(), right_chunk);
+          for (; iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+            ListsDataKey moved_data_key(key, version, parsed_lists_meta_value.RightIndex());
+            parsed_lists_meta_value.ModifyRightIndex(kListsChunkIdGap);
+            batch->Put(kListsDataCF, moved_data_key.Encode(), iter->value());
+            index.Set(moved_data_key.Encode(), ListsDataCount(kListsChunked, iter->value()));
+            DeleteListsData(batch.get(), &index, iter->key());
           }
-          delete after_half_iter;
-
-          current_index = target_index + 1;
-          for (const auto& node : list_nodes) {
-            ListsDataKey lists_data_key(key, version, current_index++);
-            BaseDataValue i_val(node);
-            batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
+          if (!iter->status().ok()) {
+            return iter->status();
           }
-          parsed_lists_meta_value.ModifyRightIndex(1);
         }
-        parsed_lists_meta_value.ModifyCount(1);
-        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
-        ListsDataKey lists_target_key(key, version, target_index);
-        BaseDataValue i_val(value);
-        batch->Put(kListsDataCF, lists_target_key.Encode(), i_val.Encode());
-        *ret = static_cast<int32_t>(parsed_lists_meta_value.Count());
-        return batch->Commit();
       }
+      PutListsData(batch.get(), &index, kListsChunked, chunk_key, chunk);
+      s = index.Flush(batch.get(), &parsed_lists_meta_value);
+      if (!s.ok()) {
+        return s;
+      }
+      batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+      *ret = static_cast<int64_t>(parsed_lists_meta_value.Count());
+      return batch->Commit();
     }
   } else if (s.IsNotFound()) {
     *ret = 0;
@@ -241,24 +611,18 @@ Status Redis::LPop(const Slice& key, int64_t count, std::vector<std::string>* el
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      auto size = static_cast<int64_t>(parsed_lists_meta_value.Count());
-      uint64_t version = parsed_lists_meta_value.Version();
-      int32_t start_index = 0;
-      auto stop_index = static_cast<int32_t>(count <= size ? count - 1 : size - 1);
-      int32_t cur_index = 0;
-      ListsDataKey lists_data_key(key, version, parsed_lists_meta_value.LeftIndex() + 1);
-      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-      for (iter->Seek(lists_data_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
-        statistic++;
-        ParsedBaseDataValue parsed_base_data_value(iter->value());
-        elements->push_back(parsed_base_data_value.UserValue().ToString());
-        batch->Delete(kListsDataCF, iter->key());
-
-        parsed_lists_meta_value.ModifyCount(-1);
-        parsed_lists_meta_value.ModifyLeftIndex(-1);
+      uint64_t pop_count = count > 0 ? std::min<uint64_t>(count, parsed_lists_meta_value.Count()) : 0;
+      ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+      s = PopListsElements(db_, handles_[kListsDataCF], batch.get(), &index, key, &parsed_lists_meta_value, pop_count,
+                           true, elements);
+      if (s.ok()) {
+        s = index.Flush(batch.get(), &parsed_lists_meta_value);
       }
+      if (!s.ok()) {
+        return s;
+      }
+      statistic = elements->size();
       batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
-      delete iter;
     }
   }
   if (batch->Count() != 0U) {
@@ -273,8 +637,6 @@ Status Redis::LPush(const Slice& key, const std::vector<std::string>& values, ui
   auto batch = Batch::CreateBatch(this);
   ScopeRecordLock l(lock_mgr_, key);
 
-  uint64_t index = 0;
-  uint64_t version = 0;
   std::string meta_value;
 
   BaseMetaKey base_meta_key(key);
@@ -293,37 +655,24 @@ Status Redis::LPush(const Slice& key, const std::vector<std::string>& values, ui
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
     if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
-      version = parsed_lists_meta_value.InitialMetaValue();
-    } else {
-      version = parsed_lists_meta_value.Version();
+      parsed_lists_meta_value.InitialMetaValue();
     }
-    for (const auto& value : values) {
-      index = parsed_lists_meta_value.LeftIndex();
-      parsed_lists_meta_value.ModifyLeftIndex(1);
-      parsed_lists_meta_value.ModifyCount(1);
-      ListsDataKey lists_data_key(key, version, index);
-      BaseDataValue i_val(value);
-      batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
-    }
-    batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
-    *ret = parsed_lists_meta_value.Count();
   } else if (s.IsNotFound()) {
-    char str[8];
-    EncodeFixed64(str, values.size());
-    ListsMetaValue lists_meta_value(Slice(str, sizeof(uint64_t)));
-    version = lists_meta_value.UpdateVersion();
-    for (const auto& value : values) {
-      index = lists_meta_value.LeftIndex();
-      lists_meta_value.ModifyLeftIndex(1);
-      ListsDataKey lists_data_key(key, version, index);
-      BaseDataValue i_val(value);
-      batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
-    }
-    batch->Put(kMetaCF, base_meta_key.Encode(), lists_meta_value.Encode());
-    *ret = lists_meta_value.RightIndex() - lists_meta_value.LeftIndex() - 1;
+    meta_value = NewListsMetaValue();
   } else {
     return s;
   }
+  ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+  ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+  s = PushListsElements(db_, handles_[kListsDataCF], batch.get(), &index, key, &parsed_lists_meta_value, values, true);
+  if (s.ok()) {
+    s = index.Flush(batch.get(), &parsed_lists_meta_value);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+  *ret = parsed_lists_meta_value.Count();
   return batch->Commit();
 }
 
@@ -345,14 +694,14 @@ Status Redis::LPushx(const Slice& key, const std::vector<std::string>& values, u
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      uint64_t version = parsed_lists_meta_value.Version();
-      for (const auto& value : values) {
-        uint64_t index = parsed_lists_meta_value.LeftIndex();
-        parsed_lists_meta_value.ModifyCount(1);
-        parsed_lists_meta_value.ModifyLeftIndex(1);
-        ListsDataKey lists_data_key(key, version, index);
-        BaseDataValue i_val(value);
-        batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
+      ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+      s = PushListsElements(db_, handles_[kListsDataCF], batch.get(), &index, key, &parsed_lists_meta_value, values,
+                            true);
+      if (s.ok()) {
+        s = index.Flush(batch.get(), &parsed_lists_meta_value);
+      }
+      if (!s.ok()) {
+        return s;
       }
       batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
       *len = parsed_lists_meta_value.Count();
@@ -381,39 +730,61 @@ Status Redis::LRange(const Slice& key, int64_t start, int64_t stop, std::vector<
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      uint64_t version = parsed_lists_meta_value.Version();
-      uint64_t origin_left_index = parsed_lists_meta_value.LeftIndex() + 1;
-      uint64_t origin_right_index = parsed_lists_meta_value.RightIndex() - 1;
-      uint64_t sublist_left_index = start >= 0 ? origin_left_index + start : origin_right_index + start + 1;
-      uint64_t sublist_right_index = stop >= 0 ? origin_left_index + stop : origin_right_index + stop + 1;
-
-      if (sublist_left_index > sublist_right_index || sublist_left_index > origin_right_index ||
-          sublist_right_index < origin_left_index) {
-        return Status::OK();
-      } else {
-        if (sublist_left_index < origin_left_index) {
-          sublist_left_index = origin_left_index;
-        }
-        if (sublist_right_index > origin_right_index) {
-          sublist_right_index = origin_right_index;
-        }
-        rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kListsDataCF]);
-        uint64_t current_index = sublist_left_index;
-        ListsDataKey start_data_key(key, version, current_index);
-        for (iter->Seek(start_data_key.Encode()); iter->Valid() && current_index <= sublist_right_index;
-             iter->Next(), current_index++) {
-          ParsedBaseDataValue parsed_value(iter->value());
-          ret->push_back(parsed_value.UserValue().ToString());
-        }
-        delete iter;
-        return Status::OK();
-      }
+      std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kListsDataCF]));
+      return RangeListsElements(iter.get(), key, &parsed_lists_meta_value, start, stop, ret);
     }
   } else {
     return s;
   }
 }
 
+Status Redis::LRange(const Slice& key, int64_t start, int64_t stop, std::unique_ptr<ElementReader>* reader) {
+  const rocksdb::Snapshot* snapshot = nullptr;
+  std::string meta_value;
+  Status s = GetReaderMeta(key, DataType::kLists, &snapshot, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+
+  ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+  int64_t start_pos = 0;
+  int64_t stop_pos = -1;
+  if (!NormalizeListsRange(&parsed_lists_meta_value, start, stop, &start_pos, &stop_pos)) {
+    start_pos = 0;
+    stop_pos = -1;
+  }
+  uint64_t count = stop_pos - start_pos + 1;
+  // every read walks on from the position the last one stopped at
+  auto read_fn = [key = key.ToString(), meta_value, pos = start_pos, stop_pos](
+                     rocksdb::Iterator* iter, ElementSink* sink, size_t max_bytes, bool* done) mutable {
+    ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+    size_t bytes = 0;
+    bool paused = false;
+    Status s = ForEachListsElement(iter, key, &parsed_lists_meta_value, pos, stop_pos,
+                                   [&](const Slice& element) {
+                                     ++pos;
+                                     bytes += element.size();
+                                     Status appended = sink->Append(element);
+                                     if (appended.ok() && bytes >= max_bytes && pos <= stop_pos) {
+                                       paused = true;
+                                       return Status::Incomplete("paused");
+                                     }
+                                     return appended;
+                                   });
+    if (paused) {
+      return Status::OK();
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    *done = pos > stop_pos;
+    return *done ? Status::OK() : Status::Corruption("list has fewer elements than its count");
+  };
+  *reader = std::make_unique<CollectionReader>(this, snapshot, DataType::kLists, key, kListsDataCF, count,
+                                               std::move(read_fn));
+  return Status::OK();
+}
+
 Status Redis::LRangeWithTTL(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret,
                             int64_t* ttl) {
   rocksdb::ReadOptions read_options;
@@ -444,33 +815,8 @@ Status Redis::LRangeWithTTL(const Slice& key, int64_t start, int64_t stop, std::
         *ttl = *ttl - curtime >= 0 ? *ttl - curtime : -2;
       }
 
-      uint64_t version = parsed_lists_meta_value.Version();
-      uint64_t origin_left_index = parsed_lists_meta_value.LeftIndex() + 1;
-      uint64_t origin_right_index = parsed_lists_meta_value.RightIndex() - 1;
-      uint64_t sublist_left_index = start >= 0 ? origin_left_index + start : origin_right_index + start + 1;
-      uint64_t sublist_right_index = stop >= 0 ? origin_left_index + stop : origin_right_index + stop + 1;
-
-      if (sublist_left_index > sublist_right_index || sublist_left_index > origin_right_index ||
-          sublist_right_index < origin_left_index) {
-        return Status::OK();
-      } else {
-        if (sublist_left_index < origin_left_index) {
-          sublist_left_index = origin_left_index;
-        }
-        if (sublist_right_index > origin_right_index) {
-          sublist_right_index = origin_right_index;
-        }
-        rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kListsDataCF]);
-        uint64_t current_index = sublist_left_index;
-        ListsDataKey start_data_key(key, version, current_index);
-        for (iter->Seek(start_data_key.Encode()); iter->Valid() && current_index <= sublist_right_index;
-             iter->Next(), current_index++) {
-          ParsedBaseDataValue parsed_value(iter->value());
-          ret->push_back(iter->value().ToString());
-        }
-        delete iter;
-        return Status::OK();
-      }
+      std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kListsDataCF]));
+      return RangeListsElements(iter.get(), key, &parsed_lists_meta_value, start, stop, ret);
     }
   } else {
     return s;
@@ -493,108 +839,114 @@ Status Redis::LRem(const Slice& key, int64_t count, const Slice& value, uint64_t
                                                  DataTypeStrings[static_cast<int>(DataType::kLists)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
-      ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      uint64_t current_index;
-      std::vector<uint64_t> target_index;
-      std::vector<uint64_t> delete_index;
       uint64_t rest = (count < 0) ? -count : count;
-      uint64_t version = parsed_lists_meta_value.Version();
-      uint64_t start_index = parsed_lists_meta_value.LeftIndex() + 1;
-      uint64_t stop_index = parsed_lists_meta_value.RightIndex() - 1;
-      ListsDataKey start_data_key(key, version, start_index);
-      ListsDataKey stop_data_key(key, version, stop_index);
-      if (count >= 0) {
-        current_index = start_index;
-        rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-        for (iter->Seek(start_data_key.Encode());
-             iter->Valid() && current_index <= stop_index && ((count == 0) || rest != 0);
-             iter->Next(), current_index++) {
-          ParsedBaseDataValue parsed_value(iter->value());
-          if (value.compare(parsed_value.UserValue()) == 0) {
-            target_index.push_back(current_index);
-            if (count != 0) {
-              rest--;
-            }
-          }
+      uint64_t removed = 0;
+      bool from_head = count >= 0;
+      if (ParsedListsMetaValue(&meta_value).Encoding() != kListsChunked) {
+        std::vector<std::string> elements;
+        s = ReadLegacyListsElements(db_, handles_[kListsDataCF], key, &meta_value, &elements);
+        if (!s.ok()) {
+          return s;
         }
-        delete iter;
-      } else {
-        current_index = stop_index;
-        rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-        for (iter->Seek(stop_data_key.Encode());
-             iter->Valid() && current_index >= start_index && ((count == 0) || rest != 0);
-             iter->Prev(), current_index--) {
-          ParsedBaseDataValue parsed_value(iter->value());
-          if (value.compare(parsed_value.UserValue()) == 0) {
-            target_index.push_back(current_index);
-            if (count != 0) {
-              rest--;
-            }
+        std::vector<std::string> kept;
+        for (size_t i = 0; i < elements.size(); ++i) {
+          std::string& element = elements[from_head ? i : elements.size() - 1 - i];
+          if ((count == 0 || removed < rest) && value.compare(element) == 0) {
+            removed++;
+          } else {
+            kept.push_back(std::move(element));
           }
         }
-        delete iter;
+        if (removed == 0) {
+          return Status::NotFound();
+        }
+        if (!from_head) {
+          std::reverse(kept.begin(), kept.end());
+        }
+        s = ListsToChunked(batch.get(), key, &meta_value, kept);
+        if (!s.ok()) {
+          return s;
+        }
+        *ret = removed;
+        return batch->Commit();
       }
-      if (target_index.empty()) {
-        *ret = 0;
-        return Status::NotFound();
-      } else {
-        rest = target_index.size();
-        uint64_t sublist_left_index = (count >= 0) ? target_index[0] : target_index[target_index.size() - 1];
-        uint64_t sublist_right_index = (count >= 0) ? target_index[target_index.size() - 1] : target_index[0];
-        uint64_t left_part_len = sublist_right_index - start_index;
-        uint64_t right_part_len = stop_index - sublist_left_index;
-        if (left_part_len <= right_part_len) {
-          uint64_t left = sublist_right_index;
-          current_index = sublist_right_index;
-          ListsDataKey sublist_right_key(key, version, sublist_right_index);
-          rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-          for (iter->Seek(sublist_right_key.Encode()); iter->Valid() && current_index >= start_index;
-               iter->Prev(), current_index--) {
-            ParsedBaseDataValue parsed_value(iter->value());
-            if (value.compare(parsed_value.UserValue()) == 0 && rest > 0) {
-              rest--;
+      ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+      std::string prefix = ListsDataPrefix(key, parsed_lists_meta_value.Version());
+      std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(default_read_options_, handles_[kListsDataCF]));
+      ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+      ListsChunk chunk;
+      // Only the chunks holding a removed element are rewritten. A chunk left underfull is
+      // folded into the chunk visited right before it when both fit in one, so scattered
+      // removals do not leave a long run of near-empty chunks behind. The previous chunk is
+      // held back until it is known whether the current one merges into it.
+      ListsChunk prev_chunk;
+      std::string prev_key;
+      bool prev_modified = false;
+      for (SeekListsEnd(iter.get(), key, &parsed_lists_meta_value, from_head);
+           (count == 0 || removed < rest) && iter->Valid() && iter->key().starts_with(prefix);
+           from_head ? iter->Next() : iter->Prev()) {
+        if (!DecodeListsData(kListsChunked, iter->value(), &chunk)) {
+          return Status::Corruption("invalid list chunk");
+        }
+        bool modified = false;
+        if (from_head) {
+          for (size_t idx = 0; idx < chunk.Size() && (count == 0 || removed < rest);) {
+            if (value.compare(chunk.Element(idx)) == 0) {
+              chunk.Erase(idx);
+              removed++;
+              modified = true;
             } else {
-              ListsDataKey lists_data_key(key, version, left--);
-              batch->Put(kListsDataCF, lists_data_key.Encode(), iter->value());
+              idx++;
             }
           }
-          delete iter;
-          uint64_t left_index = parsed_lists_meta_value.LeftIndex();
-          for (uint64_t idx = 0; idx < target_index.size(); ++idx) {
-            delete_index.push_back(left_index + idx + 1);
-          }
-          parsed_lists_meta_value.ModifyLeftIndex(-target_index.size());
         } else {
-          uint64_t right = sublist_left_index;
-          current_index = sublist_left_index;
-          ListsDataKey sublist_left_key(key, version, sublist_left_index);
-          rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-          for (iter->Seek(sublist_left_key.Encode()); iter->Valid() && current_index <= stop_index;
-               iter->Next(), current_index++) {
-            ParsedBaseDataValue parsed_value(iter->value());
-            if ((value.compare(parsed_value.UserValue()) == 0) && rest > 0) {
-              rest--;
-            } else {
-              ListsDataKey lists_data_key(key, version, right++);
-              batch->Put(kListsDataCF, lists_data_key.Encode(), iter->value());
+          for (size_t idx = chunk.Size(); idx > 0 && removed < rest; --idx) {
+            if (value.compare(chunk.Element(idx - 1)) == 0) {
+              chunk.Erase(idx - 1);
+              removed++;
+              modified = true;
             }
           }
-          delete iter;
-          uint64_t right_index = parsed_lists_meta_value.RightIndex();
-          for (uint64_t idx = 0; idx < target_index.size(); ++idx) {
-            delete_index.push_back(right_index - idx - 1);
+        }
+        if (!prev_key.empty() && (modified || prev_modified) && (chunk.Underfull() || prev_chunk.Underfull()) &&
+            prev_chunk.FitsWith(chunk)) {
+          // the merged chunk keeps the id of the one nearer the head
+          if (from_head) {
+            prev_chunk.Append(chunk);
+            DeleteListsData(batch.get(), &index, iter->key());
+          } else {
+            chunk.Append(prev_chunk);
+            prev_chunk = std::move(chunk);
+            DeleteListsData(batch.get(), &index, prev_key);
+            prev_key = iter->key().ToString();
           }
-          parsed_lists_meta_value.ModifyRightIndex(-target_index.size());
+          prev_modified = true;
+          continue;
         }
-        parsed_lists_meta_value.ModifyCount(-target_index.size());
-        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
-        for (const auto& idx : delete_index) {
-          ListsDataKey lists_data_key(key, version, idx);
-          batch->Delete(kListsDataCF, lists_data_key.Encode());
+        if (prev_modified) {
+          PutListsData(batch.get(), &index, kListsChunked, prev_key, prev_chunk);
         }
-        *ret = target_index.size();
-        return batch->Commit();
+        prev_chunk = std::move(chunk);
+        prev_key = iter->key().ToString();
+        prev_modified = modified;
       }
+      if (prev_modified) {
+        PutListsData(batch.get(), &index, kListsChunked, prev_key, prev_chunk);
+      }
+      if (!iter->status().ok()) {
+        return iter->status();
+      }
+      if (removed == 0) {
+        return Status::NotFound();
+      }
+      parsed_lists_meta_value.ModifyCount(-removed);
+      s = index.Flush(batch.get(), &parsed_lists_meta_value);
+      if (!s.ok()) {
+        return s;
+      }
+      batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+      *ret = removed;
+      return batch->Commit();
     }
   } else if (s.IsNotFound()) {
     *ret = 0;
@@ -619,15 +971,25 @@ Status Redis::LSet(const Slice& key, int64_t index, const Slice& value) {
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      uint64_t version = parsed_lists_meta_value.Version();
-      uint64_t target_index =
-          index >= 0 ? parsed_lists_meta_value.LeftIndex() + index + 1 : parsed_lists_meta_value.RightIndex() + index;
-      if (target_index <= parsed_lists_meta_value.LeftIndex() || target_index >= parsed_lists_meta_value.RightIndex()) {
+      auto count = static_cast<int64_t>(parsed_lists_meta_value.Count());
+      if (index >= count || index < -count) {
         return Status::Corruption("index out of range");
       }
-      ListsDataKey lists_data_key(key, version, target_index);
-      BaseDataValue i_val(value);
-      batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
+      uint64_t pos = index >= 0 ? index : count + index;
+      std::string prefix = ListsDataPrefix(key, parsed_lists_meta_value.Version());
+      std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(default_read_options_, handles_[kListsDataCF]));
+      uint32_t offset = 0;
+      if (!SeekListsElement(iter.get(), key, &parsed_lists_meta_value, prefix, pos, &offset)) {
+        return iter->status().ok() ? Status::Corruption("index out of range") : iter->status();
+      }
+      ListsChunk chunk;
+      if (!DecodeListsData(parsed_lists_meta_value.Encoding(), iter->value(), &chunk) || offset >= chunk.Size()) {
+        return Status::Corruption("invalid list chunk");
+      }
+      chunk.Set(offset, value);
+      // the element count of the chunk stays, its index group is left as it is
+      ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+      PutListsData(batch.get(), &index, parsed_lists_meta_value.Encoding(), iter->key(), chunk);
       statistic++;
       UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
       return batch->Commit();
@@ -654,41 +1016,82 @@ Status Redis::LTrim(const Slice& key, int64_t start, int64_t stop) {
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      uint64_t version = parsed_lists_meta_value.Version();
-      uint64_t origin_left_index = parsed_lists_meta_value.LeftIndex() + 1;
-      uint64_t origin_right_index = parsed_lists_meta_value.RightIndex() - 1;
-      uint64_t sublist_left_index = start >= 0 ? origin_left_index + start : origin_right_index + start + 1;
-      uint64_t sublist_right_index = stop >= 0 ? origin_left_index + stop : origin_right_index + stop + 1;
-
-      if (sublist_left_index > sublist_right_index || sublist_left_index > origin_right_index ||
-          sublist_right_index < origin_left_index) {
+      ListsEncoding encoding = parsed_lists_meta_value.Encoding();
+      auto count = static_cast<int64_t>(parsed_lists_meta_value.Count());
+      int64_t start_pos = start >= 0 ? start : count + start;
+      int64_t stop_pos = stop >= 0 ? stop : count + stop;
+      start_pos = std::max<int64_t>(start_pos, 0);
+      stop_pos = std::min<int64_t>(stop_pos, count - 1);
+
+      if (start_pos > stop_pos) {
         parsed_lists_meta_value.InitialMetaValue();
         batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
       } else {
-        if (sublist_left_index < origin_left_index) {
-          sublist_left_index = origin_left_index;
+        std::string prefix = ListsDataPrefix(key, parsed_lists_meta_value.Version());
+        std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(default_read_options_, handles_[kListsDataCF]));
+        ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+        ListsChunk chunk;
+
+        // drop the data keys before start, the chunk holding start keeps its tail
+        ListsChunk head_chunk;
+        std::string head_chunk_key;
+        uint64_t head_rest = start_pos;
+        for (SeekListsEnd(iter.get(), key, &parsed_lists_meta_value, true);
+             head_rest != 0 && iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+          uint32_t data_count = ListsDataCount(encoding, iter->value());
+          if (data_count <= head_rest) {
+            DeleteListsData(batch.get(), &index, iter->key());
+            head_rest -= data_count;
+            continue;
+          }
+          if (!DecodeListsData(encoding, iter->value(), &head_chunk)) {
+            return Status::Corruption("invalid list chunk");
+          }
+          head_chunk.EraseFront(head_rest);
+          head_chunk_key = iter->key().ToString();
+          head_rest = 0;
         }
 
-        if (sublist_right_index > origin_right_index) {
-          sublist_right_index = origin_right_index;
+        // drop the data keys after stop, the chunk holding stop keeps its head
+        uint64_t tail_rest = count - 1 - stop_pos;
+        for (SeekListsEnd(iter.get(), key, &parsed_lists_meta_value, false);
+             tail_rest != 0 && iter->Valid() && iter->key().starts_with(prefix); iter->Prev()) {
+          uint32_t data_count = ListsDataCount(encoding, iter->value());
+          if (data_count <= tail_rest) {
+            DeleteListsData(batch.get(), &index, iter->key());
+            tail_rest -= data_count;
+            continue;
+          }
+          if (iter->key() == Slice(head_chunk_key)) {
+            head_chunk.EraseBack(tail_rest);
+          } else {
+            if (!DecodeListsData(encoding, iter->value(), &chunk)) {
+              return Status::Corruption("invalid list chunk");
+            }
+            chunk.EraseBack(tail_rest);
+            PutListsData(batch.get(), &index, encoding, iter->key(), chunk);
+          }
+          tail_rest = 0;
+        }
+        if (!iter->status().ok()) {
+          return iter->status();
+        }
+        if (!head_chunk_key.empty()) {
+          PutListsData(batch.get(), &index, encoding, head_chunk_key, head_chunk);
         }
 
-        uint64_t delete_node_num =
-            (sublist_left_index - origin_left_index) + (origin_right_index - sublist_right_index);
-        parsed_lists_meta_value.ModifyLeftIndex(-(sublist_left_index - origin_left_index));
-        parsed_lists_meta_value.ModifyRightIndex(-(origin_right_index - sublist_right_index));
-        parsed_lists_meta_value.ModifyCount(-delete_node_num);
-        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
-        for (uint64_t idx = origin_left_index; idx < sublist_left_index; ++idx) {
-          statistic++;
-          ListsDataKey lists_data_key(key, version, idx);
-          batch->Delete(kListsDataCF, lists_data_key.Encode());
+        uint64_t delete_node_num = start_pos + (count - 1 - stop_pos);
+        if (encoding != kListsChunked) {
+          parsed_lists_meta_value.ModifyLeftIndex(-start_pos);
+          parsed_lists_meta_value.ModifyRightIndex(-(count - 1 - stop_pos));
         }
-        for (uint64_t idx = origin_right_index; idx > sublist_right_index; --idx) {
-          statistic++;
-          ListsDataKey lists_data_key(key, version, idx);
-          batch->Delete(kListsDataCF, lists_data_key.Encode());
+        parsed_lists_meta_value.ModifyCount(-delete_node_num);
+        s = index.Flush(batch.get(), &parsed_lists_meta_value);
+        if (!s.ok()) {
+          return s;
         }
+        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+        statistic = delete_node_num;
       }
     }
   } else {
@@ -718,25 +1121,18 @@ Status Redis::RPop(const Slice& key, int64_t count, std::vector<std::string>* el
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      auto size = static_cast<int64_t>(parsed_lists_meta_value.Count());
-      uint64_t version = parsed_lists_meta_value.Version();
-      int32_t start_index = 0;
-      auto stop_index = static_cast<int32_t>(count <= size ? count - 1 : size - 1);
-      int32_t cur_index = 0;
-      ListsDataKey lists_data_key(key, version, parsed_lists_meta_value.RightIndex() - 1);
-      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kListsDataCF]);
-      for (iter->SeekForPrev(lists_data_key.Encode()); iter->Valid() && cur_index <= stop_index;
-           iter->Prev(), ++cur_index) {
-        statistic++;
-        ParsedBaseDataValue parsed_value(iter->value());
-        elements->push_back(parsed_value.UserValue().ToString());
-        batch->Delete(kListsDataCF, iter->key());
-
-        parsed_lists_meta_value.ModifyCount(-1);
-        parsed_lists_meta_value.ModifyRightIndex(-1);
+      uint64_t pop_count = count > 0 ? std::min<uint64_t>(count, parsed_lists_meta_value.Count()) : 0;
+      ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+      s = PopListsElements(db_, handles_[kListsDataCF], batch.get(), &index, key, &parsed_lists_meta_value, pop_count,
+                           false, elements);
+      if (s.ok()) {
+        s = index.Flush(batch.get(), &parsed_lists_meta_value);
+      }
+      if (!s.ok()) {
+        return s;
       }
+      statistic = elements->size();
       batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
-      delete iter;
     }
   }
   if (batch->Count() != 0U) {
@@ -766,41 +1162,57 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
                                                    DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
       } else {
         ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-        std::string target;
-        uint64_t version = parsed_lists_meta_value.Version();
-        uint64_t last_node_index = parsed_lists_meta_value.RightIndex() - 1;
-        ListsDataKey lists_data_key(source, version, last_node_index);
-        s = db_->Get(default_read_options_, handles_[kListsDataCF], lists_data_key.Encode(), &target);
-        if (s.ok()) {
-          *element = target;
-          ParsedBaseDataValue parsed_value(element);
-          parsed_value.StripSuffix();
-          if (parsed_lists_meta_value.Count() == 1) {
-            return Status::OK();
-          } else {
-            uint64_t target_index = parsed_lists_meta_value.LeftIndex();
-            ListsDataKey lists_target_key(source, version, target_index);
-            batch->Delete(kListsDataCF, lists_data_key.Encode());
-            batch->Put(kListsDataCF, lists_target_key.Encode(), target);
-            statistic++;
-            parsed_lists_meta_value.ModifyRightIndex(-1);
-            parsed_lists_meta_value.ModifyLeftIndex(1);
-            batch->Put(kMetaCF, base_source.Encode(), meta_value);
-            s = batch->Commit();
-            UpdateSpecificKeyStatistics(DataType::kLists, source.ToString(), statistic);
+        ListsEncoding encoding = parsed_lists_meta_value.Encoding();
+        std::string prefix = ListsDataPrefix(source, parsed_lists_meta_value.Version());
+        std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(default_read_options_, handles_[kListsDataCF]));
+        SeekListsEnd(iter.get(), source, &parsed_lists_meta_value, false);
+        if (!iter->Valid() || !iter->key().starts_with(prefix)) {
+          return iter->status().ok() ? Status::NotFound() : iter->status();
+        }
+        ListsChunk tail_chunk;
+        if (!DecodeListsData(encoding, iter->value(), &tail_chunk) || tail_chunk.Empty()) {
+          return Status::Corruption("invalid list chunk");
+        }
+        *element = tail_chunk.Element(tail_chunk.Size() - 1);
+        if (parsed_lists_meta_value.Count() == 1) {
+          return Status::OK();
+        }
+        std::string tail_chunk_key = iter->key().ToString();
+        ListsChunkIndex index(db_, handles_[kListsDataCF], source);
+        SeekListsEnd(iter.get(), source, &parsed_lists_meta_value, true);
+        if (encoding == kListsChunked && iter->Valid() && iter->key() == Slice(tail_chunk_key)) {
+          // the whole list lives in a single chunk, rotate it in place
+          tail_chunk.EraseBack(1);
+          tail_chunk.PushFront(*element);
+          PutListsData(batch.get(), &index, encoding, tail_chunk_key, tail_chunk);
+        } else {
+          s = PopListsElements(db_, handles_[kListsDataCF], batch.get(), &index, source, &parsed_lists_meta_value, 1,
+                               false, nullptr);
+          if (!s.ok()) {
             return s;
           }
-        } else {
+          s = PushListsElements(db_, handles_[kListsDataCF], batch.get(), &index, source, &parsed_lists_meta_value,
+                                {*element}, true);
+          if (!s.ok()) {
+            return s;
+          }
+        }
+        s = index.Flush(batch.get(), &parsed_lists_meta_value);
+        if (!s.ok()) {
           return s;
         }
+        statistic++;
+        batch->Put(kMetaCF, base_source.Encode(), meta_value);
+        s = batch->Commit();
+        UpdateSpecificKeyStatistics(DataType::kLists, source.ToString(), statistic);
+        return s;
       }
     } else {
       return s;
     }
   }
 
-  uint64_t version = 0;
-  std::string target;
+  std::vector<std::string> elements;
   std::string source_meta_value;
   BaseMetaKey base_source(source);
   s = db_->Get(default_read_options_, handles_[kMetaCF], base_source.Encode(), &source_meta_value);
@@ -814,19 +1226,20 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
                       DataTypeStrings[static_cast<int>(GetMetaValueType(source_meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&source_meta_value);
-      version = parsed_lists_meta_value.Version();
-      uint64_t last_node_index = parsed_lists_meta_value.RightIndex() - 1;
-      ListsDataKey lists_data_key(source, version, last_node_index);
-      s = db_->Get(default_read_options_, handles_[kListsDataCF], lists_data_key.Encode(), &target);
-      if (s.ok()) {
-        batch->Delete(kListsDataCF, lists_data_key.Encode());
-        statistic++;
-        parsed_lists_meta_value.ModifyCount(-1);
-        parsed_lists_meta_value.ModifyRightIndex(-1);
-        batch->Put(kMetaCF, base_source.Encode(), source_meta_value);
-      } else {
+      ListsChunkIndex source_index(db_, handles_[kListsDataCF], source);
+      s = PopListsElements(db_, handles_[kListsDataCF], batch.get(), &source_index, source, &parsed_lists_meta_value, 1,
+                           false, &elements);
+      if (!s.ok()) {
         return s;
+      } else if (elements.empty()) {
+        return Status::NotFound();
       }
+      s = source_index.Flush(batch.get(), &parsed_lists_meta_value);
+      if (!s.ok()) {
+        return s;
+      }
+      statistic++;
+      batch->Put(kMetaCF, base_source.Encode(), source_meta_value);
     }
   } else {
     return s;
@@ -847,36 +1260,29 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&destination_meta_value);
     if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
-      version = parsed_lists_meta_value.InitialMetaValue();
-    } else {
-      version = parsed_lists_meta_value.Version();
+      parsed_lists_meta_value.InitialMetaValue();
     }
-    uint64_t target_index = parsed_lists_meta_value.LeftIndex();
-    ListsDataKey lists_data_key(destination, version, target_index);
-    batch->Put(kListsDataCF, lists_data_key.Encode(), target);
-    parsed_lists_meta_value.ModifyCount(1);
-    parsed_lists_meta_value.ModifyLeftIndex(1);
-    batch->Put(kMetaCF, base_destination.Encode(), destination_meta_value);
   } else if (s.IsNotFound()) {
-    char str[8];
-    EncodeFixed64(str, 1);
-    ListsMetaValue lists_meta_value(Slice(str, sizeof(uint64_t)));
-    version = lists_meta_value.UpdateVersion();
-    uint64_t target_index = lists_meta_value.LeftIndex();
-    ListsDataKey lists_data_key(destination, version, target_index);
-    batch->Put(kListsDataCF, lists_data_key.Encode(), target);
-    lists_meta_value.ModifyLeftIndex(1);
-    batch->Put(kMetaCF, base_destination.Encode(), lists_meta_value.Encode());
+    destination_meta_value = NewListsMetaValue();
   } else {
     return s;
   }
+  ParsedListsMetaValue parsed_lists_meta_value(&destination_meta_value);
+  ListsChunkIndex destination_index(db_, handles_[kListsDataCF], destination);
+  s = PushListsElements(db_, handles_[kListsDataCF], batch.get(), &destination_index, destination,
+                        &parsed_lists_meta_value, elements, true);
+  if (s.ok()) {
+    s = destination_index.Flush(batch.get(), &parsed_lists_meta_value);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  batch->Put(kMetaCF, base_destination.Encode(), destination_meta_value);
 
   s = batch->Commit();
   UpdateSpecificKeyStatistics(DataType::kLists, source.ToString(), statistic);
   if (s.ok()) {
-    ParsedBaseDataValue parsed_value(&target);
-    parsed_value.StripSuffix();
-    *element = target;
+    *element = elements.front();
   }
   return s;
 }
@@ -884,9 +1290,8 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
 Status Redis::RPush(const Slice& key, const std::vector<std::string>& values, uint64_t* ret) {
   *ret = 0;
   auto batch = Batch::CreateBatch(this);
+  ScopeRecordLock l(lock_mgr_, key);
 
-  uint64_t index = 0;
-  uint64_t version = 0;
   std::string meta_value;
 
   BaseMetaKey base_meta_key(key);
@@ -903,37 +1308,24 @@ Status Redis::RPush(const Slice& key, const std::vector<std::string>& values, ui
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
     if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
-      version = parsed_lists_meta_value.InitialMetaValue();
-    } else {
-      version = parsed_lists_meta_value.Version();
-    }
-    for (const auto& value : values) {
-      index = parsed_lists_meta_value.RightIndex();
-      parsed_lists_meta_value.ModifyRightIndex(1);
-      parsed_lists_meta_value.ModifyCount(1);
-      ListsDataKey lists_data_key(key, version, index);
-      BaseDataValue i_val(value);
-      batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
+      parsed_lists_meta_value.InitialMetaValue();
     }
-    batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
-    *ret = parsed_lists_meta_value.Count();
   } else if (s.IsNotFound()) {
-    char str[8];
-    EncodeFixed64(str, values.size());
-    ListsMetaValue lists_meta_value(Slice(str, sizeof(uint64_t)));
-    version = lists_meta_value.UpdateVersion();
-    for (const auto& value : values) {
-      index = lists_meta_value.RightIndex();
-      lists_meta_value.ModifyRightIndex(1);
-      ListsDataKey lists_data_key(key, version, index);
-      BaseDataValue i_val(value);
-      batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
-    }
-    batch->Put(kMetaCF, base_meta_key.Encode(), lists_meta_value.Encode());
-    *ret = lists_meta_value.RightIndex() - lists_meta_value.LeftIndex() - 1;
+    meta_value = NewListsMetaValue();
   } else {
     return s;
   }
+  ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+  ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+  s = PushListsElements(db_, handles_[kListsDataCF], batch.get(), &index, key, &parsed_lists_meta_value, values, false);
+  if (s.ok()) {
+    s = index.Flush(batch.get(), &parsed_lists_meta_value);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+  *ret = parsed_lists_meta_value.Count();
   return batch->Commit();
 }
 
@@ -955,14 +1347,14 @@ Status Redis::RPushx(const Slice& key, const std::vector<std::string>& values, u
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
     } else {
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-      uint64_t version = parsed_lists_meta_value.Version();
-      for (const auto& value : values) {
-        uint64_t index = parsed_lists_meta_value.RightIndex();
-        parsed_lists_meta_value.ModifyCount(1);
-        parsed_lists_meta_value.ModifyRightIndex(1);
-        ListsDataKey lists_data_key(key, version, index);
-        BaseDataValue i_val(value);
-        batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
+      ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+      s = PushListsElements(db_, handles_[kListsDataCF], batch.get(), &index, key, &parsed_lists_meta_value, values,
+                            false);
+      if (s.ok()) {
+        s = index.Flush(batch.get(), &parsed_lists_meta_value);
+      }
+      if (!s.ok()) {
+        return s;
       }
       batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
       *len = parsed_lists_meta_value.Count();
@@ -972,6 +1364,46 @@ Status Redis::RPushx(const Slice& key, const std::vector<std::string>& values, u
   return s;
 }
 
+// Lists written before the chunked encoding keep one element per data key, a middle
+// operation on such a list reads all its elements, edits them in memory and hands them
+// here. They are packed into chunks under a new version in the command's own batch, so
+// the conversion and the edit land together. The old data keys fall behind the meta
+// version and are dropped by ListsDataFilter.
+Status Redis::ListsToChunked(Batch* batch, const Slice& key, std::string* meta_value,
+                             const std::vector<std::string>& elements) {
+  ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+  parsed_lists_meta_value.UpdateVersion();
+  parsed_lists_meta_value.set_left_index(InitalLeftIndex);
+  parsed_lists_meta_value.set_right_index(InitalRightIndex);
+  parsed_lists_meta_value.SetEncoding(kListsChunked);
+  parsed_lists_meta_value.SetCount(elements.size());
+  uint64_t version = parsed_lists_meta_value.Version();
+
+  ListsChunkIndex index(db_, handles_[kListsDataCF], key);
+  ListsChunk chunk;
+  for (const auto& element : elements) {
+    if (chunk.Full()) {
+      ListsDataKey lists_data_key(key, version, parsed_lists_meta_value.RightIndex());
+      parsed_lists_meta_value.ModifyRightIndex(kListsChunkIdGap);
+      PutListsData(batch, &index, kListsChunked, lists_data_key.Encode(), chunk);
+      chunk.Clear();
+    }
+    chunk.PushBack(element);
+  }
+  if (!chunk.Empty()) {
+    ListsDataKey lists_data_key(key, version, parsed_lists_meta_value.RightIndex());
+    parsed_lists_meta_value.ModifyRightIndex(kListsChunkIdGap);
+    PutListsData(batch, &index, kListsChunked, lists_data_key.Encode(), chunk);
+  }
+  Status s = index.Flush(batch, &parsed_lists_meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  BaseMetaKey base_meta_key(key);
+  batch->Put(kMetaCF, base_meta_key.Encode(), *meta_value);
+  return Status::OK();
+}
+
 Status Redis::ListsRename(const Slice& key, Redis* new_inst, const Slice& newkey) {
   std::string meta_value;
   uint32_t statistic = 0;
@@ -979,7 +1411,6 @@ Status Redis::ListsRename(const Slice& key, Redis* new_inst, const Slice& newkey
   MultiScopeRecordLock ml(lock_mgr_, keys);
 
   BaseMetaKey base_meta_key(key);
-  BaseMetaKey base_meta_newkey(newkey);
   Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (!s.ok() || !ExpectedMetaValue(DataType::kLists, meta_value)) {
     return s;
@@ -994,12 +1425,13 @@ Status Redis::ListsRename(const Slice& key, Redis* new_inst, const Slice& newkey
   // copy a new list with newkey
   ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
   statistic = parsed_lists_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // ListsDel key
+  uint64_t etime = parsed_lists_meta_value.Etime();
   parsed_lists_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
 
   return s;
@@ -1036,12 +1468,13 @@ Status Redis::ListsRenamenx(const Slice& key, Redis* new_inst, const Slice& newk
   ParsedSetsMetaValue parsed_lists_new_meta_value(&new_meta_value);
   // copy a new list with newkey
   statistic = parsed_lists_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // ListsDel key
+  uint64_t etime = parsed_lists_meta_value.Etime();
   parsed_lists_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
 
   return s;
@@ -1053,6 +1486,7 @@ void Redis::ScanLists() {
   ScopeSnapshot ss(db_, &snapshot);
   iterator_options.snapshot = snapshot;
   iterator_options.fill_cache = false;
+  iterator_options.total_order_seek = true;
   auto current_time = static_cast<int32_t>(time(nullptr));
 
   INFO("***************rocksdb instance: {} List Meta Data***************", index_);
@@ -18,6 +18,7 @@
 #include "pstd/log.h"
 #include "src/base_data_value_format.h"
 #include "src/base_filter.h"
+#include "src/scan_cursor.h"
 #include "src/scope_record_lock.h"
 #include "src/scope_snapshot.h"
 #include "storage/util.h"
@@ -610,6 +611,49 @@ rocksdb::Status Redis::SIsmember(const Slice& key, const Slice& member, int32_t*
   return s;
 }
 
+rocksdb::Status Redis::SMIsmember(const Slice& key, const std::vector<std::string>& members,
+                                  std::vector<int32_t>* rets) {
+  rets->assign(members.size(), 0);
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+
+  std::string meta_value;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
+
+  BaseMetaKey base_meta_key(key);
+  rocksdb::Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+  if (s.ok()) {
+    if (IsStale(meta_value)) {
+      return rocksdb::Status::NotFound();
+    } else if (!ExpectedMetaValue(DataType::kSets, meta_value)) {
+      return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
+                                                 DataTypeStrings[static_cast<int>(DataType::kSets)],
+                                                 DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
+    } else {
+      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
+      uint64_t version = parsed_sets_meta_value.Version();
+      std::vector<std::string> member_keys;
+      member_keys.reserve(members.size());
+      for (const auto& member : members) {
+        SetsMemberKey sets_member_key(key, version, member);
+        member_keys.push_back(sets_member_key.Encode().ToString());
+      }
+      std::vector<std::string> member_values;
+      std::vector<Status> statuses;
+      MultiGetSorted(read_options, kSetsDataCF, member_keys, &member_values, &statuses);
+      for (size_t idx = 0; idx < members.size(); ++idx) {
+        if (statuses[idx].ok()) {
+          (*rets)[idx] = 1;
+        } else if (!statuses[idx].IsNotFound()) {
+          return statuses[idx];
+        }
+      }
+    }
+  }
+  return s;
+}
+
 rocksdb::Status Redis::SMembers(const Slice& key, std::vector<std::string>* members) {
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
@@ -645,6 +689,44 @@ rocksdb::Status Redis::SMembers(const Slice& key, std::vector<std::string>* memb
   return s;
 }
 
+Status Redis::SMembers(const Slice& key, std::unique_ptr<ElementReader>* reader) {
+  const rocksdb::Snapshot* snapshot = nullptr;
+  std::string meta_value;
+  Status s = GetReaderMeta(key, DataType::kSets, &snapshot, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+
+  ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
+  uint64_t rest = parsed_sets_meta_value.Count();
+  SetsMemberKey sets_member_key(key, parsed_sets_meta_value.Version(), Slice());
+  std::string prefix = sets_member_key.EncodeSeekKey().ToString();
+  auto read_fn = [prefix, rest, seeked = false](rocksdb::Iterator* iter, ElementSink* sink, size_t max_bytes,
+                                               bool* done) mutable {
+    if (!seeked) {
+      seeked = true;
+      iter->Seek(prefix);
+    }
+    size_t bytes = 0;
+    for (; rest != 0 && bytes < max_bytes && iter->Valid() && iter->key().starts_with(prefix); iter->Next(), --rest) {
+      ParsedSetsMemberKey parsed_sets_member_key(iter->key());
+      Status s = sink->Append(parsed_sets_member_key.member());
+      if (!s.ok()) {
+        return s;
+      }
+      bytes += parsed_sets_member_key.member().size();
+    }
+    *done = rest == 0;
+    if (*done || bytes >= max_bytes) {
+      return Status::OK();
+    }
+    return iter->status().ok() ? Status::Corruption("set has fewer members than its count") : iter->status();
+  };
+  *reader = std::make_unique<CollectionReader>(this, snapshot, DataType::kSets, key, kSetsDataCF,
+                                               parsed_sets_meta_value.Count(), std::move(read_fn));
+  return Status::OK();
+}
+
 Status Redis::SMembersWithTTL(const Slice& key, std::vector<std::string>* members, int64_t* ttl) {
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
@@ -1159,12 +1241,13 @@ rocksdb::Status Redis::SUnionstore(const Slice& destination, const std::vector<s
   return s;
 }
 
-rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
-                             std::vector<std::string>* members, int64_t* next_cursor) {
-  *next_cursor = 0;
+rocksdb::Status Redis::SScan(const Slice& key, const std::string& cursor, bool stateless, const std::string& pattern,
+                             int64_t count, std::vector<std::string>* members, std::string* next_cursor) {
+  *next_cursor = "0";
   members->clear();
-  if (cursor < 0) {
-    *next_cursor = 0;
+  int64_t number = 0;
+  if (ScanCursor::ParseNumbered(cursor, &number) && number < 0) {
+    *next_cursor = "0";
     return rocksdb::Status::OK();
   }
 
@@ -1181,7 +1264,7 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
   rocksdb::Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
     if (IsStale(meta_value)) {
-      *next_cursor = 0;
+      *next_cursor = "0";
       return rocksdb::Status::NotFound();
     } else if (!ExpectedMetaValue(DataType::kSets, meta_value)) {
       return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
@@ -1194,7 +1277,7 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
       uint64_t version = parsed_sets_meta_value.Version();
       s = GetScanStartPoint(DataType::kSets, key, pattern, cursor, &start_point);
       if (s.IsNotFound()) {
-        cursor = 0;
+        number = 0;
         if (isTailWildcard(pattern)) {
           start_point = pattern.substr(0, pattern.size() - 1);
         }
@@ -1219,17 +1302,16 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
       }
 
       if (iter->Valid() && (iter->key().compare(prefix) <= 0 || iter->key().starts_with(prefix))) {
-        *next_cursor = cursor + step_length;
         ParsedSetsMemberKey parsed_sets_member_key(iter->key());
         std::string next_member = parsed_sets_member_key.member().ToString();
-        StoreScanNextPoint(DataType::kSets, key, pattern, *next_cursor, next_member);
+        *next_cursor = StoreScanNextPoint(DataType::kSets, key, pattern, number + step_length, stateless, next_member);
       } else {
-        *next_cursor = 0;
+        *next_cursor = "0";
       }
       delete iter;
     }
   } else {
-    *next_cursor = 0;
+    *next_cursor = "0";
     return s;
   }
   return rocksdb::Status::OK();
@@ -1242,7 +1324,6 @@ Status Redis::SetsRename(const Slice& key, Redis* new_inst, const Slice& newkey)
   MultiScopeRecordLock ml(lock_mgr_, keys);
 
   BaseMetaKey base_meta_key(key);
-  BaseMetaKey base_meta_newkey(newkey);
   rocksdb::Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (!s.ok()) {
     return s;
@@ -1262,12 +1343,13 @@ Status Redis::SetsRename(const Slice& key, Redis* new_inst, const Slice& newkey)
   }
   // copy a new set with newkey
   statistic = parsed_sets_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // SetsDel key
+  uint64_t etime = parsed_sets_meta_value.Etime();
   parsed_sets_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kSets, key.ToString(), statistic);
 
   return s;
@@ -1307,12 +1389,13 @@ Status Redis::SetsRenamenx(const Slice& key, Redis* new_inst, const Slice& newke
 
   // copy a new set with newkey
   statistic = parsed_sets_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // SetsDel key
+  uint64_t etime = parsed_sets_meta_value.Etime();
   parsed_sets_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kSets, key.ToString(), statistic);
 
   return s;
@@ -1324,6 +1407,7 @@ void Redis::ScanSets() {
   ScopeSnapshot ss(db_, &snapshot);
   iterator_options.snapshot = snapshot;
   iterator_options.fill_cache = false;
+  iterator_options.total_order_seek = true;
   auto current_time = static_cast<int32_t>(time(nullptr));
 
   INFO("***************Sets Meta Data***************");
@@ -3,13 +3,20 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <tuple>
 
 #include <fmt/core.h>
 
 #include "pstd/log.h"
+#include "src/base_data_key_format.h"
+#include "src/base_data_value_format.h"
 #include "src/base_key_format.h"
 #include "src/batch.h"
+#include "src/bit_kernels.h"
+#include "src/expire_index_format.h"
 #include "src/redis.h"
 #include "src/scope_record_lock.h"
 #include "src/scope_snapshot.h"
@@ -72,6 +79,10 @@ Status Redis::Append(const Slice& key, const Slice& value, int32_t* ret) {
                                                  DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(old_value))]));
     }
+    s = ExpandBitmapFragments(key, &old_value);
+    if (!s.ok()) {
+      return s;
+    }
     ParsedStringsValue parsed_strings_value(&old_value);
     if (parsed_strings_value.IsStale()) {
       *ret = static_cast<int32_t>(value.size());
@@ -95,27 +106,19 @@ Status Redis::Append(const Slice& key, const Slice& value, int32_t* ret) {
 }
 
 int GetBitCount(const unsigned char* value, int64_t bytes) {
-  int bit_num = 0;
-  static const unsigned char bitsinbyte[256] = {
-      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2,
-      3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3,
-      3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5,
-      6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4,
-      3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4,
-      5, 5, 6, 5, 6, 6, 7, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6,
-      6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
-  for (int i = 0; i < bytes; i++) {
-    bit_num += bitsinbyte[static_cast<unsigned int>(value[i])];
-  }
-  return bit_num;
+  return static_cast<int>(GetBitKernels().pop_count(value, static_cast<size_t>(bytes)));
 }
 
 Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret, bool have_range) {
   *ret = 0;
   std::string value;
 
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
   BaseKey base_key(key);
-  Status s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  Status s = db_->Get(read_options, base_key.Encode(), &value);
   if (s.ok()) {
     if (!ExpectedMetaValue(DataType::kStrings, value) && !IsStale(value)) {
       return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
@@ -127,9 +130,11 @@ Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offse
     if (parsed_strings_value.IsStale()) {
       return Status::NotFound();
     } else {
+      BitmapFragmentsMeta bitmap_meta;
+      bool fragments = bitmap_meta.DecodeStringsValue(value);
       parsed_strings_value.StripSuffix();
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(fragments ? bitmap_meta.Length() : value.length());
       if (have_range) {
         if (start_offset < 0) {
           start_offset = start_offset + value_length;
@@ -154,6 +159,17 @@ Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offse
         start_offset = 0;
         end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
       }
+      if (fragments) {
+        int64_t count = 0;
+        s = ForEachBitmapFragment(read_options, key, bitmap_meta, start_offset, end_offset,
+                                  [&count](uint64_t offset, const Slice& bytes) {
+                                    count += GetBitCount(reinterpret_cast<const unsigned char*>(bytes.data()),
+                                                         static_cast<int64_t>(bytes.size()));
+                                    return true;
+                                  });
+        *ret = static_cast<int32_t>(count);
+        return s;
+      }
       *ret = GetBitCount(bit_value + start_offset, end_offset - start_offset + 1);
     }
   } else {
@@ -163,44 +179,34 @@ Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offse
 }
 
 std::string BitOpOperate(BitOpType op, const std::vector<std::string>& src_values, int64_t max_len) {
-  char byte;
-  char output;
-  auto dest_value = std::make_unique<char[]>(max_len);
-  for (int64_t j = 0; j < max_len; j++) {
-    if (j < static_cast<int64_t>(src_values[0].size())) {
-      output = src_values[0][j];
-    } else {
-      output = 0;
-    }
-    if (op == kBitOpNot) {
-      output = static_cast<char>(~output);
-    }
-    for (size_t i = 1; i < src_values.size(); i++) {
-      if (static_cast<int64_t>(src_values[i].size()) - 1 >= j) {
-        byte = src_values[i][j];
-      } else {
-        byte = 0;
-      }
-      switch (op) {
-        case kBitOpNot:
-          break;
-        case kBitOpAnd:
-          output = static_cast<char>(output & byte);
-          break;
-        case kBitOpOr:
-          output = static_cast<char>(output | byte);
-          break;
-        case kBitOpXor:
-          output = static_cast<char>(output ^ byte);
-          break;
-        case kBitOpDefault:
-          break;
-      }
+  const auto& kernels = GetBitKernels();
+  // the shorter sources are padded with zero bytes
+  std::string dest_value(src_values[0].substr(0, max_len));
+  dest_value.resize(max_len, '\0');
+  auto dest = reinterpret_cast<unsigned char*>(dest_value.data());
+  if (op == kBitOpNot) {
+    kernels.not_bytes(dest, max_len);
+    return dest_value;
+  }
+  for (size_t i = 1; i < src_values.size(); i++) {
+    auto src = reinterpret_cast<const unsigned char*>(src_values[i].data());
+    auto src_len = std::min(static_cast<int64_t>(src_values[i].size()), max_len);
+    switch (op) {
+      case kBitOpAnd:
+        kernels.and_bytes(dest, src, src_len);
+        memset(dest + src_len, 0, max_len - src_len);
+        break;
+      case kBitOpOr:
+        kernels.or_bytes(dest, src, src_len);
+        break;
+      case kBitOpXor:
+        kernels.xor_bytes(dest, src, src_len);
+        break;
+      default:
+        break;
     }
-    dest_value[j] = output;
   }
-  std::string dest_str(dest_value.get(), max_len);
-  return dest_str;
+  return dest_value;
 }
 
 Status Redis::BitOp(BitOpType op, const std::string& dest_key, const std::vector<std::string>& src_keys,
@@ -219,6 +225,9 @@ Status Redis::BitOp(BitOpType op, const std::string& dest_key, const std::vector
     std::string value;
     BaseKey base_key(src_key);
     s = db_->Get(default_read_options_, base_key.Encode(), &value);
+    if (s.ok()) {
+      s = ExpandBitmapFragments(src_key, &value);
+    }
     if (s.ok()) {
       if (!ExpectedMetaValue(DataType::kStrings, value) && !IsStale(value)) {
         return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", src_key,
@@ -268,6 +277,10 @@ Status Redis::Decrby(const Slice& key, int64_t value, int64_t* ret) {
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(old_value))]));
     }
 
+    s = ExpandBitmapFragments(key, &old_value);
+    if (!s.ok()) {
+      return s;
+    }
     ParsedStringsValue parsed_strings_value(&old_value);
     if (parsed_strings_value.IsStale()) {
       *ret = -value;
@@ -316,6 +329,10 @@ Status Redis::Get(const Slice& key, std::string* value) {
                                                  DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(*value))]));
     } else {
+      s = ExpandBitmapFragments(key, value);
+      if (!s.ok()) {
+        return s;
+      }
       ParsedStringsValue parsed_strings_value(value);
       parsed_strings_value.StripSuffix();
     }
@@ -337,6 +354,10 @@ Status Redis::GetWithTTL(const Slice& key, std::string* value, int64_t* ttl) {
                                                  DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(*value))]));
     } else {
+      s = ExpandBitmapFragments(key, value);
+      if (!s.ok()) {
+        return s;
+      }
       ParsedStringsValue parsed_strings_value(value);
       parsed_strings_value.StripSuffix();
       *ttl = parsed_strings_value.Etime();
@@ -356,11 +377,95 @@ Status Redis::GetWithTTL(const Slice& key, std::string* value, int64_t* ttl) {
   return s;
 }
 
+Status Redis::MGet(const std::vector<Slice>& keys, std::vector<ValueStatus>* vss) {
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  MultiGetMeta(keys, &values, &statuses);
+
+  vss->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ValueStatus& vs = (*vss)[i];
+    vs.value.clear();
+    vs.ttl = 0;
+    if (statuses[i].ok()) {
+      if (IsStale(values[i]) || !ExpectedMetaValue(DataType::kStrings, values[i])) {
+        vs.status = Status::NotFound();
+      } else {
+        Status s = ExpandBitmapFragments(keys[i], &values[i]);
+        if (s.IsNotFound() || s.IsInvalidArgument()) {
+          // the bitmap was removed or replaced meanwhile
+          vs.status = Status::NotFound();
+          continue;
+        } else if (!s.ok()) {
+          return s;
+        }
+        ParsedStringsValue parsed_strings_value(&values[i]);
+        parsed_strings_value.StripSuffix();
+        vs.value = std::move(values[i]);
+        vs.status = Status::OK();
+      }
+    } else if (statuses[i].IsNotFound()) {
+      vs.status = Status::NotFound();
+    } else {
+      return statuses[i];
+    }
+  }
+  return Status::OK();
+}
+
+Status Redis::MGetWithTTL(const std::vector<Slice>& keys, std::vector<ValueStatus>* vss) {
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  MultiGetMeta(keys, &values, &statuses);
+
+  int64_t curtime;
+  rocksdb::Env::Default()->GetCurrentTime(&curtime);
+  vss->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ValueStatus& vs = (*vss)[i];
+    vs.value.clear();
+    vs.ttl = -2;
+    if (statuses[i].ok()) {
+      if (IsStale(values[i]) || !ExpectedMetaValue(DataType::kStrings, values[i])) {
+        vs.status = Status::NotFound();
+      } else {
+        Status s = ExpandBitmapFragments(keys[i], &values[i]);
+        if (s.IsNotFound() || s.IsInvalidArgument()) {
+          // the bitmap was removed or replaced meanwhile
+          vs.status = Status::NotFound();
+          continue;
+        } else if (!s.ok()) {
+          return s;
+        }
+        ParsedStringsValue parsed_strings_value(&values[i]);
+        parsed_strings_value.StripSuffix();
+        int64_t etime = parsed_strings_value.Etime();
+        if (etime == 0) {
+          vs.ttl = -1;
+        } else {
+          vs.ttl = etime - curtime >= 0 ? etime - curtime : -2;
+        }
+        vs.value = std::move(values[i]);
+        vs.status = Status::OK();
+      }
+    } else if (statuses[i].IsNotFound()) {
+      vs.status = Status::NotFound();
+    } else {
+      return statuses[i];
+    }
+  }
+  return Status::OK();
+}
+
 Status Redis::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
   std::string meta_value;
 
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
   BaseKey base_key(key);
-  Status s = db_->Get(default_read_options_, base_key.Encode(), &meta_value);
+  Status s = db_->Get(read_options, base_key.Encode(), &meta_value);
   if (s.ok() || s.IsNotFound()) {
     std::string data_value;
     if (s.ok()) {
@@ -373,7 +478,20 @@ Status Redis::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
                                                    DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
       } else {
         ParsedStringsValue parsed_strings_value(&meta_value);
-        data_value = parsed_strings_value.UserValue().ToString();
+        BitmapFragmentsMeta bitmap_meta;
+        if (parsed_strings_value.Encoding() != kStringsBitmapFragments) {
+          data_value = parsed_strings_value.UserValue().ToString();
+        } else if (!bitmap_meta.Decode(parsed_strings_value.UserValue())) {
+          return Status::Corruption("invalid bitmap meta");
+        } else {
+          // only the fragment holding the bit is read
+          uint64_t index = (offset >> 3) / kBitmapFragmentBytes;
+          s = GetBitmapFragment(read_options, key, bitmap_meta.Version(), index, &data_value);
+          if (!s.ok()) {
+            return s;
+          }
+          offset -= static_cast<int64_t>(index * kBitmapFragmentBytes * 8);
+        }
       }
     }
     size_t byte = offset >> 3;
@@ -393,8 +511,12 @@ Status Redis::Getrange(const Slice& key, int64_t start_offset, int64_t end_offse
   *ret = "";
   std::string value;
 
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
   BaseKey base_key(key);
-  Status s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  Status s = db_->Get(read_options, base_key.Encode(), &value);
   if (s.ok()) {
     if (IsStale(value)) {
       return Status::NotFound("Stale");
@@ -404,8 +526,10 @@ Status Redis::Getrange(const Slice& key, int64_t start_offset, int64_t end_offse
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(value))]));
     } else {
       ParsedStringsValue parsed_strings_value(&value);
+      BitmapFragmentsMeta bitmap_meta;
+      bool fragments = bitmap_meta.DecodeStringsValue(value);
       parsed_strings_value.StripSuffix();
-      auto size = static_cast<int64_t>(value.size());
+      auto size = static_cast<int64_t>(fragments ? bitmap_meta.Length() : value.size());
       int64_t start_t = start_offset >= 0 ? start_offset : size + start_offset;
       int64_t end_t = end_offset >= 0 ? end_offset : size + end_offset;
       if (start_t > size - 1 || (start_t != 0 && start_t > end_t) || (start_t != 0 && end_t < 0)) {
@@ -420,6 +544,15 @@ Status Redis::Getrange(const Slice& key, int64_t start_offset, int64_t end_offse
       if (start_t == 0 && end_t < 0) {
         end_t = 0;
       }
+      if (fragments) {
+        // only the fragments overlapping the range are read
+        ret->assign(end_t - start_t + 1, '\0');
+        return ForEachBitmapFragment(read_options, key, bitmap_meta, start_t, end_t,
+                                     [ret, start_t](uint64_t offset, const Slice& bytes) {
+                                       ret->replace(offset - start_t, bytes.size(), bytes.data(), bytes.size());
+                                       return true;
+                                     });
+      }
       *ret = value.substr(start_t, end_t - start_t + 1);
       return Status::OK();
     }
@@ -442,6 +575,10 @@ Status Redis::GetrangeWithValue(const Slice& key, int64_t start_offset, int64_t
                                                  DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(*value))]));
     } else {
+      s = ExpandBitmapFragments(key, value);
+      if (!s.ok()) {
+        return s;
+      }
       ParsedStringsValue parsed_strings_value(value);
       parsed_strings_value.StripSuffix();
       // get ttl
@@ -492,6 +629,10 @@ Status Redis::GetSet(const Slice& key, const Slice& value, std::string* old_valu
                                                  DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(*old_value))]));
     } else {
+      s = ExpandBitmapFragments(key, old_value);
+      if (!s.ok()) {
+        return s;
+      }
       ParsedStringsValue parsed_strings_value(old_value);
       parsed_strings_value.StripSuffix();
     }
@@ -521,12 +662,17 @@ Status Redis::Incrby(const Slice& key, int64_t value, int64_t* ret) {
                                               DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                               DataTypeStrings[static_cast<int>(GetMetaValueType(old_value))]));
     } else {
+      s = ExpandBitmapFragments(key, &old_value);
+      if (!s.ok()) {
+        return s;
+      }
       ParsedStringsValue parsed_strings_value(&old_value);
       uint64_t timestamp = parsed_strings_value.Etime();
       std::string old_user_value = parsed_strings_value.UserValue().ToString();
       char* end = nullptr;
+      errno = 0;
       int64_t ival = strtoll(old_user_value.c_str(), &end, 10);
-      if (*end != 0) {
+      if (errno == ERANGE || *end != 0) {
         return Status::Corruption("Value is not a integer");
       }
       if ((value >= 0 && LLONG_MAX - value < ival) || (value < 0 && LLONG_MIN - value > ival)) {
@@ -570,6 +716,10 @@ Status Redis::Incrbyfloat(const Slice& key, const Slice& value, std::string* ret
                                                  DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(old_value))]));
     } else {
+      s = ExpandBitmapFragments(key, &old_value);
+      if (!s.ok()) {
+        return s;
+      }
       ParsedStringsValue parsed_strings_value(&old_value);
       uint64_t timestamp = parsed_strings_value.Etime();
       std::string old_user_value = parsed_strings_value.UserValue().ToString();
@@ -605,6 +755,10 @@ Status Redis::MSet(const std::vector<KeyValue>& kvs) {
   }
 
   MultiScopeRecordLock ml(lock_mgr_, keys);
+  return MSetLocked(kvs);
+}
+
+Status Redis::MSetLocked(const std::vector<KeyValue>& kvs) {
   auto batch = Batch::CreateBatch(this);
   for (const auto& kv : kvs) {
     BaseKey base_key(kv.key);
@@ -674,7 +828,10 @@ Status Redis::Setxx(const Slice& key, const Slice& value, int32_t* ret, int64_t
     if (ttl > 0) {
       strings_value.SetRelativeTimestamp(ttl);
     }
-    return db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
+    auto batch = Batch::CreateBatch(this);
+    batch->Put(kMetaCF, base_key.Encode(), strings_value.Encode());
+    UpdateExpireIndex(batch.get(), key, 0, strings_value.Etime());
+    return batch->Commit();
   }
 }
 
@@ -698,6 +855,9 @@ Status Redis::SetBit(const Slice& key, int64_t offset, int32_t on, int32_t* ret)
       }
       if (!IsStale(meta_value)) {
         ParsedStringsValue parsed_strings_value(&meta_value);
+        if (parsed_strings_value.Encoding() == kStringsBitmapFragments) {
+          return SetBitInFragments(key, &meta_value, offset, on, ret);
+        }
         data_value = parsed_strings_value.UserValue().ToString();
         timestamp = parsed_strings_value.Etime();
       }
@@ -716,6 +876,9 @@ Status Redis::SetBit(const Slice& key, int64_t offset, int32_t on, int32_t* ret)
     if (*ret == on) {
       return Status::OK();
     }
+    if (std::max(byte + 1, value_lenth) > kBitmapFragmentThreshold) {
+      return SetBitToFragments(key, data_value, timestamp, offset, on);
+    }
     byte_val = static_cast<char>(byte_val & (~(1 << bit)));
     byte_val = static_cast<char>(byte_val | ((on & 0x1) << bit));
     if (byte + 1 <= value_lenth) {
@@ -748,6 +911,7 @@ Status Redis::Setex(const Slice& key, const Slice& value, int64_t ttl) {
   ScopeRecordLock l(lock_mgr_, key);
   auto batch = Batch::CreateBatch(this);
   batch->Put(kMetaCF, base_key.Encode(), strings_value.Encode());
+  UpdateExpireIndex(batch.get(), key, 0, strings_value.Etime());
   return batch->Commit();
 }
 
@@ -764,7 +928,10 @@ Status Redis::Setnx(const Slice& key, const Slice& value, int32_t* ret, int64_t
       if (ttl > 0) {
         strings_value.SetRelativeTimestamp(ttl);
       }
-      s = db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
+      auto batch = Batch::CreateBatch(this);
+      batch->Put(kMetaCF, base_key.Encode(), strings_value.Encode());
+      UpdateExpireIndex(batch.get(), key, 0, strings_value.Etime());
+      s = batch->Commit();
       if (s.ok()) {
         *ret = 1;
       }
@@ -774,7 +941,10 @@ Status Redis::Setnx(const Slice& key, const Slice& value, int32_t* ret, int64_t
     if (ttl > 0) {
       strings_value.SetRelativeTimestamp(ttl);
     }
-    s = db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
+    auto batch = Batch::CreateBatch(this);
+    batch->Put(kMetaCF, base_key.Encode(), strings_value.Encode());
+    UpdateExpireIndex(batch.get(), key, 0, strings_value.Etime());
+    s = batch->Commit();
     if (s.ok()) {
       *ret = 1;
     }
@@ -791,6 +961,10 @@ Status Redis::Setvx(const Slice& key, const Slice& value, const Slice& new_value
   ScopeRecordLock l(lock_mgr_, key);
   Status s = db_->Get(default_read_options_, base_key.Encode(), &old_value);
   if (s.ok()) {
+    s = ExpandBitmapFragments(key, &old_value);
+    if (!s.ok()) {
+      return s;
+    }
     ParsedStringsValue parsed_strings_value(&old_value);
     if (parsed_strings_value.IsStale()) {
       *ret = 0;
@@ -800,7 +974,10 @@ Status Redis::Setvx(const Slice& key, const Slice& value, const Slice& new_value
         if (ttl > 0) {
           strings_value.SetRelativeTimestamp(ttl);
         }
-        s = db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
+        auto batch = Batch::CreateBatch(this);
+        batch->Put(kMetaCF, base_key.Encode(), strings_value.Encode());
+        UpdateExpireIndex(batch.get(), key, 0, strings_value.Etime());
+        s = batch->Commit();
         if (!s.ok()) {
           return s;
         }
@@ -826,6 +1003,10 @@ Status Redis::Delvx(const Slice& key, const Slice& value, int32_t* ret) {
   ScopeRecordLock l(lock_mgr_, key);
   Status s = db_->Get(default_read_options_, base_key.Encode(), &old_value);
   if (s.ok()) {
+    s = ExpandBitmapFragments(key, &old_value);
+    if (!s.ok()) {
+      return s;
+    }
     ParsedStringsValue parsed_strings_value(&old_value);
     if (parsed_strings_value.IsStale()) {
       *ret = 0;
@@ -866,6 +1047,10 @@ Status Redis::Setrange(const Slice& key, int64_t start_offset, const Slice& valu
                                                  DataTypeStrings[static_cast<int>(DataType::kStrings)],
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(old_value))]));
     } else {
+      s = ExpandBitmapFragments(key, &old_value);
+      if (!s.ok()) {
+        return s;
+      }
       ParsedStringsValue parsed_strings_value(&old_value);
       parsed_strings_value.StripSuffix();
       timestamp = parsed_strings_value.Etime();
@@ -899,68 +1084,52 @@ Status Redis::Setrange(const Slice& key, int64_t start_offset, const Slice& valu
 }
 
 Status Redis::Strlen(const Slice& key, int32_t* len) {
+  *len = 0;
   std::string value;
-  Status s = Get(key, &value);
+  BaseKey base_key(key);
+  Status s = db_->Get(default_read_options_, base_key.Encode(), &value);
   if (s.ok()) {
-    *len = static_cast<int32_t>(value.size());
-  } else {
-    *len = 0;
+    if (IsStale(value)) {
+      return Status::NotFound("Stale");
+    } else if (!ExpectedMetaValue(DataType::kStrings, value)) {
+      return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
+                                                 DataTypeStrings[static_cast<int>(DataType::kStrings)],
+                                                 DataTypeStrings[static_cast<int>(GetMetaValueType(value))]));
+    }
+    // the length of a bitmap in fragments is kept in its meta
+    BitmapFragmentsMeta bitmap_meta;
+    if (bitmap_meta.DecodeStringsValue(value)) {
+      *len = static_cast<int32_t>(bitmap_meta.Length());
+    } else {
+      *len = static_cast<int32_t>(ParsedStringsValue(&value).UserValue().size());
+    }
   }
   return s;
 }
 
+// The position of the first bit equal to bit, counting from the msb of the first
+// byte. Past the bytes a bitmap is made of zero bits, the search of a 0 bit in
+// a bitmap of ones ends there, the search of a 1 bit in zeros fails with -1.
 int32_t GetBitPos(const unsigned char* s, unsigned int bytes, int bit) {
-  uint64_t word = 0;
-  uint64_t skip_val = 0;
-  auto value = const_cast<unsigned char*>(s);
-  auto l = reinterpret_cast<uint64_t*>(value);
-  int pos = 0;
-  if (bit == 0) {
-    skip_val = std::numeric_limits<uint64_t>::max();
-  } else {
-    skip_val = 0;
+  unsigned char skip = bit == 0 ? 0xff : 0x00;
+  size_t index = GetBitKernels().find_first_not(s, bytes, skip);
+  if (index == bytes) {
+    return bit == 1 ? -1 : static_cast<int32_t>(bytes * 8);
   }
-  // skip 8 bytes at one time, find the first int64 that should not be skipped
-  while (bytes >= sizeof(*l)) {
-    if (*l != skip_val) {
-      break;
-    }
-    l++;
-    bytes = bytes - sizeof(*l);
-    pos += static_cast<int32_t>(8 * sizeof(*l));
-  }
-  auto c = reinterpret_cast<unsigned char*>(l);
-  for (size_t j = 0; j < sizeof(*l); j++) {
-    word = word << 8;
-    if (bytes != 0U) {
-      word = word | *c;
-      c++;
-      bytes--;
-    }
-  }
-  if (bit == 1 && word == 0) {
-    return -1;
-  }
-  // set each bit of mask to 0 except msb
-  uint64_t mask = std::numeric_limits<uint64_t>::max();
-  mask = mask >> 1;
-  mask = ~(mask);
-  while (mask != 0U) {
-    if (static_cast<int>((word & mask) != 0) == bit) {
-      return pos;
-    }
-    pos++;
-    mask = mask >> 1;
-  }
-  return pos;
+  unsigned int byte = bit == 0 ? static_cast<unsigned char>(~s[index]) : s[index];
+  return static_cast<int32_t>(index * 8 + __builtin_clz(byte) - (sizeof(unsigned int) - 1) * 8);
 }
 
 Status Redis::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
   Status s;
   std::string value;
 
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
   BaseKey base_key(key);
-  s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  s = db_->Get(read_options, base_key.Encode(), &value);
   if (s.ok()) {
     if (IsStale(value)) {
       if (bit == 1) {
@@ -975,11 +1144,16 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(value))]));
     } else {
       ParsedStringsValue parsed_strings_value(&value);
+      BitmapFragmentsMeta bitmap_meta;
+      bool fragments = bitmap_meta.DecodeStringsValue(value);
       parsed_strings_value.StripSuffix();
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(fragments ? bitmap_meta.Length() : value.length());
       int64_t start_offset = 0;
       int64_t end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
+      if (fragments) {
+        return BitPosInFragments(read_options, key, bitmap_meta, bit, start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
       if (pos == (8 * bytes) && bit == 0) {
@@ -1000,8 +1174,12 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
   Status s;
   std::string value;
 
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
   BaseKey base_key(key);
-  s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  s = db_->Get(read_options, base_key.Encode(), &value);
   if (s.ok()) {
     if (IsStale(value)) {
       if (bit == 1) {
@@ -1016,9 +1194,11 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(value))]));
     } else {
       ParsedStringsValue parsed_strings_value(&value);
+      BitmapFragmentsMeta bitmap_meta;
+      bool fragments = bitmap_meta.DecodeStringsValue(value);
       parsed_strings_value.StripSuffix();
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(fragments ? bitmap_meta.Length() : value.length());
       int64_t end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
       if (start_offset < 0) {
         start_offset = start_offset + value_length;
@@ -1034,6 +1214,9 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
         *ret = -1;
         return Status::OK();
       }
+      if (fragments) {
+        return BitPosInFragments(read_options, key, bitmap_meta, bit, start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
       if (pos == (8 * bytes) && bit == 0) {
@@ -1054,8 +1237,12 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
   Status s;
   std::string value;
 
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
   BaseKey base_key(key);
-  s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  s = db_->Get(read_options, base_key.Encode(), &value);
   if (s.ok()) {
     if (IsStale(value)) {
       if (bit == 1) {
@@ -1070,9 +1257,11 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
                                                  DataTypeStrings[static_cast<int>(GetMetaValueType(value))]));
     } else {
       ParsedStringsValue parsed_strings_value(&value);
+      BitmapFragmentsMeta bitmap_meta;
+      bool fragments = bitmap_meta.DecodeStringsValue(value);
       parsed_strings_value.StripSuffix();
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(fragments ? bitmap_meta.Length() : value.length());
       if (start_offset < 0) {
         start_offset = start_offset + value_length;
       }
@@ -1083,7 +1272,7 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
         end_offset = end_offset + value_length;
       }
       // converting to int64_t just avoid warning
-      if (end_offset > static_cast<int64_t>(value.length()) - 1) {
+      if (end_offset > value_length - 1) {
         end_offset = value_length - 1;
       }
       if (end_offset < 0) {
@@ -1097,6 +1286,9 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
         *ret = -1;
         return Status::OK();
       }
+      if (fragments) {
+        return BitPosInFragments(read_options, key, bitmap_meta, bit, start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
       if (pos == (8 * bytes) && bit == 0) {
@@ -1120,7 +1312,10 @@ Status Redis::PKSetexAt(const Slice& key, const Slice& value, uint64_t timestamp
   BaseKey base_key(key);
   ScopeRecordLock l(lock_mgr_, key);
   strings_value.SetEtime(uint64_t(timestamp));
-  return db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
+  auto batch = Batch::CreateBatch(this);
+  batch->Put(kMetaCF, base_key.Encode(), strings_value.Encode());
+  UpdateExpireIndex(batch.get(), key, 0, timestamp);
+  return batch->Commit();
 }
 
 Status Redis::StringsRename(const Slice& key, Redis* new_inst, const Slice& newkey) {
@@ -1130,7 +1325,6 @@ Status Redis::StringsRename(const Slice& key, Redis* new_inst, const Slice& newk
   MultiScopeRecordLock ml(lock_mgr_, keys);
 
   BaseKey base_key(key);
-  BaseKey base_newkey(newkey);
   s = db_->Get(default_read_options_, base_key.Encode(), &value);
   if (!s.ok() || !ExpectedMetaValue(DataType::kStrings, value)) {
     return s;
@@ -1142,9 +1336,10 @@ Status Redis::StringsRename(const Slice& key, Redis* new_inst, const Slice& newk
   if (IsStale(value)) {
     return Status::NotFound("Stale");
   }
-  db_->Delete(default_write_options_, base_key.Encode());
-  s = new_inst->GetDB()->Put(default_write_options_, base_newkey.Encode(), value);
-  return s;
+  if (BitmapFragmentsMeta::IsFragments(value)) {
+    return MoveBitmapFragments(key, value, new_inst, newkey);
+  }
+  return CommitRename(key, nullptr, new_inst, newkey, value, ParsedStringsValue(&value).Etime());
 }
 
 Status Redis::StringsRenamenx(const Slice& key, Redis* new_inst, const Slice& newkey) {
@@ -1167,16 +1362,17 @@ Status Redis::StringsRenamenx(const Slice& key, Redis* new_inst, const Slice& ne
     return Status::NotFound("Stale");
   }
   // check if newkey exists.
-  s = new_inst->GetDB()->Get(default_read_options_, base_newkey.Encode(), &value);
+  std::string new_value;
+  s = new_inst->GetDB()->Get(default_read_options_, base_newkey.Encode(), &new_value);
   if (s.ok()) {
-    if (!IsStale(value)) {
+    if (!IsStale(new_value)) {
       return Status::Corruption();  // newkey already exists.
     }
   }
-  db_->Delete(default_write_options_, base_key.Encode());
-  s = new_inst->GetDB()->Put(default_write_options_, base_newkey.Encode(), value);
-
-  return s;
+  if (BitmapFragmentsMeta::IsFragments(value)) {
+    return MoveBitmapFragments(key, value, new_inst, newkey);
+  }
+  return CommitRename(key, nullptr, new_inst, newkey, value, ParsedStringsValue(&value).Etime());
 }
 
 void Redis::ScanStrings() {
@@ -1242,12 +1438,31 @@ Status Redis::Exists(const Slice& key) {
   return s;
 }
 
+Status Redis::Exists(const std::vector<Slice>& keys, int64_t* count) {
+  std::vector<std::string> meta_values;
+  std::vector<Status> statuses;
+  MultiGetMeta(keys, &meta_values, &statuses);
+
+  *count = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (statuses[i].ok()) {
+      if (!IsStale(meta_values[i])) {
+        ++(*count);
+      }
+    } else if (!statuses[i].IsNotFound()) {
+      return statuses[i];
+    }
+  }
+  return Status::OK();
+}
+
 Status Redis::Del(const Slice& key) {
   ScopeRecordLock l(lock_mgr_, key);
   BaseMetaKey base_meta_key(key);
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
+    auto batch = Batch::CreateBatch(this);
     auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
     switch (type) {
       case DataType::kStrings: {
@@ -1255,8 +1470,9 @@ Status Redis::Del(const Slice& key) {
         if (parsed_string_value.IsStale()) {
           return Status::NotFound();
         }
-        return db_->Delete(default_write_options_, base_meta_key.Encode());
-        break;
+        batch->Delete(kMetaCF, base_meta_key.Encode());
+        DeleteBitmapFragments(batch.get(), key, meta_value);
+        return batch->Commit();
       }
       case DataType::kHashes:
       case DataType::kSets:
@@ -1266,8 +1482,10 @@ Status Redis::Del(const Slice& key) {
         }
         ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
         uint64_t statistic = parsed_base_meta_value.Count();
+        DeleteDataRange(batch.get(), type, key, parsed_base_meta_value.Version(), parsed_base_meta_value.Count());
         parsed_base_meta_value.InitialMetaValue();
-        s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+        s = batch->Commit();
         UpdateSpecificKeyStatistics(type, key.ToString(), statistic);
         break;
       }
@@ -1277,8 +1495,10 @@ Status Redis::Del(const Slice& key) {
         }
         ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
         uint64_t statistic = parsed_lists_meta_value.Count();
+        DeleteDataRange(batch.get(), type, key, parsed_lists_meta_value.Version(), parsed_lists_meta_value.Count());
         parsed_lists_meta_value.InitialMetaValue();
-        s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+        s = batch->Commit();
         UpdateSpecificKeyStatistics(type, key.ToString(), statistic);
         break;
       }
@@ -1289,12 +1509,87 @@ Status Redis::Del(const Slice& key) {
   return s;
 }
 
+Status Redis::Del(const std::vector<std::string>& keys, int64_t* count) {
+  *count = 0;
+  std::vector<std::string> unique_keys(keys);
+  std::sort(unique_keys.begin(), unique_keys.end());
+  unique_keys.erase(std::unique(unique_keys.begin(), unique_keys.end()), unique_keys.end());
+
+  MultiScopeRecordLock ml(lock_mgr_, unique_keys);
+  std::vector<Slice> key_slices(unique_keys.begin(), unique_keys.end());
+  std::vector<std::string> meta_values;
+  std::vector<Status> statuses;
+  MultiGetMeta(key_slices, &meta_values, &statuses);
+
+  auto batch = Batch::CreateBatch(this);
+  std::vector<std::tuple<DataType, size_t, uint64_t>> statistics;
+  for (size_t idx = 0; idx < unique_keys.size(); ++idx) {
+    if (statuses[idx].IsNotFound()) {
+      continue;
+    } else if (!statuses[idx].ok()) {
+      return statuses[idx];
+    }
+    std::string& meta_value = meta_values[idx];
+    if (IsStale(meta_value)) {
+      continue;
+    }
+    BaseMetaKey base_meta_key(unique_keys[idx]);
+    auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+    switch (type) {
+      case DataType::kStrings: {
+        batch->Delete(kMetaCF, base_meta_key.Encode());
+        DeleteBitmapFragments(batch.get(), unique_keys[idx], meta_value);
+        break;
+      }
+      case DataType::kHashes:
+      case DataType::kSets:
+      case DataType::kZSets: {
+        ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
+        statistics.emplace_back(type, idx, parsed_base_meta_value.Count());
+        DeleteDataRange(batch.get(), type, unique_keys[idx], parsed_base_meta_value.Version(),
+                        parsed_base_meta_value.Count());
+        parsed_base_meta_value.InitialMetaValue();
+        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+        break;
+      }
+      case DataType::kLists: {
+        ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+        statistics.emplace_back(type, idx, parsed_lists_meta_value.Count());
+        DeleteDataRange(batch.get(), type, unique_keys[idx], parsed_lists_meta_value.Version(),
+                        parsed_lists_meta_value.Count());
+        parsed_lists_meta_value.InitialMetaValue();
+        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+        break;
+      }
+      default:
+        continue;
+    }
+    ++(*count);
+  }
+  if (*count == 0) {
+    return Status::OK();
+  }
+
+  Status s = batch->Commit();
+  if (!s.ok()) {
+    *count = 0;
+    return s;
+  }
+  for (const auto& [type, idx, statistic] : statistics) {
+    UpdateSpecificKeyStatistics(type, unique_keys[idx], statistic);
+  }
+  return s;
+}
+
 Status Redis::Expire(const Slice& key, int64_t timestamp) {
   ScopeRecordLock l(lock_mgr_, key);
   BaseMetaKey base_meta_key(key);
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
+    auto batch = Batch::CreateBatch(this);
+    uint64_t old_etime = MetaValueEtime(meta_value);
+    uint64_t new_etime = 0;
     auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
     switch (type) {
       case DataType::kStrings: {
@@ -1303,9 +1598,10 @@ Status Redis::Expire(const Slice& key, int64_t timestamp) {
           s = Status::NotFound();
         } else if (timestamp > 0) {
           parsed_strings_value.SetRelativeTimestamp(timestamp);
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          new_etime = parsed_strings_value.Etime();
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         } else {
-          s = db_->Delete(default_write_options_, base_meta_key.Encode());
+          batch->Delete(kMetaCF, base_meta_key.Encode());
         }
         break;
       }
@@ -1317,10 +1613,12 @@ Status Redis::Expire(const Slice& key, int64_t timestamp) {
           s = Status::NotFound();
         } else if (timestamp > 0) {
           parsed_base_meta_value.SetRelativeTimestamp(timestamp);
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          new_etime = parsed_base_meta_value.Etime();
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         } else {
+          DeleteDataRange(batch.get(), type, key, parsed_base_meta_value.Version(), parsed_base_meta_value.Count());
           parsed_base_meta_value.InitialMetaValue();
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         }
         break;
       }
@@ -1330,10 +1628,12 @@ Status Redis::Expire(const Slice& key, int64_t timestamp) {
           s = Status::NotFound();
         } else if (timestamp > 0) {
           parsed_lists_meta_value.SetRelativeTimestamp(timestamp);
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          new_etime = parsed_lists_meta_value.Etime();
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         } else {
+          DeleteDataRange(batch.get(), type, key, parsed_lists_meta_value.Version(), parsed_lists_meta_value.Count());
           parsed_lists_meta_value.InitialMetaValue();
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         }
         break;
       }
@@ -1342,6 +1642,10 @@ Status Redis::Expire(const Slice& key, int64_t timestamp) {
         break;
       }
     }
+    if (s.ok()) {
+      UpdateExpireIndex(batch.get(), key, old_etime, new_etime);
+      s = batch->Commit();
+    }
   }
   return s;
 }
@@ -1352,6 +1656,9 @@ Status Redis::Expireat(const Slice& key, int64_t timestamp) {
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
+    auto batch = Batch::CreateBatch(this);
+    uint64_t old_etime = MetaValueEtime(meta_value);
+    uint64_t new_etime = 0;
     auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
     switch (type) {
       case DataType::kStrings: {
@@ -1360,9 +1667,10 @@ Status Redis::Expireat(const Slice& key, int64_t timestamp) {
           s = Status::NotFound();
         } else if (timestamp > 0) {
           parsed_strings_value.SetEtime(timestamp);
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          new_etime = parsed_strings_value.Etime();
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         } else {
-          s = db_->Delete(default_write_options_, base_meta_key.Encode());
+          batch->Delete(kMetaCF, base_meta_key.Encode());
         }
         break;
       }
@@ -1374,10 +1682,12 @@ Status Redis::Expireat(const Slice& key, int64_t timestamp) {
           s = Status::NotFound();
         } else if (timestamp > 0) {
           parsed_base_meta_value.SetEtime(timestamp);
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          new_etime = parsed_base_meta_value.Etime();
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         } else {
+          DeleteDataRange(batch.get(), type, key, parsed_base_meta_value.Version(), parsed_base_meta_value.Count());
           parsed_base_meta_value.InitialMetaValue();
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         }
         break;
       }
@@ -1387,10 +1697,12 @@ Status Redis::Expireat(const Slice& key, int64_t timestamp) {
           s = Status::NotFound();
         } else if (timestamp > 0) {
           parsed_lists_meta_value.SetEtime(timestamp);
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          new_etime = parsed_lists_meta_value.Etime();
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         } else {
+          DeleteDataRange(batch.get(), type, key, parsed_lists_meta_value.Version(), parsed_lists_meta_value.Count());
           parsed_lists_meta_value.InitialMetaValue();
-          s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+          batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
         }
         break;
       }
@@ -1399,6 +1711,10 @@ Status Redis::Expireat(const Slice& key, int64_t timestamp) {
         break;
       }
     }
+    if (s.ok()) {
+      UpdateExpireIndex(batch.get(), key, old_etime, new_etime);
+      s = batch->Commit();
+    }
   }
   return s;
 }
@@ -1409,6 +1725,8 @@ Status Redis::Persist(const Slice& key) {
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
+    auto batch = Batch::CreateBatch(this);
+    uint64_t old_etime = MetaValueEtime(meta_value);
     auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
     switch (type) {
       case DataType::kStrings: {
@@ -1419,7 +1737,7 @@ Status Redis::Persist(const Slice& key) {
           uint64_t expire_time = parsed_strings_value.Etime();
           if (expire_time != 0) {
             parsed_strings_value.SetEtime(0);
-            s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+            batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
           } else {
             s = Status::NotFound();
           }
@@ -1436,7 +1754,7 @@ Status Redis::Persist(const Slice& key) {
           uint64_t expire_time = parsed_base_meta_value.Etime();
           if (expire_time != 0) {
             parsed_base_meta_value.SetEtime(0);
-            s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+            batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
           } else {
             s = Status::NotFound();
           }
@@ -1451,7 +1769,7 @@ Status Redis::Persist(const Slice& key) {
           uint64_t expire_time = parsed_lists_meta_value.Etime();
           if (expire_time != 0) {
             parsed_lists_meta_value.SetEtime(0);
-            s = db_->Put(default_write_options_, base_meta_key.Encode(), meta_value);
+            batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
           } else {
             s = Status::NotFound();
           }
@@ -1463,6 +1781,138 @@ Status Redis::Persist(const Slice& key) {
         break;
       }
     }
+    if (s.ok()) {
+      UpdateExpireIndex(batch.get(), key, old_etime, 0);
+      s = batch->Commit();
+    }
+  }
+  return s;
+}
+
+void Redis::UpdateExpireIndex(Batch* batch, const Slice& key, uint64_t old_etime, uint64_t new_etime) {
+  if (old_etime == new_etime) {
+    return;
+  }
+  if (old_etime != 0) {
+    ExpireIndexKey old_index_key(old_etime, key);
+    batch->Delete(kExpireIndexCF, old_index_key.Encode());
+  }
+  if (new_etime != 0) {
+    ExpireIndexKey new_index_key(new_etime, key);
+    batch->Put(kExpireIndexCF, new_index_key.Encode(), Slice());
+  }
+}
+
+Status Redis::CommitRename(const Slice& key, const std::string* old_meta, Redis* new_inst, const Slice& newkey,
+                           const Slice& new_meta, uint64_t etime) {
+  BaseMetaKey base_meta_key(key);
+  BaseMetaKey base_meta_newkey(newkey);
+  auto new_batch = Batch::CreateBatch(new_inst);
+  new_batch->Put(kMetaCF, base_meta_newkey.Encode(), new_meta);
+  new_inst->UpdateExpireIndex(new_batch.get(), newkey, 0, etime);
+  auto batch = new_inst == this ? std::move(new_batch) : Batch::CreateBatch(this);
+  if (new_batch) {
+    // newkey goes first, a failure in between leaves the value reachable under both keys
+    Status s = new_batch->Commit();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (old_meta != nullptr) {
+    batch->Put(kMetaCF, base_meta_key.Encode(), *old_meta);
+  } else {
+    batch->Delete(kMetaCF, base_meta_key.Encode());
+  }
+  UpdateExpireIndex(batch.get(), key, etime, 0);
+  return batch->Commit();
+}
+
+Status Redis::ActiveExpireCycle(uint64_t now, size_t limit, size_t* expired) {
+  *expired = 0;
+  std::string upper_bound = ExpireIndexKey::EncodeEtime(now);
+  Slice upper_bound_slice(upper_bound);
+  rocksdb::ReadOptions read_options;
+  read_options.iterate_upper_bound = &upper_bound_slice;
+  read_options.fill_cache = false;
+
+  std::vector<std::string> index_keys;
+  std::vector<std::string> keys;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kExpireIndexCF]));
+  for (iter->SeekToFirst(); iter->Valid() && index_keys.size() < limit; iter->Next()) {
+    index_keys.push_back(iter->key().ToString());
+    keys.push_back(ParsedExpireIndexKey(iter->key()).Key().ToString());
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+  iter.reset();
+  if (index_keys.empty()) {
+    return Status::OK();
+  }
+
+  std::vector<std::string> unique_keys(keys);
+  std::sort(unique_keys.begin(), unique_keys.end());
+  unique_keys.erase(std::unique(unique_keys.begin(), unique_keys.end()), unique_keys.end());
+  MultiScopeRecordLock ml(lock_mgr_, unique_keys);
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::vector<std::string> meta_values;
+  std::vector<Status> statuses;
+  MultiGetMeta(key_slices, &meta_values, &statuses);
+
+  auto batch = Batch::CreateBatch(this);
+  std::vector<std::tuple<DataType, size_t, uint64_t>> statistics;
+  for (size_t idx = 0; idx < index_keys.size(); ++idx) {
+    batch->Delete(kExpireIndexCF, index_keys[idx]);
+    if (statuses[idx].IsNotFound()) {
+      continue;
+    } else if (!statuses[idx].ok()) {
+      return statuses[idx];
+    }
+    std::string& meta_value = meta_values[idx];
+    // the key was given another etime (or none) after this entry was written
+    if (MetaValueEtime(meta_value) != ParsedExpireIndexKey(index_keys[idx]).Etime()) {
+      continue;
+    }
+    BaseMetaKey base_meta_key(keys[idx]);
+    auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+    switch (type) {
+      case DataType::kStrings: {
+        batch->Delete(kMetaCF, base_meta_key.Encode());
+        DeleteBitmapFragments(batch.get(), keys[idx], meta_value);
+        break;
+      }
+      case DataType::kHashes:
+      case DataType::kSets:
+      case DataType::kZSets: {
+        ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
+        statistics.emplace_back(type, idx, parsed_base_meta_value.Count());
+        DeleteDataRange(batch.get(), type, keys[idx], parsed_base_meta_value.Version(), parsed_base_meta_value.Count());
+        parsed_base_meta_value.InitialMetaValue();
+        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+        break;
+      }
+      case DataType::kLists: {
+        ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+        statistics.emplace_back(type, idx, parsed_lists_meta_value.Count());
+        DeleteDataRange(batch.get(), type, keys[idx], parsed_lists_meta_value.Version(),
+                        parsed_lists_meta_value.Count());
+        parsed_lists_meta_value.InitialMetaValue();
+        batch->Put(kMetaCF, base_meta_key.Encode(), meta_value);
+        break;
+      }
+      default:
+        continue;
+    }
+    ++(*expired);
+  }
+
+  Status s = batch->Commit();
+  if (!s.ok()) {
+    *expired = 0;
+    return s;
+  }
+  for (const auto& [type, idx, statistic] : statistics) {
+    UpdateSpecificKeyStatistics(type, keys[idx], statistic);
   }
   return s;
 }
@@ -1626,4 +2076,450 @@ Status Redis::IsExist(const Slice& key) {
   return Status::NotFound();
 }
 
+// Bitmaps stored in fragments, see bitmap_fragment_format.h
+
+// Fragments are committed every kBitmapWriterBatchSize writes while a bitmap is stored
+static const int32_t kBitmapWriterBatchSize = 256;
+
+static bool IsZeroBytes(const Slice& bytes) {
+  return GetBitKernels().find_first_not(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size(), 0) ==
+         bytes.size();
+}
+
+static std::string BitmapFragmentKey(const Slice& key, uint64_t version, uint64_t index) {
+  std::string index_data = BitmapFragmentsMeta::EncodeIndex(index);
+  BaseDataKey data_key(key, version, index_data);
+  return data_key.Encode().ToString();
+}
+
+static std::string BitmapFragmentsMetaValue(const BitmapFragmentsMeta& bitmap_meta, uint64_t etime) {
+  std::string user_value = bitmap_meta.Encode();
+  StringsValue strings_value(user_value);
+  strings_value.SetEncoding(kStringsBitmapFragments);
+  strings_value.SetEtime(etime);
+  return strings_value.Encode().ToString();
+}
+
+uint64_t Redis::NewBitmapVersion() {
+  uint64_t now = pstd::NowMicros();
+  uint64_t last = last_bitmap_version_.load(std::memory_order_relaxed);
+  while (!last_bitmap_version_.compare_exchange_weak(last, std::max(now, last + 1), std::memory_order_relaxed)) {
+  }
+  return std::max(now, last + 1);
+}
+
+Status Redis::GetBitmapFragment(const rocksdb::ReadOptions& read_options, const Slice& key, uint64_t version,
+                                uint64_t index, std::string* bytes) {
+  Status s = db_->Get(read_options, handles_[kHashesDataCF], BitmapFragmentKey(key, version, index), bytes);
+  if (s.IsNotFound()) {
+    bytes->clear();
+    return Status::OK();
+  } else if (s.ok()) {
+    ParsedBaseDataValue parsed_value(bytes);
+    parsed_value.StripSuffix();
+  }
+  return s;
+}
+
+Status Redis::ForEachBitmapFragment(const rocksdb::ReadOptions& read_options, const Slice& key,
+                                    const BitmapFragmentsMeta& meta, uint64_t start, uint64_t end,
+                                    const std::function<bool(uint64_t offset, const Slice& bytes)>& func) {
+  if (meta.Length() == 0) {
+    return Status::OK();
+  }
+  end = std::min(end, meta.Length() - 1);
+  BaseDataKey prefix_key(key, meta.Version(), Slice());
+  std::string prefix = prefix_key.EncodeSeekKey().ToString();
+  std::string seek_key = prefix + BitmapFragmentsMeta::EncodeIndex(start / kBitmapFragmentBytes);
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kHashesDataCF]));
+  for (iter->Seek(seek_key); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+    uint64_t index = BitmapFragmentsMeta::DecodeIndex(Slice(iter->key().data() + prefix.size(), sizeof(uint64_t)));
+    uint64_t offset = index * kBitmapFragmentBytes;
+    if (offset > end) {
+      break;
+    }
+    ParsedBaseDataValue parsed_value(iter->value());
+    Slice bytes = parsed_value.UserValue();
+    uint64_t first = std::max(start, offset);
+    uint64_t last = std::min(end + 1, offset + bytes.size());
+    if (first < last && !func(first, Slice(bytes.data() + (first - offset), last - first))) {
+      break;
+    }
+  }
+  return iter->status();
+}
+
+Status Redis::ExpandBitmapFragments(const Slice& key, std::string* value) {
+  if (!BitmapFragmentsMeta::IsFragments(*value) || IsStale(*value)) {
+    return Status::OK();
+  }
+  // the meta is read again under the snapshot of the fragments
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
+  BaseKey base_key(key);
+  Status s = db_->Get(read_options, base_key.Encode(), value);
+  if (!s.ok()) {
+    return s;
+  } else if (!ExpectedMetaValue(DataType::kStrings, *value) && !IsStale(*value)) {
+    return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
+                                               DataTypeStrings[static_cast<int>(DataType::kStrings)],
+                                               DataTypeStrings[static_cast<int>(GetMetaValueType(*value))]));
+  }
+  BitmapFragmentsMeta bitmap_meta;
+  if (!bitmap_meta.DecodeStringsValue(*value) || IsStale(*value)) {
+    return Status::OK();
+  }
+  std::string bytes(bitmap_meta.Length(), '\0');
+  s = ForEachBitmapFragment(read_options, key, bitmap_meta, 0, bitmap_meta.Length(),
+                                   [&bytes](uint64_t offset, const Slice& fragment) {
+                                     memcpy(bytes.data() + offset, fragment.data(), fragment.size());
+                                     return true;
+                                   });
+  if (!s.ok()) {
+    return s;
+  }
+  // the timestamps of the meta are kept
+  std::string suffix = value->substr(value->size() - kStringsValueSuffixLength);
+  suffix[0] = static_cast<char>(kStringsRaw);
+  value->resize(kTypeLength);
+  value->append(bytes).append(suffix);
+  return Status::OK();
+}
+
+Status Redis::MoveBitmapFragments(const Slice& key, const std::string& meta_value, Redis* new_inst,
+                                  const Slice& newkey) {
+  BitmapFragmentsMeta bitmap_meta;
+  if (!bitmap_meta.DecodeStringsValue(meta_value)) {
+    return Status::Corruption("invalid bitmap meta");
+  }
+  // a new version keeps the fragments apart from those of an older bitmap at newkey
+  BitmapFragmentsMeta new_meta(new_inst->NewBitmapVersion(), bitmap_meta.Length());
+  BaseKey base_newkey(newkey);
+  std::string new_meta_key = base_newkey.Encode().ToString();
+  // the copied fragments have no meta until the last batch, the compaction has to keep them meanwhile
+  new_inst->pending_versions_.Add(new_meta_key, new_meta.Version());
+  auto batch = Batch::CreateBatch(new_inst);
+  int32_t batched = 0;
+  bool copied = false;
+  Status write_status;
+  auto copy_fragment = [&](uint64_t offset, const Slice& bytes) {
+    BaseDataValue i_val(bytes);
+    batch->Put(kHashesDataCF, BitmapFragmentKey(newkey, new_meta.Version(), offset / kBitmapFragmentBytes),
+               i_val.Encode());
+    if (++batched == kBitmapWriterBatchSize) {
+      copied = true;
+      write_status = batch->Commit();
+      batch = Batch::CreateBatch(new_inst);
+      batched = 0;
+    }
+    return write_status.ok();
+  };
+  // drops what a failed move copied so far and ends the pending version
+  auto abort_move = [&](const Status& status) {
+    if (copied) {
+      auto cleanup = Batch::CreateBatch(new_inst);
+      new_inst->DeleteDataRange(cleanup.get(), DataType::kHashes, newkey, new_meta.Version(),
+                                new_meta.FragmentNum());
+      if (Status cs = cleanup->Commit(); !cs.ok()) {
+        WARN("drop unfinished bitmap of key {} failed: {}", newkey.ToString(), cs.ToString());
+      }
+    }
+    new_inst->pending_versions_.Remove(new_meta_key, new_meta.Version());
+    return status;
+  };
+  Status s = ForEachBitmapFragment(default_read_options_, key, bitmap_meta, 0, bitmap_meta.Length(), copy_fragment);
+  if (s.ok()) {
+    s = write_status;
+  }
+  if (!s.ok()) {
+    return abort_move(s);
+  }
+  // the meta comes last, with the fragments it points at and its expire index entry
+  uint64_t etime = ParsedStringsValue(meta_value).Etime();
+  batch->Put(kMetaCF, base_newkey.Encode(), BitmapFragmentsMetaValue(new_meta, etime));
+  new_inst->UpdateExpireIndex(batch.get(), newkey, 0, etime);
+  auto old_batch = new_inst == this ? std::move(batch) : Batch::CreateBatch(this);
+  if (batch) {
+    s = batch->Commit();
+    if (!s.ok()) {
+      return abort_move(s);
+    }
+    new_inst->pending_versions_.Remove(new_meta_key, new_meta.Version());
+  }
+
+  BaseKey base_key(key);
+  old_batch->Delete(kMetaCF, base_key.Encode());
+  DeleteBitmapFragments(old_batch.get(), key, meta_value);
+  UpdateExpireIndex(old_batch.get(), key, etime, 0);
+  s = old_batch->Commit();
+  if (new_inst != this) {
+    return s;
+  }
+  if (!s.ok()) {
+    return abort_move(s);
+  }
+  pending_versions_.Remove(new_meta_key, new_meta.Version());
+  return s;
+}
+
+Status Redis::SetBitInFragments(const Slice& key, std::string* meta_value, int64_t offset, int32_t on, int32_t* ret) {
+  ParsedStringsValue parsed_strings_value(meta_value);
+  BitmapFragmentsMeta bitmap_meta;
+  if (!bitmap_meta.Decode(parsed_strings_value.UserValue())) {
+    return Status::Corruption("invalid bitmap meta");
+  }
+  uint64_t byte = offset >> 3;
+  uint64_t index = byte / kBitmapFragmentBytes;
+  size_t pos = byte % kBitmapFragmentBytes;
+  size_t bit = 7 - (offset & 0x7);
+  std::string fragment;
+  Status s = GetBitmapFragment(default_read_options_, key, bitmap_meta.Version(), index, &fragment);
+  if (!s.ok()) {
+    return s;
+  }
+  if (pos >= fragment.size()) {
+    fragment.resize(pos + 1, '\0');
+  }
+  auto byte_val = static_cast<uint8_t>(fragment[pos]);
+  *ret = (byte_val >> bit) & 0x1;
+  if (*ret == on) {
+    return Status::OK();
+  }
+  fragment[pos] = static_cast<char>((byte_val & ~(1 << bit)) | ((on & 0x1) << bit));
+
+  auto batch = Batch::CreateBatch(this);
+  std::string data_key = BitmapFragmentKey(key, bitmap_meta.Version(), index);
+  if (IsZeroBytes(fragment)) {
+    batch->Delete(kHashesDataCF, data_key);
+  } else {
+    BaseDataValue i_val(fragment);
+    batch->Put(kHashesDataCF, data_key, i_val.Encode());
+  }
+  if (byte + 1 > bitmap_meta.Length()) {
+    bitmap_meta.SetLength(byte + 1);
+    BaseKey base_key(key);
+    batch->Put(kMetaCF, base_key.Encode(), BitmapFragmentsMetaValue(bitmap_meta, parsed_strings_value.Etime()));
+  }
+  return batch->Commit();
+}
+
+Status Redis::SetBitToFragments(const Slice& key, const std::string& value, uint64_t etime, int64_t offset,
+                                int32_t on) {
+  uint64_t byte = offset >> 3;
+  uint64_t bit_index = byte / kBitmapFragmentBytes;
+  BitmapFragmentsMeta bitmap_meta(NewBitmapVersion(), std::max<uint64_t>(byte + 1, value.size()));
+  auto batch = Batch::CreateBatch(this);
+  uint64_t value_fragments = (value.size() + kBitmapFragmentBytes - 1) / kBitmapFragmentBytes;
+  for (uint64_t index = 0; index < value_fragments; ++index) {
+    uint64_t begin = index * kBitmapFragmentBytes;
+    Slice fragment(value.data() + begin, std::min<uint64_t>(kBitmapFragmentBytes, value.size() - begin));
+    if (index != bit_index && !IsZeroBytes(fragment)) {
+      BaseDataValue i_val(fragment);
+      batch->Put(kHashesDataCF, BitmapFragmentKey(key, bitmap_meta.Version(), index), i_val.Encode());
+    }
+  }
+
+  std::string fragment;
+  if (bit_index < value_fragments) {
+    fragment = value.substr(bit_index * kBitmapFragmentBytes, kBitmapFragmentBytes);
+  }
+  size_t pos = byte % kBitmapFragmentBytes;
+  size_t bit = 7 - (offset & 0x7);
+  if (pos >= fragment.size()) {
+    fragment.resize(pos + 1, '\0');
+  }
+  auto byte_val = static_cast<uint8_t>(fragment[pos]);
+  fragment[pos] = static_cast<char>((byte_val & ~(1 << bit)) | ((on & 0x1) << bit));
+  if (!IsZeroBytes(fragment)) {
+    BaseDataValue i_val(fragment);
+    batch->Put(kHashesDataCF, BitmapFragmentKey(key, bitmap_meta.Version(), bit_index), i_val.Encode());
+  }
+
+  BaseKey base_key(key);
+  batch->Put(kMetaCF, base_key.Encode(), BitmapFragmentsMetaValue(bitmap_meta, etime));
+  return batch->Commit();
+}
+
+Status Redis::BitPosInFragments(const rocksdb::ReadOptions& read_options, const Slice& key,
+                                const BitmapFragmentsMeta& meta, int32_t bit, int64_t start, int64_t end,
+                                int64_t* pos) {
+  *pos = -1;
+  // all the bytes in [start, next) are ones while a 0 bit is searched
+  auto next = static_cast<uint64_t>(start);
+  Status s = ForEachBitmapFragment(
+      read_options, key, meta, start, end, [bit, pos, &next](uint64_t offset, const Slice& bytes) {
+        if (bit == 0 && offset > next) {
+          // the bytes missing before the fragment are zero
+          return false;
+        }
+        int64_t bit_pos = GetBitPos(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size(), bit);
+        if (bit_pos != -1 && bit_pos != static_cast<int64_t>(8 * bytes.size())) {
+          *pos = static_cast<int64_t>(8 * offset) + bit_pos;
+          return false;
+        }
+        next = offset + bytes.size();
+        return true;
+      });
+  if (s.ok() && *pos == -1 && bit == 0 && next <= static_cast<uint64_t>(end)) {
+    *pos = static_cast<int64_t>(8 * next);
+  }
+  return s;
+}
+
+Status Redis::NewBitmapReader(const Slice& key, std::unique_ptr<BitmapReader>* reader) {
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = db_->GetSnapshot();
+  // the reader owns the snapshot from here on
+  *reader = std::make_unique<BitmapReader>(this, key, read_options.snapshot);
+  std::string value;
+  BaseKey base_key(key);
+  Status s = db_->Get(read_options, base_key.Encode(), &value);
+  if (s.ok()) {
+    if (IsStale(value)) {
+      value.clear();
+    } else if (!ExpectedMetaValue(DataType::kStrings, value)) {
+      return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
+                                                 DataTypeStrings[static_cast<int>(DataType::kStrings)],
+                                                 DataTypeStrings[static_cast<int>(GetMetaValueType(value))]));
+    }
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+  return (*reader)->Init(&value);
+}
+
+std::unique_ptr<Redis::BitmapWriter> Redis::NewBitmapWriter(const Slice& destination) {
+  return std::make_unique<BitmapWriter>(this, destination);
+}
+
+Redis::BitmapReader::BitmapReader(Redis* redis, const Slice& key, const rocksdb::Snapshot* snapshot)
+    : redis_(redis), key_(key.ToString()), snapshot_(snapshot) {}
+
+Redis::BitmapReader::~BitmapReader() {
+  iter_.reset();
+  redis_->db_->ReleaseSnapshot(snapshot_);
+}
+
+Status Redis::BitmapReader::Init(std::string* value) {
+  if (value->empty()) {
+    return Status::OK();
+  }
+  if (!meta_.DecodeStringsValue(*value)) {
+    ParsedStringsValue parsed_strings_value(value);
+    parsed_strings_value.StripSuffix();
+    value_ = std::move(*value);
+    length_ = value_.size();
+    return Status::OK();
+  }
+  fragments_ = true;
+  length_ = meta_.Length();
+  BaseDataKey prefix_key(key_, meta_.Version(), Slice());
+  prefix_ = prefix_key.EncodeSeekKey().ToString();
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot_;
+  read_options.fill_cache = false;
+  iter_.reset(redis_->db_->NewIterator(read_options, redis_->handles_[kHashesDataCF]));
+  iter_->Seek(prefix_);
+  return iter_->status();
+}
+
+Status Redis::BitmapReader::ReadFragment(uint64_t index, std::string* bytes) {
+  bytes->clear();
+  uint64_t begin = index * kBitmapFragmentBytes;
+  if (begin >= length_) {
+    return Status::OK();
+  }
+  size_t size = std::min<uint64_t>(kBitmapFragmentBytes, length_ - begin);
+  if (!fragments_) {
+    bytes->assign(value_, begin, size);
+    return Status::OK();
+  }
+  auto fragment_index = [this]() {
+    return BitmapFragmentsMeta::DecodeIndex(Slice(iter_->key().data() + prefix_.size(), sizeof(uint64_t)));
+  };
+  while (iter_->Valid() && iter_->key().starts_with(prefix_) && fragment_index() < index) {
+    iter_->Next();
+  }
+  if (iter_->Valid() && iter_->key().starts_with(prefix_) && fragment_index() == index) {
+    ParsedBaseDataValue parsed_value(iter_->value());
+    Slice stored = parsed_value.UserValue();
+    bytes->assign(stored.data(), std::min<size_t>(stored.size(), size));
+  }
+  bytes->resize(size, '\0');
+  return iter_->status();
+}
+
+Status Redis::BitmapReader::ReadAll(std::string* bytes) {
+  bytes->clear();
+  if (!fragments_) {
+    *bytes = value_;
+    return Status::OK();
+  }
+  std::string fragment;
+  for (uint64_t index = 0; index * kBitmapFragmentBytes < length_; ++index) {
+    Status s = ReadFragment(index, &fragment);
+    if (!s.ok()) {
+      return s;
+    }
+    bytes->append(fragment);
+  }
+  return Status::OK();
+}
+
+Redis::BitmapWriter::BitmapWriter(Redis* redis, const Slice& destination)
+    : redis_(redis),
+      key_(destination.ToString()),
+      meta_key_(BaseKey(destination).Encode().ToString()),
+      lock_(redis->lock_mgr_, key_),
+      batch_(Batch::CreateBatch(redis)),
+      version_(redis->NewBitmapVersion()) {
+  redis_->pending_versions_.Add(meta_key_, version_);
+}
+
+Redis::BitmapWriter::~BitmapWriter() {
+  if (committed_ && !finished_) {
+    auto batch = Batch::CreateBatch(redis_);
+    redis_->DeleteDataRange(batch.get(), DataType::kHashes, key_, version_, end_index_);
+    if (Status s = batch->Commit(); !s.ok()) {
+      WARN("drop unfinished bitmap of key {} failed: {}", key_, s.ToString());
+    }
+  }
+  redis_->pending_versions_.Remove(meta_key_, version_);
+}
+
+Status Redis::BitmapWriter::Add(uint64_t index, const Slice& bytes) {
+  if (IsZeroBytes(bytes)) {
+    return Status::OK();
+  }
+  BaseDataValue i_val(bytes);
+  batch_->Put(kHashesDataCF, BitmapFragmentKey(key_, version_, index), i_val.Encode());
+  end_index_ = index + 1;
+  if (batch_->Count() < kBitmapWriterBatchSize) {
+    return Status::OK();
+  }
+  committed_ = true;
+  Status s = batch_->Commit();
+  batch_ = Batch::CreateBatch(redis_);
+  return s;
+}
+
+Status Redis::BitmapWriter::Finish(uint64_t length) {
+  BaseKey base_key(key_);
+  std::string old_value;
+  Status s = redis_->db_->Get(redis_->default_read_options_, base_key.Encode(), &old_value);
+  if (s.ok()) {
+    // the fragments of the bitmap replaced go with it
+    redis_->DeleteBitmapFragments(batch_.get(), key_, old_value);
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+  batch_->Put(kMetaCF, base_key.Encode(), BitmapFragmentsMetaValue(BitmapFragmentsMeta(version_, length), 0));
+  committed_ = true;
+  s = batch_->Commit();
+  finished_ = s.ok();
+  return s;
+}
+
 }  //  namespace storage
@@ -16,6 +16,7 @@
 #include "src/base_key_format.h"
 #include "src/batch.h"
 #include "src/redis.h"
+#include "src/scan_cursor.h"
 #include "src/scope_record_lock.h"
 #include "src/scope_snapshot.h"
 #include "src/zsets_filter.h"
@@ -484,6 +485,61 @@ Status Redis::ZRange(const Slice& key, int32_t start, int32_t stop, std::vector<
   return s;
 }
 
+Status Redis::ZRange(const Slice& key, int32_t start, int32_t stop, bool with_scores,
+                     std::unique_ptr<ElementReader>* reader) {
+  const rocksdb::Snapshot* snapshot = nullptr;
+  std::string meta_value;
+  Status s = GetReaderMeta(key, DataType::kZSets, &snapshot, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+
+  ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+  int32_t count = parsed_zsets_meta_value.Count();
+  int32_t start_index = start >= 0 ? start : count + start;
+  int32_t stop_index = stop >= 0 ? stop : count + stop;
+  start_index = start_index <= 0 ? 0 : start_index;
+  stop_index = stop_index >= count ? count - 1 : stop_index;
+  uint64_t members = 0;
+  if (start_index <= stop_index && start_index < count && stop_index >= 0) {
+    members = stop_index - start_index + 1;
+  }
+
+  ZSetsScoreKey zsets_score_key(key, parsed_zsets_meta_value.Version(), std::numeric_limits<double>::lowest(),
+                                Slice());
+  std::string seek_key = zsets_score_key.Encode().ToString();
+  auto read_fn = [seek_key, start_index, stop_index, with_scores, cur_index = 0, seeked = false](
+                     rocksdb::Iterator* iter, ElementSink* sink, size_t max_bytes, bool* done) mutable {
+    if (!seeked) {
+      seeked = true;
+      iter->Seek(seek_key);
+    }
+    size_t bytes = 0;
+    for (; iter->Valid() && cur_index <= stop_index && bytes < max_bytes; iter->Next(), ++cur_index) {
+      if (cur_index < start_index) {
+        continue;
+      }
+      ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
+      Status s = sink->Append(parsed_zsets_score_key.member());
+      if (s.ok() && with_scores) {
+        s = sink->AppendScore(parsed_zsets_score_key.score());
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      bytes += parsed_zsets_score_key.member().size();
+    }
+    *done = cur_index > stop_index;
+    if (*done || bytes >= max_bytes) {
+      return Status::OK();
+    }
+    return iter->status().ok() ? Status::Corruption("sorted set has fewer members than its count") : iter->status();
+  };
+  *reader = std::make_unique<CollectionReader>(this, snapshot, DataType::kZSets, key, kZsetsScoreCF,
+                                               with_scores ? members * 2 : members, std::move(read_fn));
+  return Status::OK();
+}
+
 Status Redis::ZRangeWithTTL(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members,
                             int64_t* ttl) {
   score_members->clear();
@@ -1058,6 +1114,52 @@ Status Redis::ZScore(const Slice& key, const Slice& member, double* score) {
   return s;
 }
 
+Status Redis::ZMScore(const Slice& key, const std::vector<std::string>& members, std::vector<ScoreStatus>* sss) {
+  sss->assign(members.size(), {0, Status::NotFound()});
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot = nullptr;
+
+  std::string meta_value;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
+
+  BaseMetaKey base_meta_key(key);
+  Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+  if (s.ok()) {
+    if (IsStale(meta_value)) {
+      return Status::NotFound();
+    } else if (!ExpectedMetaValue(DataType::kZSets, meta_value)) {
+      return Status::InvalidArgument(fmt::format("WRONGTYPE, key: {}, expect type: {}, get type: {}", key.ToString(),
+                                                 DataTypeStrings[static_cast<int>(DataType::kZSets)],
+                                                 DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]));
+    } else {
+      ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+      uint64_t version = parsed_zsets_meta_value.Version();
+      std::vector<std::string> member_keys;
+      member_keys.reserve(members.size());
+      for (const auto& member : members) {
+        ZSetsMemberKey zsets_member_key(key, version, member);
+        member_keys.push_back(zsets_member_key.Encode().ToString());
+      }
+      std::vector<std::string> data_values;
+      std::vector<Status> statuses;
+      MultiGetSorted(read_options, kZsetsDataCF, member_keys, &data_values, &statuses);
+      for (size_t idx = 0; idx < members.size(); ++idx) {
+        if (statuses[idx].ok()) {
+          ParsedBaseDataValue parsed_value(&data_values[idx]);
+          parsed_value.StripSuffix();
+          uint64_t tmp = DecodeFixed64(data_values[idx].data());
+          const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
+          (*sss)[idx] = {*reinterpret_cast<const double*>(ptr_tmp), Status::OK()};
+        } else if (!statuses[idx].IsNotFound()) {
+          return statuses[idx];
+        }
+      }
+    }
+  }
+  return s;
+}
+
 Status Redis::ZGetAll(const Slice& key, double weight, std::map<std::string, double>* value_to_dest) {
   Status s;
   rocksdb::ReadOptions read_options;
@@ -1487,12 +1589,13 @@ Status Redis::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& ma
   return s;
 }
 
-Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
-                    std::vector<ScoreMember>* score_members, int64_t* next_cursor) {
-  *next_cursor = 0;
+Status Redis::ZScan(const Slice& key, const std::string& cursor, bool stateless, const std::string& pattern,
+                    int64_t count, std::vector<ScoreMember>* score_members, std::string* next_cursor) {
+  *next_cursor = "0";
   score_members->clear();
-  if (cursor < 0) {
-    *next_cursor = 0;
+  int64_t number = 0;
+  if (ScanCursor::ParseNumbered(cursor, &number) && number < 0) {
+    *next_cursor = "0";
     return Status::OK();
   }
 
@@ -1509,7 +1612,7 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
   Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
     if (IsStale(meta_value)) {
-      *next_cursor = 0;
+      *next_cursor = "0";
       return Status::NotFound();
     } else if (!ExpectedMetaValue(DataType::kZSets, meta_value)) {
       return Status::InvalidArgument("WRONGTYPE, key: " + key.ToString() +
@@ -1522,7 +1625,7 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
       uint64_t version = parsed_zsets_meta_value.Version();
       s = GetScanStartPoint(DataType::kZSets, key, pattern, cursor, &start_point);
       if (s.IsNotFound()) {
-        cursor = 0;
+        number = 0;
         if (isTailWildcard(pattern)) {
           start_point = pattern.substr(0, pattern.size() - 1);
         }
@@ -1551,17 +1654,16 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
       }
 
       if (iter->Valid() && (iter->key().compare(prefix) <= 0 || iter->key().starts_with(prefix))) {
-        *next_cursor = cursor + step_length;
         ParsedZSetsMemberKey parsed_zsets_member_key(iter->key());
         std::string next_member = parsed_zsets_member_key.member().ToString();
-        StoreScanNextPoint(DataType::kZSets, key, pattern, *next_cursor, next_member);
+        *next_cursor = StoreScanNextPoint(DataType::kZSets, key, pattern, number + step_length, stateless, next_member);
       } else {
-        *next_cursor = 0;
+        *next_cursor = "0";
       }
       delete iter;
     }
   } else {
-    *next_cursor = 0;
+    *next_cursor = "0";
     return s;
   }
   return Status::OK();
@@ -1574,7 +1676,6 @@ Status Redis::ZsetsRename(const Slice& key, Redis* new_inst, const Slice& newkey
   MultiScopeRecordLock ml(lock_mgr_, keys);
 
   BaseMetaKey base_meta_key(key);
-  BaseMetaKey base_meta_newkey(newkey);
   Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (!s.ok() || !ExpectedMetaValue(DataType::kZSets, meta_value)) {
     return s;
@@ -1591,12 +1692,13 @@ Status Redis::ZsetsRename(const Slice& key, Redis* new_inst, const Slice& newkey
   }
   // copy a new zset with newkey
   statistic = parsed_zsets_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // ZsetsDel key
+  uint64_t etime = parsed_zsets_meta_value.Etime();
   parsed_zsets_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
 
   return s;
@@ -1636,12 +1738,13 @@ Status Redis::ZsetsRenamenx(const Slice& key, Redis* new_inst, const Slice& newk
 
   // copy a new zset with newkey
   statistic = parsed_zsets_meta_value.Count();
-  s = new_inst->GetDB()->Put(default_write_options_, handles_[kMetaCF], base_meta_newkey.Encode(), meta_value);
-  new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey.ToString(), statistic);
+  std::string renamed_meta_value = meta_value;
 
   // ZsetsDel key
+  uint64_t etime = parsed_zsets_meta_value.Etime();
   parsed_zsets_meta_value.InitialMetaValue();
-  s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+  s = CommitRename(key, &meta_value, new_inst, newkey, renamed_meta_value, etime);
+  new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey.ToString(), statistic);
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
 
   return s;
@@ -1653,6 +1756,7 @@ void Redis::ScanZsets() {
   ScopeSnapshot ss(db_, &snapshot);
   iterator_options.snapshot = snapshot;
   iterator_options.fill_cache = false;
+  iterator_options.total_order_seek = true;
   auto current_time = static_cast<int32_t>(time(nullptr));
 
   INFO("***************rocksdb instance: {} ZSets Meta Data***************", index_);
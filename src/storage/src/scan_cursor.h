@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "src/base_value_format.h"
+
+namespace storage {
+
+/*
+ * With stateless_scan_cursors the cursors of SCAN, HSCAN, SSCAN and ZSCAN are
+ * tokens carrying the whole point their scan resumes at, so a scan goes on
+ * exactly without the cursor cache, after an eviction or a restart. A token is
+ * the DataTypeTag scanned followed by, in base64url without padding:
+ *
+ * | mac (8 bytes) | shared (1 byte) | point suffix |
+ *
+ * The point starts with shared bytes of the literal prefix of the pattern, which
+ * the points of a scan with a prefix pattern all begin with, only the rest is
+ * carried. The mac is the HMAC-SHA256 under the scan cursor secret of the scope
+ * (type, key and pattern), the type and the whole point, truncated to 8 bytes.
+ * Clients can't forge the point of a token, a token of another scan or secret
+ * or a damaged one starts the scan over. Tokens start with a letter, numbered
+ * cursors are integers.
+ */
+class ScanCursor {
+ public:
+  static std::string Encode(std::string_view secret, char type, std::string_view scope, std::string_view pattern,
+                            std::string_view point) {
+    size_t shared = SharedPrefix(pattern, point);
+    std::string raw;
+    raw.reserve(kMacBytes + 1 + point.size() - shared);
+    Mac(secret, scope, type, point, &raw);
+    raw.push_back(static_cast<char>(shared));
+    raw.append(point.substr(shared));
+
+    std::string cursor(1, type);
+    cursor.reserve(1 + (raw.size() * 4 + 2) / 3);
+    uint32_t bits = 0;
+    int bit_count = 0;
+    for (char c : raw) {
+      bits = (bits << 8) | static_cast<uint8_t>(c);
+      bit_count += 8;
+      while (bit_count >= 6) {
+        bit_count -= 6;
+        cursor.push_back(kAlphabet[(bits >> bit_count) & 0x3f]);
+      }
+    }
+    if (bit_count > 0) {
+      cursor.push_back(kAlphabet[(bits << (6 - bit_count)) & 0x3f]);
+    }
+    return cursor;
+  }
+
+  // Sets the type and the point of a token of the scan of scope and pattern
+  static bool Decode(std::string_view secret, std::string_view cursor, std::string_view scope,
+                     std::string_view pattern, char* type, std::string* point) {
+    if (cursor.empty() || !IsTypeTag(cursor[0])) {
+      return false;
+    }
+    std::string raw;
+    raw.reserve(cursor.size() * 3 / 4);
+    uint32_t bits = 0;
+    int bit_count = 0;
+    for (char c : cursor.substr(1)) {
+      int value = AlphabetIndex(c);
+      if (value < 0) {
+        return false;
+      }
+      bits = (bits << 6) | static_cast<uint32_t>(value);
+      bit_count += 6;
+      if (bit_count >= 8) {
+        bit_count -= 8;
+        raw.push_back(static_cast<char>((bits >> bit_count) & 0xff));
+      }
+    }
+    if (raw.size() < kMacBytes + 1) {
+      return false;
+    }
+    auto shared = static_cast<uint8_t>(raw[kMacBytes]);
+    std::string_view prefix = LiteralPrefix(pattern);
+    if (shared > prefix.size()) {
+      return false;
+    }
+    std::string full_point(prefix.substr(0, shared));
+    full_point.append(raw, kMacBytes + 1);
+    std::string mac;
+    Mac(secret, scope, cursor[0], full_point, &mac);
+    if (CRYPTO_memcmp(mac.data(), raw.data(), kMacBytes) != 0) {
+      return false;
+    }
+    *type = cursor[0];
+    *point = std::move(full_point);
+    return true;
+  }
+
+  // Parses a numbered cursor
+  static bool ParseNumbered(std::string_view cursor, int64_t* number) {
+    auto [end, ec] = std::from_chars(cursor.data(), cursor.data() + cursor.size(), *number);
+    return ec == std::errc() && end == cursor.data() + cursor.size();
+  }
+
+ private:
+  static constexpr size_t kMacBytes = 8;
+  static constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+  static bool IsTypeTag(char c) {
+    for (char tag : DataTypeTag) {
+      if (c == tag) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static int AlphabetIndex(char c) {
+    if (c >= 'A' && c <= 'Z') {
+      return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+      return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+      return c - '0' + 52;
+    }
+    if (c == '-') {
+      return 62;
+    }
+    return c == '_' ? 63 : -1;
+  }
+
+  // The part of the literal prefix of pattern that point starts with, 255 bytes at most
+  static size_t SharedPrefix(std::string_view pattern, std::string_view point) {
+    std::string_view prefix = LiteralPrefix(pattern);
+    size_t shared = 0;
+    while (shared < prefix.size() && shared < point.size() && shared < 255 && prefix[shared] == point[shared]) {
+      ++shared;
+    }
+    return shared;
+  }
+
+  static std::string_view LiteralPrefix(std::string_view pattern) {
+    return pattern.substr(0, std::min(pattern.find_first_of("*?[\\"), pattern.size()));
+  }
+
+  // Appends the first kMacBytes of the mac of the scope, the type and the point to out
+  static void Mac(std::string_view secret, std::string_view scope, char type, std::string_view point,
+                  std::string* out) {
+    std::string message;
+    message.reserve(scope.size() + 2 + point.size());
+    message.append(scope);
+    message.push_back('\0');
+    message.push_back(type);
+    message.append(point);
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len = 0;
+    HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+         reinterpret_cast<const unsigned char*>(message.data()), message.size(), md, &md_len);
+    out->append(reinterpret_cast<const char*>(md), kMacBytes);
+  }
+};
+
+}  // namespace storage
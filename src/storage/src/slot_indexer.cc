@@ -0,0 +1,89 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "storage/slot_indexer.h"
+
+#include <sstream>
+
+#include "rocksdb/env.h"
+
+namespace storage {
+
+SlotIndexer::SlotIndexer(int32_t inst_num) {
+  assert(inst_num > 0);
+  auto num = static_cast<uint32_t>(inst_num);
+  slot_num_ = (kMinSlotNum + num - 1) / num * num;
+  owners_ = std::make_unique<std::atomic<uint32_t>[]>(slot_num_);
+  for (uint32_t slot = 0; slot < slot_num_; ++slot) {
+    owners_[slot].store(slot % num, std::memory_order_relaxed);
+  }
+}
+
+std::vector<uint32_t> SlotIndexer::GetSlotsOf(uint32_t inst_id) const {
+  std::vector<uint32_t> slots;
+  for (uint32_t slot = 0; slot < slot_num_; ++slot) {
+    if (GetSlotOwner(slot) == inst_id) {
+      slots.push_back(slot);
+    }
+  }
+  return slots;
+}
+
+void SlotIndexer::ReshardSlots(const std::vector<uint32_t>& slots, uint32_t inst_id) {
+  for (auto slot : slots) {
+    assert(slot < slot_num_);
+    owners_[slot].store(inst_id, std::memory_order_release);
+  }
+}
+
+/*
+ * slot map file format, in text:
+ * | slot_num | owner of slot 0 | owner of slot 1 | ... |
+ * separated by whitespace.
+ */
+rocksdb::Status SlotIndexer::Load(const std::string& path) {
+  std::string content;
+  rocksdb::Status s = rocksdb::ReadFileToString(rocksdb::Env::Default(), path, &content);
+  if (!s.ok()) {
+    return s;
+  }
+  std::istringstream in(content);
+  uint32_t slot_num = 0;
+  if (!(in >> slot_num) || slot_num == 0) {
+    return rocksdb::Status::Corruption("invalid slot num in " + path);
+  }
+  auto owners = std::make_unique<std::atomic<uint32_t>[]>(slot_num);
+  for (uint32_t slot = 0; slot < slot_num; ++slot) {
+    uint32_t owner = 0;
+    if (!(in >> owner)) {
+      return rocksdb::Status::Corruption("missing owner of slot " + std::to_string(slot) + " in " + path);
+    }
+    owners[slot].store(owner, std::memory_order_relaxed);
+  }
+  slot_num_ = slot_num;
+  owners_ = std::move(owners);
+  return rocksdb::Status::OK();
+}
+
+// The map is written to a temporary file and renamed over the old one, so a
+// crash leaves either map on disk.
+rocksdb::Status SlotIndexer::Save(const std::string& path) const {
+  std::string content = std::to_string(slot_num_) + "\n";
+  for (uint32_t slot = 0; slot < slot_num_; ++slot) {
+    content.append(std::to_string(GetSlotOwner(slot)));
+    content.push_back((slot + 1) % 32 == 0 ? '\n' : ' ');
+  }
+  content.push_back('\n');
+
+  auto env = rocksdb::Env::Default();
+  std::string tmp_path = path + ".tmp";
+  rocksdb::Status s = rocksdb::WriteStringToFile(env, content, tmp_path, true);
+  if (!s.ok()) {
+    return s;
+  }
+  return env->RenameFile(tmp_path, path);
+}
+
+}  // namespace storage
@@ -4,12 +4,17 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <future>
+#include <numeric>
 #include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include <openssl/rand.h>
+
 #include "binlog.pb.h"
 #include "config.h"
 #include "pstd/log.h"
@@ -17,11 +22,15 @@
 #include "pstd/pstd_string.h"
 #include "rocksdb/utilities/checkpoint.h"
 #include "scope_snapshot.h"
+#include "src/base_data_value_format.h"
+#include "src/bitmap_fragment_format.h"
 #include "src/lru_cache.h"
 #include "src/mutex_impl.h"
 #include "src/options_helper.h"
 #include "src/redis.h"
 #include "src/redis_hyperloglog.h"
+#include "src/scan_cursor.h"
+#include "src/scope_record_lock.h"
 #include "src/type_iterator.h"
 #include "storage/slot_indexer.h"
 #include "storage/storage.h"
@@ -34,6 +43,25 @@ namespace storage {
 extern std::string BitOpOperate(BitOpType op, const std::vector<std::string>& src_values, int64_t max_len);
 class Redis;
 
+// The keys written to the migrating slots are remembered up to kMigrationMaxTouchedKeys, past
+// that the slots are copied again from new snapshots, kMigrationCopyRounds times at most
+static const size_t kMigrationMaxTouchedKeys = 256 << 10;
+static const int kMigrationCopyRounds = 3;
+// The written keys are copied again in rounds until at most kMigrationSwitchKeys are left, only
+// those are copied with every command blocked, when the slots are switched over
+static const size_t kMigrationSwitchKeys = 1024;
+static const int kMigrationCatchUpRounds = 16;
+
+struct Storage::SlotMigration {
+  std::unordered_set<uint32_t> slots;
+  pstd::Mutex mutex;
+  // the keys of the slots written since the last copy round, they are copied again
+  std::unordered_set<std::string> touched_keys;
+  // more than kMigrationMaxTouchedKeys keys were written, they were not kept
+  bool overflowed = false;
+  bool untracked_write = false;
+};
+
 Status StorageOptions::ResetOptions(const OptionType& option_type,
                                     const std::unordered_map<std::string, std::string>& options_map) {
   std::unordered_map<std::string, MemberTypeInfo>& options_member_type_info = mutable_cf_options_member_type_info;
@@ -61,7 +89,7 @@ Status StorageOptions::ResetOptions(const OptionType& option_type,
 }
 
 Storage::Storage() {
-  cursors_store_ = std::make_unique<LRUCache<std::string, std::string>>();
+  cursors_store_ = std::make_unique<ShardedLRUCache<std::string, std::string>>();
   cursors_store_->SetCapacity(5000);
 
   Status s = StartBGThread();
@@ -72,6 +100,7 @@ Storage::Storage() {
 
 Storage::~Storage() {
   INFO("Storage begin to clear storage!");
+  StopActiveExpire();
   bg_tasks_should_exit_.store(true);
   bg_tasks_cond_var_.notify_one();
   if (is_opened_.load()) {
@@ -88,6 +117,7 @@ Status Storage::Close() {
   if (!is_opened_.load()) {
     return Status::OK();
   }
+  StopActiveExpire();
   is_opened_.store(false);
   for (auto& inst : insts_) {
     inst->SetNeedClose(true);
@@ -95,12 +125,152 @@ Status Storage::Close() {
   return Status::OK();
 }
 
-static std::string AppendSubDirectory(const std::string& db_path, int index) {
+// Emits every element of reader into sink at once
+static Status ReadAllElements(ElementReader* reader, ElementSink* sink) {
+  while (!reader->Done()) {
+    Status s = reader->Read(sink, std::numeric_limits<size_t>::max());
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+static std::string AppendSubDirectory(const std::string& db_path, const std::string& name) {
   if (db_path.back() == '/') {
-    return db_path + std::to_string(index);
+    return db_path + name;
   } else {
-    return db_path + "/" + std::to_string(index);
+    return db_path + "/" + name;
+  }
+}
+
+static std::string AppendSubDirectory(const std::string& db_path, int index) {
+  return AppendSubDirectory(db_path, std::to_string(index));
+}
+
+static const std::string kSlotMapFileName = "slot_map";
+static const std::string kDataPathMapFileName = "data_paths";
+static const std::string kScanCursorSecretFileName = "scan_cursor_secret";
+static const size_t kScanCursorSecretBytes = 32;
+
+// Without a configured secret the tokens are signed with a random one, made once and kept
+// in the db path so that the tokens stay valid across restarts
+static Status LoadScanCursorSecret(const std::string& db_path, std::string* secret) {
+  auto env = rocksdb::Env::Default();
+  auto path = AppendSubDirectory(db_path, kScanCursorSecretFileName);
+  if (pstd::FileExists(path)) {
+    return rocksdb::ReadFileToString(env, path, secret);
+  }
+  secret->resize(kScanCursorSecretBytes);
+  if (RAND_bytes(reinterpret_cast<unsigned char*>(secret->data()), static_cast<int>(secret->size())) != 1) {
+    return Status::IOError("no random bytes for the scan cursor secret");
+  }
+  std::string tmp_path = path + ".tmp";
+  Status s = rocksdb::WriteStringToFile(env, *secret, tmp_path, true);
+  if (!s.ok()) {
+    return s;
+  }
+  return env->RenameFile(tmp_path, path);
+}
+
+/*
+ * data path map file format, in text:
+ * the data path of instance 0, of instance 1 ... one per line, an empty line
+ * stands for the db path so the db directory can be moved as a whole.
+ */
+static Status LoadDataPathMap(const std::string& path, std::vector<std::string>* data_paths) {
+  std::string content;
+  Status s = rocksdb::ReadFileToString(rocksdb::Env::Default(), path, &content);
+  if (!s.ok()) {
+    return s;
+  }
+  data_paths->clear();
+  size_t begin = 0;
+  while (begin < content.size()) {
+    auto end = content.find('\n', begin);
+    if (end == std::string::npos) {
+      return Status::Corruption("truncated data path map " + path);
+    }
+    data_paths->emplace_back(content.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return Status::OK();
+}
+
+static Status SaveDataPathMap(const std::string& path, const std::vector<std::string>& data_paths) {
+  std::string content;
+  for (const auto& data_path : data_paths) {
+    content.append(data_path).push_back('\n');
+  }
+  auto env = rocksdb::Env::Default();
+  std::string tmp_path = path + ".tmp";
+  Status s = rocksdb::WriteStringToFile(env, content, tmp_path, true);
+  if (!s.ok()) {
+    return s;
+  }
+  return env->RenameFile(tmp_path, path);
+}
+
+// Places the instances of a db in data paths. The instances recorded in the data path map,
+// or left in the db path by an older version, stay where they are. The others are dealt out
+// over storage_options.data_paths by a smooth weighted round-robin running through the
+// instances of all the dbs in db order, so the dbs do not all start on the first path.
+static Status PlaceInstances(const StorageOptions& storage_options, const std::string& db_path,
+                             std::vector<std::string>* inst_data_paths) {
+  auto map_path = AppendSubDirectory(db_path, kDataPathMapFileName);
+  std::vector<std::string> recorded;
+  if (pstd::FileExists(map_path)) {
+    Status s = LoadDataPathMap(map_path, &recorded);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  const auto& data_paths = storage_options.data_paths;
+  std::vector<size_t> round;
+  if (!data_paths.empty()) {
+    uint64_t total_weight = 0;
+    for (const auto& [data_path, weight] : data_paths) {
+      total_weight += weight;
+    }
+    std::vector<int64_t> current(data_paths.size(), 0);
+    for (uint64_t turn = 0; turn < total_weight; ++turn) {
+      size_t picked = 0;
+      for (size_t i = 0; i < data_paths.size(); ++i) {
+        current[i] += data_paths[i].second;
+        if (current[i] > current[picked]) {
+          picked = i;
+        }
+      }
+      current[picked] -= static_cast<int64_t>(total_weight);
+      round.push_back(picked);
+    }
+  }
+
+  bool changed = recorded.size() < storage_options.db_instance_num;
+  inst_data_paths->clear();
+  for (size_t index = 0; index < storage_options.db_instance_num; ++index) {
+    if (index < recorded.size()) {
+      inst_data_paths->push_back(recorded[index].empty() ? db_path : recorded[index]);
+    } else if (round.empty() || pstd::FileExists(AppendSubDirectory(AppendSubDirectory(db_path, index), "CURRENT"))) {
+      inst_data_paths->push_back(db_path);
+    } else {
+      auto ordinal = static_cast<size_t>(storage_options.db_id) * storage_options.db_instance_num + index;
+      inst_data_paths->push_back(data_paths[round[ordinal % round.size()]].first);
+    }
+    if (mkpath(inst_data_paths->back().c_str(), 0755) != 0) {
+      return Status::IOError("create data path " + inst_data_paths->back() + " fail");
+    }
   }
+  if (!changed) {
+    return Status::OK();
+  }
+
+  std::vector<std::string> to_save(recorded);
+  for (size_t index = recorded.size(); index < inst_data_paths->size(); ++index) {
+    to_save.push_back((*inst_data_paths)[index] == db_path ? "" : (*inst_data_paths)[index]);
+  }
+  return SaveDataPathMap(map_path, to_save);
 }
 
 static int RecursiveLinkAndCopy(const std::filesystem::path& source, const std::filesystem::path& destination) {
@@ -108,12 +278,16 @@ static int RecursiveLinkAndCopy(const std::filesystem::path& source, const std::
     if (source.filename() == PRAFT_SNAPSHOT_META_FILE) {
       return 0;
     } else if (source.extension() == SST_FILE_EXTENSION) {
-      // Create a hard link
-      if (::link(source.c_str(), destination.c_str()) != 0) {
+      // Create a hard link, the file is copied when the instance is on another disk
+      if (::link(source.c_str(), destination.c_str()) == 0) {
+        DEBUG("hard link success! source_file = {} , destination_file = {}", source.string(), destination.string());
+      } else if (errno != EXDEV) {
         WARN("hard link file {} fail", source.string());
         return -1;
+      } else if (!std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing)) {
+        WARN("copy file {} fail", source.string());
+        return -1;
       }
-      DEBUG("hard link success! source_file = {} , destination_file = {}", source.string(), destination.string());
     } else {
       // Copy the file
       if (!std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing)) {
@@ -142,13 +316,66 @@ static int RecursiveLinkAndCopy(const std::filesystem::path& source, const std::
 Status Storage::Open(const StorageOptions& storage_options, const std::string& db_path) {
   mkpath(db_path.c_str(), 0755);
   db_instance_num_ = storage_options.db_instance_num;
+  stateless_scan_cursors_ = storage_options.stateless_scan_cursors;
+  scan_cursor_secret_ = storage_options.scan_cursor_secret;
+  if (stateless_scan_cursors_ && scan_cursor_secret_.empty()) {
+    if (Status s = LoadScanCursorSecret(db_path, &scan_cursor_secret_); !s.ok()) {
+      ERROR("load the scan cursor secret of {} failed {}", db_path, s.ToString());
+      return s;
+    }
+  }
+  // a command runs at most db_instance_num_ - 1 of its groups on the pool, one thread per
+  // instance keeps the pool fixed however many commands fan out at once
+  multi_key_pool_.SetMaxThread(static_cast<unsigned>(std::max<size_t>(1, db_instance_num_)));
+  multi_key_pool_.SetMaxIdleThread(static_cast<unsigned>(std::max<size_t>(1, db_instance_num_)));
   // Temporarily set to 100000
   LogIndexAndSequenceCollector::max_gap_.store(storage_options.max_gap);
   storage_options.options.write_buffer_manager =
       std::make_shared<rocksdb::WriteBufferManager>(storage_options.mem_manager_size);
+  db_path_ = db_path;
+  if (Status s = PlaceInstances(storage_options, db_path, &inst_data_paths_); !s.ok()) {
+    ERROR("place the RocksDB instances of {} failed {}", db_path, s.ToString());
+    return s;
+  }
+
+  slot_indexer_ = std::make_unique<SlotIndexer>(db_instance_num_);
+  slot_map_path_ = AppendSubDirectory(db_path, kSlotMapFileName);
+  if (pstd::FileExists(slot_map_path_)) {
+    Status s = slot_indexer_->Load(slot_map_path_);
+    if (!s.ok()) {
+      ERROR("load slot map {} failed {}", slot_map_path_, s.ToString());
+      return s;
+    }
+    for (uint32_t slot = 0; slot < slot_indexer_->GetSlotNum(); ++slot) {
+      if (slot_indexer_->GetSlotOwner(slot) >= db_instance_num_) {
+        ERROR("slot {} belongs to RocksDB{}, but there are {} instances", slot, slot_indexer_->GetSlotOwner(slot),
+              db_instance_num_);
+        return Status::InvalidArgument("slot map refers to a missing instance");
+      }
+    }
+  } else {
+    // Keys written without a slot map were routed by crc % the instance count of that
+    // time, with more instances now some of them would be looked up in the wrong one
+    size_t existing_num = 0;
+    for (size_t index = 0; index < db_instance_num_; index++) {
+      auto inst_path = AppendSubDirectory(inst_data_paths_[index], index);
+      existing_num += pstd::FileExists(AppendSubDirectory(inst_path, "CURRENT")) ? 1 : 0;
+    }
+    if (existing_num != 0 && existing_num != db_instance_num_) {
+      ERROR("{} has {} of {} instances but no slot map, open it with db-instance-num {}", db_path, existing_num,
+            db_instance_num_, existing_num);
+      return Status::InvalidArgument("instances were added without a slot map");
+    }
+    // a new db gets its slot map before any instance, so the check holds after a crash
+    if (Status s = slot_indexer_->Save(slot_map_path_); !s.ok()) {
+      ERROR("save slot map {} failed {}", slot_map_path_, s.ToString());
+      return s;
+    }
+  }
+
   for (size_t index = 0; index < db_instance_num_; index++) {
     insts_.emplace_back(std::make_unique<Redis>(this, index));
-    Status s = insts_.back()->Open(storage_options, AppendSubDirectory(db_path, index));
+    Status s = insts_.back()->Open(storage_options, AppendSubDirectory(inst_data_paths_[index], index));
     if (!s.ok()) {
       ERROR("open RocksDB{} failed {}", index, s.ToString());
       return Status::IOError();
@@ -156,10 +383,15 @@ Status Storage::Open(const StorageOptions& storage_options, const std::string& d
     INFO("open RocksDB{} success!", index);
   }
 
-  slot_indexer_ = std::make_unique<SlotIndexer>(db_instance_num_);
   db_id_ = storage_options.db_id;
 
   is_opened_.store(true);
+  if (storage_options.active_expire_keys_per_second > 0) {
+    can_write_function_ = storage_options.can_write_function;
+    active_expire_should_exit_ = false;
+    active_expire_thread_ =
+        std::thread(&Storage::RunActiveExpire, this, storage_options.active_expire_keys_per_second);
+  }
   return Status::OK();
 }
 
@@ -167,6 +399,12 @@ std::vector<std::future<Status>> Storage::CreateCheckpoint(const std::string& ch
   INFO("DB{} begin to generate a checkpoint to {}", db_id_, checkpoint_path);
   //  auto source_dir = AppendSubDirectory(checkpoint_path, db_id_);
 
+  // the slot map goes with the instances, a migration can not run meanwhile
+  // since the caller holds the db shared lock
+  if (auto s = slot_indexer_->Save(AppendSubDirectory(checkpoint_path, kSlotMapFileName)); !s.ok()) {
+    WARN("DB{} save the slot map to {} failed: {}", db_id_, checkpoint_path, s.ToString());
+  }
+
   std::vector<std::future<Status>> result;
   result.reserve(db_instance_num_);
   for (int i = 0; i < db_instance_num_; ++i) {
@@ -227,10 +465,30 @@ Status Storage::CreateCheckpointInternal(const std::string& checkpoint_path, int
   return Status::OK();
 }
 
-std::vector<std::future<Status>> Storage::LoadCheckpoint(const std::string& checkpoint_sub_path,
+std::vector<std::future<Status>> Storage::LoadCheckpoint(const StorageOptions& storage_options,
+                                                         const std::string& checkpoint_sub_path,
                                                          const std::string& db_sub_path) {
+  db_instance_num_ = storage_options.db_instance_num;
+  db_id_ = storage_options.db_id;
   INFO("DB{} begin to load a checkpoint from {} to {}", db_id_, checkpoint_sub_path, db_sub_path);
+  // the checkpoint holds no data path map, the instances go where this node keeps them
   std::vector<std::future<Status>> result;
+  if (Status s = PlaceInstances(storage_options, db_sub_path, &inst_data_paths_); !s.ok()) {
+    WARN("DB{} place the RocksDB instances of {} failed: {}", db_id_, db_sub_path, s.ToString());
+    std::promise<Status> failed;
+    failed.set_value(s);
+    result.push_back(failed.get_future());
+    return result;
+  }
+  auto checkpoint_slot_map = AppendSubDirectory(checkpoint_sub_path, kSlotMapFileName);
+  if (pstd::FileExists(checkpoint_slot_map)) {
+    std::error_code ec;
+    std::filesystem::copy_file(checkpoint_slot_map, AppendSubDirectory(db_sub_path, kSlotMapFileName),
+                               std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec) {
+      WARN("DB{} copy the slot map {} failed: {}", db_id_, checkpoint_slot_map, ec.message());
+    }
+  }
   result.reserve(db_instance_num_);
   for (int i = 0; i < db_instance_num_; ++i) {
     // In a new thread, Load a checkpoint for the specified rocksdb i
@@ -243,7 +501,7 @@ std::vector<std::future<Status>> Storage::LoadCheckpoint(const std::string& chec
 
 Status Storage::LoadCheckpointInternal(const std::string& checkpoint_sub_path, const std::string& db_sub_path,
                                        int index) {
-  auto rocksdb_path = AppendSubDirectory(db_sub_path, index);  // ./db/db_id/index
+  auto rocksdb_path = AppendSubDirectory(inst_data_paths_[index], index);  // ./db/db_id/index
   auto tmp_rocksdb_path = rocksdb_path + ".tmp";               // ./db/db_id/index.tmp
 
   auto source_dir = AppendSubDirectory(checkpoint_sub_path, index);
@@ -275,33 +533,200 @@ Status Storage::LoadCheckpointInternal(const std::string& checkpoint_sub_path, c
   return Status::OK();
 }
 
-Status Storage::LoadCursorStartKey(const DataType& dtype, int64_t cursor, char* type, std::string* start_key) {
-  std::string index_key = DataTypeTag[static_cast<uint8_t>(dtype)] + std::to_string(cursor);
+// A token carries its start key, a numbered cursor finds it in the cursor cache
+Status Storage::LoadCursorStartKey(const DataType& dtype, const std::string& pattern, const std::string& cursor,
+                                   char* type, std::string* start_key) {
+  // format of index key: dtype tag(1B) | pattern | '_'
+  std::string scope = DataTypeTag[static_cast<uint8_t>(dtype)] + pattern + "_";
+  if (ScanCursor::Decode(scan_cursor_secret_, cursor, scope, pattern, type, start_key)) {
+    return Status::OK();
+  }
+  int64_t number = 0;
+  if (!ScanCursor::ParseNumbered(cursor, &number)) {
+    return Status::NotFound();
+  }
   std::string index_value;
-  Status s = cursors_store_->Lookup(index_key, &index_value);
-  if (!s.ok() || index_value.size() < 3) {
-    return s;
+  Status s = cursors_store_->Lookup(scope + std::to_string(number), &index_value);
+  if (!s.ok() || index_value.size() < 1) {
+    return Status::NotFound();
   }
   *type = index_value[0];
   *start_key = index_value.substr(1);
   return s;
 }
 
-Status Storage::StoreCursorStartKey(const DataType& dtype, int64_t cursor, char type, const std::string& next_key) {
-  std::string index_key = DataTypeTag[static_cast<uint8_t>(dtype)] + std::to_string(cursor);
-  // format: data_type tag(1B) | start_key
+std::string Storage::StoreCursorStartKey(const DataType& dtype, const std::string& pattern, int64_t cursor,
+                                         bool stateless, char type, const std::string& next_key) {
+  std::string scope = DataTypeTag[static_cast<uint8_t>(dtype)] + pattern + "_";
+  if (stateless) {
+    return ScanCursor::Encode(scan_cursor_secret_, type, scope, pattern, next_key);
+  }
+  // format of index value: data_type tag(1B) | start_key
   std::string index_value(1, type);
   index_value.append(next_key);
-  return cursors_store_->Insert(index_key, index_value);
+  cursors_store_->Insert(scope + std::to_string(cursor), index_value);
+  return std::to_string(cursor);
 }
 
 std::unique_ptr<Redis>& Storage::GetDBInstance(const Slice& key) { return GetDBInstance(key.ToString()); }
 
 std::unique_ptr<Redis>& Storage::GetDBInstance(const std::string& key) {
-  auto inst_index = slot_indexer_->GetInstanceID(GetSlotID(key));
+  auto slot_id = GetSlotID(key);
+  if (migrating_.load(std::memory_order_acquire)) [[unlikely]] {
+    TrackMigratingKey(slot_id, key);
+  }
+  auto inst_index = slot_indexer_->GetInstanceID(slot_id);
   return insts_[inst_index];
 }
 
+std::unique_ptr<Redis>& Storage::GetReadDBInstance(const Slice& key) { return GetReadDBInstance(key.ToString()); }
+
+std::unique_ptr<Redis>& Storage::GetReadDBInstance(const std::string& key) {
+  return insts_[slot_indexer_->GetInstanceID(GetSlotID(key))];
+}
+
+std::vector<std::vector<size_t>> Storage::GroupKeysByInstance(const std::vector<std::string>& keys, bool write) {
+  std::vector<std::vector<size_t>> groups(insts_.size());
+  bool migrating = write && migrating_.load(std::memory_order_acquire);
+  for (size_t pos = 0; pos < keys.size(); ++pos) {
+    auto slot_id = GetSlotID(keys[pos]);
+    if (migrating) [[unlikely]] {
+      TrackMigratingKey(slot_id, keys[pos]);
+    }
+    groups[slot_indexer_->GetInstanceID(slot_id)].push_back(pos);
+  }
+  return groups;
+}
+
+Status Storage::ForEachInstanceGroup(const std::vector<std::vector<size_t>>& groups,
+                                     const std::function<Status(size_t, const std::vector<size_t>&)>& func) {
+  std::vector<size_t> indexes;
+  for (size_t index = 0; index < groups.size(); ++index) {
+    if (!groups[index].empty()) {
+      indexes.push_back(index);
+    }
+  }
+  if (indexes.empty()) {
+    return Status::OK();
+  }
+
+  // the last instance runs in the calling thread, so a single instance never leaves it
+  std::vector<std::future<Status>> results;
+  results.reserve(indexes.size() - 1);
+  for (size_t i = 0; i + 1 < indexes.size(); ++i) {
+    results.push_back(multi_key_pool_.ExecuteTask(func, indexes[i], std::cref(groups[indexes[i]])));
+  }
+  Status s = func(indexes.back(), groups[indexes.back()]);
+  for (auto& result : results) {
+    Status inst_s = result.valid() ? result.get() : Status::Aborted("multi key pool is shut down");
+    if (s.ok() && !inst_s.ok()) {
+      s = inst_s;
+    }
+  }
+  return s;
+}
+
+Status Storage::ForEachInstance(const std::function<Status(size_t)>& func) {
+  if (insts_.empty()) {
+    return Status::OK();
+  }
+
+  // the first instance runs in the calling thread
+  std::vector<std::future<Status>> results;
+  results.reserve(insts_.size() - 1);
+  for (size_t index = 1; index < insts_.size(); ++index) {
+    results.push_back(scan_pool_.ExecuteTask(func, index));
+  }
+  Status s = func(0);
+  for (auto& result : results) {
+    Status inst_s = result.valid() ? result.get() : Status::Aborted("scan pool is shut down");
+    if (s.ok() && !inst_s.ok()) {
+      s = inst_s;
+    }
+  }
+  return s;
+}
+
+// Bounds of the encoded meta keys whose user key starts with the literal prefix of
+// pattern, both are left empty when the pattern starts with a wildcard.
+static void PatternKeyBounds(const std::string& pattern, std::string* lower_bound, std::string* upper_bound) {
+  size_t prefix_len = pattern.find_first_of("*?[\\");
+  std::string prefix = pattern.substr(0, prefix_len);
+  if (prefix.empty()) {
+    return;
+  }
+  // drop the key delimiter and reserve2, what is left prefixes the encoding of every matching key
+  BaseMetaKey base_prefix_key(prefix);
+  Slice encoded = base_prefix_key.Encode();
+  lower_bound->assign(encoded.data(), encoded.size() - kEncodedKeyDelimSize - kSuffixReserveLength);
+  *upper_bound = *lower_bound;
+  while (!upper_bound->empty() && static_cast<uint8_t>(upper_bound->back()) == 0xff) {
+    upper_bound->pop_back();
+  }
+  if (!upper_bound->empty()) {
+    upper_bound->back() = static_cast<char>(static_cast<uint8_t>(upper_bound->back()) + 1);
+  }
+}
+
+Status Storage::CollectKeys(char type, const std::string& pattern, const std::string& start_key, size_t limit,
+                            std::vector<std::string>* keys) {
+  std::string lower_bound;
+  std::string upper_bound;
+  PatternKeyBounds(pattern, &lower_bound, &upper_bound);
+  BaseMetaKey base_start_key(start_key);
+  std::string seek_key = base_start_key.Encode().ToString();
+  if (seek_key < lower_bound) {
+    seek_key = lower_bound;
+  }
+
+  // the keys being migrated are found in two instances, only their owner reports them
+  bool check_owner = migrating_.load(std::memory_order_acquire);
+  std::vector<std::vector<std::string>> inst_keys(insts_.size());
+  Status s = ForEachInstance([&](size_t index) {
+    Slice lower_slice(lower_bound);
+    Slice upper_slice(upper_bound);
+    std::unique_ptr<TypeIterator> iter(insts_[index]->CreateIterator(
+        type, pattern, lower_bound.empty() ? nullptr : &lower_slice, upper_bound.empty() ? nullptr : &upper_slice));
+    if (iter == nullptr) {
+      return Status::InvalidArgument("invalid data type");
+    }
+    auto& collected = inst_keys[index];
+    for (iter->Seek(seek_key); iter->Valid() && collected.size() < limit; iter->Next()) {
+      if (!check_owner || IsOwnedBy(iter->Key(), index)) {
+        collected.push_back(iter->Key());
+      }
+    }
+    return iter->status();
+  });
+  if (!s.ok()) {
+    return s;
+  }
+
+  // k-way merge of the sorted per-instance results
+  using Cursor = std::pair<size_t, size_t>;  // (instance index, position)
+  auto greater = [&inst_keys](const Cursor& a, const Cursor& b) {
+    return inst_keys[a.first][a.second] > inst_keys[b.first][b.second];
+  };
+  std::priority_queue<Cursor, std::vector<Cursor>, decltype(greater)> heap(greater);
+  size_t total = 0;
+  for (size_t index = 0; index < inst_keys.size(); ++index) {
+    total += inst_keys[index].size();
+    if (!inst_keys[index].empty()) {
+      heap.emplace(index, 0);
+    }
+  }
+  keys->reserve(keys->size() + std::min(total, limit));
+  for (size_t num = 0; !heap.empty() && num < limit; ++num) {
+    auto [index, pos] = heap.top();
+    heap.pop();
+    keys->push_back(std::move(inst_keys[index][pos]));
+    if (pos + 1 < inst_keys[index].size()) {
+      heap.emplace(index, pos + 1);
+    }
+  }
+  return Status::OK();
+}
+
 // Strings Commands
 Status Storage::Set(const Slice& key, const Slice& value) {
   auto& inst = GetDBInstance(key);
@@ -314,12 +739,12 @@ Status Storage::Setxx(const Slice& key, const Slice& value, int32_t* ret, int64_
 }
 
 Status Storage::Get(const Slice& key, std::string* value) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->Get(key, value);
 }
 
 Status Storage::GetWithTTL(const Slice& key, std::string* value, int64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->GetWithTTL(key, value, ttl);
 }
 
@@ -334,59 +759,65 @@ Status Storage::SetBit(const Slice& key, int64_t offset, int32_t value, int32_t*
 }
 
 Status Storage::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->GetBit(key, offset, ret);
 }
 
-Status Storage::MSet(const std::vector<KeyValue>& kvs) {
-  Status s;
+// keys[i] is the key of kvs[i]
+static std::vector<std::string> KeysOf(const std::vector<KeyValue>& kvs) {
+  std::vector<std::string> keys;
+  keys.reserve(kvs.size());
   for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
-    s = inst->Set(Slice(kv.key), Slice(kv.value));
-    if (!s.ok()) {
-      return s;
-    }
+    keys.push_back(kv.key);
   }
-  return s;
+  return keys;
 }
 
-Status Storage::MGet(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss) {
-  vss->clear();
-  Status s;
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    std::string value;
-    s = inst->Get(key, &value);
-    if (s.ok()) {
-      vss->push_back({value, Status::OK()});
-    } else if (s.IsNotFound() || s.IsInvalidArgument()) {
-      vss->push_back({std::string(), Status::NotFound()});
-    } else {
-      vss->clear();
-      return s;
+Status Storage::MSet(const std::vector<KeyValue>& kvs) {
+  auto groups = GroupKeysByInstance(KeysOf(kvs));
+  return ForEachInstanceGroup(groups, [&](size_t index, const std::vector<size_t>& positions) {
+    std::vector<KeyValue> inst_kvs;
+    inst_kvs.reserve(positions.size());
+    for (auto pos : positions) {
+      inst_kvs.push_back(kvs[pos]);
     }
-  }
-  return Status::OK();
+    return insts_[index]->MSet(inst_kvs);
+  });
+}
+
+Status Storage::MGet(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss) {
+  return MGetInternal(keys, vss, false);
 }
 
 Status Storage::MGetWithTTL(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss) {
+  return MGetInternal(keys, vss, true);
+}
+
+Status Storage::MGetInternal(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss, bool with_ttl) {
   vss->clear();
-  Status s;
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    std::string value;
-    int64_t ttl;
-    s = inst->GetWithTTL(key, &value, &ttl);
-    if (s.ok()) {
-      vss->push_back({value, Status::OK(), ttl});
-    } else if (s.IsNotFound() || s.IsInvalidArgument()) {
-      vss->push_back({std::string(), Status::NotFound(), ttl});
-    } else {
-      vss->clear();
+  vss->resize(keys.size());
+  auto groups = GroupKeysByInstance(keys, false);
+  Status s = ForEachInstanceGroup(groups, [&](size_t index, const std::vector<size_t>& positions) {
+    std::vector<Slice> inst_keys;
+    inst_keys.reserve(positions.size());
+    for (auto pos : positions) {
+      inst_keys.emplace_back(keys[pos]);
+    }
+    std::vector<ValueStatus> inst_vss;
+    Status s = with_ttl ? insts_[index]->MGetWithTTL(inst_keys, &inst_vss) : insts_[index]->MGet(inst_keys, &inst_vss);
+    if (!s.ok()) {
       return s;
     }
+    // every instance writes a disjoint set of positions
+    for (size_t i = 0; i < positions.size(); ++i) {
+      (*vss)[positions[i]] = std::move(inst_vss[i]);
+    }
+    return Status::OK();
+  });
+  if (!s.ok()) {
+    vss->clear();
   }
-  return Status::OK();
+  return s;
 }
 
 Status Storage::Setnx(const Slice& key, const Slice& value, int32_t* ret, int64_t ttl) {
@@ -396,24 +827,47 @@ Status Storage::Setnx(const Slice& key, const Slice& value, int32_t* ret, int64_
 
 // TODO: Not concurrent safe now, merge wuxianrong's bugfix after floyd's PR review finishes.
 Status Storage::MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret) {
-  Status s;
-  for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
-    std::string value;
-    s = inst->IsExist(Slice(kv.key));
-    if (!s.IsNotFound()) {
-      *ret = 0;
-      return s;
+  *ret = 0;
+  auto keys = KeysOf(kvs);
+  auto groups = GroupKeysByInstance(keys);
+
+  // hold the record locks of all the keys until every instance is written, the
+  // instances are always locked in index order so two MSETNX can not deadlock
+  std::vector<std::vector<std::string>> inst_keys(groups.size());
+  std::vector<std::unique_ptr<MultiScopeRecordLock>> locks;
+  for (size_t index = 0; index < groups.size(); ++index) {
+    if (groups[index].empty()) {
+      continue;
+    }
+    for (auto pos : groups[index]) {
+      inst_keys[index].push_back(keys[pos]);
     }
+    locks.push_back(std::make_unique<MultiScopeRecordLock>(insts_[index]->GetLockMgr(), inst_keys[index]));
   }
 
-  for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
-    s = inst->Set(Slice(kv.key), Slice(kv.value));
+  for (size_t index = 0; index < groups.size(); ++index) {
+    if (groups[index].empty()) {
+      continue;
+    }
+    std::vector<Slice> key_slices(inst_keys[index].begin(), inst_keys[index].end());
+    int64_t exist_count = 0;
+    Status s = insts_[index]->Exists(key_slices, &exist_count);
     if (!s.ok()) {
       return s;
     }
+    if (exist_count != 0) {
+      return Status::OK();
+    }
   }
+
+  Status s = ForEachInstanceGroup(groups, [&](size_t index, const std::vector<size_t>& positions) {
+    std::vector<KeyValue> inst_kvs;
+    inst_kvs.reserve(positions.size());
+    for (auto pos : positions) {
+      inst_kvs.push_back(kvs[pos]);
+    }
+    return insts_[index]->MSetLocked(inst_kvs);
+  });
   if (s.ok()) {
     *ret = 1;
   }
@@ -436,13 +890,13 @@ Status Storage::Setrange(const Slice& key, int64_t start_offset, const Slice& va
 }
 
 Status Storage::Getrange(const Slice& key, int64_t start_offset, int64_t end_offset, std::string* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->Getrange(key, start_offset, end_offset, ret);
 }
 
 Status Storage::GetrangeWithValue(const Slice& key, int64_t start_offset, int64_t end_offset, std::string* ret,
                                   std::string* value, int64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->GetrangeWithValue(key, start_offset, end_offset, ret, value, ttl);
 }
 
@@ -452,7 +906,7 @@ Status Storage::Append(const Slice& key, const Slice& value, int32_t* ret) {
 }
 
 Status Storage::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret, bool have_range) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->BitCount(key, start_offset, end_offset, ret, have_range);
 }
 
@@ -463,45 +917,66 @@ Status Storage::BitOp(BitOpType op, const std::string& dest_key, const std::vect
     return Status::InvalidArgument();
   }
   Status s;
-  int64_t max_len = 0;
-  int64_t value_len = 0;
-  std::vector<std::string> src_vlaues;
+  uint64_t max_len = 0;
+  std::vector<std::unique_ptr<Redis::BitmapReader>> readers;
   for (const auto& src_key : src_keys) {
-    auto& inst = GetDBInstance(src_key);
-    std::string value;
-    s = inst->Get(Slice(src_key), &value);
-    if (s.ok()) {
-      src_vlaues.push_back(value);
-      value_len = value.size();
-    } else if (s.IsNotFound()) {
-      src_vlaues.push_back("");
-      value_len = 0;
-    } else {
+    auto& inst = GetReadDBInstance(src_key);
+    std::unique_ptr<Redis::BitmapReader> reader;
+    s = inst->NewBitmapReader(Slice(src_key), &reader);
+    if (!s.ok()) {
       return s;
     }
-    max_len = std::max(max_len, value_len);
+    max_len = std::max(max_len, reader->Length());
+    readers.push_back(std::move(reader));
   }
 
-  std::string dest_value = BitOpOperate(op, src_vlaues, max_len);
-  value_to_dest = dest_value;
-  *ret = dest_value.size();
-
+  std::vector<std::string> src_values(readers.size());
   auto& dest_inst = GetDBInstance(dest_key);
-  return dest_inst->Set(Slice(dest_key), Slice(dest_value));
+  if (max_len <= kBitmapFragmentThreshold) {
+    for (size_t i = 0; i < readers.size(); ++i) {
+      s = readers[i]->ReadAll(&src_values[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    std::string dest_value = BitOpOperate(op, src_values, static_cast<int64_t>(max_len));
+    value_to_dest = dest_value;
+    *ret = static_cast<int64_t>(dest_value.size());
+    return dest_inst->Set(Slice(dest_key), Slice(dest_value));
+  }
+
+  // a long result is stored in fragments, computed one fragment at a time
+  auto writer = dest_inst->NewBitmapWriter(dest_key);
+  for (uint64_t index = 0; index * kBitmapFragmentBytes < max_len; ++index) {
+    for (size_t i = 0; i < readers.size(); ++i) {
+      s = readers[i]->ReadFragment(index, &src_values[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    auto fragment_len = std::min<uint64_t>(kBitmapFragmentBytes, max_len - index * kBitmapFragmentBytes);
+    s = writer->Add(index, BitOpOperate(op, src_values, static_cast<int64_t>(fragment_len)));
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  value_to_dest.clear();
+  *ret = static_cast<int64_t>(max_len);
+  return writer->Finish(max_len);
 }
 
 Status Storage::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->BitPos(key, bit, ret);
 }
 
 Status Storage::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->BitPos(key, bit, start_offset, ret);
 }
 
 Status Storage::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_t end_offset, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->BitPos(key, bit, start_offset, end_offset, ret);
 }
 
@@ -526,7 +1001,7 @@ Status Storage::Setex(const Slice& key, const Slice& value, int64_t ttl) {
 }
 
 Status Storage::Strlen(const Slice& key, int32_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->Strlen(key, len);
 }
 
@@ -542,7 +1017,7 @@ Status Storage::HSet(const Slice& key, const Slice& field, const Slice& value, i
 }
 
 Status Storage::HGet(const Slice& key, const Slice& field, std::string* value) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HGet(key, field, value);
 }
 
@@ -552,27 +1027,38 @@ Status Storage::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
 }
 
 Status Storage::HMGet(const Slice& key, const std::vector<std::string>& fields, std::vector<ValueStatus>* vss) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HMGet(key, fields, vss);
 }
 
 Status Storage::HGetall(const Slice& key, std::vector<FieldValue>* fvs) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HGetall(key, fvs);
 }
 
+Status Storage::HGetall(const Slice& key, ElementSink* sink) {
+  std::unique_ptr<ElementReader> reader;
+  Status s = HGetall(key, &reader);
+  return s.ok() ? ReadAllElements(reader.get(), sink) : s;
+}
+
+Status Storage::HGetall(const Slice& key, std::unique_ptr<ElementReader>* reader) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->HGetall(key, reader);
+}
+
 Status Storage::HGetallWithTTL(const Slice& key, std::vector<FieldValue>* fvs, int64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HGetallWithTTL(key, fvs, ttl);
 }
 
 Status Storage::HKeys(const Slice& key, std::vector<std::string>* fields) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HKeys(key, fields);
 }
 
 Status Storage::HVals(const Slice& key, std::vector<std::string>* values) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HVals(key, values);
 }
 
@@ -582,17 +1068,17 @@ Status Storage::HSetnx(const Slice& key, const Slice& field, const Slice& value,
 }
 
 Status Storage::HLen(const Slice& key, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HLen(key, ret);
 }
 
 Status Storage::HStrlen(const Slice& key, const Slice& field, int32_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HStrlen(key, field, len);
 }
 
 Status Storage::HExists(const Slice& key, const Slice& field) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HExists(key, field);
 }
 
@@ -613,32 +1099,41 @@ Status Storage::HDel(const Slice& key, const std::vector<std::string>& fields, i
 
 Status Storage::HScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<FieldValue>* field_values, int64_t* next_cursor) {
-  auto& inst = GetDBInstance(key);
-  return inst->HScan(key, cursor, pattern, count, field_values, next_cursor);
+  auto& inst = GetReadDBInstance(key);
+  std::string next;
+  Status s = inst->HScan(key, std::to_string(cursor), false, pattern, count, field_values, &next);
+  ScanCursor::ParseNumbered(next, next_cursor);
+  return s;
+}
+
+Status Storage::HScan(const Slice& key, const std::string& cursor, const std::string& pattern, int64_t count,
+                      std::vector<FieldValue>* field_values, std::string* next_cursor) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->HScan(key, cursor, stateless_scan_cursors_, pattern, count, field_values, next_cursor);
 }
 
 Status Storage::HScanx(const Slice& key, const std::string& start_field, const std::string& pattern, int64_t count,
                        std::vector<FieldValue>* field_values, std::string* next_field) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HScanx(key, start_field, pattern, count, field_values, next_field);
 }
 
 Status Storage::HRandField(const Slice& key, int64_t count, bool with_values, std::vector<std::string>* res) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->HRandField(key, count, with_values, res);
 }
 
 Status Storage::PKHScanRange(const Slice& key, const Slice& field_start, const std::string& field_end,
                              const Slice& pattern, int32_t limit, std::vector<FieldValue>* field_values,
                              std::string* next_field) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->PKHScanRange(key, field_start, field_end, pattern, limit, field_values, next_field);
 }
 
 Status Storage::PKHRScanRange(const Slice& key, const Slice& field_start, const std::string& field_end,
                               const Slice& pattern, int32_t limit, std::vector<FieldValue>* field_values,
                               std::string* next_field) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->PKHRScanRange(key, field_start, field_end, pattern, limit, field_values, next_field);
 }
 
@@ -649,127 +1144,66 @@ Status Storage::SAdd(const Slice& key, const std::vector<std::string>& members,
 }
 
 Status Storage::SCard(const Slice& key, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->SCard(key, ret);
 }
 
 Status Storage::SDiff(const std::vector<std::string>& keys, std::vector<std::string>* members) {
-  if (keys.empty()) {
-    return rocksdb::Status::Corruption("SDiff invalid parameter, no keys");
-  }
   members->clear();
-
-  Status s;
-  auto& inst = GetDBInstance(keys[0]);
-  std::vector<std::string> keys0_members;
-  s = inst->SMembers(Slice(keys[0]), &keys0_members);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-
-  for (const auto& member : keys0_members) {
-    int32_t exist = 0;
-    for (int idx = 1; idx < keys.size(); idx++) {
-      Slice pkey = Slice(keys[idx]);
-      auto& inst = GetDBInstance(pkey);
-      s = inst->SIsmember(pkey, Slice(member), &exist);
-      if (!s.ok() && !s.IsNotFound()) {
-        return s;
-      }
-      if (exist) break;
-    }
-    if (!exist) {
-      members->push_back(member);
-    }
-  }
-  return Status::OK();
+  return SetsMerge(kMergeDiff, keys, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
 }
 
 Status Storage::SDiffstore(const Slice& destination, const std::vector<std::string>& keys,
                            std::vector<std::string>& value_to_dest, int32_t* ret) {
-  Status s;
-
-  s = SDiff(keys, &value_to_dest);
-  if (!s.ok()) {
-    return s;
-  }
-
-  auto& inst = GetDBInstance(destination);
-  s = inst->Del(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-
-  s = inst->SAdd(destination, value_to_dest, ret);
-  return s;
+  value_to_dest.clear();
+  return SetsMergeStore(kMergeDiff, destination, keys, ret);
 }
 
 Status Storage::SInter(const std::vector<std::string>& keys, std::vector<std::string>* members) {
-  Status s;
   members->clear();
-
-  std::vector<std::string> key0_members;
-  auto& inst = GetDBInstance(keys[0]);
-  s = inst->SMembers(keys[0], &key0_members);
-  if (s.IsNotFound()) {
+  return SetsMerge(kMergeInter, keys, [members](const Slice& member) {
+    members->push_back(member.ToString());
     return Status::OK();
-  }
-  if (!s.ok()) {
-    return s;
-  }
-
-  for (const auto member : key0_members) {
-    int32_t exist = 1;
-    for (int idx = 1; idx < keys.size(); idx++) {
-      Slice pkey(keys[idx]);
-      auto& inst = GetDBInstance(keys[idx]);
-      s = inst->SIsmember(keys[idx], member, &exist);
-      if (s.ok() && exist > 0) {
-        continue;
-      } else if (!s.IsNotFound()) {
-        return s;
-      } else {
-        break;
-      }
-    }
-    if (exist > 0) {
-      members->push_back(member);
-    }
-  }
-  return Status::OK();
+  });
 }
 
 Status Storage::SInterstore(const Slice& destination, const std::vector<std::string>& keys,
                             std::vector<std::string>& value_to_dest, int32_t* ret) {
-  Status s;
-
-  s = SInter(keys, &value_to_dest);
-  if (!s.ok()) {
-    return s;
-  }
-
-  auto& dest_inst = GetDBInstance(destination);
-  s = dest_inst->Del(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-
-  s = dest_inst->SAdd(destination, value_to_dest, ret);
-  return s;
+  value_to_dest.clear();
+  return SetsMergeStore(kMergeInter, destination, keys, ret);
 }
 
 Status Storage::SIsmember(const Slice& key, const Slice& member, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->SIsmember(key, member, ret);
 }
 
+Status Storage::SMIsmember(const Slice& key, const std::vector<std::string>& members, std::vector<int32_t>* rets) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->SMIsmember(key, members, rets);
+}
+
 Status Storage::SMembers(const Slice& key, std::vector<std::string>* members) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->SMembers(key, members);
 }
 
+Status Storage::SMembers(const Slice& key, ElementSink* sink) {
+  std::unique_ptr<ElementReader> reader;
+  Status s = SMembers(key, &reader);
+  return s.ok() ? ReadAllElements(reader.get(), sink) : s;
+}
+
+Status Storage::SMembers(const Slice& key, std::unique_ptr<ElementReader>* reader) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->SMembers(key, reader);
+}
+
 Status Storage::SMembersWithTTL(const Slice& key, std::vector<std::string>* members, int64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->SMembersWithTTL(key, members, ttl);
 }
 
@@ -802,7 +1236,7 @@ Status Storage::SPop(const Slice& key, std::vector<std::string>* members, int64_
 }
 
 Status Storage::SRandmember(const Slice& key, int32_t count, std::vector<std::string>* members) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->SRandmember(key, count, members);
 }
 
@@ -812,53 +1246,192 @@ Status Storage::SRem(const Slice& key, const std::vector<std::string>& members,
 }
 
 Status Storage::SUnion(const std::vector<std::string>& keys, std::vector<std::string>* members) {
-  Status s;
   members->clear();
+  return SetsMerge(kMergeUnion, keys, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
+}
 
-  using Iter = std::vector<std::string>::iterator;
-  using Uset = std::unordered_set<std::string>;
-  Uset member_set;
-  for (const auto& key : keys) {
-    std::vector<std::string> vec;
-    auto& inst = GetDBInstance(key);
-    s = inst->SMembers(key, &vec);
-    if (s.IsNotFound()) {
-      continue;
+Status Storage::SUnionstore(const Slice& destination, const std::vector<std::string>& keys,
+                            std::vector<std::string>& value_to_dest, int32_t* ret) {
+  value_to_dest.clear();
+  return SetsMergeStore(kMergeUnion, destination, keys, ret);
+}
+
+using MemberIterators = std::vector<std::unique_ptr<MemberIterator>>;
+
+static Status MemberIteratorsStatus(const MemberIterators& iters) {
+  for (const auto& iter : iters) {
+    if (iter && !iter->status().ok()) {
+      return iter->status();
     }
+  }
+  return Status::OK();
+}
+
+// Leapfrog join starting from the smallest key: the other keys seek to the current
+// candidate, and whichever of them lands past it moves the candidate forward.
+// on_match is called while every iterator points at the matched member.
+static Status InterMerge(MemberIterators& iters, const std::function<Status(const Slice&)>& on_match) {
+  std::vector<size_t> order(iters.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&iters](size_t a, size_t b) { return iters[a]->Count() < iters[b]->Count(); });
+  auto& leader = iters[order[0]];
+  std::string candidate;
+  while (leader->Valid()) {
+    candidate.assign(leader->member().data(), leader->member().size());
+    bool matched = true;
+    for (size_t pos = 1; pos < order.size(); ++pos) {
+      auto& iter = iters[order[pos]];
+      iter->SeekAtLeast(candidate);
+      if (!iter->Valid()) {
+        return MemberIteratorsStatus(iters);
+      }
+      if (iter->member() != Slice(candidate)) {
+        leader->SeekAtLeast(iter->member());
+        matched = false;
+        break;
+      }
+    }
+    if (matched) {
+      Status s = on_match(candidate);
+      if (!s.ok()) {
+        return s;
+      }
+      leader->Next();
+    }
+  }
+  return MemberIteratorsStatus(iters);
+}
+
+// K-way merge of the keys, on_member is called once per distinct member with the
+// positions, in ascending order, of the iterators pointing at it
+static Status UnionMerge(MemberIterators& iters,
+                         const std::function<Status(const Slice&, const std::vector<size_t>&)>& on_member) {
+  auto greater = [&iters](size_t a, size_t b) {
+    int cmp = iters[a]->member().compare(iters[b]->member());
+    return cmp != 0 ? cmp > 0 : a > b;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t idx = 0; idx < iters.size(); ++idx) {
+    if (iters[idx] && iters[idx]->Valid()) {
+      heap.push(idx);
+    }
+  }
+  std::string member;
+  std::vector<size_t> holders;
+  while (!heap.empty()) {
+    holders.clear();
+    holders.push_back(heap.top());
+    heap.pop();
+    member.assign(iters[holders[0]]->member().data(), iters[holders[0]]->member().size());
+    while (!heap.empty() && iters[heap.top()]->member() == Slice(member)) {
+      holders.push_back(heap.top());
+      heap.pop();
+    }
+    Status s = on_member(member, holders);
     if (!s.ok()) {
       return s;
     }
-    std::copy(std::move_iterator<Iter>(vec.begin()), std::move_iterator<Iter>(vec.end()),
-              std::insert_iterator<Uset>(member_set, member_set.begin()));
+    for (size_t idx : holders) {
+      iters[idx]->Next();
+      if (iters[idx]->Valid()) {
+        heap.push(idx);
+      }
+    }
   }
+  return MemberIteratorsStatus(iters);
+}
 
-  std::copy(member_set.begin(), member_set.end(), std::back_inserter(*members));
-  return Status::OK();
+static Status DiffMerge(MemberIterators& iters, const std::function<Status(const Slice&)>& emit) {
+  auto& first = iters[0];
+  for (; first->Valid(); first->Next()) {
+    Slice member = first->member();
+    bool found = false;
+    for (size_t idx = 1; idx < iters.size() && !found; ++idx) {
+      if (iters[idx]) {
+        iters[idx]->SeekAtLeast(member);
+        found = iters[idx]->Valid() && iters[idx]->member() == member;
+      }
+    }
+    if (!found) {
+      Status s = emit(member);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  return MemberIteratorsStatus(iters);
 }
 
-Status Storage::SUnionstore(const Slice& destination, const std::vector<std::string>& keys,
-                            std::vector<std::string>& value_to_dest, int32_t* ret) {
-  Status s;
-  value_to_dest.clear();
+Status Storage::OpenMemberIterators(DataType type, const std::vector<std::string>& keys, MemberIterators* iters) {
+  if (keys.empty()) {
+    return Status::Corruption("invalid parameter, no keys");
+  }
+  iters->resize(keys.size());
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    auto& inst = GetReadDBInstance(keys[idx]);
+    Status s = inst->NewMemberIterator(type, keys[idx], &(*iters)[idx]);
+    if (!s.ok() && !s.IsNotFound()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
 
-  s = SUnion(keys, &value_to_dest);
+Status Storage::SetsMerge(MergeOperation op, const std::vector<std::string>& keys,
+                          const std::function<Status(const Slice&)>& emit) {
+  MemberIterators iters;
+  Status s = OpenMemberIterators(DataType::kSets, keys, &iters);
   if (!s.ok()) {
     return s;
   }
-  *ret = value_to_dest.size();
-  auto& dest_inst = GetDBInstance(destination);
-  s = dest_inst->Del(destination);
-  if (!s.ok() && !s.IsNotFound()) {
+
+  switch (op) {
+    case kMergeInter:
+      if (std::any_of(iters.begin(), iters.end(), [](const auto& iter) { return iter == nullptr; })) {
+        return Status::OK();
+      }
+      return InterMerge(iters, emit);
+    case kMergeUnion:
+      return UnionMerge(iters, [&emit](const Slice& member, const std::vector<size_t>&) { return emit(member); });
+    case kMergeDiff:
+      if (!iters[0]) {
+        return Status::OK();
+      }
+      return DiffMerge(iters, emit);
+  }
+  return Status::OK();
+}
+
+Status Storage::SetsMergeStore(MergeOperation op, const Slice& destination, const std::vector<std::string>& keys,
+                               int32_t* ret) {
+  *ret = 0;
+  auto& inst = GetDBInstance(destination);
+  // the source iterators hold snapshots taken before the first write to destination,
+  // so destination may be one of the keys
+  auto writer = inst->NewMembersStoreWriter(DataType::kSets, destination);
+  Status s = SetsMerge(op, keys, [&writer](const Slice& member) { return writer->Add(member); });
+  if (!s.ok()) {
     return s;
   }
-  int unused_ret;
-  return dest_inst->SAdd(destination, value_to_dest, &unused_ret);
+  return writer->Finish(ret);
 }
 
 Status Storage::SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<std::string>* members, int64_t* next_cursor) {
-  auto& inst = GetDBInstance(key);
-  return inst->SScan(key, cursor, pattern, count, members, next_cursor);
+  auto& inst = GetReadDBInstance(key);
+  std::string next;
+  Status s = inst->SScan(key, std::to_string(cursor), false, pattern, count, members, &next);
+  ScanCursor::ParseNumbered(next, next_cursor);
+  return s;
+}
+
+Status Storage::SScan(const Slice& key, const std::string& cursor, const std::string& pattern, int64_t count,
+                      std::vector<std::string>* members, std::string* next_cursor) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->SScan(key, cursor, stateless_scan_cursors_, pattern, count, members, next_cursor);
 }
 
 Status Storage::LPush(const Slice& key, const std::vector<std::string>& values, uint64_t* ret) {
@@ -873,13 +1446,24 @@ Status Storage::RPush(const Slice& key, const std::vector<std::string>& values,
 
 Status Storage::LRange(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret) {
   ret->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->LRange(key, start, stop, ret);
 }
 
+Status Storage::LRange(const Slice& key, int64_t start, int64_t stop, ElementSink* sink) {
+  std::unique_ptr<ElementReader> reader;
+  Status s = LRange(key, start, stop, &reader);
+  return s.ok() ? ReadAllElements(reader.get(), sink) : s;
+}
+
+Status Storage::LRange(const Slice& key, int64_t start, int64_t stop, std::unique_ptr<ElementReader>* reader) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->LRange(key, start, stop, reader);
+}
+
 Status Storage::LRangeWithTTL(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret,
                               int64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->LRangeWithTTL(key, start, stop, ret, ttl);
 }
 
@@ -889,7 +1473,7 @@ Status Storage::LTrim(const Slice& key, int64_t start, int64_t stop) {
 }
 
 Status Storage::LLen(const Slice& key, uint64_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->LLen(key, len);
 }
 
@@ -907,7 +1491,7 @@ Status Storage::RPop(const Slice& key, int64_t count, std::vector<std::string>*
 
 Status Storage::LIndex(const Slice& key, int64_t index, std::string* element) {
   element->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->LIndex(key, index, element);
 }
 
@@ -983,12 +1567,12 @@ Status Storage::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_mem
 }
 
 Status Storage::ZCard(const Slice& key, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZCard(key, ret);
 }
 
 Status Storage::ZCount(const Slice& key, double min, double max, bool left_close, bool right_close, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZCount(key, min, max, left_close, right_close, ret);
 }
 
@@ -999,13 +1583,25 @@ Status Storage::ZIncrby(const Slice& key, const Slice& member, double increment,
 
 Status Storage::ZRange(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRange(key, start, stop, score_members);
 }
+
+Status Storage::ZRange(const Slice& key, int32_t start, int32_t stop, bool with_scores, ElementSink* sink) {
+  std::unique_ptr<ElementReader> reader;
+  Status s = ZRange(key, start, stop, with_scores, &reader);
+  return s.ok() ? ReadAllElements(reader.get(), sink) : s;
+}
+
+Status Storage::ZRange(const Slice& key, int32_t start, int32_t stop, bool with_scores,
+                       std::unique_ptr<ElementReader>* reader) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->ZRange(key, start, stop, with_scores, reader);
+}
 Status Storage::ZRangeWithTTL(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members,
                               int64_t* ttl) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRangeWithTTL(key, start, stop, score_members, ttl);
 }
 
@@ -1013,7 +1609,7 @@ Status Storage::ZRangebyscore(const Slice& key, double min, double max, bool lef
                               std::vector<ScoreMember>* score_members) {
   // maximum number of zset is std::numeric_limits<int32_t>::max()
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRangebyscore(key, min, max, left_close, right_close, std::numeric_limits<int32_t>::max(), 0,
                              score_members);
 }
@@ -1021,12 +1617,12 @@ Status Storage::ZRangebyscore(const Slice& key, double min, double max, bool lef
 Status Storage::ZRangebyscore(const Slice& key, double min, double max, bool left_close, bool right_close,
                               int64_t count, int64_t offset, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRangebyscore(key, min, max, left_close, right_close, count, offset, score_members);
 }
 
 Status Storage::ZRank(const Slice& key, const Slice& member, int32_t* rank) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRank(key, member, rank);
 }
 
@@ -1049,13 +1645,13 @@ Status Storage::ZRemrangebyscore(const Slice& key, double min, double max, bool
 Status Storage::ZRevrangebyscore(const Slice& key, double min, double max, bool left_close, bool right_close,
                                  int64_t count, int64_t offset, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRevrangebyscore(key, min, max, left_close, right_close, count, offset, score_members);
 }
 
 Status Storage::ZRevrange(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRevrange(key, start, stop, score_members);
 }
 
@@ -1063,143 +1659,120 @@ Status Storage::ZRevrangebyscore(const Slice& key, double min, double max, bool
                                  std::vector<ScoreMember>* score_members) {
   // maximum number of zset is std::numeric_limits<int32_t>::max()
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRevrangebyscore(key, min, max, left_close, right_close, std::numeric_limits<int32_t>::max(), 0,
                                 score_members);
 }
 
 Status Storage::ZRevrank(const Slice& key, const Slice& member, int32_t* rank) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRevrank(key, member, rank);
 }
 
 Status Storage::ZScore(const Slice& key, const Slice& member, double* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZScore(key, member, ret);
 }
 
+Status Storage::ZMScore(const Slice& key, const std::vector<std::string>& members, std::vector<ScoreStatus>* sss) {
+  auto& inst = GetReadDBInstance(key);
+  return inst->ZMScore(key, members, sss);
+}
+
 Status Storage::ZUnionstore(const Slice& destination, const std::vector<std::string>& keys,
                             const std::vector<double>& weights, const AGGREGATE agg,
                             std::map<std::string, double>& value_to_dest, int32_t* ret) {
   value_to_dest.clear();
-  Status s;
-
-  for (int idx = 0; idx < keys.size(); idx++) {
-    Slice key = Slice(keys[idx]);
-    auto& inst = GetDBInstance(key);
-    std::map<std::string, double> member_to_score;
-    double weight = idx >= weights.size() ? 1 : weights[idx];
-    s = inst->ZGetAll(key, weight, &member_to_score);
-    if (!s.ok() && !s.IsNotFound()) {
-      return s;
-    }
-    for (const auto& key_score : member_to_score) {
-      const std::string& member = key_score.first;
-      double score = key_score.second;
-      if (value_to_dest.find(member) == value_to_dest.end()) {
-        value_to_dest[member] = score;
-        continue;
-      }
-      switch (agg) {
-        case SUM:
-          score += value_to_dest[member];
-          break;
-        case MIN:
-          score = std::min(value_to_dest[member], score);
-          break;
-        case MAX:
-          score = std::max(value_to_dest[member], score);
-          break;
-      }
-      value_to_dest[member] = (score == -0.0) ? 0 : score;
-    }
-  }
-
-  BaseMetaKey base_destination(destination);
-  auto& inst = GetDBInstance(destination);
-  s = inst->Del(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-  std::vector<ScoreMember> score_members;
-  std::for_each(value_to_dest.begin(), value_to_dest.end(),
-                [&score_members](auto kv) { score_members.emplace_back(kv.second, kv.first); });
-  *ret = score_members.size();
-  int unused_ret;
-  return inst->ZAdd(destination, score_members, &unused_ret);
+  return ZSetsMergeStore(kMergeUnion, destination, keys, weights, agg, ret);
 }
 
 Status Storage::ZInterstore(const Slice& destination, const std::vector<std::string>& keys,
                             const std::vector<double>& weights, const AGGREGATE agg,
                             std::vector<ScoreMember>& value_to_dest, int32_t* ret) {
-  Status s;
   value_to_dest.clear();
+  return ZSetsMergeStore(kMergeInter, destination, keys, weights, agg, ret);
+}
 
-  Slice key = Slice(keys[0]);
-  auto& inst = GetDBInstance(key);
-  std::map<std::string, double> member_to_score;
-  double weight = weights.empty() ? 1 : weights[0];
-  s = inst->ZGetAll(key, weight, &member_to_score);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
+// Score of the member the iterator points at, multiplied by weight
+static double ZSetsWeightedScore(const MemberIterator& iter, double weight) {
+  ParsedBaseDataValue parsed_value(iter.value());
+  uint64_t tmp = DecodeFixed64(parsed_value.UserValue().data());
+  const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
+  double score = *reinterpret_cast<const double*>(ptr_tmp) * weight;
+  return (score == -0.0) ? 0 : score;
+}
+
+static double ZSetsAggregate(AGGREGATE agg, double acc, double score) {
+  switch (agg) {
+    case SUM:
+      return acc + score;
+    case MIN:
+      return std::min(acc, score);
+    case MAX:
+      return std::max(acc, score);
   }
+  return acc;
+}
 
-  for (const auto member_score : member_to_score) {
-    std::string member = member_score.first;
-    double score = member_score.second;
-    bool reliable = true;
+Status Storage::ZSetsMerge(MergeOperation op, const std::vector<std::string>& keys, const std::vector<double>& weights,
+                           AGGREGATE agg, const std::function<Status(const Slice&, double)>& emit) {
+  MemberIterators iters;
+  Status s = OpenMemberIterators(DataType::kZSets, keys, &iters);
+  if (!s.ok()) {
+    return s;
+  }
+  auto weight = [&weights](size_t idx) { return idx < weights.size() ? weights[idx] : 1; };
 
-    for (int idx = 1; idx < keys.size(); idx++) {
-      double weight = idx >= weights.size() ? 1 : weights[idx];
-      auto& inst = GetDBInstance(keys[idx]);
-      double ret_score;
-      s = inst->ZScore(keys[idx], member, &ret_score);
-      if (!s.ok() && !s.IsNotFound()) {
-        return s;
-      }
-      if (s.IsNotFound()) {
-        reliable = false;
-        break;
-      }
-      switch (agg) {
-        case SUM:
-          score += ret_score * weight;
-          break;
-        case MIN:
-          score = std::min(score, ret_score * weight);
-          break;
-        case MAX:
-          score = std::max(score, ret_score * weight);
-          break;
+  // the scores of a member are aggregated in the order of the keys
+  switch (op) {
+    case kMergeInter:
+      if (std::any_of(iters.begin(), iters.end(), [](const auto& iter) { return iter == nullptr; })) {
+        return Status::OK();
       }
-    }
-    if (reliable) {
-      value_to_dest.emplace_back(score, member);
-    }
+      return InterMerge(iters, [&](const Slice& member) {
+        double score = ZSetsWeightedScore(*iters[0], weight(0));
+        for (size_t idx = 1; idx < iters.size(); ++idx) {
+          score = ZSetsAggregate(agg, score, ZSetsWeightedScore(*iters[idx], weight(idx)));
+        }
+        return emit(member, (score == -0.0) ? 0 : score);
+      });
+    case kMergeUnion:
+      return UnionMerge(iters, [&](const Slice& member, const std::vector<size_t>& holders) {
+        double score = ZSetsWeightedScore(*iters[holders[0]], weight(holders[0]));
+        for (size_t pos = 1; pos < holders.size(); ++pos) {
+          score = ZSetsAggregate(agg, score, ZSetsWeightedScore(*iters[holders[pos]], weight(holders[pos])));
+        }
+        return emit(member, (score == -0.0) ? 0 : score);
+      });
+    default:
+      return Status::NotSupported("zsets merge operation");
   }
+}
 
-  BaseMetaKey base_destination(destination);
-  auto& dinst = GetDBInstance(destination);
-
-  s = dinst->Del(destination);
-  if (!s.ok() && !s.IsNotFound()) {
+Status Storage::ZSetsMergeStore(MergeOperation op, const Slice& destination, const std::vector<std::string>& keys,
+                                const std::vector<double>& weights, AGGREGATE agg, int32_t* ret) {
+  *ret = 0;
+  auto& inst = GetDBInstance(destination);
+  // as in SetsMergeStore, destination may be one of the keys
+  auto writer = inst->NewMembersStoreWriter(DataType::kZSets, destination);
+  Status s = ZSetsMerge(op, keys, weights, agg,
+                        [&writer](const Slice& member, double score) { return writer->Add(member, score); });
+  if (!s.ok()) {
     return s;
   }
-  *ret = value_to_dest.size();
-  int unused_ret;
-  return dinst->ZAdd(destination, value_to_dest, &unused_ret);
+  return writer->Finish(ret);
 }
 
 Status Storage::ZRangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                             std::vector<std::string>* members) {
   members->clear();
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZRangebylex(key, min, max, left_close, right_close, members);
 }
 
 Status Storage::ZLexcount(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                           int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->ZLexcount(key, min, max, left_close, right_close, ret);
 }
 
@@ -1212,8 +1785,18 @@ Status Storage::ZRemrangebylex(const Slice& key, const Slice& min, const Slice&
 Status Storage::ZScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<ScoreMember>* score_members, int64_t* next_cursor) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
-  return inst->ZScan(key, cursor, pattern, count, score_members, next_cursor);
+  auto& inst = GetReadDBInstance(key);
+  std::string next;
+  Status s = inst->ZScan(key, std::to_string(cursor), false, pattern, count, score_members, &next);
+  ScanCursor::ParseNumbered(next, next_cursor);
+  return s;
+}
+
+Status Storage::ZScan(const Slice& key, const std::string& cursor, const std::string& pattern, int64_t count,
+                      std::vector<ScoreMember>* score_members, std::string* next_cursor) {
+  score_members->clear();
+  auto& inst = GetReadDBInstance(key);
+  return inst->ZScan(key, cursor, stateless_scan_cursors_, pattern, count, score_members, next_cursor);
 }
 
 // Keys Commands
@@ -1230,61 +1813,78 @@ int32_t Storage::Expire(const Slice& key, int64_t ttl) {
 }
 
 int64_t Storage::Del(const std::vector<std::string>& keys) {
-  Status s;
-  int64_t count = 0;
-
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    s = inst->Del(key);
-    if (s.ok()) {
-      ++count;
+  std::atomic<int64_t> count = 0;
+  auto groups = GroupKeysByInstance(keys);
+  ForEachInstanceGroup(groups, [&](size_t index, const std::vector<size_t>& positions) {
+    std::vector<std::string> inst_keys;
+    inst_keys.reserve(positions.size());
+    for (auto pos : positions) {
+      inst_keys.push_back(keys[pos]);
     }
-  }
-  return count;
+    int64_t inst_count = 0;
+    Status s = insts_[index]->Del(inst_keys, &inst_count);
+    count += inst_count;
+    return s;
+  });
+  return count.load();
 }
 
 int64_t Storage::Exists(const std::vector<std::string>& keys) {
-  int64_t count = 0;
-  Status s;
-
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    s = inst->Exists(key);
-    if (s.ok()) {
-      ++count;
-    } else if (!s.IsNotFound()) {
-      return -1;
+  std::atomic<int64_t> count = 0;
+  auto groups = GroupKeysByInstance(keys, false);
+  Status s = ForEachInstanceGroup(groups, [&](size_t index, const std::vector<size_t>& positions) {
+    std::vector<Slice> inst_keys;
+    inst_keys.reserve(positions.size());
+    for (auto pos : positions) {
+      inst_keys.emplace_back(keys[pos]);
     }
-  }
-  return count;
+    int64_t inst_count = 0;
+    Status s = insts_[index]->Exists(inst_keys, &inst_count);
+    count += inst_count;
+    return s;
+  });
+  return s.ok() ? count.load() : -1;
 }
 
 int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<std::string>* keys) {
+  int64_t cursor_ret = 0;
+  ScanCursor::ParseNumbered(ScanKeys(dtype, std::to_string(cursor), false, pattern, count, keys), &cursor_ret);
+  return cursor_ret;
+}
+
+std::string Storage::Scan(const DataType& dtype, const std::string& cursor, const std::string& pattern,
+                          int64_t count, std::vector<std::string>* keys) {
+  return ScanKeys(dtype, cursor, stateless_scan_cursors_, pattern, count, keys);
+}
+
+std::string Storage::ScanKeys(const DataType& dtype, const std::string& cursor, bool stateless,
+                              const std::string& pattern, int64_t count, std::vector<std::string>* keys) {
   keys->clear();
   bool is_finish;
   int64_t leftover_visits = count;
   int64_t step_length = count;
-  int64_t cursor_ret = 0;
+  std::string cursor_ret = "0";
   std::string start_key;
   std::string next_key;
   std::string prefix;
   char key_type;
 
   // invalid cursor
-  if (cursor < 0) {
+  int64_t number = 0;
+  if (ScanCursor::ParseNumbered(cursor, &number) && number < 0) {
     return cursor_ret;
   }
 
   // get seek by corsor
   prefix = isTailWildcard(pattern) ? pattern.substr(0, pattern.size() - 1) : "";
-  Status s = LoadCursorStartKey(dtype, cursor, &key_type, &start_key);
+  Status s = LoadCursorStartKey(dtype, pattern, cursor, &key_type, &start_key);
   if (!s.ok()) {
     // If want to scan all the databases, we start with the strings database
     key_type = dtype == DataType::kAll ? DataTypeTag[static_cast<uint8_t>(DataType::kStrings)]
                                        : DataTypeTag[static_cast<uint8_t>(dtype)];
     start_key = prefix;
-    cursor = 0;
+    number = 0;
   }
 
   // collect types to scan
@@ -1294,7 +1894,7 @@ int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string&
     auto pos = std::find(std::begin(DataTypeTag), iter_end, key_type);
     if (pos == iter_end) {
       WARN("Invalid key_type: ", key_type);
-      return 0;
+      return cursor_ret;
     }
     std::copy(pos, iter_end - 2, std::back_inserter(types));
   } else {
@@ -1302,25 +1902,23 @@ int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string&
   }
 
   for (const auto& type : types) {
-    std::vector<IterSptr> inst_iters;
-    for (const auto& inst : insts_) {
-      IterSptr iter_sptr;
-      iter_sptr.reset(inst->CreateIterator(type, pattern, nullptr /*lower_bound*/, nullptr /*upper_bound*/));
-      inst_iters.push_back(iter_sptr);
+    // one key more than needed tells whether the scan has to go on
+    std::vector<std::string> type_keys;
+    s = CollectKeys(type, pattern, start_key, count + 1, &type_keys);
+    if (!s.ok()) {
+      WARN("scan keys failed: {}", s.ToString());
+      return cursor_ret;
     }
-
-    BaseMetaKey base_start_key(start_key);
-    MergingIterator miter(inst_iters);
-    miter.Seek(base_start_key.Encode().ToString());
-    while (miter.Valid() && count > 0) {
-      keys->push_back(miter.Key());
-      miter.Next();
+    auto key_iter = type_keys.begin();
+    while (key_iter != type_keys.end() && count > 0) {
+      keys->push_back(std::move(*key_iter));
+      ++key_iter;
       count--;
     }
 
-    bool is_finish = !miter.Valid();
-    if (miter.Valid() && (miter.Key().compare(prefix) <= 0 || miter.Key().substr(0, prefix.size()) == prefix)) {
-      is_finish = false;
+    bool is_finish = key_iter == type_keys.end();
+    if (!is_finish && !(key_iter->compare(prefix) <= 0 || key_iter->substr(0, prefix.size()) == prefix)) {
+      is_finish = true;
     }
 
     // for specific type scan, reach the end
@@ -1331,9 +1929,8 @@ int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string&
     // already get count's element, while iterator is still valid,
     // store cursor
     if (!is_finish) {
-      next_key = miter.Key();
-      cursor_ret = cursor + step_length;
-      StoreCursorStartKey(dtype, cursor_ret, type, next_key);
+      next_key = *key_iter;
+      cursor_ret = StoreCursorStartKey(dtype, pattern, number + step_length, stateless, type, next_key);
       return cursor_ret;
     }
 
@@ -1376,9 +1973,30 @@ Status Storage::PKScanRange(const DataType& data_type, const Slice& key_start, c
     miter.Seek(temp);
   }
 
+  // the keys being migrated are met in two instances
+  bool migrating = migrating_.load(std::memory_order_acquire);
+  std::string last_key;
   while (miter.Valid() && limit > 0 && (end_no_limit || miter.Key().compare(key_end.ToString()) <= 0)) {
+    if (migrating) {
+      if (miter.Key() == last_key) {
+        miter.Next();
+        continue;
+      }
+      last_key = miter.Key();
+    }
     if (data_type == DataType::kStrings) {
-      kvs->push_back({miter.Key(), miter.Value()});
+      std::string value = miter.Value();
+      if (miter.IsBitmapFragments()) {
+        // a bitmap in fragments is read whole, one removed or replaced since is skipped
+        Status s = GetReadDBInstance(miter.Key())->Get(miter.Key(), &value);
+        if (s.IsNotFound() || s.IsInvalidArgument()) {
+          miter.Next();
+          continue;
+        } else if (!s.ok()) {
+          return s;
+        }
+      }
+      kvs->push_back({miter.Key(), std::move(value)});
     } else {
       keys->push_back(miter.Key());
     }
@@ -1422,9 +2040,29 @@ Status Storage::PKRScanRange(const DataType& data_type, const Slice& key_start,
     miter.SeekForPrev(base_key_start.Encode().ToString());
   }
 
+  bool migrating = migrating_.load(std::memory_order_acquire);
+  std::string last_key;
   while (miter.Valid() && limit > 0 && (end_no_limit || miter.Key().compare(key_end.ToString()) >= 0)) {
+    if (migrating) {
+      if (miter.Key() == last_key) {
+        miter.Prev();
+        continue;
+      }
+      last_key = miter.Key();
+    }
     if (data_type == DataType::kStrings) {
-      kvs->push_back({miter.Key(), miter.Value()});
+      std::string value = miter.Value();
+      if (miter.IsBitmapFragments()) {
+        // a bitmap in fragments is read whole, one removed or replaced since is skipped
+        Status s = GetReadDBInstance(miter.Key())->Get(miter.Key(), &value);
+        if (s.IsNotFound() || s.IsInvalidArgument()) {
+          miter.Prev();
+          continue;
+        } else if (!s.ok()) {
+          return s;
+        }
+      }
+      kvs->push_back({miter.Key(), std::move(value)});
     } else {
       keys->push_back(miter.Key());
     }
@@ -1439,13 +2077,17 @@ Status Storage::PKRScanRange(const DataType& data_type, const Slice& key_start,
 }
 
 Status Storage::PKPatternMatchDel(const DataType& data_type, const std::string& pattern, int32_t* ret) {
-  Status s;
-  for (const auto& inst : insts_) {
-    s = inst->PKPatternMatchDel(pattern, ret);
-    if (!s.ok()) {
-      return s;
-    }
-  }
+  if (migrating_.load(std::memory_order_acquire)) {
+    TrackUntrackedWrite();
+  }
+  std::atomic<int32_t> total_delete = 0;
+  Status s = ForEachInstance([&](size_t index) {
+    int32_t inst_delete = 0;
+    Status s = insts_[index]->PKPatternMatchDel(pattern, &inst_delete);
+    total_delete += inst_delete;
+    return s;
+  });
+  *ret = total_delete.load();
   return s;
 }
 
@@ -1455,25 +2097,22 @@ Status Storage::Scanx(const DataType& data_type, const std::string& start_key, c
   keys->clear();
   next_key->clear();
 
-  std::vector<IterSptr> inst_iters;
-  for (const auto& inst : insts_) {
-    IterSptr iter_sptr;
-    iter_sptr.reset(inst->CreateIterator(data_type, pattern, nullptr /*lower_bound*/, nullptr /*upper_bound*/));
-    inst_iters.push_back(iter_sptr);
+  std::vector<std::string> collected_keys;
+  s = CollectKeys(DataTypeTag[static_cast<uint8_t>(data_type)], pattern, start_key, count + 1, &collected_keys);
+  if (!s.ok()) {
+    return s;
   }
-
-  BaseMetaKey base_start_key(start_key);
-  MergingIterator miter(inst_iters);
-  miter.Seek(base_start_key.Encode().ToString());
-  while (miter.Valid() && count > 0) {
-    keys->push_back(miter.Key());
-    miter.Next();
+  auto key_iter = collected_keys.begin();
+  while (key_iter != collected_keys.end() && count > 0) {
+    keys->push_back(std::move(*key_iter));
+    ++key_iter;
     count--;
   }
 
   std::string prefix = isTailWildcard(pattern) ? pattern.substr(0, pattern.size() - 1) : "";
-  if (miter.Valid() && (miter.Key().compare(prefix) <= 0 || miter.Key().substr(0, prefix.size()) == prefix)) {
-    *next_key = miter.Key();
+  if (key_iter != collected_keys.end() &&
+      (key_iter->compare(prefix) <= 0 || key_iter->substr(0, prefix.size()) == prefix)) {
+    *next_key = *key_iter;
   } else {
     *next_key = "";
   }
@@ -1507,10 +2146,63 @@ int32_t Storage::Persist(const Slice& key) {
   return count;
 }
 
+Status Storage::ActiveExpireCycle(size_t limit, size_t* expired) {
+  *expired = 0;
+  int64_t unix_time;
+  rocksdb::Env::Default()->GetCurrentTime(&unix_time);
+  for (const auto& inst : insts_) {
+    size_t inst_expired = 0;
+    Status s = inst->ActiveExpireCycle(static_cast<uint64_t>(unix_time), limit, &inst_expired);
+    if (!s.ok()) {
+      return s;
+    }
+    *expired += inst_expired;
+  }
+  return Status::OK();
+}
+
+// The cycle runs every kActiveExpireIntervalMs and deletes at most a tenth of the
+// per second budget from each instance, a backlog of expired keys is drained over
+// several cycles instead of stalling the foreground writes.
+static const int64_t kActiveExpireIntervalMs = 100;
+
+void Storage::RunActiveExpire(uint64_t keys_per_second) {
+  size_t limit = std::max<uint64_t>(keys_per_second * kActiveExpireIntervalMs / 1000, 1);
+  std::unique_lock<std::mutex> lock(active_expire_mutex_);
+  while (!active_expire_should_exit_) {
+    active_expire_cond_var_.wait_for(lock, std::chrono::milliseconds(kActiveExpireIntervalMs),
+                                     [this]() { return active_expire_should_exit_; });
+    if (active_expire_should_exit_) {
+      break;
+    }
+    if (can_write_function_ && !can_write_function_()) {
+      continue;
+    }
+    lock.unlock();
+    size_t expired = 0;
+    Status s = ActiveExpireCycle(limit, &expired);
+    if (!s.ok()) {
+      WARN("DB{} active expire cycle failed, {}", db_id_, s.ToString());
+    }
+    lock.lock();
+  }
+}
+
+void Storage::StopActiveExpire() {
+  {
+    std::lock_guard<std::mutex> lock(active_expire_mutex_);
+    active_expire_should_exit_ = true;
+  }
+  active_expire_cond_var_.notify_one();
+  if (active_expire_thread_.joinable()) {
+    active_expire_thread_.join();
+  }
+}
+
 int64_t Storage::TTL(const Slice& key) {
   Status s;
   int64_t timestamp = 0;
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   s = inst->TTL(key, &timestamp);
 
   if (s.ok() || s.IsNotFound()) {
@@ -1522,28 +2214,14 @@ int64_t Storage::TTL(const Slice& key) {
 }
 
 Status Storage::GetType(const std::string& key, enum DataType& type) {
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   return inst->GetType(key, type);
 }
 
 Status Storage::Keys(const DataType& data_type, const std::string& pattern, std::vector<std::string>* keys) {
   keys->clear();
-
-  std::vector<IterSptr> inst_iters;
-  for (const auto& inst : insts_) {
-    IterSptr inst_iter;
-    inst_iter.reset(inst->CreateIterator(data_type, pattern, nullptr /*lower_bound*/, nullptr /*upper_bound*/));
-    inst_iters.push_back(inst_iter);
-  }
-
-  MergingIterator miter(inst_iters);
-  miter.SeekToFirst();
-  while (miter.Valid()) {
-    keys->push_back(miter.Key());
-    miter.Next();
-  }
-
-  return Status::OK();
+  return CollectKeys(DataTypeTag[static_cast<uint8_t>(data_type)], pattern, "", std::numeric_limits<size_t>::max(),
+                     keys);
 }
 
 Status Storage::Rename(const std::string& key, const std::string& newkey) {
@@ -1651,6 +2329,19 @@ void Storage::ScanDatabase(const DataType& type) {
 }
 
 // HyperLogLog
+static const char kInvalidHyperLogLog[] = "WRONGTYPE Key is not a valid HyperLogLog string value.";
+
+// Merges the HyperLogLog stored at key into log, NotFound leaves it unchanged.
+// value is a buffer the caller reuses across keys.
+static Status MergeHyperLogLog(const std::unique_ptr<Redis>& inst, const Slice& key, HyperLogLog* log,
+                               std::string* value) {
+  Status s = inst->Get(key, value);
+  if (s.ok() && !log->Merge(*value)) {
+    return Status::InvalidArgument(kInvalidHyperLogLog);
+  }
+  return s;
+}
+
 Status Storage::PfAdd(const Slice& key, const std::vector<std::string>& values, bool* update) {
   *update = false;
   if (values.size() >= kMaxKeys) {
@@ -1658,29 +2349,21 @@ Status Storage::PfAdd(const Slice& key, const std::vector<std::string>& values,
   }
 
   std::string value;
-  std::string registers;
-  std::string result;
   auto& inst = GetDBInstance(key);
-  Status s = inst->Get(key, &value);
-  if (s.ok()) {
-    registers = value;
-  } else if (s.IsNotFound()) {
-    registers = "";
-  } else {
+  HyperLogLog log(kPrecision);
+  Status s = MergeHyperLogLog(inst, key, &log, &value);
+  if (!s.ok() && !s.IsNotFound()) {
     return s;
   }
-  HyperLogLog log(kPrecision, registers);
-  auto previous = static_cast<int32_t>(log.Estimate());
-  for (const auto& value : values) {
-    result = log.Add(value.data(), value.size());
+  bool changed = s.IsNotFound();
+  for (const auto& element : values) {
+    changed = log.Add(element.data(), element.size()) || changed;
   }
-  HyperLogLog update_log(kPrecision, result);
-  auto now = static_cast<int32_t>(update_log.Estimate());
-  if (previous != now || (s.IsNotFound() && values.empty())) {
-    *update = true;
+  if (!changed) {
+    return Status::OK();
   }
-  s = inst->Set(key, result);
-  return s;
+  *update = true;
+  return inst->Set(key, log.Encode());
 }
 
 Status Storage::PfCount(const std::vector<std::string>& keys, int64_t* result) {
@@ -1689,32 +2372,14 @@ Status Storage::PfCount(const std::vector<std::string>& keys, int64_t* result) {
   }
 
   std::string value;
-  std::string first_registers;
-  auto& inst = GetDBInstance(keys[0]);
-  Status s = inst->Get(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
-    first_registers = "";
-  }
-
-  HyperLogLog first_log(kPrecision, first_registers);
-  for (size_t i = 1; i < keys.size(); ++i) {
-    std::string value;
-    std::string registers;
-    auto& inst = GetDBInstance(keys[i]);
-    s = inst->Get(keys[i], &value);
-    if (s.ok()) {
-      registers = value;
-    } else if (s.IsNotFound()) {
-      continue;
-    } else {
+  HyperLogLog log(kPrecision);
+  for (const auto& key : keys) {
+    Status s = MergeHyperLogLog(GetReadDBInstance(key), key, &log, &value);
+    if (!s.ok() && !s.IsNotFound()) {
       return s;
     }
-    HyperLogLog log(kPrecision, registers);
-    first_log.Merge(log);
   }
-  *result = static_cast<int32_t>(first_log.Estimate());
+  *result = static_cast<int32_t>(log.Estimate());
   return Status::OK();
 }
 
@@ -1723,39 +2388,16 @@ Status Storage::PfMerge(const std::vector<std::string>& keys, std::string& value
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  Status s;
   std::string value;
-  std::string first_registers;
-  std::string result;
-  auto& inst = GetDBInstance(keys[0]);
-  s = inst->Get(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
-    first_registers = "";
-  }
-
-  result = first_registers;
-  HyperLogLog first_log(kPrecision, first_registers);
-  for (size_t i = 1; i < keys.size(); ++i) {
-    std::string value;
-    std::string registers;
-    auto& tmp_inst = GetDBInstance(keys[i]);
-    s = tmp_inst->Get(keys[i], &value);
-    if (s.ok()) {
-      registers = std::string(value.data(), value.size());
-    } else if (s.IsNotFound()) {
-      continue;
-    } else {
+  HyperLogLog log(kPrecision);
+  for (const auto& key : keys) {
+    Status s = MergeHyperLogLog(GetReadDBInstance(key), key, &log, &value);
+    if (!s.ok() && !s.IsNotFound()) {
       return s;
     }
-    HyperLogLog log(kPrecision, registers);
-    result = first_log.Merge(log);
   }
-  auto& ninst = GetDBInstance(keys[0]);
-  s = ninst->Set(keys[0], result);
-  value_to_dest = std::move(result);
-  return s;
+  value_to_dest = log.Encode();
+  return GetDBInstance(keys[0])->Set(keys[0], value_to_dest);
 }
 
 static void* StartBGThreadWrapper(void* arg) {
@@ -1861,7 +2503,7 @@ Status Storage::CompactRange(const DataType& type, const std::string& start, con
 
 Status Storage::DoCompactSpecificKey(const DataType& type, const std::string& key) {
   Status s;
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
 
   std::string start_key;
   std::string end_key;
@@ -1935,19 +2577,23 @@ uint64_t Storage::GetProperty(const std::string& property) {
 }
 
 Status Storage::GetKeyNum(std::vector<KeyInfo>* key_infos) {
-  KeyInfo key_info;
   key_infos->resize(5);
-  for (const auto& db : insts_) {
-    std::vector<KeyInfo> db_key_infos;
-    // check the scanner was stopped or not, before scanning the next db
+  std::vector<std::vector<KeyInfo>> inst_key_infos(insts_.size());
+  Status s = ForEachInstance([&](size_t index) {
+    // check the scanner was stopped or not, before scanning the db
     if (scan_keynum_exit_) {
-      break;
+      return Status::OK();
     }
-    auto s = db->ScanKeyNum(&db_key_infos);
-    if (!s.ok()) {
-      return s;
+    return insts_[index]->ScanKeyNum(&inst_key_infos[index]);
+  });
+  if (!s.ok()) {
+    return s;
+  }
+  for (auto& db_key_infos : inst_key_infos) {
+    if (db_key_infos.size() == key_infos->size()) {
+      std::transform(db_key_infos.begin(), db_key_infos.end(), key_infos->begin(), key_infos->begin(),
+                     std::plus<>{});
     }
-    std::transform(db_key_infos.begin(), db_key_infos.end(), key_infos->begin(), key_infos->begin(), std::plus<>{});
   }
   if (scan_keynum_exit_) {
     scan_keynum_exit_ = false;
@@ -1956,6 +2602,42 @@ Status Storage::GetKeyNum(std::vector<KeyInfo>* key_infos) {
   return Status::OK();
 }
 
+Status Storage::GetKeyNum(size_t index, std::vector<KeyInfo>* key_infos) {
+  if (index >= insts_.size()) {
+    return Status::InvalidArgument("invalid instance index");
+  }
+  if (scan_keynum_exit_) {
+    scan_keynum_exit_ = false;
+    return Status::Corruption("exit");
+  }
+  return insts_[index]->ScanKeyNum(key_infos);
+}
+
+Status Storage::GetApproximateKeyNum(std::vector<KeyInfo>* key_infos) {
+  key_infos->assign(5, KeyInfo());
+  std::vector<std::vector<KeyInfo>> inst_key_infos(insts_.size());
+  Status s = ForEachInstance([&](size_t index) { return insts_[index]->GetApproximateKeyNum(&inst_key_infos[index]); });
+  if (!s.ok()) {
+    return s;
+  }
+  // avg_ttl is weighted by the expiring keys of every instance
+  std::vector<double> ttl_sums(key_infos->size(), 0);
+  for (auto& db_key_infos : inst_key_infos) {
+    for (size_t i = 0; i < db_key_infos.size() && i < key_infos->size(); ++i) {
+      auto& info = (*key_infos)[i];
+      info.keys += db_key_infos[i].keys;
+      info.expires += db_key_infos[i].expires;
+      info.invalid_keys += db_key_infos[i].invalid_keys;
+      ttl_sums[i] += static_cast<double>(db_key_infos[i].avg_ttl) * static_cast<double>(db_key_infos[i].expires);
+    }
+  }
+  for (size_t i = 0; i < key_infos->size(); ++i) {
+    auto& info = (*key_infos)[i];
+    info.avg_ttl = info.expires == 0 ? 0 : static_cast<uint64_t>(ttl_sums[i] / static_cast<double>(info.expires));
+  }
+  return Status::OK();
+}
+
 Status Storage::StopScanKeyNum() {
   scan_keynum_exit_ = true;
   return Status::OK();
@@ -1988,9 +2670,290 @@ void Storage::GetRocksDBInfo(std::string& info) {
   }
 }
 
+void Storage::GetCompressionInfo(std::string& info) {
+  char temp[12] = {0};
+  for (const auto& inst : insts_) {
+    sprintf(temp, "instance:%2d", inst->GetIndex());
+    inst->GetCompressionInfo(info, temp);
+  }
+}
+
+pstd::lock::LockStats Storage::GetKeyLockStats() const {
+  pstd::lock::LockStats stats;
+  for (const auto& inst : insts_) {
+    auto inst_stats = inst->GetLockMgr()->GetStats();
+    stats.waits += inst_stats.waits;
+    stats.wait_micros += inst_stats.wait_micros;
+    stats.max_wait_micros = std::max(stats.max_wait_micros, inst_stats.max_wait_micros);
+  }
+  return stats;
+}
+
+std::vector<std::string> Storage::GetDataPaths() const {
+  std::vector<std::string> data_paths{db_path_};
+  for (const auto& data_path : inst_data_paths_) {
+    if (std::find(data_paths.begin(), data_paths.end(), data_path) == data_paths.end()) {
+      data_paths.push_back(data_path);
+    }
+  }
+  return data_paths;
+}
+
+std::vector<DataPathIOStats> Storage::GetDataPathIOStats() const {
+  std::vector<DataPathIOStats> result;
+  for (const auto& data_path : GetDataPaths()) {
+    result.emplace_back().path = data_path;
+  }
+  for (size_t index = 0; index < insts_.size(); ++index) {
+    auto iter = std::find_if(result.begin(), result.end(),
+                             [&](const DataPathIOStats& stats) { return stats.path == inst_data_paths_[index]; });
+    ++iter->instances;
+    insts_[index]->GetIOStats(&*iter);
+  }
+  return result;
+}
+
+void Storage::TrackMigratingKey(uint32_t slot_id, const std::string& key) {
+  auto slot = slot_indexer_->GetSlot(slot_id);
+  std::lock_guard<std::mutex> lock(migration_->mutex);
+  if (migration_->slots.count(slot) == 0 || migration_->overflowed) {
+    return;
+  }
+  migration_->touched_keys.insert(key);
+  if (migration_->touched_keys.size() > kMigrationMaxTouchedKeys) {
+    migration_->overflowed = true;
+    migration_->touched_keys.clear();
+  }
+}
+
+void Storage::TrackUntrackedWrite() {
+  std::lock_guard<std::mutex> lock(migration_->mutex);
+  migration_->untracked_write = true;
+}
+
+bool Storage::IsOwnedBy(const std::string& key, size_t index) const {
+  return slot_indexer_->GetInstanceID(GetSlotID(key)) == index;
+}
+
+Status Storage::MigrateSlots(const std::vector<uint32_t>& slots, int32_t dst_index,
+                             const ExclusiveRunner& run_exclusive) {
+  if (dst_index < 0 || static_cast<size_t>(dst_index) >= insts_.size()) {
+    return Status::InvalidArgument("invalid instance index");
+  }
+  if (std::any_of(slots.begin(), slots.end(), [this](uint32_t slot) { return slot >= slot_indexer_->GetSlotNum(); })) {
+    return Status::InvalidArgument("invalid slot");
+  }
+  // the binlog of an instance does not carry the keys copied into it
+  if (insts_[dst_index]->GetAppendLogFunction()) {
+    return Status::NotSupported("slot migration is not supported with raft");
+  }
+  std::unique_lock<std::mutex> migrate_lock(migrate_mutex_, std::try_to_lock);
+  if (!migrate_lock.owns_lock()) {
+    return Status::Busy("a slot migration is running");
+  }
+
+  auto migration = std::make_unique<SlotMigration>();
+  std::vector<std::pair<uint32_t, uint32_t>> old_owners;
+  std::vector<bool> is_source(insts_.size(), false);
+  for (auto slot : slots) {
+    auto owner = slot_indexer_->GetSlotOwner(slot);
+    if (owner != static_cast<uint32_t>(dst_index) && migration->slots.insert(slot).second) {
+      old_owners.emplace_back(slot, owner);
+      is_source[owner] = true;
+    }
+  }
+  if (old_owners.empty()) {
+    return Status::OK();
+  }
+  INFO("DB{} begin to migrate {} slots to RocksDB{}", db_id_, old_owners.size(), dst_index);
+  auto& dst = insts_[dst_index];
+  auto in_slots = [this](const std::string& key) {
+    return migration_->slots.count(slot_indexer_->GetSlot(GetSlotID(key))) != 0;
+  };
+
+  // 1) From now on the keys written to the slots are tracked, and the copies read snapshots
+  // taken with no command running, so that every change after them is tracked. The keys of
+  // the slots found in dst are left over by a copy that did not finish, dst does not own them
+  // so they are dropped first. The slots are copied again from new snapshots whenever more
+  // keys were written meanwhile than can be tracked.
+  Status s;
+  std::vector<std::vector<std::string>> moved_keys(insts_.size());
+  bool switched = false;
+  for (int copy_round = 0; s.ok() && !switched; ++copy_round) {
+    if (copy_round == kMigrationCopyRounds) {
+      s = Status::Incomplete("too many keys were written during the migration");
+      break;
+    }
+    std::vector<const rocksdb::Snapshot*> snapshots(insts_.size(), nullptr);
+    s = run_exclusive([&]() {
+      if (migration_ == nullptr) {
+        migration_ = std::move(migration);
+        migrating_.store(true, std::memory_order_release);
+      }
+      migration_->touched_keys.clear();
+      migration_->overflowed = false;
+      for (size_t index = 0; index < insts_.size(); ++index) {
+        if (is_source[index]) {
+          snapshots[index] = insts_[index]->GetDB()->GetSnapshot();
+        }
+      }
+      return Status::OK();
+    });
+
+    // 2) Copy the keys of the slots.
+    if (s.ok()) {
+      std::vector<std::string> leftover_keys;
+      s = dst->CollectKeys(nullptr, in_slots, &leftover_keys);
+      for (size_t pos = 0; s.ok() && pos < leftover_keys.size(); ++pos) {
+        s = dst->PurgeKey(leftover_keys[pos]);
+      }
+      if (s.ok()) {
+        moved_keys.assign(insts_.size(), {});
+      }
+    }
+    for (size_t index = 0; index < insts_.size(); ++index) {
+      if (s.ok() && is_source[index]) {
+        s = insts_[index]->CollectKeys(snapshots[index], in_slots, &moved_keys[index]);
+        for (size_t pos = 0; s.ok() && pos < moved_keys[index].size(); ++pos) {
+          if (migration_exit_.load(std::memory_order_relaxed)) {
+            // only the keys copied so far are dropped from dst
+            moved_keys[index].resize(pos);
+            s = Status::Incomplete("the migration was stopped");
+            break;
+          }
+          s = insts_[index]->CopyKeyTo(snapshots[index], moved_keys[index][pos], dst.get());
+        }
+      }
+      if (snapshots[index] != nullptr) {
+        insts_[index]->GetDB()->ReleaseSnapshot(snapshots[index]);
+      }
+    }
+
+    // 3) Copy the written keys again from their latest state. Each round takes the keys written
+    // so far with no command running, so none of their writes is still in flight while they
+    // are copied, and the writes after that are tracked for the next round. Once few enough
+    // are left, the last of them are copied and the slots switched over with every command
+    // blocked.
+    for (int catch_up_round = 0; s.ok() && !switched; ++catch_up_round) {
+      std::unordered_set<std::string> written_keys;
+      bool overflowed = false;
+      s = run_exclusive([&]() {
+        if (migration_->untracked_write) {
+          return Status::Incomplete("keys were deleted by pattern during the migration");
+        }
+        overflowed = migration_->overflowed;
+        if (overflowed) {
+          return Status::OK();
+        }
+        if (migration_->touched_keys.size() > kMigrationSwitchKeys) {
+          if (catch_up_round == kMigrationCatchUpRounds) {
+            return Status::Incomplete("the slots are written faster than they are copied");
+          }
+          written_keys.swap(migration_->touched_keys);
+          return Status::OK();
+        }
+        for (const auto& key : migration_->touched_keys) {
+          auto src_index = slot_indexer_->GetInstanceID(GetSlotID(key));
+          Status copy_s = insts_[src_index]->CopyKeyTo(nullptr, key, dst.get());
+          if (!copy_s.ok()) {
+            return copy_s;
+          }
+          moved_keys[src_index].push_back(key);
+        }
+        std::vector<uint32_t> moved_slots(migration_->slots.begin(), migration_->slots.end());
+        slot_indexer_->ReshardSlots(moved_slots, dst_index);
+        Status save_s = slot_indexer_->Save(slot_map_path_);
+        if (!save_s.ok()) {
+          for (const auto& [slot, owner] : old_owners) {
+            slot_indexer_->ReshardSlots({slot}, owner);
+          }
+        }
+        switched = save_s.ok();
+        return save_s;
+      });
+      if (overflowed) {
+        break;
+      }
+      for (const auto& key : written_keys) {
+        if (!s.ok()) {
+          break;
+        }
+        if (migration_exit_.load(std::memory_order_relaxed)) {
+          s = Status::Incomplete("the migration was stopped");
+          break;
+        }
+        auto src_index = slot_indexer_->GetInstanceID(GetSlotID(key));
+        s = insts_[src_index]->CopyKeyTo(nullptr, key, dst.get());
+        if (s.ok()) {
+          moved_keys[src_index].push_back(key);
+        }
+      }
+    }
+  }
+
+  // 4) Drop the keys the slots left behind, the old owners do not serve them any more.
+  // If the migration failed, the copies in dst are dropped instead.
+  for (size_t index = 0; index < insts_.size(); ++index) {
+    auto& inst = s.ok() ? insts_[index] : dst;
+    for (const auto& key : moved_keys[index]) {
+      if (auto purge_s = inst->PurgeKey(key); !purge_s.ok()) {
+        WARN("DB{} drop key {} from RocksDB{} failed: {}", db_id_, key, inst->GetIndex(), purge_s.ToString());
+      }
+    }
+  }
+
+  run_exclusive([&]() {
+    migrating_.store(false, std::memory_order_release);
+    migration_.reset();
+    return Status::OK();
+  });
+  if (s.ok()) {
+    INFO("DB{} migrated {} slots to RocksDB{}", db_id_, old_owners.size(), dst_index);
+  } else {
+    WARN("DB{} migrate slots to RocksDB{} failed: {}", db_id_, dst_index, s.ToString());
+  }
+  return s;
+}
+
+Status Storage::StopMigration() {
+  migration_exit_.store(true, std::memory_order_relaxed);
+  return Status::OK();
+}
+
+Status Storage::BalanceSlots(const ExclusiveRunner& run_exclusive) {
+  size_t inst_num = insts_.size();
+  uint32_t slot_num = slot_indexer_->GetSlotNum();
+  // the first slot_num % inst_num instances own one more slot
+  auto quota = [&](size_t index) { return slot_num / inst_num + (index < slot_num % inst_num ? 1 : 0); };
+
+  std::vector<std::vector<uint32_t>> owned(inst_num);
+  std::vector<uint32_t> spare_slots;
+  for (size_t index = 0; index < inst_num; ++index) {
+    owned[index] = slot_indexer_->GetSlotsOf(index);
+    while (owned[index].size() > quota(index)) {
+      spare_slots.push_back(owned[index].back());
+      owned[index].pop_back();
+    }
+  }
+  for (size_t index = 0; index < inst_num; ++index) {
+    size_t lack = quota(index) > owned[index].size() ? quota(index) - owned[index].size() : 0;
+    if (lack == 0) {
+      continue;
+    }
+    lack = std::min(lack, spare_slots.size());
+    std::vector<uint32_t> slots(spare_slots.end() - static_cast<ptrdiff_t>(lack), spare_slots.end());
+    spare_slots.resize(spare_slots.size() - lack);
+    Status s = MigrateSlots(slots, static_cast<int32_t>(index), run_exclusive);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
 int64_t Storage::IsExist(const Slice& key, std::map<DataType, Status>* type_status) {
   int64_t type_count = 0;
-  auto& inst = GetDBInstance(key);
+  auto& inst = GetReadDBInstance(key);
   Status s = inst->IsExist(key);
   if (s.ok()) {
     return type_count = 1;
@@ -2028,6 +2991,10 @@ Status Storage::OnBinlogWrite(const pikiwidb::Binlog& log, LogIndex log_idx) {
         assert(!entry.has_value());
         batch.Delete(inst->GetColumnFamilyHandles()[entry.cf_idx()], entry.key());
       } break;
+      case pikiwidb::OperateType::kDeleteRange: {
+        assert(entry.has_value());
+        batch.DeleteRange(inst->GetColumnFamilyHandles()[entry.cf_idx()], entry.key(), entry.value());
+      } break;
       default:
         static constexpr std::string_view msg = "Unknown operate type in binlog";
         ERROR(msg);
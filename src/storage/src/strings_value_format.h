@@ -16,9 +16,21 @@ namespace storage {
  * | type | value | reserve | cdate | timestamp |
  * |  1B  |       |   16B   |   8B  |     8B    |
  */
+const size_t kStringsValueSuffixLength = 2 * kTimestampLength + kSuffixReserveLength;
+
+/*
+ * The first reserve byte of a strings value records what the value holds.
+ * kStringsRaw is the string itself, kStringsBitmapFragments the meta of a
+ * bitmap stored in fragments (see bitmap_fragment_format.h).
+ */
+enum StringsEncoding : uint8_t { kStringsRaw = 0, kStringsBitmapFragments = 1 };
+
 class StringsValue : public InternalValue {
  public:
   explicit StringsValue(const rocksdb::Slice& user_value) : InternalValue(DataType::kStrings, user_value) {}
+
+  void SetEncoding(StringsEncoding encoding) { reserve_[0] = static_cast<char>(encoding); }
+
   virtual rocksdb::Slice Encode() override {
     size_t usize = user_value_.size();
     size_t needed = usize + kSuffixReserveLength + 2 * kTimestampLength + kTypeLength;
@@ -78,6 +90,8 @@ class ParsedStringsValue : public ParsedInternalValue {
     }
   }
 
+  StringsEncoding Encoding() { return static_cast<StringsEncoding>(reserve_[0]); }
+
   void StripSuffix() override {
     if (value_) {
       value_->erase(0, kTypeLength);
@@ -102,9 +116,6 @@ class ParsedStringsValue : public ParsedInternalValue {
       EncodeFixed64(dst, etime_);
     }
   }
-
- private:
-  const size_t kStringsValueSuffixLength = 2 * kTimestampLength + kSuffixReserveLength;
 };
 
 }  //  namespace storage
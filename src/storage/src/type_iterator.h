@@ -18,6 +18,7 @@
 #include "src/base_data_key_format.h"
 #include "src/base_key_format.h"
 #include "src/base_meta_value_format.h"
+#include "src/bitmap_fragment_format.h"
 #include "src/debug.h"
 #include "src/lists_meta_value_format.h"
 #include "src/mutex.h"
@@ -90,6 +91,9 @@ class TypeIterator {
 
   virtual bool Valid() { return raw_iter_->Valid(); }
 
+  // Tells whether Value() is the meta of a bitmap in fragments rather than the bitmap itself
+  virtual bool IsBitmapFragments() const { return false; }
+
   virtual Status status() { return raw_iter_->status(); }
 
  protected:
@@ -130,11 +134,15 @@ class StringsIterator : public TypeIterator {
 
     user_key_ = parsed_key.Key().ToString();
     user_value_ = parsed_value.UserValue().ToString();
+    bitmap_fragments_ = BitmapFragmentsMeta::IsFragments(raw_iter_->value());
     return false;
   }
 
+  bool IsBitmapFragments() const override { return bitmap_fragments_; }
+
  private:
   std::string pattern_;
+  bool bitmap_fragments_ = false;
 };
 
 class HashesIterator : public TypeIterator {
@@ -451,6 +459,8 @@ class MergingIterator {
 
   std::string Value() { return current_->Value(); }
 
+  bool IsBitmapFragments() { return current_->IsBitmapFragments(); }
+
   Status status() {
     Status s;
     for (const auto& child : children_) {
@@ -18,10 +18,11 @@
 
 namespace storage {
 
-class ZSetsScoreFilter : public rocksdb::CompactionFilter {
+class ZSetsScoreFilter : public BaseDataKeyFilter {
  public:
-  ZSetsScoreFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr, enum DataType type)
-      : db_(db), cf_handles_ptr_(handles_ptr), type_(type) {}
+  ZSetsScoreFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr, enum DataType type,
+                   const PendingVersions* pending_versions = nullptr)
+      : BaseDataKeyFilter(db, handles_ptr, type, pending_versions) {}
 
   bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
               bool* value_changed) const override {
@@ -34,84 +35,33 @@ class ZSetsScoreFilter : public rocksdb::CompactionFilter {
     TRACE("[ScoreFilter], key: %s, score = %lf, member = %s, version = %lld",
           parsed_zsets_score_key.key().ToString().c_str(), parsed_zsets_score_key.score(),
           parsed_zsets_score_key.member().ToString().c_str(), parsed_zsets_score_key.Version());
+    return DropByMeta(key, parsed_zsets_score_key.Version());
+  }
 
-    const char* ptr = key.data();
-    int key_size = key.size();
-    ptr = SeekUserkeyDelim(ptr + kPrefixReserveLength, key_size - kPrefixReserveLength);
-    std::string meta_key_enc(key.data(), std::distance(key.data(), ptr));
-    meta_key_enc.append(kSuffixReserveLength, kNeedTransformCharacter);
-
-    if (meta_key_enc != cur_key_) {
-      cur_meta_etime_ = 0;
-      cur_meta_version_ = 0;
-      meta_not_found_ = true;
-      cur_key_ = meta_key_enc;
-      std::string meta_value;
-      // destroyed when close the database, Reserve Current key value
-      if (cf_handles_ptr_->empty()) {
-        return false;
-      }
-      Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[0], cur_key_, &meta_value);
-      if (s.ok()) {
-        auto type = static_cast<enum DataType>(static_cast<uint8_t>(meta_value[0]));
-        if (type != type_) {
-          return true;
-        }
-        ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
-        meta_not_found_ = false;
-        cur_meta_version_ = parsed_zsets_meta_value.Version();
-        cur_meta_etime_ = parsed_zsets_meta_value.Etime();
-      } else if (s.IsNotFound()) {
-        meta_not_found_ = true;
-      } else {
-        cur_key_ = "";
-        TRACE("Reserve[Get meta_key faild]");
-        return false;
-      }
-    }
-
-    if (meta_not_found_) {
-      TRACE("Drop[Meta key not exist]");
-      return true;
-    }
+  const char* Name() const override { return "ZSetsScoreFilter"; }
 
-    int64_t unix_time;
-    rocksdb::Env::Default()->GetCurrentTime(&unix_time);
-    if (cur_meta_etime_ != 0 && cur_meta_etime_ < static_cast<uint64_t>(unix_time)) {
-      TRACE("Drop[Timeout]");
-      return true;
-    }
-    if (cur_meta_version_ > parsed_zsets_score_key.Version()) {
-      TRACE("Drop[score_key_version < cur_meta_version]");
-      return true;
-    } else {
-      TRACE("Reserve[score_key_version == cur_meta_version]");
+ protected:
+  bool ParseMeta(std::string* meta_value, uint64_t* version, uint64_t* etime) const override {
+    auto type = static_cast<enum DataType>(static_cast<uint8_t>((*meta_value)[0]));
+    if (type != type_) {
       return false;
     }
+    ParsedZSetsMetaValue parsed_zsets_meta_value(meta_value);
+    *version = parsed_zsets_meta_value.Version();
+    *etime = parsed_zsets_meta_value.Etime();
+    return true;
   }
-
-  const char* Name() const override { return "ZSetsScoreFilter"; }
-
- private:
-  rocksdb::DB* db_ = nullptr;
-  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
-  rocksdb::ReadOptions default_read_options_;
-  mutable std::string cur_key_;
-  mutable bool meta_not_found_ = false;
-  mutable uint64_t cur_meta_version_ = 0;
-  mutable uint64_t cur_meta_etime_ = 0;
-  enum DataType type_ = DataType::kNones;
 };
 
 class ZSetsScoreFilterFactory : public rocksdb::CompactionFilterFactory {
  public:
   ZSetsScoreFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr,
-                          enum DataType type)
-      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type) {}
+                          enum DataType type, const PendingVersions* pending_versions = nullptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type), pending_versions_(pending_versions) {}
 
   std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
       const rocksdb::CompactionFilter::Context& context) override {
-    return std::make_unique<ZSetsScoreFilter>(*db_ptr_, cf_handles_ptr_, type_);
+    return std::make_unique<ZSetsScoreFilter>(*db_ptr_, cf_handles_ptr_, type_, pending_versions_);
   }
 
   const char* Name() const override { return "ZSetsScoreFilterFactory"; }
@@ -120,6 +70,7 @@ class ZSetsScoreFilterFactory : public rocksdb::CompactionFilterFactory {
   rocksdb::DB** db_ptr_ = nullptr;
   std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
   enum DataType type_ = DataType::kNones;
+  const PendingVersions* pending_versions_ = nullptr;
 };
 
 }  //  namespace storage
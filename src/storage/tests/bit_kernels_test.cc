@@ -0,0 +1,156 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/bit_kernels.h"
+
+using namespace storage;
+
+static std::string RandomBytes(size_t size, std::mt19937* rng) {
+  std::string bytes(size, '\0');
+  for (auto& c : bytes) {
+    c = static_cast<char>((*rng)() & 0xff);
+  }
+  return bytes;
+}
+
+static const unsigned char* Bytes(const std::string& s) { return reinterpret_cast<const unsigned char*>(s.data()); }
+
+static unsigned char* Bytes(std::string* s) { return reinterpret_cast<unsigned char*>(s->data()); }
+
+// Every kernel set agrees with the scalar one, for every size around the vector widths
+// and every alignment
+TEST(BitKernelsTest, MatchScalarTest) {
+  auto kernels = SupportedBitKernels();
+  ASSERT_STREQ(kernels.front()->name, "scalar");
+  ASSERT_EQ(&GetBitKernels(), kernels.back());
+  const auto& scalar = *kernels.front();
+
+  std::mt19937 rng(301);
+  for (const auto* kernel : kernels) {
+    for (size_t size = 0; size < 300; ++size) {
+      for (size_t offset = 0; offset < 3; ++offset) {
+        std::string a = RandomBytes(size + offset, &rng);
+        std::string b = RandomBytes(size + offset, &rng);
+        const unsigned char* pa = Bytes(a) + offset;
+        const unsigned char* pb = Bytes(b) + offset;
+        ASSERT_EQ(kernel->pop_count(pa, size), scalar.pop_count(pa, size)) << kernel->name << " size " << size;
+
+        for (auto op : {&BitKernels::and_bytes, &BitKernels::or_bytes, &BitKernels::xor_bytes}) {
+          std::string expected = a;
+          std::string actual = a;
+          (scalar.*op)(Bytes(&expected) + offset, pb, size);
+          (kernel->*op)(Bytes(&actual) + offset, pb, size);
+          ASSERT_EQ(actual, expected) << kernel->name << " size " << size;
+        }
+        std::string expected = a;
+        std::string actual = a;
+        scalar.not_bytes(Bytes(&expected) + offset, size);
+        kernel->not_bytes(Bytes(&actual) + offset, size);
+        ASSERT_EQ(actual, expected) << kernel->name << " size " << size;
+
+        expected = a;
+        actual = a;
+        scalar.max_bytes(Bytes(&expected) + offset, pb, size);
+        kernel->max_bytes(Bytes(&actual) + offset, pb, size);
+        ASSERT_EQ(actual, expected) << kernel->name << " size " << size;
+      }
+    }
+  }
+}
+
+TEST(BitKernelsTest, FindFirstNotTest) {
+  for (const auto* kernel : SupportedBitKernels()) {
+    for (unsigned char skip : {0x00, 0xff}) {
+      for (size_t size = 0; size < 200; ++size) {
+        std::string bytes(size, static_cast<char>(skip));
+        ASSERT_EQ(kernel->find_first_not(Bytes(bytes), size, skip), size) << kernel->name;
+        for (size_t pos = 0; pos < size; pos += 7) {
+          std::string with_other = bytes;
+          with_other[pos] = static_cast<char>(skip ^ 0x10);
+          if (pos + 1 < size) {
+            with_other[size - 1] = static_cast<char>(skip ^ 0x01);
+          }
+          ASSERT_EQ(kernel->find_first_not(Bytes(with_other), size, skip), pos) << kernel->name << " size " << size;
+        }
+      }
+    }
+  }
+}
+
+// The sum of 2^-register is exact for registers up to 33, whatever order the
+// kernels add them in
+TEST(BitKernelsTest, InversePow2SumTest) {
+  std::mt19937 rng(17);
+  for (const auto* kernel : SupportedBitKernels()) {
+    for (size_t size = 0; size < 300; ++size) {
+      std::string registers(size, '\0');
+      double expected = 0;
+      size_t expected_zeros = 0;
+      for (auto& r : registers) {
+        r = static_cast<char>(rng() % 4 == 0 ? 0 : rng() % 34);
+        expected += std::ldexp(1.0, -r);
+        expected_zeros += r == 0;
+      }
+      size_t zeros = 0;
+      ASSERT_EQ(kernel->inverse_pow2_sum(Bytes(registers), size, &zeros), expected) << kernel->name << " size " << size;
+      ASSERT_EQ(zeros, expected_zeros) << kernel->name << " size " << size;
+    }
+    std::string high(100, static_cast<char>(200));
+    size_t zeros = 0;
+    ASSERT_EQ(kernel->inverse_pow2_sum(Bytes(high), high.size(), &zeros), 100 * std::ldexp(1.0, -63)) << kernel->name;
+  }
+}
+
+static void BenchmarkKernels(size_t size, int rounds) {
+  std::mt19937 rng(7);
+  std::string a = RandomBytes(size, &rng);
+  std::string b = RandomBytes(size, &rng);
+  std::string zeros(size, '\0');
+  printf("bitmap of %zu KB\n", size >> 10);
+
+  auto measure = [&](const char* kernel, const char* name, const std::function<void()>& func) {
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+      func();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-8s %-16s %8.1f MB/s\n", kernel, name, size * rounds / elapsed.count() / (1 << 20));
+  };
+
+  for (const auto* kernel : SupportedBitKernels()) {
+    volatile int64_t sink = 0;
+    measure(kernel->name, "pop_count", [&]() { sink = sink + kernel->pop_count(Bytes(a), size); });
+    measure(kernel->name, "find_first_not", [&]() { sink = sink + kernel->find_first_not(Bytes(zeros), size, 0); });
+    measure(kernel->name, "and_bytes", [&]() { kernel->and_bytes(Bytes(&a), Bytes(b), size); });
+    measure(kernel->name, "xor_bytes", [&]() { kernel->xor_bytes(Bytes(&a), Bytes(b), size); });
+    measure(kernel->name, "not_bytes", [&]() { kernel->not_bytes(Bytes(&a), size); });
+    measure(kernel->name, "max_bytes", [&]() { kernel->max_bytes(Bytes(&a), Bytes(b), size); });
+    size_t zeros = 0;
+    measure(kernel->name, "inverse_pow2_sum",
+            [&]() { sink = sink + kernel->inverse_pow2_sum(Bytes(a), size, &zeros); });
+  }
+}
+
+// Throughput of every kernel set on a bitmap held in the cpu caches, and on a
+// multi-MB one, run with --gtest_also_run_disabled_tests
+TEST(BitKernelsTest, DISABLED_Benchmark) {
+  for (size_t size : {size_t{256} << 10, size_t{16} << 20}) {
+    BenchmarkKernels(size, static_cast<int>((size_t{1} << 30) / size));
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,6 +8,8 @@
 #include <thread>
 
 #include "src/custom_comparator.h"
+#include "src/data_key_prefix_transform.h"
+#include "src/lists_data_key_format.h"
 #include "src/redis.h"
 #include "src/zsets_data_key_format.h"
 #include "storage/storage.h"
@@ -152,6 +154,43 @@ TEST(ZSetScoreKeyComparator, FindShortestSeparatorTest) {
   ASSERT_TRUE(impl.Compare(start_10, limit_10) < 0);
 }
 
+// Transform
+TEST(DataKeyPrefixTransform, TransformTest) {
+  DataKeyPrefixTransformImpl impl;
+
+  // ***************** Group 1 Test *****************
+  // keys holding \0 bytes are escaped, the prefix still ends right after the version
+  std::string user_key("A\0B\0\0C", 6);
+  HashesDataKey seek_key(user_key, 1557212501, rocksdb::Slice());
+  std::string prefix = seek_key.EncodeSeekKey().ToString();
+  ASSERT_TRUE(impl.InDomain(prefix));
+  ASSERT_TRUE(impl.InRange(prefix));
+  ASSERT_EQ(impl.Transform(prefix).ToString(), prefix);
+
+  std::string field("\0\0field", 7);
+  HashesDataKey data_key(user_key, 1557212501, field);
+  std::string encoded = data_key.Encode().ToString();
+  ASSERT_TRUE(impl.InDomain(encoded));
+  ASSERT_EQ(impl.Transform(encoded).ToString(), prefix);
+
+  // ***************** Group 2 Test *****************
+  // another version or another key that shares the leading bytes gets another prefix
+  HashesDataKey other_version(user_key, 1557212502, field);
+  ASSERT_NE(impl.Transform(other_version.Encode()).ToString(), prefix);
+  HashesDataKey other_key(std::string("A\0B\0\0", 5), 1557212501, std::string("C", 1));
+  ASSERT_NE(impl.Transform(other_key.Encode()).ToString(), prefix);
+
+  // ***************** Group 3 Test *****************
+  ListsDataKey lists_data_key(user_key, 1557212501, 100);
+  ASSERT_EQ(impl.Transform(lists_data_key.Encode()).ToString(), prefix);
+
+  // ***************** Group 4 Test *****************
+  // truncated keys are out of the domain
+  ASSERT_FALSE(impl.InDomain(rocksdb::Slice(prefix.data(), prefix.size() - 1)));
+  ASSERT_FALSE(impl.InRange(rocksdb::Slice(prefix.data(), prefix.size() - 1)));
+  ASSERT_FALSE(impl.InDomain(rocksdb::Slice(prefix.data(), kPrefixReserveLength)));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
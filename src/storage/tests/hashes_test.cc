@@ -2440,6 +2440,107 @@ TEST_F(HashesTest, PKHRScanRangeTest) {
   ASSERT_EQ(next_field, "i");
 }
 
+// Collects what a streaming read emits, refusing elements past limit
+class CollectSink : public storage::ElementSink {
+ public:
+  Status Begin(uint64_t n) override {
+    begun = true;
+    count = n;
+    return Status::OK();
+  }
+  Status Append(const Slice& element) override {
+    if (elements.size() == limit) {
+      return Status::Incomplete("limit");
+    }
+    elements.push_back(element.ToString());
+    return Status::OK();
+  }
+  Status AppendScore(double score) override { return Append(std::to_string(static_cast<int64_t>(score))); }
+
+  size_t limit = SIZE_MAX;
+  bool begun = false;
+  uint64_t count = 0;
+  std::vector<std::string> elements;
+};
+
+// HGetall streamed into a sink
+TEST_F(HashesTest, HGetallSinkTest) {
+  std::vector<storage::FieldValue> fvs;
+  for (int i = 0; i < 1000; ++i) {
+    fvs.push_back({"FIELD" + std::to_string(i), "VALUE" + std::to_string(i)});
+  }
+  s = db.HMSet("HGETALL_SINK_KEY", fvs);
+  ASSERT_TRUE(s.ok());
+
+  CollectSink sink;
+  s = db.HGetall("HGETALL_SINK_KEY", &sink);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(sink.count, 2000);
+  ASSERT_EQ(sink.elements.size(), 2000);
+  std::vector<storage::FieldValue> streamed;
+  for (size_t i = 0; i < sink.elements.size(); i += 2) {
+    streamed.push_back({sink.elements[i], sink.elements[i + 1]});
+  }
+  ASSERT_TRUE(field_value_match(streamed, fvs));
+
+  CollectSink limited;
+  limited.limit = 11;
+  s = db.HGetall("HGETALL_SINK_KEY", &limited);
+  ASSERT_TRUE(s.IsIncomplete());
+  ASSERT_EQ(limited.elements.size(), 11);
+
+  CollectSink not_found;
+  s = db.HGetall("HGETALL_SINK_NOT_EXIST_KEY", &not_found);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_FALSE(not_found.begun);
+
+  int32_t ret = 0;
+  s = db.SAdd("HGETALL_SINK_SET_KEY", {"MEMBER"}, &ret);
+  ASSERT_TRUE(s.ok());
+  CollectSink wrong_type;
+  s = db.HGetall("HGETALL_SINK_SET_KEY", &wrong_type);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_FALSE(wrong_type.begun);
+}
+
+// HGetall read a piece at a time, while the hash changes in between
+TEST_F(HashesTest, HGetallReaderTest) {
+  std::vector<storage::FieldValue> fvs;
+  for (int i = 0; i < 1000; ++i) {
+    fvs.push_back({"FIELD" + std::to_string(i), "VALUE" + std::to_string(i)});
+  }
+  s = db.HMSet("HGETALL_READER_KEY", fvs);
+  ASSERT_TRUE(s.ok());
+
+  std::unique_ptr<storage::ElementReader> reader;
+  s = db.HGetall("HGETALL_READER_KEY", &reader);
+  ASSERT_TRUE(s.ok());
+  int32_t ret = 0;
+  s = db.HDel("HGETALL_READER_KEY", {"FIELD0", "FIELD500"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.HSet("HGETALL_READER_KEY", "FIELD1000", "VALUE1000", &ret);
+  ASSERT_TRUE(s.ok());
+
+  CollectSink sink;
+  int pieces = 0;
+  while (!reader->Done()) {
+    s = reader->Read(&sink, 100);
+    ASSERT_TRUE(s.ok());
+    ++pieces;
+  }
+  ASSERT_GT(pieces, 10);
+  ASSERT_EQ(sink.count, 2000);
+  ASSERT_EQ(sink.elements.size(), 2000);
+  std::vector<storage::FieldValue> streamed;
+  for (size_t i = 0; i < sink.elements.size(); i += 2) {
+    streamed.push_back({sink.elements[i], sink.elements[i + 1]});
+  }
+  ASSERT_TRUE(field_value_match(streamed, fvs));
+
+  s = db.HGetall("HGETALL_READER_MISSING_KEY", &reader);
+  ASSERT_TRUE(s.IsNotFound());
+}
+
 int main(int argc, char** argv) {
   if (!pstd::FileExists("./log")) {
     pstd::CreatePath("./log");
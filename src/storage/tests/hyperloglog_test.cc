@@ -0,0 +1,169 @@
+//  Copyright (c) 2024-present, OpenAtom Foundation, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "pstd/env.h"
+#include "src/redis_hyperloglog.h"
+#include "storage/storage.h"
+
+using namespace storage;
+
+static const uint8_t kTestPrecision = Storage::kPrecision;
+
+static std::string Element(const std::string& prefix, int i) { return prefix + std::to_string(i); }
+
+static HyperLogLog MakeLog(const std::string& prefix, int count) {
+  HyperLogLog log(kTestPrecision);
+  for (int i = 0; i < count; ++i) {
+    auto element = Element(prefix, i);
+    log.Add(element.data(), element.size());
+  }
+  return log;
+}
+
+// A HyperLogLog stays sparse, 3 bytes per register, until it has more than
+// kSparseMaxRegisters registers, then it holds every register
+TEST(HyperLogLogTest, SparseToDenseTest) {
+  HyperLogLog log(kTestPrecision);
+  ASSERT_TRUE(log.IsSparse());
+  ASSERT_EQ(log.Estimate(), 0);
+
+  int added = 0;
+  size_t sparse_size = 0;
+  while (log.IsSparse()) {
+    sparse_size = log.Encode().size();
+    auto element = Element("a", added++);
+    log.Add(element.data(), element.size());
+  }
+  ASSERT_EQ(sparse_size, 4 + 3 * HyperLogLog::kSparseMaxRegisters);
+  ASSERT_EQ(log.Encode().size(), size_t{1} << kTestPrecision);
+
+  auto element = Element("a", 0);
+  ASSERT_FALSE(log.Add(element.data(), element.size()));
+  ASSERT_NEAR(log.Estimate(), added, added * 0.02);
+
+  for (int count : {10, 500, 100000}) {
+    auto counted = MakeLog("b", count);
+    ASSERT_NEAR(counted.Estimate(), count, count * 0.02 + 1);
+  }
+}
+
+// Decoding and merging gives the same registers whatever the encodings
+TEST(HyperLogLogTest, MergeTest) {
+  auto sparse = MakeLog("a", 300);
+  auto dense = MakeLog("b", 20000);
+  ASSERT_TRUE(sparse.IsSparse());
+  ASSERT_FALSE(dense.IsSparse());
+
+  HyperLogLog decoded(kTestPrecision);
+  ASSERT_TRUE(decoded.Merge(sparse.Encode()));
+  ASSERT_EQ(decoded.Encode(), sparse.Encode());
+  ASSERT_EQ(decoded.Estimate(), sparse.Estimate());
+
+  HyperLogLog all(kTestPrecision);
+  for (int i = 0; i < 300; ++i) {
+    auto element = Element("a", i);
+    all.Add(element.data(), element.size());
+  }
+  for (int i = 0; i < 20000; ++i) {
+    auto element = Element("b", i);
+    all.Add(element.data(), element.size());
+  }
+
+  HyperLogLog sparse_first(kTestPrecision);
+  ASSERT_TRUE(sparse_first.Merge(sparse.Encode()));
+  ASSERT_TRUE(sparse_first.Merge(dense.Encode()));
+  HyperLogLog dense_first(kTestPrecision);
+  ASSERT_TRUE(dense_first.Merge(dense.Encode()));
+  ASSERT_TRUE(dense_first.Merge(sparse.Encode()));
+  ASSERT_EQ(sparse_first.Encode(), all.Encode());
+  ASSERT_EQ(dense_first.Encode(), all.Encode());
+
+  // Two sparse ones past kSparseMaxRegisters together turn dense
+  auto other_sparse = MakeLog("c", 900);
+  ASSERT_TRUE(other_sparse.IsSparse());
+  HyperLogLog merged(kTestPrecision);
+  ASSERT_TRUE(merged.Merge(sparse.Encode()));
+  ASSERT_TRUE(merged.Merge(other_sparse.Encode()));
+  ASSERT_FALSE(merged.IsSparse());
+  ASSERT_NEAR(merged.Estimate(), 1200, 1200 * 0.02);
+
+  ASSERT_TRUE(merged.Merge(""));
+  HyperLogLog invalid(kTestPrecision);
+  ASSERT_FALSE(invalid.Merge("not a hyperloglog"));
+  ASSERT_FALSE(invalid.Merge(std::string("HYLS\x00\x00\x41\x00\x00\x01", 10)));
+  ASSERT_FALSE(invalid.Merge(std::string("HYLS\x00\x00\x40", 7)));
+}
+
+class HyperLogLogStorageTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    pstd::DeleteDirIfExist(db_path);
+    mkdir(db_path.c_str(), 0755);
+    options.options.create_if_missing = true;
+    options.options.create_missing_column_families = true;
+    options.db_instance_num = 1;
+    auto s = db.Open(options, db_path);
+    ASSERT_TRUE(s.ok());
+  }
+
+  void TearDown() override { db.Close(); }
+
+  std::string db_path{"./test_db/hyperloglog_test"};
+  StorageOptions options;
+  storage::Storage db;
+};
+
+TEST_F(HyperLogLogStorageTest, PfTest) {
+  bool update = false;
+  ASSERT_TRUE(db.PfAdd("PF_KEY", {}, &update).ok());
+  ASSERT_TRUE(update);
+  ASSERT_TRUE(db.PfAdd("PF_KEY", {}, &update).ok());
+  ASSERT_FALSE(update);
+
+  std::vector<std::string> elements;
+  for (int i = 0; i < 100; ++i) {
+    elements.push_back(Element("a", i));
+  }
+  ASSERT_TRUE(db.PfAdd("PF_KEY", elements, &update).ok());
+  ASSERT_TRUE(update);
+  ASSERT_TRUE(db.PfAdd("PF_KEY", elements, &update).ok());
+  ASSERT_FALSE(update);
+  std::string value;
+  ASSERT_TRUE(db.Get("PF_KEY", &value).ok());
+  ASSERT_LT(value.size(), size_t{1} << kTestPrecision);
+
+  std::vector<std::string> other_elements;
+  for (int i = 0; i < 5000; ++i) {
+    other_elements.push_back(Element("b", i));
+  }
+  ASSERT_TRUE(db.PfAdd("PF_OTHER_KEY", other_elements, &update).ok());
+  ASSERT_TRUE(db.Get("PF_OTHER_KEY", &value).ok());
+  ASSERT_EQ(value.size(), size_t{1} << kTestPrecision);
+
+  int64_t count = 0;
+  ASSERT_TRUE(db.PfCount({"PF_KEY"}, &count).ok());
+  ASSERT_NEAR(count, 100, 2);
+  ASSERT_TRUE(db.PfCount({"PF_KEY", "PF_OTHER_KEY", "PF_NOT_EXIST_KEY"}, &count).ok());
+  ASSERT_NEAR(count, 5100, 5100 * 0.02);
+
+  std::string merged;
+  ASSERT_TRUE(db.PfMerge({"PF_KEY", "PF_OTHER_KEY"}, merged).ok());
+  ASSERT_TRUE(db.PfCount({"PF_KEY"}, &count).ok());
+  ASSERT_NEAR(count, 5100, 5100 * 0.02);
+
+  ASSERT_TRUE(db.Set("PF_STRING_KEY", "not a hyperloglog").ok());
+  ASSERT_TRUE(db.PfAdd("PF_STRING_KEY", elements, &update).IsInvalidArgument());
+  ASSERT_TRUE(db.PfCount({"PF_KEY", "PF_STRING_KEY"}, &count).IsInvalidArgument());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -4,11 +4,15 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <iostream>
+#include <set>
 #include <thread>
 
 #include "pstd/env.h"
 #include "pstd/log.h"
+#include "rocksdb/env.h"
+#include "src/redis.h"
 #include "storage/storage.h"
 #include "storage/util.h"
 
@@ -5096,6 +5100,110 @@ TEST_F(KeysTest, DelTest) {
   // Strings
   s = db.Get("DEL_KEY", &value);
   ASSERT_TRUE(s.IsNotFound());
+
+  // Several types in one call, duplicated and missing keys are not counted
+  std::vector<std::string> members{"MEMBER"};
+  s = db.Set("DEL_MULTI_STRING_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.HSet("DEL_MULTI_HASH_KEY", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("DEL_MULTI_SET_KEY", members, &ret);
+  ASSERT_TRUE(s.ok());
+  uint64_t len = 0;
+  s = db.RPush("DEL_MULTI_LIST_KEY", members, &len);
+  ASSERT_TRUE(s.ok());
+  s = db.ZAdd("DEL_MULTI_ZSET_KEY", {{1, "MEMBER"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  ret = db.Del({"DEL_MULTI_STRING_KEY", "DEL_MULTI_HASH_KEY", "DEL_MULTI_SET_KEY", "DEL_MULTI_LIST_KEY",
+                "DEL_MULTI_ZSET_KEY", "DEL_MULTI_STRING_KEY", "DEL_MULTI_NOT_EXIST_KEY"});
+  ASSERT_EQ(ret, 5);
+  ASSERT_EQ(db.Exists({"DEL_MULTI_STRING_KEY", "DEL_MULTI_HASH_KEY", "DEL_MULTI_SET_KEY", "DEL_MULTI_LIST_KEY",
+                       "DEL_MULTI_ZSET_KEY"}),
+            0);
+  ret = db.Del({"DEL_MULTI_STRING_KEY", "DEL_MULTI_HASH_KEY"});
+  ASSERT_EQ(ret, 0);
+}
+
+// DEL drops the data keys of the deleted version with range tombstones, or with point
+// deletes when the collection is small
+TEST_F(KeysTest, DelRangeTombstoneTest) {
+  std::string value(100, 'v');
+  int32_t ret = 0;
+  uint64_t len = 0;
+  std::vector<std::string> list_values;
+  std::vector<storage::ScoreMember> score_members;
+  for (int i = 0; i < 20000; ++i) {
+    s = db.HSet("DEL_RANGE_HASH", "FIELD_" + std::to_string(i), value, &ret);
+    ASSERT_TRUE(s.ok());
+    list_values.push_back(value);
+    score_members.push_back({static_cast<double>(i % 100 - 50), "MEMBER_" + std::to_string(i)});
+  }
+  s = db.RPush("DEL_RANGE_LIST", list_values, &len);
+  ASSERT_TRUE(s.ok());
+  s = db.ZAdd("DEL_RANGE_ZSET", score_members, &ret);
+  ASSERT_TRUE(s.ok());
+  // neighbours of the deleted keys keep their data
+  s = db.HSet("DEL_RANGE_HASH_KEEP", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.RPush("DEL_RANGE_LIST_KEEP", {"VALUE"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = db.ZAdd("DEL_RANGE_ZSET_KEEP", {{-100, "MEMBER"}}, &ret);
+  ASSERT_TRUE(s.ok());
+
+  auto& inst = db.GetDBInstance(std::string("DEL_RANGE_HASH"));
+  rocksdb::DB* rocks = inst->GetDB();
+  const auto& handles = inst->GetColumnFamilyHandles();
+  std::vector<storage::ColumnFamilyIndex> data_cfs{storage::kHashesDataCF, storage::kListsDataCF,
+                                                   storage::kZsetsDataCF, storage::kZsetsScoreCF};
+  auto count_data_keys = [&](storage::ColumnFamilyIndex cf) {
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    std::unique_ptr<rocksdb::Iterator> iter(rocks->NewIterator(read_options, handles[cf]));
+    int64_t count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ++count;
+    }
+    return count;
+  };
+  for (auto cf : data_cfs) {
+    ASSERT_TRUE(rocks->Flush(rocksdb::FlushOptions(), handles[cf]).ok());
+  }
+  uint64_t size_before = 0;
+  ASSERT_TRUE(rocks->GetIntProperty(handles[storage::kHashesDataCF], "rocksdb.total-sst-files-size", &size_before));
+  ASSERT_GT(size_before, 20000 * 100);
+
+  ASSERT_EQ(db.Del({"DEL_RANGE_HASH", "DEL_RANGE_LIST", "DEL_RANGE_ZSET"}), 3);
+  // the old versions are gone from the data cfs before any compaction filter ran
+  ASSERT_EQ(count_data_keys(storage::kHashesDataCF), 1);
+  ASSERT_EQ(count_data_keys(storage::kListsDataCF), 1);
+  ASSERT_EQ(count_data_keys(storage::kZsetsDataCF), 1);
+  ASSERT_EQ(count_data_keys(storage::kZsetsScoreCF), 1);
+
+  ASSERT_TRUE(rocks->Flush(rocksdb::FlushOptions(), handles[storage::kHashesDataCF]).ok());
+  ASSERT_TRUE(
+      rocks->CompactRange(rocksdb::CompactRangeOptions(), handles[storage::kHashesDataCF], nullptr, nullptr).ok());
+  uint64_t size_after = 0;
+  ASSERT_TRUE(rocks->GetIntProperty(handles[storage::kHashesDataCF], "rocksdb.total-sst-files-size", &size_after));
+  ASSERT_LT(size_after, size_before / 10);
+
+  int32_t hlen = 0;
+  s = db.HLen("DEL_RANGE_HASH_KEEP", &hlen);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(hlen, 1);
+  s = db.LLen("DEL_RANGE_LIST_KEEP", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 1);
+
+  // a small collection gets point deletes rather than a range tombstone
+  s = db.HSet("DEL_POINT_HASH", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(rocks->Flush(rocksdb::FlushOptions(), handles[storage::kHashesDataCF]).ok());
+  ASSERT_EQ(db.Del({"DEL_POINT_HASH"}), 1);
+  uint64_t range_deletes = 0;
+  ASSERT_TRUE(rocks->GetIntProperty(handles[storage::kHashesDataCF], "rocksdb.num-range-deletes-active-mem",
+                                    &range_deletes));
+  ASSERT_EQ(range_deletes, 0);
+  ASSERT_EQ(count_data_keys(storage::kHashesDataCF), 1);
 }
 
 // Exists
@@ -5195,6 +5303,738 @@ TEST_F(KeysTest, TTLTest) {
   ttl_ret = db.TTL("TTL_KEY");
 }
 
+// ActiveExpireCycle
+TEST_F(KeysTest, ActiveExpireCycleTest) {
+  std::vector<std::string> expire_keys;
+  for (int i = 0; i < 100; ++i) {
+    expire_keys.push_back("ACTIVE_EXPIRE_KEY_" + std::to_string(i));
+    s = db.Setex(expire_keys.back(), "VALUE", 1);
+    ASSERT_TRUE(s.ok());
+  }
+  int32_t ret = 0;
+  s = db.HSet("ACTIVE_EXPIRE_HASH", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db.Expire("ACTIVE_EXPIRE_HASH", 1), 1);
+  uint64_t len = 0;
+  s = db.RPush("ACTIVE_EXPIRE_LIST", {"a", "b", "c"}, &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db.Expire("ACTIVE_EXPIRE_LIST", 1), 1);
+
+  // the timeout was removed, or the key was overwritten without one
+  s = db.Set("ACTIVE_PERSIST_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db.Expire("ACTIVE_PERSIST_KEY", 1), 1);
+  ASSERT_EQ(db.Persist("ACTIVE_PERSIST_KEY"), 1);
+  s = db.Setex("ACTIVE_OVERWRITE_KEY", "VALUE", 1);
+  ASSERT_TRUE(s.ok());
+  s = db.Set("ACTIVE_OVERWRITE_KEY", "NEW_VALUE");
+  ASSERT_TRUE(s.ok());
+
+  // not due yet
+  s = db.Setex("ACTIVE_LATER_KEY", "VALUE", 1000);
+  ASSERT_TRUE(s.ok());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+  size_t expired = 0;
+  s = db.ActiveExpireCycle(50, &expired);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LE(expired, 50);
+  size_t total = expired;
+  s = db.ActiveExpireCycle(1000, &expired);
+  ASSERT_TRUE(s.ok());
+  total += expired;
+  ASSERT_EQ(total, 102);
+  s = db.ActiveExpireCycle(1000, &expired);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(expired, 0);
+
+  ASSERT_EQ(db.Exists(expire_keys), 0);
+  ASSERT_EQ(db.Exists({"ACTIVE_EXPIRE_HASH", "ACTIVE_EXPIRE_LIST"}), 0);
+  int32_t hlen = 0;
+  s = db.HLen("ACTIVE_EXPIRE_HASH", &hlen);
+  ASSERT_TRUE(s.IsNotFound());
+
+  std::string value;
+  s = db.Get("ACTIVE_PERSIST_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  s = db.Get("ACTIVE_OVERWRITE_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "NEW_VALUE");
+  ASSERT_GT(db.TTL("ACTIVE_LATER_KEY"), 0);
+}
+
+// The conditional sets with a timeout and the renames keep the expire index in step
+TEST_F(KeysTest, ActiveExpireIndexTest) {
+  size_t expired = 0;
+  do {
+    s = db.ActiveExpireCycle(1000, &expired);
+    ASSERT_TRUE(s.ok());
+  } while (expired != 0);
+
+  int32_t ret = 0;
+  s = db.Setnx("EXPIRE_INDEX_SETNX_KEY", "VALUE", &ret, 1);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.Set("EXPIRE_INDEX_SETXX_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.Setxx("EXPIRE_INDEX_SETXX_KEY", "NEW_VALUE", &ret, 1);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.Set("EXPIRE_INDEX_SETVX_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.Setvx("EXPIRE_INDEX_SETVX_KEY", "VALUE", "NEW_VALUE", &ret, 1);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+
+  // the index entry follows the key to its new name
+  s = db.Setex("EXPIRE_INDEX_RENAME_KEY", "VALUE", 1);
+  ASSERT_TRUE(s.ok());
+  s = db.Rename("EXPIRE_INDEX_RENAME_KEY", "EXPIRE_INDEX_RENAMED_KEY");
+  ASSERT_TRUE(s.ok());
+  s = db.HSet("EXPIRE_INDEX_RENAME_HASH", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db.Expire("EXPIRE_INDEX_RENAME_HASH", 1), 1);
+  s = db.Rename("EXPIRE_INDEX_RENAME_HASH", "EXPIRE_INDEX_RENAMED_HASH");
+  ASSERT_TRUE(s.ok());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+  s = db.ActiveExpireCycle(1000, &expired);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(expired, 5);
+  ASSERT_EQ(db.Exists({"EXPIRE_INDEX_SETNX_KEY", "EXPIRE_INDEX_SETXX_KEY", "EXPIRE_INDEX_SETVX_KEY",
+                       "EXPIRE_INDEX_RENAMED_KEY", "EXPIRE_INDEX_RENAMED_HASH"}),
+            0);
+}
+
+// Keys, Scan, Scanx, PKPatternMatchDel and GetKeyNum on keys spread over several instances
+TEST_F(KeysTest, MultiInstanceKeyspaceTest) {
+  std::string multi_db_path = "./test_db/keys_multi_instance_test";
+  pstd::DeleteDirIfExist(multi_db_path);
+  mkdir(multi_db_path.c_str(), 0755);
+  storage::StorageOptions multi_options = options;
+  multi_options.db_instance_num = 8;
+  storage::Storage multi_db;
+  s = multi_db.Open(multi_options, multi_db_path);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> prefix_keys;
+  std::vector<std::string> all_keys;
+  int32_t ret = 0;
+  for (int i = 0; i < 300; ++i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "MULTI_PREFIX_%03d", i);
+    prefix_keys.emplace_back(buf);
+    s = multi_db.Set(buf, "VALUE");
+    ASSERT_TRUE(s.ok());
+    snprintf(buf, sizeof(buf), "MULTI_OTHER_%03d", i);
+    s = multi_db.HSet(buf, "FIELD", "VALUE", &ret);
+    ASSERT_TRUE(s.ok());
+    all_keys.emplace_back(buf);
+  }
+  all_keys.insert(all_keys.end(), prefix_keys.begin(), prefix_keys.end());
+  std::sort(all_keys.begin(), all_keys.end());
+
+  std::vector<std::string> keys;
+  s = multi_db.Keys(storage::DataType::kAll, "*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_match(keys, all_keys));
+
+  s = multi_db.Keys(storage::DataType::kAll, "MULTI_PREFIX_*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_match(keys, prefix_keys));
+
+  s = multi_db.Keys(storage::DataType::kHashes, "MULTI_PREFIX_*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(keys.empty());
+
+  // scan the prefix 7 keys at a time, the cursor must visit every key exactly once
+  std::vector<std::string> scanned_keys;
+  int64_t cursor = 0;
+  do {
+    std::vector<std::string> batch_keys;
+    cursor = multi_db.Scan(storage::DataType::kStrings, cursor, "MULTI_PREFIX_*", 7, &batch_keys);
+    ASSERT_LE(batch_keys.size(), 7);
+    scanned_keys.insert(scanned_keys.end(), batch_keys.begin(), batch_keys.end());
+  } while (cursor != 0);
+  ASSERT_TRUE(key_match(scanned_keys, prefix_keys));
+
+  std::string next_key;
+  s = multi_db.Scanx(storage::DataType::kStrings, "MULTI_PREFIX_100", "MULTI_PREFIX_*", 10, &keys, &next_key);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_match(keys, std::vector<std::string>(prefix_keys.begin() + 100, prefix_keys.begin() + 110)));
+  ASSERT_EQ(next_key, "MULTI_PREFIX_110");
+
+  std::vector<storage::KeyInfo> key_infos;
+  s = multi_db.GetKeyNum(&key_infos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(key_infos[0].keys, 300);
+  ASSERT_EQ(key_infos[1].keys, 300);
+
+  int32_t delete_count = 0;
+  s = multi_db.PKPatternMatchDel(storage::DataType::kAll, "MULTI_PREFIX_*", &delete_count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(delete_count, 300);
+  s = multi_db.Keys(storage::DataType::kAll, "*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys.size(), 300);
+
+  multi_db.Close();
+}
+
+// The key counts follow every write, a rewritten key is counted once, the metas the
+// compaction drops are taken away, and the counts are saved on close or counted again
+// in the background when they were not
+TEST_F(KeysTest, ApproximateKeyNumTest) {
+  std::string approximate_db_path = "./test_db/keys_approximate_num_test";
+  pstd::DeleteDirIfExist(approximate_db_path);
+  mkdir(approximate_db_path.c_str(), 0755);
+  storage::StorageOptions approximate_options = options;
+  approximate_options.db_instance_num = 3;
+  auto approximate_db = std::make_unique<storage::Storage>();
+  s = approximate_db->Open(approximate_options, approximate_db_path);
+  ASSERT_TRUE(s.ok());
+
+  int32_t ret = 0;
+  uint64_t len = 0;
+  for (int i = 0; i < 10; ++i) {
+    std::string key = "APPROXIMATE_STRING_" + std::to_string(i);
+    s = i < 5 ? approximate_db->Setex(key, "VALUE", 100) : approximate_db->Set(key, "VALUE");
+    ASSERT_TRUE(s.ok());
+  }
+  for (int i = 0; i < 4; ++i) {
+    s = approximate_db->HSet("APPROXIMATE_HASH_" + std::to_string(i), "FIELD", "VALUE", &ret);
+    ASSERT_TRUE(s.ok());
+  }
+  for (int i = 0; i < 3; ++i) {
+    s = approximate_db->RPush("APPROXIMATE_LIST_" + std::to_string(i), {"VALUE"}, &len);
+    ASSERT_TRUE(s.ok());
+  }
+  for (int i = 0; i < 2; ++i) {
+    s = approximate_db->ZAdd("APPROXIMATE_ZSET_" + std::to_string(i), {{1, "MEMBER"}}, &ret);
+    ASSERT_TRUE(s.ok());
+  }
+  s = approximate_db->SAdd("APPROXIMATE_SET_0", {"MEMBER"}, &ret);
+  ASSERT_TRUE(s.ok());
+
+  // in the order of GetKeyNum(): strings, hashes, lists, zsets, sets
+  uint64_t expected_expires = 5;
+  auto key_num_match = [&](const std::vector<uint64_t>& expected_keys) {
+    std::vector<storage::KeyInfo> key_infos;
+    if (!approximate_db->GetApproximateKeyNum(&key_infos).ok() || key_infos.size() != expected_keys.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < key_infos.size(); ++i) {
+      if (key_infos[i].keys != expected_keys[i]) {
+        return false;
+      }
+    }
+    return key_infos[0].expires == expected_expires && key_infos[0].avg_ttl > 0 && key_infos[0].avg_ttl <= 100;
+  };
+  auto check_key_num = [&](const std::vector<uint64_t>& expected_keys) {
+    ASSERT_TRUE(key_num_match(expected_keys));
+  };
+  check_key_num({10, 4, 3, 2, 1});
+
+  // rewrites of existing keys leave the counts alone
+  ASSERT_TRUE(approximate_db->Set("APPROXIMATE_STRING_9", "NEW_VALUE").ok());
+  ASSERT_TRUE(approximate_db->HSet("APPROXIMATE_HASH_0", "NEW_FIELD", "VALUE", &ret).ok());
+  ASSERT_TRUE(approximate_db->Append("APPROXIMATE_STRING_8", "TAIL", &ret).ok());
+  check_key_num({10, 4, 3, 2, 1});
+
+  s = approximate_db->Compact(storage::DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  check_key_num({10, 4, 3, 2, 1});
+
+  std::vector<storage::KeyInfo> exact_key_infos;
+  s = approximate_db->GetKeyNum(&exact_key_infos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(exact_key_infos[0].keys, 10);
+
+  ASSERT_EQ(approximate_db->Del({"APPROXIMATE_STRING_5", "APPROXIMATE_STRING_6", "APPROXIMATE_HASH_0"}), 3);
+  check_key_num({8, 3, 3, 2, 1});
+
+  // the expired strings the compaction drops are taken away
+  for (int i = 0; i < 3; ++i) {
+    s = approximate_db->Setex("APPROXIMATE_EXPIRED_" + std::to_string(i), "VALUE", 1);
+    ASSERT_TRUE(s.ok());
+  }
+  expected_expires = 8;
+  check_key_num({11, 3, 3, 2, 1});
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  s = approximate_db->Compact(storage::DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  expected_expires = 5;
+  check_key_num({8, 3, 3, 2, 1});
+
+  // the counts are saved on close
+  approximate_db->Close();
+  approximate_db = std::make_unique<storage::Storage>();
+  s = approximate_db->Open(approximate_options, approximate_db_path);
+  ASSERT_TRUE(s.ok());
+  check_key_num({8, 3, 3, 2, 1});
+
+  // and counted again when they are missing
+  approximate_db->Close();
+  approximate_db.reset();
+  for (int index = 0; index < 3; ++index) {
+    pstd::DeleteFile(approximate_db_path + "/" + std::to_string(index) + "/KEY_COUNTS");
+  }
+  approximate_db = std::make_unique<storage::Storage>();
+  s = approximate_db->Open(approximate_options, approximate_db_path);
+  ASSERT_TRUE(s.ok());
+  bool recounted = false;
+  for (int i = 0; i < 100 && !recounted; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    recounted = key_num_match({8, 3, 3, 2, 1});
+  }
+  ASSERT_TRUE(recounted);
+
+  approximate_db->Close();
+}
+
+// Tokens carry their whole point, the scans resume exactly after a restart
+TEST_F(KeysTest, StatelessScanCursorTest) {
+  std::string stateless_db_path = "./test_db/keys_stateless_scan_cursor_test";
+  pstd::DeleteDirIfExist(stateless_db_path);
+  mkdir(stateless_db_path.c_str(), 0755);
+  storage::StorageOptions stateless_options = options;
+  stateless_options.stateless_scan_cursors = true;
+  const int kKeyNum = 50;
+  std::vector<std::string> long_keys;
+  std::vector<std::string> fields;
+
+  auto stateless_db = std::make_unique<storage::Storage>();
+  s = stateless_db->Open(stateless_options, stateless_db_path);
+  ASSERT_TRUE(s.ok());
+  int32_t ret = 0;
+  for (int i = 0; i < kKeyNum; ++i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "STATELESS_SCAN_KEY_%02d", i);
+    long_keys.emplace_back(buf);
+    ASSERT_TRUE(stateless_db->Set(buf, "VALUE").ok());
+    snprintf(buf, sizeof(buf), "STATELESS_SCAN_FIELD_%02d", i);
+    fields.emplace_back(buf);
+    ASSERT_TRUE(stateless_db->HSet("STATELESS_SCAN_HASH", buf, "VALUE", &ret).ok());
+  }
+
+  std::vector<std::string> keys;
+  std::vector<std::string> total_keys;
+  std::string cursor = "0";
+  do {
+    cursor = stateless_db->Scan(DataType::kStrings, cursor, "STATELESS_SCAN_KEY_*", 7, &keys);
+    total_keys.insert(total_keys.end(), keys.begin(), keys.end());
+  } while (cursor != "0");
+  ASSERT_EQ(total_keys, long_keys);
+
+  std::string long_cursor = stateless_db->Scan(DataType::kStrings, "0", "STATELESS_SCAN_KEY_*", 7, &keys);
+  ASSERT_NE(long_cursor, "0");
+  ASSERT_EQ(long_cursor[0], 'k');
+  std::vector<std::string> total_long_keys = keys;
+  std::vector<storage::FieldValue> field_values;
+  std::string hash_cursor;
+  s = stateless_db->HScan("STATELESS_SCAN_HASH", "0", "*", 7, &field_values, &hash_cursor);
+  ASSERT_TRUE(s.ok());
+  ASSERT_NE(hash_cursor, "0");
+  std::vector<std::string> total_fields;
+  for (const auto& field_value : field_values) {
+    total_fields.push_back(field_value.field);
+  }
+
+  // the literal prefix of the pattern is left out of the token
+  ASSERT_LT(long_cursor.size(), long_keys.front().size());
+
+  // a token of another scan or a forged one starts the scan over
+  stateless_db->Scan(DataType::kStrings, long_cursor, "STATELESS_SCAN_*", 7, &keys);
+  ASSERT_EQ(keys.front(), long_keys.front());
+  std::string forged_cursor = long_cursor;
+  forged_cursor[1] = forged_cursor[1] == 'A' ? 'B' : 'A';
+  stateless_db->Scan(DataType::kStrings, forged_cursor, "STATELESS_SCAN_KEY_*", 7, &keys);
+  ASSERT_EQ(keys.front(), long_keys.front());
+
+  // the int64_t cursors stay numbered
+  int64_t numbered_cursor = stateless_db->Scan(DataType::kStrings, 0, "STATELESS_SCAN_KEY_*", 7, &keys);
+  ASSERT_EQ(numbered_cursor, 7);
+
+  // the scans go on after a restart, without returning a key twice
+  stateless_db->Close();
+  stateless_db = std::make_unique<storage::Storage>();
+  s = stateless_db->Open(stateless_options, stateless_db_path);
+  ASSERT_TRUE(s.ok());
+
+  while (long_cursor != "0") {
+    long_cursor = stateless_db->Scan(DataType::kStrings, long_cursor, "STATELESS_SCAN_KEY_*", 7, &keys);
+    total_long_keys.insert(total_long_keys.end(), keys.begin(), keys.end());
+  }
+  ASSERT_EQ(total_long_keys, long_keys);
+
+  while (hash_cursor != "0") {
+    s = stateless_db->HScan("STATELESS_SCAN_HASH", hash_cursor, "*", 7, &field_values, &hash_cursor);
+    ASSERT_TRUE(s.ok());
+    for (const auto& field_value : field_values) {
+      total_fields.push_back(field_value.field);
+    }
+  }
+  ASSERT_EQ(total_fields, fields);
+
+  // the tokens signed with another secret start the scans over
+  long_cursor = stateless_db->Scan(DataType::kStrings, "0", "STATELESS_SCAN_KEY_*", 7, &keys);
+  stateless_db->Close();
+  stateless_options.scan_cursor_secret = "STATELESS_SCAN_SECRET";
+  stateless_db = std::make_unique<storage::Storage>();
+  s = stateless_db->Open(stateless_options, stateless_db_path);
+  ASSERT_TRUE(s.ok());
+  stateless_db->Scan(DataType::kStrings, long_cursor, "STATELESS_SCAN_KEY_*", 7, &keys);
+  ASSERT_EQ(keys.front(), long_keys.front());
+
+  stateless_db->Close();
+}
+
+// Values above min_blob_size live in blob files, reads and the meta filter still see them
+TEST_F(KeysTest, BlobValueTest) {
+  std::string blob_db_path = "./test_db/keys_blob_test";
+  pstd::DeleteDirIfExist(blob_db_path);
+  mkdir(blob_db_path.c_str(), 0755);
+  storage::StorageOptions blob_options = options;
+  blob_options.options.enable_blob_files = true;
+  blob_options.options.min_blob_size = 1024;
+  storage::Storage blob_db;
+  s = blob_db.Open(blob_options, blob_db_path);
+  ASSERT_TRUE(s.ok());
+
+  int32_t ret = 0;
+  std::string value;
+  std::string big_value(16 << 10, 'b');
+  ASSERT_TRUE(blob_db.Set("BLOB_KEY", big_value).ok());
+  ASSERT_TRUE(blob_db.Setex("BLOB_EXPIRE_KEY", big_value, 1).ok());
+  ASSERT_TRUE(blob_db.HSet("BLOB_HASH_KEY", "BIG_FIELD", big_value, &ret).ok());
+  ASSERT_TRUE(blob_db.HSet("BLOB_HASH_KEY", "SMALL_FIELD", "VALUE", &ret).ok());
+
+  auto& inst = blob_db.GetDBInstance(std::string("BLOB_KEY"));
+  ASSERT_EQ(inst.get(), blob_db.GetDBInstance(std::string("BLOB_EXPIRE_KEY")).get());
+  ASSERT_EQ(inst.get(), blob_db.GetDBInstance(std::string("BLOB_HASH_KEY")).get());
+  rocksdb::DB* rocks = inst->GetDB();
+  const auto& handles = inst->GetColumnFamilyHandles();
+  for (auto cf : {storage::kMetaCF, storage::kHashesDataCF}) {
+    ASSERT_TRUE(rocks->Flush(rocksdb::FlushOptions(), handles[cf]).ok());
+    uint64_t num_blob_files = 0;
+    ASSERT_TRUE(rocks->GetIntProperty(handles[cf], "rocksdb.num-blob-files", &num_blob_files));
+    ASSERT_GT(num_blob_files, 0);
+  }
+
+  ASSERT_TRUE(blob_db.Get("BLOB_KEY", &value).ok());
+  ASSERT_EQ(value, big_value);
+  ASSERT_TRUE(blob_db.HGet("BLOB_HASH_KEY", "BIG_FIELD", &value).ok());
+  ASSERT_EQ(value, big_value);
+  ASSERT_TRUE(blob_db.HGet("BLOB_HASH_KEY", "SMALL_FIELD", &value).ok());
+  ASSERT_EQ(value, "VALUE");
+
+  // the meta filter reads the expired string back from its blob file and drops it
+  std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+  ASSERT_TRUE(rocks->CompactRange(rocksdb::CompactRangeOptions(), handles[storage::kMetaCF], nullptr, nullptr).ok());
+  std::unique_ptr<rocksdb::Iterator> iter(rocks->NewIterator(rocksdb::ReadOptions(), handles[storage::kMetaCF]));
+  int64_t meta_keys = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ++meta_keys;
+  }
+  ASSERT_EQ(meta_keys, 2);
+  iter.reset();
+  ASSERT_TRUE(blob_db.Get("BLOB_EXPIRE_KEY", &value).IsNotFound());
+
+  blob_db.Close();
+}
+
+// Column families take their own compression levels, INFO compression reports every one of them
+TEST_F(KeysTest, CompressionPerLevelTest) {
+  std::string compression_db_path = "./test_db/keys_compression_test";
+  pstd::DeleteDirIfExist(compression_db_path);
+  mkdir(compression_db_path.c_str(), 0755);
+  storage::StorageOptions compression_options = options;
+  compression_options.options.compression_per_level = {rocksdb::kNoCompression, rocksdb::kNoCompression,
+                                                        rocksdb::kSnappyCompression};
+  compression_options.options.bottommost_compression = rocksdb::kZSTD;
+  compression_options.cf_compression_per_level["hash_data_cf"] = {rocksdb::kNoCompression};
+  storage::Storage compression_db;
+  s = compression_db.Open(compression_options, compression_db_path);
+  ASSERT_TRUE(s.ok());
+
+  int32_t ret = 0;
+  for (int i = 0; i < 100; ++i) {
+    std::string field = "FIELD_" + std::to_string(i);
+    ASSERT_TRUE(compression_db.HSet("COMPRESSION_HASH", field, std::string(100, 'v'), &ret).ok());
+  }
+  auto& inst = compression_db.GetDBInstance(std::string("COMPRESSION_HASH"));
+  rocksdb::DB* rocks = inst->GetDB();
+  const auto& handles = inst->GetColumnFamilyHandles();
+  ASSERT_EQ(rocks->GetOptions(handles[storage::kMetaCF]).compression_per_level.size(), 3);
+  ASSERT_EQ(rocks->GetOptions(handles[storage::kMetaCF]).bottommost_compression, rocksdb::kZSTD);
+  ASSERT_EQ(rocks->GetOptions(handles[storage::kHashesDataCF]).compression_per_level,
+            std::vector<rocksdb::CompressionType>{rocksdb::kNoCompression});
+  ASSERT_EQ(rocks->GetOptions(handles[storage::kHashesDataCF]).bottommost_compression,
+            rocksdb::kDisableCompressionOption);
+  ASSERT_TRUE(rocks->Flush(rocksdb::FlushOptions(), handles[storage::kHashesDataCF]).ok());
+
+  std::string info;
+  compression_db.GetCompressionInfo(info);
+  ASSERT_NE(info.find("hash_data_cf_raw_bytes:"), std::string::npos);
+  ASSERT_NE(info.find("hash_data_cf_compression_ratio_level0:"), std::string::npos);
+  ASSERT_NE(info.find("default_compression_ratio:"), std::string::npos);
+
+  compression_db.Close();
+}
+
+TEST_F(KeysTest, MigrateSlotsTest) {
+  std::string reshard_db_path = "./test_db/keys_reshard_test";
+  pstd::DeleteDirIfExist(reshard_db_path);
+  mkdir(reshard_db_path.c_str(), 0755);
+  storage::StorageOptions reshard_options = options;
+  const int kKeyNum = 200;
+  auto check_keys = [&](storage::Storage& reshard_db) {
+    std::string value;
+    int32_t len = 0;
+    std::vector<std::string> members;
+    double score = 0;
+    for (int i = 0; i < kKeyNum; ++i) {
+      std::string index = std::to_string(i);
+      if (i != 0) {
+        ASSERT_TRUE(reshard_db.Get("RESHARD_STRING_" + index, &value).ok());
+        ASSERT_EQ(value, "VALUE_" + index);
+      }
+      ASSERT_TRUE(reshard_db.HLen("RESHARD_HASH_" + index, &len).ok());
+      ASSERT_EQ(len, i == 0 ? 3 : 2);
+      members.clear();
+      ASSERT_TRUE(reshard_db.SMembers("RESHARD_SET_" + index, &members).ok());
+      ASSERT_EQ(members.size(), 2);
+      members.clear();
+      ASSERT_TRUE(reshard_db.LRange("RESHARD_LIST_" + index, 0, -1, &members).ok());
+      ASSERT_EQ(members, (std::vector<std::string>{"A", "B"}));
+      ASSERT_TRUE(reshard_db.ZScore("RESHARD_ZSET_" + index, "M", &score).ok());
+      ASSERT_EQ(score, i);
+      ASSERT_GT(reshard_db.TTL("RESHARD_EXPIRE_" + index), 0);
+    }
+    ASSERT_TRUE(reshard_db.Get("RESHARD_STRING_0", &value).IsNotFound());
+    ASSERT_TRUE(reshard_db.Get("RESHARD_NEW_KEY", &value).ok());
+  };
+
+  {
+    reshard_options.db_instance_num = 3;
+    storage::Storage reshard_db;
+    s = reshard_db.Open(reshard_options, reshard_db_path);
+    ASSERT_TRUE(s.ok());
+    const auto& indexer = reshard_db.GetSlotIndexer();
+    ASSERT_EQ(indexer.GetSlotNum() % 3, 0);
+
+    int32_t ret = 0;
+    uint64_t list_len = 0;
+    for (int i = 0; i < kKeyNum; ++i) {
+      std::string index = std::to_string(i);
+      ASSERT_TRUE(reshard_db.Set("RESHARD_STRING_" + index, "VALUE_" + index).ok());
+      ASSERT_TRUE(reshard_db.HSet("RESHARD_HASH_" + index, "F1", "V1", &ret).ok());
+      ASSERT_TRUE(reshard_db.HSet("RESHARD_HASH_" + index, "F2", "V2", &ret).ok());
+      ASSERT_TRUE(reshard_db.SAdd("RESHARD_SET_" + index, {"A", "B"}, &ret).ok());
+      ASSERT_TRUE(reshard_db.RPush("RESHARD_LIST_" + index, {"A", "B"}, &list_len).ok());
+      ASSERT_TRUE(reshard_db.ZAdd("RESHARD_ZSET_" + index, {{static_cast<double>(i), "M"}}, &ret).ok());
+      ASSERT_TRUE(reshard_db.Setex("RESHARD_EXPIRE_" + index, "VALUE", 1000).ok());
+    }
+
+    // Writes done between the snapshot copy and the switch-over are copied again, more than
+    // can be copied with the commands blocked take one more round first
+    const int kBulkKeyNum = 4000;
+    int calls = 0;
+    auto runner = [&](const std::function<storage::Status()>& func) {
+      if (++calls == 2) {
+        int32_t field_ret = 0;
+        reshard_db.HSet("RESHARD_HASH_0", "F3", "V3", &field_ret);
+        reshard_db.Del({"RESHARD_STRING_0"});
+        reshard_db.Set("RESHARD_NEW_KEY", "VALUE");
+        for (int i = 0; i < kBulkKeyNum; ++i) {
+          reshard_db.Set("BULK_" + std::to_string(i), "VALUE");
+        }
+      }
+      return func();
+    };
+    s = reshard_db.MigrateSlots(indexer.GetSlotsOf(0), 1, runner);
+    ASSERT_TRUE(s.ok()) << s.ToString();
+    ASSERT_EQ(calls, 4);
+    ASSERT_TRUE(indexer.GetSlotsOf(0).empty());
+    check_keys(reshard_db);
+    std::string bulk_value;
+    for (int i = 0; i < kBulkKeyNum; ++i) {
+      ASSERT_TRUE(reshard_db.Get("BULK_" + std::to_string(i), &bulk_value).ok());
+    }
+
+    // The moved keys are removed from the source instance
+    std::unique_ptr<rocksdb::Iterator> iter(reshard_db.GetDBByIndex(0)->NewIterator(rocksdb::ReadOptions()));
+    iter->SeekToFirst();
+    ASSERT_FALSE(iter->Valid());
+
+    std::vector<std::string> keys;
+    ASSERT_TRUE(reshard_db.Keys(storage::DataType::kAll, "RESHARD_*", &keys).ok());
+    std::set<std::string> unique_keys(keys.begin(), keys.end());
+    ASSERT_EQ(keys.size(), unique_keys.size());
+    ASSERT_EQ(keys.size(), 6 * kKeyNum);
+
+    ASSERT_TRUE(reshard_db.MigrateSlots({indexer.GetSlotNum()}, 1, runner).IsInvalidArgument());
+    ASSERT_TRUE(reshard_db.MigrateSlots({0}, 3, runner).IsInvalidArgument());
+    reshard_db.Close();
+  }
+
+  {
+    // The slot map is persisted, the new instance starts with no slot
+    reshard_options.db_instance_num = 4;
+    storage::Storage reshard_db;
+    s = reshard_db.Open(reshard_options, reshard_db_path);
+    ASSERT_TRUE(s.ok());
+    const auto& indexer = reshard_db.GetSlotIndexer();
+    ASSERT_TRUE(indexer.GetSlotsOf(0).empty());
+    ASSERT_TRUE(indexer.GetSlotsOf(3).empty());
+    check_keys(reshard_db);
+
+    s = reshard_db.BalanceSlots([](const std::function<storage::Status()>& func) { return func(); });
+    ASSERT_TRUE(s.ok()) << s.ToString();
+    for (uint32_t inst = 0; inst < 4; ++inst) {
+      auto slot_count = static_cast<int64_t>(indexer.GetSlotsOf(inst).size());
+      ASSERT_LE(std::abs(slot_count - indexer.GetSlotNum() / 4), 1);
+    }
+    check_keys(reshard_db);
+    reshard_db.Close();
+  }
+
+  {
+    // Without the slot map an instance can't be added, the keys routed by crc % 4
+    // would be looked up in the wrong instances
+    pstd::DeleteFile(reshard_db_path + "/slot_map");
+    reshard_options.db_instance_num = 5;
+    storage::Storage reshard_db;
+    s = reshard_db.Open(reshard_options, reshard_db_path);
+    ASSERT_TRUE(s.IsInvalidArgument());
+  }
+}
+
+TEST_F(KeysTest, DataPathsTest) {
+  std::string data_db_path = "./test_db/keys_data_paths_test/db/";
+  std::string data_path_a = "./test_db/keys_data_paths_test/disk_a/";
+  std::string data_path_b = "./test_db/keys_data_paths_test/disk_b/";
+  std::string checkpoint_path = "./test_db/keys_data_paths_test/checkpoint";
+  pstd::DeleteDirIfExist("./test_db/keys_data_paths_test");
+  storage::StorageOptions data_options = options;
+  data_options.db_instance_num = 3;
+  data_options.data_paths = {{data_path_a, 1}, {data_path_b, 2}};
+  const int kKeyNum = 100;
+
+  {
+    storage::Storage data_db;
+    s = data_db.Open(data_options, data_db_path);
+    ASSERT_TRUE(s.ok());
+    // the smooth weighted round-robin of weights 1 and 2 goes b, a, b
+    ASSERT_TRUE(pstd::FileExists(data_path_b + "0/CURRENT"));
+    ASSERT_TRUE(pstd::FileExists(data_path_a + "1/CURRENT"));
+    ASSERT_TRUE(pstd::FileExists(data_path_b + "2/CURRENT"));
+    ASSERT_EQ(data_db.GetDataPaths(), (std::vector<std::string>{data_db_path, data_path_b, data_path_a}));
+
+    for (int i = 0; i < kKeyNum; ++i) {
+      ASSERT_TRUE(data_db.Set("DATA_PATH_KEY_" + std::to_string(i), "VALUE").ok());
+    }
+    auto io_stats = data_db.GetDataPathIOStats();
+    ASSERT_EQ(io_stats.size(), 3);
+    ASSERT_EQ(io_stats[0].instances, 0);
+    ASSERT_EQ(io_stats[1].instances, 2);
+    ASSERT_EQ(io_stats[2].instances, 1);
+    ASSERT_GT(io_stats[1].wal_bytes + io_stats[2].wal_bytes, 0);
+
+    pstd::CreatePath(checkpoint_path);
+    for (auto& future : data_db.CreateCheckpoint(checkpoint_path)) {
+      ASSERT_TRUE(future.get().ok());
+    }
+    data_db.Close();
+  }
+
+  // the saved placement wins over the configured weights
+  data_options.data_paths = {{data_path_a, 2}, {data_path_b, 1}};
+  {
+    storage::Storage data_db;
+    s = data_db.Open(data_options, data_db_path);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(data_db.GetDataPaths(), (std::vector<std::string>{data_db_path, data_path_b, data_path_a}));
+    ASSERT_TRUE(data_db.Set("DATA_PATH_KEY_0", "NEW_VALUE").ok());
+    data_db.Close();
+  }
+
+  // the checkpoint is loaded into the data paths of the instances
+  {
+    storage::Storage data_db;
+    for (auto& future : data_db.LoadCheckpoint(data_options, checkpoint_path, data_db_path)) {
+      ASSERT_TRUE(future.get().ok());
+    }
+    s = data_db.Open(data_options, data_db_path);
+    ASSERT_TRUE(s.ok());
+    std::string value;
+    for (int i = 0; i < kKeyNum; ++i) {
+      ASSERT_TRUE(data_db.Get("DATA_PATH_KEY_" + std::to_string(i), &value).ok());
+      ASSERT_EQ(value, "VALUE");
+    }
+    data_db.Close();
+  }
+
+  // the instances created before the data paths were configured stay in the db path
+  std::string legacy_db_path = "./test_db/keys_data_paths_test/legacy_db/";
+  std::string data_path_c = "./test_db/keys_data_paths_test/disk_c/";
+  storage::StorageOptions legacy_options = data_options;
+  legacy_options.data_paths.clear();
+  {
+    storage::Storage data_db;
+    ASSERT_TRUE(data_db.Open(legacy_options, legacy_db_path).ok());
+    ASSERT_TRUE(data_db.Set("LEGACY_KEY", "VALUE").ok());
+    data_db.Close();
+  }
+  pstd::DeleteFile(legacy_db_path + "data_paths");
+  legacy_options.db_instance_num = 4;
+  legacy_options.data_paths = {{data_path_c, 1}};
+  {
+    storage::Storage data_db;
+    ASSERT_TRUE(data_db.Open(legacy_options, legacy_db_path).ok());
+    ASSERT_EQ(data_db.GetDataPaths(), (std::vector<std::string>{legacy_db_path, data_path_c}));
+    ASSERT_EQ(data_db.GetDataPathIOStats()[0].instances, 3);
+    data_db.Close();
+  }
+}
+
+// Every instance records its key format, keys holding \0 bytes keep their tail
+// and an instance of a newer format is refused
+TEST_F(KeysTest, KeyFormatTest) {
+  std::string format_db_path = "./test_db/keys_format_test";
+  pstd::DeleteDirIfExist(format_db_path);
+  mkdir(format_db_path.c_str(), 0755);
+  std::string format_path = format_db_path + "/0/KEY_FORMAT";
+  std::string zero_key("A\0B\0C", 5);
+  std::string cut_key("A\0B\0", 4);
+  std::string content;
+
+  {
+    storage::Storage format_db;
+    ASSERT_TRUE(format_db.Open(options, format_db_path).ok());
+    ASSERT_TRUE(format_db.Set(zero_key, "VALUE").ok());
+    format_db.Close();
+  }
+  ASSERT_TRUE(rocksdb::ReadFileToString(rocksdb::Env::Default(), format_path, &content).ok());
+  ASSERT_EQ(content, "2\n");
+
+  {
+    storage::Storage format_db;
+    ASSERT_TRUE(format_db.Open(options, format_db_path).ok());
+    std::string value;
+    ASSERT_TRUE(format_db.Get(zero_key, &value).ok());
+    ASSERT_EQ(value, "VALUE");
+    ASSERT_TRUE(format_db.Get(cut_key, &value).IsNotFound());
+    format_db.Close();
+  }
+
+  ASSERT_TRUE(rocksdb::WriteStringToFile(rocksdb::Env::Default(), "3\n", format_path, true).ok());
+  storage::Storage format_db;
+  ASSERT_FALSE(format_db.Open(options, format_db_path).ok());
+}
+
 int main(int argc, char** argv) {
   if (!pstd::FileExists("./log")) {
     pstd::CreatePath("./log");
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <thread>
 
+#include <fmt/core.h>
 #include "src/base_key_format.h"
 #include "src/coding.h"
 #include "src/lists_filter.h"
@@ -245,6 +246,78 @@ TEST_F(ListsFilterTest, DataFilterTest) {
   ASSERT_TRUE(s.ok());
 }
 
+// One filter looking up the meta keys of many user keys in turn
+TEST_F(ListsFilterTest, DataFilterMetaCursorTest) {
+  char str[8];
+  bool filter_result;
+  bool value_changed;
+  std::string new_value;
+
+  // Every third key has no meta key
+  auto user_key = [](int idx) { return fmt::format("CURSOR_TEST_KEY_{:03d}", idx); };
+  std::vector<uint64_t> versions(100, 1);
+  for (int idx = 0; idx < 100; ++idx) {
+    BaseMetaKey bmk(user_key(idx));
+    if (idx % 3 == 0) {
+      s = meta_db->Delete(rocksdb::WriteOptions(), handles[0], bmk.Encode());
+    } else {
+      storage::EncodeFixed64(str, 1);
+      ListsMetaValue lists_meta_value(rocksdb::Slice(str, sizeof(uint64_t)));
+      versions[idx] = lists_meta_value.UpdateVersion();
+      s = meta_db->Put(rocksdb::WriteOptions(), handles[0], bmk.Encode(), lists_meta_value.Encode());
+    }
+    ASSERT_TRUE(s.ok());
+  }
+
+  // The keys come in order, near keys are reached by stepping and far ones by seeking
+  auto lists_data_filter = std::make_unique<ListsDataFilter>(meta_db, &handles, DataType::kLists);
+  std::vector<int> order;
+  for (int idx = 0; idx < 40; ++idx) {
+    order.push_back(idx);
+  }
+  order.insert(order.end(), {70, 71, 99, 50, 3, 4});
+  for (int idx : order) {
+    ListsDataKey lists_data_key(user_key(idx), versions[idx], 1);
+    filter_result =
+        lists_data_filter->Filter(0, lists_data_key.Encode(), "FILTER_TEST_VALUE", &new_value, &value_changed);
+    ASSERT_EQ(filter_result, idx % 3 == 0);
+  }
+
+  // The decision does not need the value
+  ListsDataKey kept_data_key(user_key(10), versions[10], 1);
+  ASSERT_EQ(lists_data_filter->FilterBlobByKey(0, kept_data_key.Encode(), &new_value, nullptr),
+            rocksdb::CompactionFilter::Decision::kKeep);
+  ListsDataKey removed_data_key(user_key(12), versions[12], 1);
+  ASSERT_EQ(lists_data_filter->FilterBlobByKey(0, removed_data_key.Encode(), &new_value, nullptr),
+            rocksdb::CompactionFilter::Decision::kRemove);
+
+  // A key recreated after the cursor was positioned is judged on its current meta: the
+  // cursor still sees key 15 deleted, yet its new data is kept
+  auto stale_filter = std::make_unique<ListsDataFilter>(meta_db, &handles, DataType::kLists);
+  ListsDataKey first_data_key(user_key(1), versions[1], 1);
+  filter_result = stale_filter->Filter(0, first_data_key.Encode(), "FILTER_TEST_VALUE", &new_value, &value_changed);
+  ASSERT_EQ(filter_result, false);
+  storage::EncodeFixed64(str, 1);
+  ListsMetaValue recreated_meta_value(rocksdb::Slice(str, sizeof(uint64_t)));
+  versions[15] = recreated_meta_value.UpdateVersion();
+  s = meta_db->Put(rocksdb::WriteOptions(), handles[0], BaseMetaKey(user_key(15)).Encode(),
+                   recreated_meta_value.Encode());
+  ASSERT_TRUE(s.ok());
+  ListsDataKey recreated_data_key(user_key(15), versions[15], 1);
+  filter_result =
+      stale_filter->Filter(0, recreated_data_key.Encode(), "FILTER_TEST_VALUE", &new_value, &value_changed);
+  ASSERT_EQ(filter_result, false);
+  ListsDataKey deleted_data_key(user_key(18), versions[18], 1);
+  filter_result = stale_filter->Filter(0, deleted_data_key.Encode(), "FILTER_TEST_VALUE", &new_value, &value_changed);
+  ASSERT_EQ(filter_result, true);
+
+  for (int idx = 0; idx < 100; ++idx) {
+    BaseMetaKey bmk(user_key(idx));
+    s = meta_db->Delete(rocksdb::WriteOptions(), handles[0], bmk.Encode());
+    ASSERT_TRUE(s.ok());
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -4,15 +4,24 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <iostream>
 #include <thread>
 
 #include "pstd/env.h"
 #include "pstd/log.h"
+#include "src/base_data_value_format.h"
+#include "src/base_key_format.h"
+#include "src/lists_data_key_format.h"
+#include "src/lists_meta_value_format.h"
+#include "src/redis.h"
 #include "storage/storage.h"
 #include "storage/util.h"
 
-using namespace storage;
+
+using storage::Slice;
+using storage::Status;
+using storage::StorageOptions;
 
 static bool elements_match(storage::Storage* const db, const Slice& key,
                            const std::vector<std::string>& expect_elements) {
@@ -2710,6 +2719,333 @@ TEST_F(ListsTest, RPushxTest) {  // NOLINT
   ASSERT_TRUE(s.ok());
 }
 
+// Chunked lists
+TEST_F(ListsTest, ChunkedListMiddleOperationsTest) {  // NOLINT
+  uint64_t num;
+  int64_t ret;
+  std::string element;
+  std::vector<std::string> model;
+
+  // spans several chunks
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back("v" + std::to_string(i));
+  }
+  s = db.RPush("GP1_CHUNKED_KEY", values, &num);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(num, 1000);
+  model = values;
+
+  // keep inserting at the same spot, the chunk there is split again and again
+  // until no free chunk id is left between its neighbours
+  for (int i = 0; i < 1500; ++i) {
+    s = db.LInsert("GP1_CHUNKED_KEY", storage::After, "v500", "n" + std::to_string(i), &ret);
+    ASSERT_TRUE(s.ok());
+    auto pivot = std::find(model.begin(), model.end(), "v500");
+    model.insert(pivot + 1, "n" + std::to_string(i));
+    ASSERT_EQ(ret, static_cast<int64_t>(model.size()));
+  }
+  ASSERT_TRUE(len_match(&db, "GP1_CHUNKED_KEY", model.size()));
+  ASSERT_TRUE(elements_match(&db, "GP1_CHUNKED_KEY", model));
+
+  s = db.LInsert("GP1_CHUNKED_KEY", storage::Before, "v0", "head", &ret);
+  ASSERT_TRUE(s.ok());
+  model.insert(model.begin(), "head");
+  s = db.LInsert("GP1_CHUNKED_KEY", storage::After, "v999", "tail", &ret);
+  ASSERT_TRUE(s.ok());
+  model.emplace_back("tail");
+  s = db.LInsert("GP1_CHUNKED_KEY", storage::After, "missing", "x", &ret);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(ret, -1);
+
+  for (int64_t index : {0, 1, 127, 128, 501, 1200, 2000, -1, -128, -129}) {
+    s = db.LIndex("GP1_CHUNKED_KEY", index, &element);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(element, model[index >= 0 ? index : model.size() + index]);
+  }
+
+  for (int64_t index : {3, 700, 1800, -5}) {
+    s = db.LSet("GP1_CHUNKED_KEY", index, "set" + std::to_string(index));
+    ASSERT_TRUE(s.ok());
+    model[index >= 0 ? index : model.size() + index] = "set" + std::to_string(index);
+  }
+  ASSERT_TRUE(elements_match(&db, "GP1_CHUNKED_KEY", model));
+
+  std::vector<std::string> range;
+  s = db.LRange("GP1_CHUNKED_KEY", 120, 400, &range);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(elements_match(range, std::vector<std::string>(model.begin() + 120, model.begin() + 401)));
+
+  // LREM with a negative count scans from the tail, then drop half of the inserted elements
+  s = db.LRem("GP1_CHUNKED_KEY", -600, "n7", &num);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(num, 1);
+  model.erase(std::find(model.begin(), model.end(), "n7"));
+  for (int i = 0; i < 1500; i += 2) {
+    s = db.LRem("GP1_CHUNKED_KEY", 0, "n" + std::to_string(i), &num);
+    ASSERT_TRUE(s.ok());
+    model.erase(std::remove(model.begin(), model.end(), "n" + std::to_string(i)), model.end());
+  }
+  ASSERT_TRUE(len_match(&db, "GP1_CHUNKED_KEY", model.size()));
+  ASSERT_TRUE(elements_match(&db, "GP1_CHUNKED_KEY", model));
+
+  s = db.LTrim("GP1_CHUNKED_KEY", 65, -70);
+  ASSERT_TRUE(s.ok());
+  model = std::vector<std::string>(model.begin() + 65, model.end() - 69);
+  ASSERT_TRUE(len_match(&db, "GP1_CHUNKED_KEY", model.size()));
+  ASSERT_TRUE(elements_match(&db, "GP1_CHUNKED_KEY", model));
+
+  std::vector<std::string> popped;
+  s = db.LPop("GP1_CHUNKED_KEY", 200, &popped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(elements_match(popped, std::vector<std::string>(model.begin(), model.begin() + 200)));
+  model.erase(model.begin(), model.begin() + 200);
+  popped.clear();
+  s = db.RPop("GP1_CHUNKED_KEY", 3, &popped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(elements_match(popped, {model[model.size() - 1], model[model.size() - 2], model[model.size() - 3]}));
+  model.resize(model.size() - 3);
+
+  s = db.RPoplpush("GP1_CHUNKED_KEY", "GP1_CHUNKED_KEY", &element);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(element, model.back());
+  model.insert(model.begin(), model.back());
+  model.pop_back();
+  ASSERT_TRUE(len_match(&db, "GP1_CHUNKED_KEY", model.size()));
+  ASSERT_TRUE(elements_match(&db, "GP1_CHUNKED_KEY", model));
+  // the chunk index follows the splits, merges and trims above
+  for (size_t pos = 0; pos < model.size(); ++pos) {
+    s = db.LIndex("GP1_CHUNKED_KEY", static_cast<int64_t>(pos), &element);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(element, model[pos]);
+  }
+
+  // ***************** Group 2 Test *****************
+  // rotate a list that fits in a single chunk
+  s = db.RPush("GP2_CHUNKED_KEY", {"a", "b", "c"}, &num);
+  ASSERT_TRUE(s.ok());
+  s = db.RPoplpush("GP2_CHUNKED_KEY", "GP2_CHUNKED_KEY", &element);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(element, "c");
+  ASSERT_TRUE(elements_match(&db, "GP2_CHUNKED_KEY", {"c", "a", "b"}));
+  s = db.LTrim("GP2_CHUNKED_KEY", 1, 1);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(elements_match(&db, "GP2_CHUNKED_KEY", {"a"}));
+
+  // ***************** Group 3 Test *****************
+  // a list counted by several groups of the chunk index
+  std::vector<std::string> head_values;
+  std::vector<std::string> tail_values;
+  for (int i = 0; i < 40000; ++i) {
+    head_values.push_back("h" + std::to_string(i));
+    tail_values.push_back("t" + std::to_string(i));
+  }
+  s = db.LPush("GP3_CHUNKED_KEY", head_values, &num);
+  ASSERT_TRUE(s.ok());
+  s = db.RPush("GP3_CHUNKED_KEY", tail_values, &num);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(num, 80000);
+  auto expected = [&](int64_t pos) {
+    return pos < 40000 ? "h" + std::to_string(39999 - pos) : "t" + std::to_string(pos - 40000);
+  };
+  for (int64_t pos : {0, 1, 33000, 39999, 40000, 40001, 45000, 79999}) {
+    s = db.LIndex("GP3_CHUNKED_KEY", pos, &element);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(element, expected(pos));
+  }
+  s = db.LSet("GP3_CHUNKED_KEY", 70000, "set");
+  ASSERT_TRUE(s.ok());
+  s = db.LIndex("GP3_CHUNKED_KEY", -10000, &element);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(element, "set");
+  popped.clear();
+  s = db.LPop("GP3_CHUNKED_KEY", 50000, &popped);
+  ASSERT_TRUE(s.ok());
+  for (int64_t pos : {0, 1, 10000, 29999}) {
+    s = db.LIndex("GP3_CHUNKED_KEY", pos, &element);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(element, pos == 20000 ? "set" : expected(pos + 50000));
+  }
+}
+
+// Collects what a streaming read emits, refusing elements past limit
+class CollectSink : public storage::ElementSink {
+ public:
+  Status Begin(uint64_t n) override {
+    begun = true;
+    count = n;
+    return Status::OK();
+  }
+  Status Append(const Slice& element) override {
+    if (elements.size() == limit) {
+      return Status::Incomplete("limit");
+    }
+    elements.push_back(element.ToString());
+    return Status::OK();
+  }
+  Status AppendScore(double score) override { return Append(std::to_string(static_cast<int64_t>(score))); }
+
+  size_t limit = SIZE_MAX;
+  bool begun = false;
+  uint64_t count = 0;
+  std::vector<std::string> elements;
+};
+
+// LRange streamed into a sink
+TEST_F(ListsTest, LRangeSinkTest) {
+  uint64_t num;
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back("E" + std::to_string(i));
+  }
+  s = db.RPush("LRANGE_SINK_KEY", values, &num);
+  ASSERT_TRUE(s.ok());
+
+  for (auto [start, stop] : std::vector<std::pair<int64_t, int64_t>>{{0, -1}, {10, 500}, {-3, -1}, {990, 2000}}) {
+    std::vector<std::string> expected;
+    s = db.LRange("LRANGE_SINK_KEY", start, stop, &expected);
+    ASSERT_TRUE(s.ok());
+    CollectSink sink;
+    s = db.LRange("LRANGE_SINK_KEY", start, stop, &sink);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(sink.count, expected.size());
+    ASSERT_EQ(sink.elements, expected);
+  }
+
+  CollectSink empty;
+  s = db.LRange("LRANGE_SINK_KEY", 5, 1, &empty);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(empty.begun);
+  ASSERT_EQ(empty.count, 0);
+
+  CollectSink limited;
+  limited.limit = 3;
+  s = db.LRange("LRANGE_SINK_KEY", 0, -1, &limited);
+  ASSERT_TRUE(s.IsIncomplete());
+  ASSERT_EQ(limited.elements.size(), 3);
+
+  CollectSink not_found;
+  s = db.LRange("LRANGE_SINK_NOT_EXIST_KEY", 0, -1, &not_found);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_FALSE(not_found.begun);
+}
+
+// Writes key as a list of the element per key encoding, the layout lists had before chunking
+static void put_legacy_list(storage::Storage* const db, const std::string& key,
+                            const std::vector<std::string>& elements) {
+  auto& inst = db->GetDBInstance(key);
+  rocksdb::DB* rocks = inst->GetDB();
+  const auto& handles = inst->GetColumnFamilyHandles();
+  char str[8];
+  storage::EncodeFixed64(str, elements.size());
+  storage::ListsMetaValue lists_meta_value(Slice(str, sizeof(uint64_t)));
+  uint64_t version = lists_meta_value.UpdateVersion();
+  for (size_t i = 0; i < elements.size(); ++i) {
+    storage::ListsDataKey lists_data_key(key, version, storage::InitalLeftIndex + i + 1);
+    storage::BaseDataValue data_value(elements[i]);
+    ASSERT_TRUE(rocks->Put(rocksdb::WriteOptions(), handles[storage::kListsDataCF], lists_data_key.Encode(),
+                           data_value.Encode())
+                    .ok());
+  }
+  lists_meta_value.ModifyRightIndex(elements.size());
+  storage::BaseMetaKey base_meta_key(key);
+  ASSERT_TRUE(
+      rocks->Put(rocksdb::WriteOptions(), handles[storage::kMetaCF], base_meta_key.Encode(), lists_meta_value.Encode())
+          .ok());
+}
+
+// Number of data keys under the current version of the list key
+static size_t lists_data_keys(storage::Storage* const db, const std::string& key) {
+  auto& inst = db->GetDBInstance(key);
+  rocksdb::DB* rocks = inst->GetDB();
+  const auto& handles = inst->GetColumnFamilyHandles();
+  std::string meta_value;
+  storage::BaseMetaKey base_meta_key(key);
+  if (!rocks->Get(rocksdb::ReadOptions(), handles[storage::kMetaCF], base_meta_key.Encode(), &meta_value).ok()) {
+    return 0;
+  }
+  storage::ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+  storage::ListsDataKey lists_data_key(key, parsed_lists_meta_value.Version(), 0);
+  Slice encoded = lists_data_key.Encode();
+  std::string prefix(encoded.data(), encoded.size() - sizeof(uint64_t));
+  std::unique_ptr<rocksdb::Iterator> iter(rocks->NewIterator(rocksdb::ReadOptions(), handles[storage::kListsDataCF]));
+  size_t count = 0;
+  for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+    count++;
+  }
+  return count;
+}
+
+TEST_F(ListsTest, LegacyListConversionTest) {  // NOLINT
+  int64_t ret;
+  uint64_t num;
+  std::vector<std::string> model;
+  for (int i = 0; i < 300; ++i) {
+    model.push_back(i % 3 == 0 ? "x" : "v" + std::to_string(i));
+  }
+  put_legacy_list(&db, "LEGACY_LINSERT_KEY", model);
+  put_legacy_list(&db, "LEGACY_LREM_KEY", model);
+  ASSERT_TRUE(len_match(&db, "LEGACY_LINSERT_KEY", model.size()));
+  ASSERT_TRUE(elements_match(&db, "LEGACY_LINSERT_KEY", model));
+
+  // a pivot that is missing leaves the list in its old encoding
+  s = db.LInsert("LEGACY_LINSERT_KEY", storage::Before, "missing", "n", &ret);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(ret, -1);
+  ASSERT_EQ(lists_data_keys(&db, "LEGACY_LINSERT_KEY"), model.size());
+
+  // the first middle operation converts the list and applies the edit in one write
+  std::vector<std::string> linsert_model = model;
+  s = db.LInsert("LEGACY_LINSERT_KEY", storage::After, "v200", "n", &ret);
+  ASSERT_TRUE(s.ok());
+  linsert_model.insert(std::find(linsert_model.begin(), linsert_model.end(), "v200") + 1, "n");
+  ASSERT_EQ(ret, static_cast<int64_t>(linsert_model.size()));
+  ASSERT_EQ(lists_data_keys(&db, "LEGACY_LINSERT_KEY"), 3);
+  ASSERT_TRUE(len_match(&db, "LEGACY_LINSERT_KEY", linsert_model.size()));
+  ASSERT_TRUE(elements_match(&db, "LEGACY_LINSERT_KEY", linsert_model));
+  s = db.LInsert("LEGACY_LINSERT_KEY", storage::Before, "v1", "head", &ret);
+  ASSERT_TRUE(s.ok());
+  linsert_model.insert(linsert_model.begin() + 1, "head");
+  ASSERT_TRUE(elements_match(&db, "LEGACY_LINSERT_KEY", linsert_model));
+
+  // LREM with a negative count removes from the tail of the legacy list
+  std::vector<std::string> lrem_model = model;
+  s = db.LRem("LEGACY_LREM_KEY", -2, "x", &num);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(num, 2);
+  lrem_model.erase(lrem_model.begin() + 297);
+  lrem_model.erase(lrem_model.begin() + 294);
+  ASSERT_TRUE(len_match(&db, "LEGACY_LREM_KEY", lrem_model.size()));
+  ASSERT_TRUE(elements_match(&db, "LEGACY_LREM_KEY", lrem_model));
+
+  s = db.LRem("LEGACY_LREM_KEY", 0, "x", &num);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(num, 98);
+  lrem_model.erase(std::remove(lrem_model.begin(), lrem_model.end(), "x"), lrem_model.end());
+  ASSERT_TRUE(len_match(&db, "LEGACY_LREM_KEY", lrem_model.size()));
+  ASSERT_TRUE(elements_match(&db, "LEGACY_LREM_KEY", lrem_model));
+
+  // removing most of the elements of a chunked list folds the underfull chunks together
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(i % 10 == 0 ? "v" + std::to_string(i) : "x");
+  }
+  s = db.RPush("LREM_MERGE_KEY", values, &num);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(lists_data_keys(&db, "LREM_MERGE_KEY"), 8);
+  s = db.LRem("LREM_MERGE_KEY", 0, "x", &num);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(num, 900);
+  values.erase(std::remove(values.begin(), values.end(), "x"), values.end());
+  ASSERT_EQ(lists_data_keys(&db, "LREM_MERGE_KEY"), 1);
+  ASSERT_TRUE(len_match(&db, "LREM_MERGE_KEY", values.size()));
+  ASSERT_TRUE(elements_match(&db, "LREM_MERGE_KEY", values));
+  s = db.RPush("LREM_MERGE_KEY", {"tail"}, &num);
+  ASSERT_TRUE(s.ok());
+  values.emplace_back("tail");
+  ASSERT_TRUE(elements_match(&db, "LREM_MERGE_KEY", values));
+}
+
 int main(int argc, char** argv) {
   if (!pstd::FileExists("./log")) {
     pstd::CreatePath("./log");
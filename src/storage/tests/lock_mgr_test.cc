@@ -3,24 +3,26 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <gtest/gtest.h>
 #include <thread>
 
 #include "src/lock_mgr.h"
-#include "src/mutex_impl.h"
+#include "src/scope_record_lock.h"
 
 using namespace storage;
 
 void Func(LockMgr* mgr, int id, const std::string& key) {
   mgr->TryLock(key);
   printf("thread %d TryLock %s success\n", id, key.c_str());
-  std::this_thread::sleep_for(std::chrono::seconds(3));
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
   mgr->UnLock(key);
   printf("thread %d UnLock %s\n", id, key.c_str());
 }
 
-int main() {
-  std::shared_ptr<MutexFactory> factory = std::make_shared<MutexFactoryImpl>();
-  LockMgr mgr(1, 3, factory);
+// All the keys share the only slot, the lockers are served one at a time
+TEST(LockMgrTest, SingleSlotTest) {
+  LockMgr mgr(1);
+  ASSERT_EQ(mgr.NumSlots(), 1);
 
   std::thread t1(Func, &mgr, 1, "key_1");
   std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -33,6 +35,7 @@ int main() {
 
   auto s = mgr.TryLock("key_1");
   printf("thread main TryLock key_1 ret %s\n", s.ToString().c_str());
+  ASSERT_TRUE(s.ok());
   mgr.UnLock("key_1");
   printf("thread main UnLock key_1\n");
 
@@ -40,5 +43,92 @@ int main() {
   t2.join();
   t3.join();
   t4.join();
-  return 0;
+
+  auto stats = mgr.GetStats();
+  ASSERT_GE(stats.waits, 4);
+  ASSERT_GT(stats.wait_micros, 0);
+  ASSERT_GE(stats.wait_micros, stats.max_wait_micros);
+}
+
+TEST(LockMgrTest, NumSlotsTest) {
+  ASSERT_EQ(LockMgr(0).NumSlots(), 1);
+  ASSERT_EQ(LockMgr(1000).NumSlots(), 1024);
+  ASSERT_EQ(LockMgr().NumSlots(), LockMgr::kDefaultNumSlots);
+
+  LockMgr mgr(16);
+  for (int i = 0; i < 1000; ++i) {
+    std::string key = "key_" + std::to_string(i);
+    ASSERT_LT(mgr.GetSlot(key), 16);
+    ASSERT_EQ(mgr.GetSlot(key), mgr.GetSlot(key));
+  }
+}
+
+// Uncontended locking does not wait
+TEST(LockMgrTest, UncontendedTest) {
+  auto mgr = std::make_shared<LockMgr>();
+  for (int i = 0; i < 1000; ++i) {
+    ScopeRecordLock l(mgr, "key_" + std::to_string(i));
+  }
+  ASSERT_EQ(mgr->GetStats().waits, 0);
+}
+
+// Keys sharing a slot, and duplicated keys, are locked once
+TEST(LockMgrTest, MultiScopeRecordLockTest) {
+  auto mgr = std::make_shared<LockMgr>(1);
+  {
+    MultiScopeRecordLock ml(mgr, {"key_1", "key_2", "key_1", "", ""});
+  }
+  {
+    MultiScopeRecordLock ml(mgr, {});
+  }
+  ScopeRecordLock l(mgr, "key_3");
+  ASSERT_EQ(mgr->GetStats().waits, 0);
+
+  auto slots = mgr->GetSlots(std::vector<std::string>{"a", "b", "c", "a"});
+  ASSERT_EQ(slots.size(), 1);
+}
+
+// Two lockers taking the same keys in opposite orders do not deadlock, and
+// the lock guards the counters of every key
+TEST(LockMgrTest, MultiKeyContentionTest) {
+  auto mgr = std::make_shared<LockMgr>(64);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 16; ++i) {
+    keys.push_back("key_" + std::to_string(i));
+  }
+  std::vector<std::string> reversed_keys(keys.rbegin(), keys.rend());
+  std::vector<int64_t> counters(keys.size(), 0);
+  const int kRounds = 2000;
+
+  auto worker = [&](const std::vector<std::string>& lock_keys) {
+    for (int round = 0; round < kRounds; ++round) {
+      MultiScopeRecordLock ml(mgr, lock_keys);
+      for (auto& counter : counters) {
+        ++counter;
+      }
+    }
+  };
+  auto single_worker = [&]() {
+    for (int round = 0; round < kRounds; ++round) {
+      ScopeRecordLock l(mgr, keys[0]);
+      ++counters[0];
+    }
+  };
+
+  std::thread t1(worker, keys);
+  std::thread t2(worker, reversed_keys);
+  std::thread t3(single_worker);
+  t1.join();
+  t2.join();
+  t3.join();
+
+  ASSERT_EQ(counters[0], 3 * kRounds);
+  for (size_t i = 1; i < counters.size(); ++i) {
+    ASSERT_EQ(counters[i], 2 * kRounds);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
 }
@@ -4,6 +4,10 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
 
 #include "src/lru_cache.h"
 #include "storage/storage.h"
@@ -487,6 +491,152 @@ TEST(LRUCacheTest, TestRemoveCase1) {
   ASSERT_TRUE(lru_cache.LRUAsExpected({}));
 }
 
+TEST(LRUCacheTest, TestSharedLookupsCase1) {
+  Status s;
+  std::string value;
+  storage::LRUCache<std::string, std::string> lru_cache(true);
+  lru_cache.SetCapacity(3);
+
+  // ***************** Step 1 *****************
+  // (k3, v3) -> (k2, v2) -> (k1, v1)
+  lru_cache.Insert("k1", "v1");
+  lru_cache.Insert("k2", "v2");
+  lru_cache.Insert("k3", "v3");
+  ASSERT_TRUE(lru_cache.LRUAsExpected({{"k3", "v3"}, {"k2", "v2"}, {"k1", "v1"}}));
+
+  // ***************** Step 2 *****************
+  // the lookup does not move k1 to the head
+  s = lru_cache.Lookup("k1", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "v1");
+  ASSERT_TRUE(lru_cache.LRUAsExpected({{"k3", "v3"}, {"k2", "v2"}, {"k1", "v1"}}));
+
+  // ***************** Step 3 *****************
+  // (k4, v4) -> (k3, v3) -> (k2, v2)
+  lru_cache.Insert("k4", "v4");
+  ASSERT_TRUE(lru_cache.LRUAndHandleTableConsistent());
+  ASSERT_TRUE(lru_cache.LRUAsExpected({{"k4", "v4"}, {"k3", "v3"}, {"k2", "v2"}}));
+  s = lru_cache.Lookup("k1", &value);
+  ASSERT_TRUE(s.IsNotFound());
+
+  // ***************** Step 4 *****************
+  // inserting an existing key refreshes it
+  // (k2, v2_new) -> (k4, v4) -> (k3, v3)
+  lru_cache.Insert("k2", "v2_new");
+  ASSERT_TRUE(lru_cache.LRUAndHandleTableConsistent());
+  ASSERT_TRUE(lru_cache.LRUAsExpected({{"k2", "v2_new"}, {"k4", "v4"}, {"k3", "v3"}}));
+}
+
+using ShardedCache = storage::ShardedLRUCache<std::string, std::string>;
+
+TEST(LRUCacheTest, TestShardedCase1) {
+  Status s;
+  std::string value;
+  ShardedCache lru_cache;
+  ASSERT_EQ(lru_cache.NumShards(), 1 << ShardedCache::kDefaultNumShardBits);
+
+  // ***************** Step 1 *****************
+  // empty capacity
+  s = lru_cache.Insert("k1", "v1");
+  ASSERT_TRUE(s.IsCorruption());
+  ASSERT_EQ(lru_cache.Size(), 0);
+
+  // ***************** Step 2 *****************
+  // every shard keeps its part of the capacity
+  lru_cache.SetCapacity(64);
+  ASSERT_EQ(lru_cache.Capacity(), 64);
+  for (int i = 0; i < 1000; ++i) {
+    s = lru_cache.Insert("k" + std::to_string(i), "v" + std::to_string(i));
+    ASSERT_TRUE(s.ok());
+  }
+  ASSERT_LE(lru_cache.Size(), 64);
+  ASSERT_GT(lru_cache.Size(), 0);
+  ASSERT_EQ(lru_cache.TotalCharge(), lru_cache.Size());
+  ASSERT_TRUE(lru_cache.LRUAndHandleTableConsistent());
+
+  // ***************** Step 3 *****************
+  // the newest key of a shard is never evicted
+  s = lru_cache.Lookup("k999", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "v999");
+  s = lru_cache.Remove("k999");
+  ASSERT_TRUE(s.ok());
+  s = lru_cache.Lookup("k999", &value);
+  ASSERT_TRUE(s.IsNotFound());
+  s = lru_cache.Remove("k999");
+  ASSERT_TRUE(s.IsNotFound());
+
+  // ***************** Step 4 *****************
+  lru_cache.SetCapacity(16);
+  ASSERT_LE(lru_cache.Size(), 16);
+  ASSERT_TRUE(lru_cache.LRUAndHandleTableConsistent());
+
+  // ***************** Step 5 *****************
+  s = lru_cache.Clear();
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(lru_cache.Size(), 0);
+  ASSERT_EQ(lru_cache.TotalCharge(), 0);
+  ASSERT_TRUE(lru_cache.LRUAndHandleTableConsistent());
+}
+
+// Every thread runs the lookup and insert pair of Redis::UpdateSpecificKeyStatistics
+// on random keys of one cache, returns the operations per second.
+template <typename Cache>
+static double RunContention(Cache* cache, const std::vector<std::string>& keys, int num_threads, int ops_per_thread) {
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([cache, &keys, t, ops_per_thread]() {
+      std::mt19937 rng(t);
+      std::string value;
+      for (int i = 0; i < ops_per_thread; ++i) {
+        const std::string& key = keys[rng() % keys.size()];
+        cache->Lookup(key, &value);
+        cache->Insert(key, key);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return num_threads * ops_per_thread / elapsed.count();
+}
+
+TEST(LRUCacheTest, ContentionBenchmark) {
+  const int kNumThreads = 8;
+  const int kOpsPerThread = 100000;
+  const size_t kCapacity = 5000;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20000; ++i) {
+    keys.push_back("benchmark_key_" + std::to_string(i));
+  }
+
+  storage::LRUCache<std::string, std::string> lru_cache;
+  lru_cache.SetCapacity(kCapacity);
+  double lru_ops = RunContention(&lru_cache, keys, kNumThreads, kOpsPerThread);
+  ASSERT_LE(lru_cache.Size(), kCapacity);
+  ASSERT_TRUE(lru_cache.LRUAndHandleTableConsistent());
+
+  ShardedCache sharded_cache;
+  sharded_cache.SetCapacity(kCapacity);
+  double sharded_ops = RunContention(&sharded_cache, keys, kNumThreads, kOpsPerThread);
+  ASSERT_LE(sharded_cache.Size(), kCapacity + sharded_cache.NumShards());
+  ASSERT_TRUE(sharded_cache.LRUAndHandleTableConsistent());
+
+  ShardedCache shared_lookups_cache(ShardedCache::kDefaultNumShardBits, true);
+  shared_lookups_cache.SetCapacity(kCapacity);
+  double shared_lookups_ops = RunContention(&shared_lookups_cache, keys, kNumThreads, kOpsPerThread);
+  ASSERT_LE(shared_lookups_cache.Size(), kCapacity + shared_lookups_cache.NumShards());
+  ASSERT_TRUE(shared_lookups_cache.LRUAndHandleTableConsistent());
+
+  std::cout << "threads: " << kNumThreads << ", ops per thread: " << kOpsPerThread << std::endl;
+  std::cout << "LRUCache                        : " << static_cast<uint64_t>(lru_ops) << " ops/s" << std::endl;
+  std::cout << "ShardedLRUCache                 : " << static_cast<uint64_t>(sharded_ops) << " ops/s" << std::endl;
+  std::cout << "ShardedLRUCache (shared lookups): " << static_cast<uint64_t>(shared_lookups_ops) << " ops/s"
+            << std::endl;
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
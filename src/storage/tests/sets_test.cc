@@ -4,6 +4,8 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <gtest/gtest.h>
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <thread>
 
@@ -1021,6 +1023,32 @@ TEST_F(SetsTest, SIsmemberTest) {  // NOLINT
   ASSERT_EQ(ret, 0);
 }
 
+// SMIsmember
+TEST_F(SetsTest, SMIsmemberTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<int32_t> rets;
+  std::vector<std::string> members{"MEMBER1", "MEMBER2", "MEMBER3"};
+  s = db.SAdd("SMISMEMBER_KEY", members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3);
+
+  // Not exist set key
+  s = db.SMIsmember("SMISMEMBER_NOT_EXIST_KEY", {"MEMBER1", "MEMBER2"}, &rets);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(rets, std::vector<int32_t>({0, 0}));
+
+  // Results keep the order of the members, duplicates included
+  s = db.SMIsmember("SMISMEMBER_KEY", {"MEMBER3", "NOT_EXIST_MEMBER", "MEMBER1", "MEMBER3"}, &rets);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(rets, std::vector<int32_t>({1, 0, 1, 1}));
+
+  // Expire set key
+  ASSERT_TRUE(make_expired(&db, "SMISMEMBER_KEY"));
+  s = db.SMIsmember("SMISMEMBER_KEY", {"MEMBER1"}, &rets);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(rets, std::vector<int32_t>({0}));
+}
+
 // SMembers
 TEST_F(SetsTest, SMembersTest) {  // NOLINT
   int32_t ret = 0;
@@ -1852,6 +1880,145 @@ TEST_F(SetsTest, SUnionstoreTest) {  // NOLINT
 }
 
 // SScan
+// Merging SINTER/SUNION/SDIFF
+TEST_F(SetsTest, SetsMergeTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<std::string> value_to_dest;
+  std::vector<std::string> members_out;
+
+  // Members that extend each other with zero bytes must keep their order
+  std::string a0("a\0", 2);
+  std::string a00("a\0\0", 3);
+  s = db.SAdd("MERGE_KEY1", {"a", a0, a00, "ab", "b"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("MERGE_KEY2", {a0, a00, "b", "c"}, &ret);
+  ASSERT_TRUE(s.ok());
+
+  s = db.SInter({"MERGE_KEY1", "MERGE_KEY2"}, &members_out);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members_out, std::vector<std::string>({a0, a00, "b"}));
+
+  s = db.SUnion({"MERGE_KEY1", "MERGE_KEY2", "MERGE_NOT_EXIST"}, &members_out);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members_out, std::vector<std::string>({"a", a0, a00, "ab", "b", "c"}));
+
+  s = db.SDiff({"MERGE_KEY1", "MERGE_KEY2"}, &members_out);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members_out, std::vector<std::string>({"a", "ab"}));
+
+  // Sets much larger than one write batch, the destination is one of the keys
+  std::vector<std::string> odd_members;
+  std::vector<std::string> third_members;
+  for (int32_t idx = 0; idx < 10000; ++idx) {
+    if (idx % 2 == 1) {
+      odd_members.push_back("member_" + std::to_string(idx));
+    }
+    if (idx % 3 == 0) {
+      third_members.push_back("member_" + std::to_string(idx));
+    }
+  }
+  s = db.SAdd("MERGE_ODD", odd_members, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("MERGE_THIRD", third_members, &ret);
+  ASSERT_TRUE(s.ok());
+
+  s = db.SUnionstore("MERGE_DEST", {"MERGE_ODD", "MERGE_THIRD"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 6667);
+  s = db.SCard("MERGE_DEST", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 6667);
+
+  s = db.SInterstore("MERGE_DEST", {"MERGE_DEST", "MERGE_ODD", "MERGE_THIRD"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1667);
+  s = db.SMembers("MERGE_DEST", &members_out);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members_out.size(), 1667);
+  for (const auto& member : members_out) {
+    int32_t idx = std::stoi(member.substr(7));
+    ASSERT_TRUE(idx % 2 == 1 && idx % 3 == 0);
+  }
+
+  s = db.SDiffstore("MERGE_DEST", {"MERGE_ODD", "MERGE_DEST"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3333);
+
+  // An empty result leaves no destination behind
+  s = db.SInterstore("MERGE_DEST", {"MERGE_ODD", "MERGE_NOT_EXIST"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.SCard("MERGE_DEST", &ret);
+  ASSERT_TRUE(s.IsNotFound());
+
+  // A key of another type fails the command before destination is touched
+  s = db.SAdd("MERGE_DEST", {"x"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.Set("MERGE_STRING", "value");
+  ASSERT_TRUE(s.ok());
+  s = db.SUnionstore("MERGE_DEST", {"MERGE_ODD", "MERGE_STRING"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_TRUE(members_match(&db, "MERGE_DEST", {"x"}));
+
+  // Stores larger than one write batch into destinations the compaction would not keep
+  // the batches under: missing, expired, of another type, with a ttl
+  s = db.Setex("MERGE_EXPIRED_DEST", "value", 1);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("MERGE_TTL_DEST", {"x"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db.Expire("MERGE_TTL_DEST", 100), 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  for (const char* dest : {"MERGE_MISSING_DEST", "MERGE_EXPIRED_DEST", "MERGE_STRING", "MERGE_TTL_DEST"}) {
+    s = db.SUnionstore(dest, {"MERGE_ODD", "MERGE_THIRD"}, value_to_dest, &ret);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, 6667);
+  }
+  s = db.Compact(DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  for (const char* dest : {"MERGE_MISSING_DEST", "MERGE_EXPIRED_DEST", "MERGE_STRING", "MERGE_TTL_DEST"}) {
+    s = db.SMembers(dest, &members_out);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(members_out.size(), 6667);
+    ASSERT_EQ(db.TTL(dest), -1);
+  }
+}
+
+// Merges two sets of 1M members, run with --gtest_also_run_disabled_tests
+TEST_F(SetsTest, DISABLED_SetsMergeBenchmark) {  // NOLINT
+  const int32_t kMembers = 1000000;
+  const int32_t kBatch = 10000;
+  int32_t ret = 0;
+  std::vector<std::string> members;
+  for (int32_t start = 0; start < kMembers; start += kBatch) {
+    members.clear();
+    for (int32_t idx = start; idx < start + kBatch; ++idx) {
+      members.push_back("member_" + std::to_string(idx));
+    }
+    ASSERT_TRUE(db.SAdd("BENCH_KEY1", members, &ret).ok());
+    members.clear();
+    for (int32_t idx = start; idx < start + kBatch; ++idx) {
+      members.push_back("member_" + std::to_string(idx + kMembers / 2));
+    }
+    ASSERT_TRUE(db.SAdd("BENCH_KEY2", members, &ret).ok());
+  }
+
+  std::vector<std::string> value_to_dest;
+  auto run = [&](const char* name, const std::function<Status()>& func, int32_t expect) {
+    auto start = std::chrono::steady_clock::now();
+    Status s = func();
+    auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, expect);
+    std::cout << name << " of two sets of " << kMembers << " members cost " << cost.count() << "ms" << std::endl;
+  };
+  run("SINTERSTORE", [&] { return db.SInterstore("BENCH_DEST", {"BENCH_KEY1", "BENCH_KEY2"}, value_to_dest, &ret); },
+      kMembers / 2);
+  run("SUNIONSTORE", [&] { return db.SUnionstore("BENCH_DEST", {"BENCH_KEY1", "BENCH_KEY2"}, value_to_dest, &ret); },
+      kMembers * 3 / 2);
+  run("SDIFFSTORE", [&] { return db.SDiffstore("BENCH_DEST", {"BENCH_KEY1", "BENCH_KEY2"}, value_to_dest, &ret); },
+      kMembers / 2);
+}
+
 TEST_F(SetsTest, SScanTest) {  // NOLINT
   int32_t ret = 0;
   int64_t cursor = 0;
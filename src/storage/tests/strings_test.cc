@@ -6,6 +6,7 @@
 #include <gtest/gtest.h>
 #include <filesystem>
 #include <iostream>
+#include <set>
 #include <thread>
 
 #include "pstd/env.h"
@@ -537,6 +538,84 @@ TEST_F(StringsTest, MGetTest) {
   ASSERT_EQ(vss[3].value, "");
 }
 
+// MGet on keys spread over several instances
+TEST_F(StringsTest, MGetMultiInstanceTest) {
+  std::string multi_db_path = "./test_db/string_multi_instance_test";
+  pstd::DeleteDirIfExist(multi_db_path);
+  mkdir(multi_db_path.c_str(), 0755);
+  StorageOptions multi_options = options;
+  multi_options.db_instance_num = 3;
+  storage::Storage multi_db;
+  s = multi_db.Open(multi_options, multi_db_path);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<storage::KeyValue> kvs;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "MULTI_MGET_KEY" + std::to_string(i);
+    keys.push_back(key);
+    if (i % 3 != 0) {
+      kvs.push_back({key, "VALUE" + std::to_string(i)});
+    }
+  }
+  s = multi_db.MSet(kvs);
+  ASSERT_TRUE(s.ok());
+  int32_t ret = 0;
+  s = multi_db.HSet("MULTI_MGET_KEY3", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  s = multi_db.Setex("MULTI_MGET_KEY4", "VALUE4", 100);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<storage::ValueStatus> vss;
+  s = multi_db.MGet(keys, &vss);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(vss.size(), keys.size());
+  for (int i = 0; i < 100; ++i) {
+    if (i % 3 != 0) {
+      ASSERT_TRUE(vss[i].status.ok());
+      ASSERT_EQ(vss[i].value, "VALUE" + std::to_string(i));
+    } else {
+      // MULTI_MGET_KEY3 holds a hash, it is reported as nil
+      ASSERT_TRUE(vss[i].status.IsNotFound());
+      ASSERT_EQ(vss[i].value, "");
+    }
+  }
+
+  vss.clear();
+  s = multi_db.MGetWithTTL(keys, &vss);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(vss.size(), keys.size());
+  ASSERT_TRUE(vss[0].status.IsNotFound());
+  ASSERT_EQ(vss[0].ttl, -2);
+  ASSERT_TRUE(vss[1].status.ok());
+  ASSERT_EQ(vss[1].ttl, -1);
+  ASSERT_TRUE(vss[4].status.ok());
+  ASSERT_EQ(vss[4].value, "VALUE4");
+  ASSERT_GE(vss[4].ttl, 99);
+  ASSERT_LE(vss[4].ttl, 100);
+
+  ASSERT_EQ(multi_db.Exists(keys), 67);
+  ASSERT_EQ(multi_db.Exists({"MULTI_MGET_KEY0", "MULTI_MGET_KEY6"}), 0);
+
+  // MSETNX spanning instances writes nothing once any key exists
+  int32_t msetnx_ret = 0;
+  s = multi_db.MSetnx({{"MULTI_MGET_KEY0", "NEW"}, {"MULTI_MGET_KEY6", "NEW"}, {"MULTI_MGET_KEY1", "NEW"}},
+                      &msetnx_ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(msetnx_ret, 0);
+  ASSERT_EQ(multi_db.Exists({"MULTI_MGET_KEY0", "MULTI_MGET_KEY6"}), 0);
+  s = multi_db.MSetnx({{"MULTI_MGET_KEY0", "NEW"}, {"MULTI_MGET_KEY6", "NEW"}, {"MULTI_MGET_KEY9", "NEW"}},
+                      &msetnx_ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(msetnx_ret, 1);
+  ASSERT_EQ(multi_db.Exists({"MULTI_MGET_KEY0", "MULTI_MGET_KEY6", "MULTI_MGET_KEY9"}), 3);
+
+  ASSERT_EQ(multi_db.Del(keys), 70);
+  ASSERT_EQ(multi_db.Exists(keys), 0);
+
+  multi_db.Close();
+}
+
 // MSet
 TEST_F(StringsTest, MSetTest) {
   std::vector<storage::KeyValue> kvs;
@@ -658,6 +737,122 @@ TEST_F(StringsTest, SetBitTest) {
   ASSERT_TRUE(s.IsInvalidArgument());
 }
 
+// Bitmaps longer than 64KB live in 4KB fragments, they read the same as a string
+TEST_F(StringsTest, BitmapFragmentsTest) {
+  int32_t ret;
+  std::string expected;
+  auto set_bit = [&](const std::string& key, int64_t offset, int32_t on) {
+    size_t byte = offset >> 3;
+    if (byte >= expected.size()) {
+      expected.resize(byte + 1, '\0');
+    }
+    int32_t old_bit = (static_cast<uint8_t>(expected[byte]) >> (7 - (offset & 0x7))) & 0x1;
+    expected[byte] = static_cast<char>((expected[byte] & ~(1 << (7 - (offset & 0x7)))) | (on << (7 - (offset & 0x7))));
+    ASSERT_TRUE(db.SetBit(key, offset, on, &ret).ok());
+    ASSERT_EQ(ret, old_bit);
+  };
+
+  // a sparse bitmap, of a few fragments over 1MB
+  for (int64_t offset : {3, 8 * 4096 + 1, 8 * 100000 + 5, 8 * 100001, 8 * (1 << 20) + 7}) {
+    set_bit("BITMAP_FRAGMENTS_KEY", offset, 1);
+  }
+  set_bit("BITMAP_FRAGMENTS_KEY", 8 * 4096 + 1, 0);
+  for (int64_t offset : {0, 3, 4, 8 * 4096 + 1, 8 * 100000 + 5, 8 * (1 << 20) + 7, 8 * (1 << 21)}) {
+    ASSERT_TRUE(db.GetBit("BITMAP_FRAGMENTS_KEY", offset, &ret).ok());
+    ASSERT_EQ(ret, offset / 8 < static_cast<int64_t>(expected.size())
+                       ? (static_cast<uint8_t>(expected[offset / 8]) >> (7 - (offset & 0x7))) & 0x1
+                       : 0);
+  }
+
+  int32_t len;
+  ASSERT_TRUE(db.Strlen("BITMAP_FRAGMENTS_KEY", &len).ok());
+  ASSERT_EQ(len, static_cast<int32_t>(expected.size()));
+  std::string value;
+  ASSERT_TRUE(db.Get("BITMAP_FRAGMENTS_KEY", &value).ok());
+  ASSERT_EQ(value, expected);
+  ASSERT_TRUE(db.Getrange("BITMAP_FRAGMENTS_KEY", 99990, 100010, &value).ok());
+  ASSERT_EQ(value, expected.substr(99990, 21));
+
+  ASSERT_TRUE(db.BitCount("BITMAP_FRAGMENTS_KEY", 0, 0, &ret, false).ok());
+  ASSERT_EQ(ret, 4);
+  ASSERT_TRUE(db.BitCount("BITMAP_FRAGMENTS_KEY", 1, 100000, &ret, true).ok());
+  ASSERT_EQ(ret, 1);
+  ASSERT_TRUE(db.BitCount("BITMAP_FRAGMENTS_KEY", -1, -1, &ret, true).ok());
+  ASSERT_EQ(ret, 1);
+
+  int64_t pos;
+  ASSERT_TRUE(db.BitPos("BITMAP_FRAGMENTS_KEY", 1, &pos).ok());
+  ASSERT_EQ(pos, 3);
+  ASSERT_TRUE(db.BitPos("BITMAP_FRAGMENTS_KEY", 1, 1, &pos).ok());
+  ASSERT_EQ(pos, 8 * 100000 + 5);
+  ASSERT_TRUE(db.BitPos("BITMAP_FRAGMENTS_KEY", 1, 100001, 200000, &pos).ok());
+  ASSERT_EQ(pos, 8 * 100001);
+  ASSERT_TRUE(db.BitPos("BITMAP_FRAGMENTS_KEY", 1, 100002, 200000, &pos).ok());
+  ASSERT_EQ(pos, -1);
+  ASSERT_TRUE(db.BitPos("BITMAP_FRAGMENTS_KEY", 0, &pos).ok());
+  ASSERT_EQ(pos, 0);
+
+  // a string grown past the threshold by SETBIT moves to fragments
+  std::string ones(70 * 1024, '\xff');
+  ASSERT_TRUE(db.Set("BITMAP_ONES_KEY", ones).ok());
+  ASSERT_TRUE(db.SetBit("BITMAP_ONES_KEY", 8 * 5000 + 2, 0, &ret).ok());
+  ASSERT_EQ(ret, 1);
+  ones[5000] = '\xdf';
+  ASSERT_TRUE(db.BitPos("BITMAP_ONES_KEY", 0, &pos).ok());
+  ASSERT_EQ(pos, 8 * 5000 + 2);
+  ASSERT_TRUE(db.BitPos("BITMAP_ONES_KEY", 0, 5001, &pos).ok());
+  ASSERT_EQ(pos, -1);
+  ASSERT_TRUE(db.BitCount("BITMAP_ONES_KEY", 0, 0, &ret, false).ok());
+  ASSERT_EQ(ret, 70 * 1024 * 8 - 1);
+  ASSERT_TRUE(db.Get("BITMAP_ONES_KEY", &value).ok());
+  ASSERT_EQ(value, ones);
+
+  // BITOP streams over the fragments and stores a long result in fragments
+  int64_t dest_len;
+  std::string dest_value;
+  std::vector<std::string> src_keys{"BITMAP_FRAGMENTS_KEY", "BITMAP_ONES_KEY"};
+  ASSERT_TRUE(db.BitOp(kBitOpXor, "BITMAP_DEST_KEY", src_keys, dest_value, &dest_len).ok());
+  ASSERT_EQ(dest_len, static_cast<int64_t>(expected.size()));
+  std::string xored = expected;
+  for (size_t i = 0; i < ones.size(); ++i) {
+    xored[i] = static_cast<char>(xored[i] ^ ones[i]);
+  }
+  ASSERT_TRUE(db.Get("BITMAP_DEST_KEY", &value).ok());
+  ASSERT_EQ(value, xored);
+  ASSERT_TRUE(db.BitOp(kBitOpAnd, "BITMAP_DEST_KEY", src_keys, dest_value, &dest_len).ok());
+  ASSERT_TRUE(db.BitCount("BITMAP_DEST_KEY", 0, 0, &ret, false).ok());
+  ASSERT_EQ(ret, 1);
+
+  // RENAME moves the fragments along, PKSCANRANGE reads the bitmap whole
+  ASSERT_TRUE(db.Get("BITMAP_DEST_KEY", &dest_value).ok());
+  ASSERT_TRUE(db.Rename("BITMAP_DEST_KEY", "BITMAP_RENAMED_KEY").ok());
+  ASSERT_TRUE(db.Get("BITMAP_DEST_KEY", &value).IsNotFound());
+  ASSERT_TRUE(db.Get("BITMAP_RENAMED_KEY", &value).ok());
+  ASSERT_EQ(value, dest_value);
+  ASSERT_TRUE(db.BitCount("BITMAP_RENAMED_KEY", 0, 0, &ret, false).ok());
+  ASSERT_EQ(ret, 1);
+  std::vector<std::string> keys;
+  std::vector<storage::KeyValue> kvs;
+  std::string next_key;
+  ASSERT_TRUE(db.PKScanRange(DataType::kStrings, "BITMAP_RENAMED_KEY", "BITMAP_RENAMED_KEY", "*", 10, &keys, &kvs,
+                             &next_key)
+                  .ok());
+  ASSERT_EQ(kvs.size(), 1);
+  ASSERT_EQ(kvs[0].value, dest_value);
+  ASSERT_EQ(db.Del({"BITMAP_RENAMED_KEY"}), 1);
+
+  // the string commands other than the bit ones turn it back into one string
+  ASSERT_TRUE(db.Append("BITMAP_FRAGMENTS_KEY", "x", &ret).ok());
+  ASSERT_EQ(ret, static_cast<int32_t>(expected.size()) + 1);
+  ASSERT_TRUE(db.Get("BITMAP_FRAGMENTS_KEY", &value).ok());
+  ASSERT_EQ(value, expected + "x");
+
+  ASSERT_EQ(db.Del({"BITMAP_ONES_KEY"}), 1);
+  ASSERT_TRUE(db.Get("BITMAP_ONES_KEY", &value).IsNotFound());
+  ASSERT_TRUE(db.GetBit("BITMAP_ONES_KEY", 8, &ret).ok());
+  ASSERT_EQ(ret, 0);
+}
+
 // Setex
 TEST_F(StringsTest, SetexTest) {
   std::string value;
@@ -1013,6 +1208,127 @@ TEST_F(StringsTest, PKSetexAtTest) {
   ASSERT_EQ(ttl_ret, -2);
 }
 
+class UpdateStringsTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    pstd::DeleteDirIfExist(db_path);
+    mkdir(db_path.c_str(), 0755);
+    options.options.create_if_missing = true;
+    options.options.create_missing_column_families = true;
+    options.db_instance_num = 1;
+    auto s = db.Open(options, db_path);
+    ASSERT_TRUE(s.ok());
+  }
+
+  void TearDown() override { db.Close(); }
+
+  std::string db_path{"./test_db/update_strings_test"};
+  StorageOptions options;
+  storage::Storage db;
+};
+
+// INCRBY, DECRBY, INCRBYFLOAT and APPEND read and update the string under the key lock
+TEST_F(UpdateStringsTest, UpdateTest) {
+  int64_t ret;
+  ASSERT_TRUE(db.Incrby("UPDATE_INCR_KEY", 5, &ret).ok());
+  ASSERT_EQ(ret, 5);
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(db.Incrby("UPDATE_INCR_KEY", 1, &ret).ok());
+  }
+  ASSERT_EQ(ret, 105);
+  ASSERT_TRUE(db.Decrby("UPDATE_INCR_KEY", 10, &ret).ok());
+  ASSERT_EQ(ret, 95);
+  std::string value;
+  ASSERT_TRUE(db.Get("UPDATE_INCR_KEY", &value).ok());
+  ASSERT_EQ(value, "95");
+
+  // the expire time of the string is kept
+  ASSERT_EQ(db.Expire("UPDATE_INCR_KEY", 100), 1);
+  ASSERT_TRUE(db.Incrby("UPDATE_INCR_KEY", 5, &ret).ok());
+  ASSERT_EQ(ret, 100);
+  int64_t ttl = db.TTL("UPDATE_INCR_KEY");
+  ASSERT_LE(ttl, 100);
+  ASSERT_GE(ttl, 90);
+
+  std::string float_ret;
+  ASSERT_TRUE(db.Incrbyfloat("UPDATE_FLOAT_KEY", "1.5", &float_ret).ok());
+  ASSERT_EQ(float_ret, "1.5");
+  ASSERT_TRUE(db.Incrbyfloat("UPDATE_FLOAT_KEY", "2.25", &float_ret).ok());
+  ASSERT_EQ(float_ret, "3.75");
+  ASSERT_TRUE(db.Incrbyfloat("UPDATE_FLOAT_KEY", "abc", &float_ret).IsCorruption());
+
+  int32_t len;
+  ASSERT_TRUE(db.Append("UPDATE_APPEND_KEY", "hello", &len).ok());
+  ASSERT_EQ(len, 5);
+  ASSERT_TRUE(db.Append("UPDATE_APPEND_KEY", " world", &len).ok());
+  ASSERT_EQ(len, 11);
+  ASSERT_TRUE(db.Get("UPDATE_APPEND_KEY", &value).ok());
+  ASSERT_EQ(value, "hello world");
+
+  // a string that is not a number is left as it is
+  ASSERT_TRUE(db.Incrby("UPDATE_APPEND_KEY", 1, &ret).IsCorruption());
+  ASSERT_TRUE(db.Incrbyfloat("UPDATE_APPEND_KEY", "1", &float_ret).IsCorruption());
+  ASSERT_TRUE(db.Get("UPDATE_APPEND_KEY", &value).ok());
+  ASSERT_EQ(value, "hello world");
+
+  // an overflow is an error and writes nothing
+  ASSERT_TRUE(db.Set("UPDATE_OVERFLOW_KEY", "9223372036854775807").ok());
+  ASSERT_TRUE(db.Incrby("UPDATE_OVERFLOW_KEY", 1, &ret).IsInvalidArgument());
+  ASSERT_TRUE(db.Get("UPDATE_OVERFLOW_KEY", &value).ok());
+  ASSERT_EQ(value, "9223372036854775807");
+  ASSERT_TRUE(db.Decrby("UPDATE_OVERFLOW_KEY", 1, &ret).ok());
+  ASSERT_EQ(ret, 9223372036854775806);
+
+  // concurrent increments each reply their own number
+  std::vector<std::thread> threads;
+  std::vector<std::vector<int64_t>> replies(4);
+  for (auto& thread_replies : replies) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 500; ++i) {
+        int64_t reply;
+        ASSERT_TRUE(db.Incrby("UPDATE_CONCURRENT_KEY", 1, &reply).ok());
+        thread_replies.push_back(reply);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::set<int64_t> distinct;
+  for (const auto& thread_replies : replies) {
+    distinct.insert(thread_replies.begin(), thread_replies.end());
+  }
+  ASSERT_EQ(distinct.size(), 2000);
+  ASSERT_EQ(*distinct.rbegin(), 2000);
+
+  // an expired string starts over
+  ASSERT_TRUE(db.Setex("UPDATE_EXPIRED_KEY", "100", 1).ok());
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  ASSERT_TRUE(db.Incrby("UPDATE_EXPIRED_KEY", 1, &ret).ok());
+  ASSERT_EQ(ret, 1);
+  ASSERT_EQ(db.TTL("UPDATE_EXPIRED_KEY"), -1);
+
+  // a key of another type is left as it is
+  int32_t res;
+  ASSERT_TRUE(db.HSet("UPDATE_HASH_KEY", "field", "value", &res).ok());
+  ASSERT_TRUE(db.Incrby("UPDATE_HASH_KEY", 1, &ret).IsNotSupported());
+  ASSERT_TRUE(db.Decrby("UPDATE_HASH_KEY", 1, &ret).IsInvalidArgument());
+  ASSERT_TRUE(db.Append("UPDATE_HASH_KEY", "x", &len).IsInvalidArgument());
+  ASSERT_TRUE(db.HGet("UPDATE_HASH_KEY", "field", &value).ok());
+  ASSERT_EQ(value, "value");
+  ASSERT_EQ(db.Del({"UPDATE_HASH_KEY"}), 1);
+  ASSERT_TRUE(db.Incrby("UPDATE_HASH_KEY", 1, &ret).ok());
+  ASSERT_EQ(ret, 1);
+
+  // a bitmap in fragments is expanded first
+  ASSERT_TRUE(db.SetBit("UPDATE_BITMAP_KEY", 8 * (1 << 20), 1, &res).ok());
+  ASSERT_TRUE(db.Append("UPDATE_BITMAP_KEY", "x", &len).ok());
+  ASSERT_EQ(len, (1 << 20) + 2);
+  ASSERT_TRUE(db.Get("UPDATE_BITMAP_KEY", &value).ok());
+  ASSERT_EQ(value.size(), size_t{(1 << 20) + 2});
+  ASSERT_EQ(value.back(), 'x');
+}
+
 int main(int argc, char** argv) {
   if (!pstd::FileExists("./log")) {
     pstd::CreatePath("./log");
@@ -3705,6 +3705,52 @@ TEST_F(ZSetsTest, ZScoreTest) {  // NOLINT
   ASSERT_DOUBLE_EQ(0, score);
 }
 
+// ZMScore
+TEST_F(ZSetsTest, ZMScoreTest) {  // NOLINT
+  int32_t ret;
+  std::vector<storage::ScoreStatus> sss;
+
+  // ***************** Group 1 Test *****************
+  std::vector<storage::ScoreMember> gp1_sm;
+  std::vector<std::string> gp1_members;
+  for (int i = 0; i < 200; ++i) {
+    gp1_sm.push_back({i + 0.5, "MM" + std::to_string(i)});
+    gp1_members.push_back("MM" + std::to_string(199 - i * 2));
+  }
+  s = db.ZAdd("GP1_ZMSCORE_KEY", gp1_sm, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(200, ret);
+  gp1_members.emplace_back("MM7");
+  s = db.ZMScore("GP1_ZMSCORE_KEY", gp1_members, &sss);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(sss.size(), 201);
+  for (int i = 0; i < 200; ++i) {
+    int member = 199 - i * 2;
+    if (member >= 0) {
+      ASSERT_TRUE(sss[i].status.ok());
+      ASSERT_DOUBLE_EQ(member + 0.5, sss[i].score);
+    } else {
+      ASSERT_TRUE(sss[i].status.IsNotFound());
+    }
+  }
+  ASSERT_TRUE(sss[200].status.ok());
+  ASSERT_DOUBLE_EQ(7.5, sss[200].score);
+
+  // ***************** Group 2 Test *****************
+  ASSERT_TRUE(make_expired(&db, "GP1_ZMSCORE_KEY"));
+  s = db.ZMScore("GP1_ZMSCORE_KEY", {"MM1", "MM2"}, &sss);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(sss.size(), 2);
+  ASSERT_TRUE(sss[0].status.IsNotFound());
+  ASSERT_TRUE(sss[1].status.IsNotFound());
+
+  // ***************** Group 3 Test *****************
+  s = db.ZMScore("GP3_ZMSCORE_KEY", {"MM1"}, &sss);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(sss.size(), 1);
+  ASSERT_TRUE(sss[0].status.IsNotFound());
+}
+
 // ZUNIONSTORE
 TEST_F(ZSetsTest, ZUnionstoreTest) {  // NOLINT
   int32_t ret;
@@ -4181,6 +4227,100 @@ TEST_F(ZSetsTest, ZInterstoreTest) {  // NOLINT
   ASSERT_TRUE(score_members_match(&db, "GP10_ZINTERSTORE_DESTINATION", {}));
 }
 
+// ZUnionstore/ZInterstore over zsets larger than one write batch
+TEST_F(ZSetsTest, ZStoreMergeTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<storage::ScoreMember> even_sm;
+  std::vector<storage::ScoreMember> third_sm;
+  for (int32_t idx = 0; idx < 6000; ++idx) {
+    std::string member = "member_" + std::to_string(idx);
+    if (idx % 2 == 0) {
+      even_sm.push_back({static_cast<double>(idx), member});
+    }
+    if (idx % 3 == 0) {
+      third_sm.push_back({static_cast<double>(-idx), member});
+    }
+  }
+  s = db.ZAdd("ZMERGE_EVEN", even_sm, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZAdd("ZMERGE_THIRD", third_sm, &ret);
+  ASSERT_TRUE(s.ok());
+
+  // even + third - even & third = 3000 + 2000 - 1000
+  std::map<std::string, double> union_to_dest;
+  s = db.ZUnionstore("ZMERGE_DEST", {"ZMERGE_EVEN", "ZMERGE_THIRD"}, {2, 1}, storage::SUM, union_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 4000);
+  ASSERT_TRUE(size_match(&db, "ZMERGE_DEST", 4000));
+  double score = 0;
+  s = db.ZScore("ZMERGE_DEST", "member_6", &score);
+  ASSERT_TRUE(s.ok());
+  ASSERT_DOUBLE_EQ(score, 6);
+  s = db.ZScore("ZMERGE_DEST", "member_3", &score);
+  ASSERT_TRUE(s.ok());
+  ASSERT_DOUBLE_EQ(score, -3);
+  s = db.ZScore("ZMERGE_DEST", "member_4", &score);
+  ASSERT_TRUE(s.ok());
+  ASSERT_DOUBLE_EQ(score, 8);
+
+  // The destination is one of the keys
+  std::vector<storage::ScoreMember> inter_to_dest;
+  s = db.ZInterstore("ZMERGE_DEST", {"ZMERGE_DEST", "ZMERGE_THIRD"}, {1, 1}, storage::MAX, inter_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2000);
+  ASSERT_TRUE(size_match(&db, "ZMERGE_DEST", 2000));
+  s = db.ZScore("ZMERGE_DEST", "member_6", &score);
+  ASSERT_TRUE(s.ok());
+  ASSERT_DOUBLE_EQ(score, 6);
+  s = db.ZScore("ZMERGE_DEST", "member_9", &score);
+  ASSERT_TRUE(s.ok());
+  ASSERT_DOUBLE_EQ(score, -9);
+  std::vector<storage::ScoreMember> sm_out;
+  s = db.ZRange("ZMERGE_DEST", 0, 0, &sm_out);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(sm_out, {{-5997, "member_5997"}}));
+
+  // An empty intersection leaves no destination behind
+  s = db.ZInterstore("ZMERGE_DEST", {"ZMERGE_EVEN", "ZMERGE_NOT_EXIST"}, {1, 1}, storage::SUM, inter_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(size_match(&db, "ZMERGE_DEST", 0));
+
+  // A key of another type fails the command before destination is touched
+  s = db.ZAdd("ZMERGE_DEST", {{1, "x"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.Set("ZMERGE_STRING", "value");
+  ASSERT_TRUE(s.ok());
+  s = db.ZUnionstore("ZMERGE_DEST", {"ZMERGE_EVEN", "ZMERGE_STRING"}, {1, 1}, storage::SUM, union_to_dest, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_TRUE(score_members_match(&db, "ZMERGE_DEST", {{1, "x"}}));
+
+  // Stores larger than one write batch into destinations the compaction would not keep
+  // the batches under: missing, expired, of another type, with a ttl. The member and the
+  // score cfs keep both halves of every member.
+  s = db.Setex("ZMERGE_EXPIRED_DEST", "value", 1);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db.Expire("ZMERGE_DEST", 100), 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  for (const char* dest : {"ZMERGE_MISSING_DEST", "ZMERGE_EXPIRED_DEST", "ZMERGE_STRING", "ZMERGE_DEST"}) {
+    s = db.ZUnionstore(dest, {"ZMERGE_EVEN", "ZMERGE_THIRD"}, {2, 1}, storage::SUM, union_to_dest, &ret);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, 4000);
+  }
+  s = db.Compact(DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  for (const char* dest : {"ZMERGE_MISSING_DEST", "ZMERGE_EXPIRED_DEST", "ZMERGE_STRING", "ZMERGE_DEST"}) {
+    ASSERT_TRUE(size_match(&db, dest, 4000));
+    s = db.ZRange(dest, 0, -1, &sm_out);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(sm_out.size(), 4000);
+    s = db.ZScore(dest, "member_4", &score);
+    ASSERT_TRUE(s.ok());
+    ASSERT_DOUBLE_EQ(score, 8);
+    ASSERT_EQ(db.TTL(dest), -1);
+  }
+}
+
 // ZRANGEBYLEX
 TEST_F(ZSetsTest, ZRangebylexTest) {  // NOLINT
   int32_t ret;
@@ -5250,6 +5390,65 @@ TEST_F(ZSetsTest, ZScanTest) {  // NOLINT
   ASSERT_TRUE(score_members_match(score_member_out, {}));
 }
 
+// Collects what a streaming read emits, refusing elements past limit
+class CollectSink : public storage::ElementSink {
+ public:
+  Status Begin(uint64_t n) override {
+    begun = true;
+    count = n;
+    return Status::OK();
+  }
+  Status Append(const Slice& element) override {
+    if (elements.size() == limit) {
+      return Status::Incomplete("limit");
+    }
+    elements.push_back(element.ToString());
+    return Status::OK();
+  }
+  Status AppendScore(double score) override { return Append(std::to_string(static_cast<int64_t>(score))); }
+
+  size_t limit = SIZE_MAX;
+  bool begun = false;
+  uint64_t count = 0;
+  std::vector<std::string> elements;
+};
+
+// ZRange streamed into a sink
+TEST_F(ZSetsTest, ZRangeSinkTest) {
+  int32_t ret;
+  std::vector<ScoreMember> score_members;
+  for (int i = 0; i < 1000; ++i) {
+    score_members.push_back({static_cast<double>(i), "MEMBER" + std::to_string(i)});
+  }
+  s = db.ZAdd("ZRANGE_SINK_KEY", score_members, &ret);
+  ASSERT_TRUE(s.ok());
+
+  CollectSink sink;
+  s = db.ZRange("ZRANGE_SINK_KEY", 0, -1, false, &sink);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(sink.count, 1000);
+  ASSERT_EQ(sink.elements.size(), 1000);
+  ASSERT_EQ(sink.elements.front(), "MEMBER0");
+  ASSERT_EQ(sink.elements.back(), "MEMBER999");
+
+  CollectSink with_scores;
+  s = db.ZRange("ZRANGE_SINK_KEY", -2, -1, true, &with_scores);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(with_scores.count, 4);
+  ASSERT_EQ(with_scores.elements, (std::vector<std::string>{"MEMBER998", "998", "MEMBER999", "999"}));
+
+  CollectSink empty;
+  s = db.ZRange("ZRANGE_SINK_KEY", 2000, 3000, true, &empty);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(empty.begun);
+  ASSERT_EQ(empty.count, 0);
+
+  CollectSink not_found;
+  s = db.ZRange("ZRANGE_SINK_NOT_EXIST_KEY", 0, -1, false, &not_found);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_FALSE(not_found.begun);
+}
+
 int main(int argc, char** argv) {
   if (!pstd::FileExists("./log")) {
     pstd::CreatePath("./log");
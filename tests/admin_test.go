@@ -69,6 +69,53 @@ var _ = Describe("Admin", Ordered, func() {
 		Expect(client.Info(ctx).Val()).NotTo(Equal("FooBar"))
 	})
 
+	It("Cmd INFO compression", func() {
+		Expect(client.Set(ctx, "info_compression_key", "value", 0).Err()).NotTo(HaveOccurred())
+		info := client.Info(ctx, "compression")
+		Expect(info.Err()).NotTo(HaveOccurred())
+		Expect(info.Val()).To(ContainSubstring("Compression"))
+	})
+
+	It("Cmd INFO stats", func() {
+		info := client.Info(ctx, "stats")
+		Expect(info.Err()).NotTo(HaveOccurred())
+		Expect(info.Val()).To(ContainSubstring("keylock_waits:"))
+		Expect(info.Val()).To(ContainSubstring("keylock_wait_micros:"))
+		Expect(info.Val()).To(ContainSubstring("data_dir0:path="))
+	})
+
+	It("Cmd INFO keyspace", func() {
+		Expect(client.Set(ctx, "info_keyspace_key", "value", 0).Err()).NotTo(HaveOccurred())
+		info := client.Info(ctx, "keyspace")
+		Expect(info.Err()).NotTo(HaveOccurred())
+		Expect(info.Val()).To(ContainSubstring("# Keyspace"))
+		Expect(info.Val()).To(ContainSubstring("db0_strings:keys="))
+
+		Expect(client.Do(ctx, "info", "keyspace", "1").Err()).NotTo(HaveOccurred())
+		Expect(client.Do(ctx, "info", "keyspace", "2").Err()).To(HaveOccurred())
+	})
+
+	It("Cmd DBSIZE", func() {
+		Expect(client.Set(ctx, "dbsize_key", "value", 0).Err()).NotTo(HaveOccurred())
+		dbsize := client.DBSize(ctx)
+		Expect(dbsize.Err()).NotTo(HaveOccurred())
+		Expect(dbsize.Val()).To(BeNumerically(">=", 1))
+	})
+
+	It("Cmd RESHARD", func() {
+		info := client.Do(ctx, "reshard", "info")
+		Expect(info.Err()).NotTo(HaveOccurred())
+		Expect(info.Val()).To(ContainSubstring("slot_num:"))
+		Expect(info.Val()).To(ContainSubstring("instance0_slots:"))
+
+		status := client.Do(ctx, "reshard", "status")
+		Expect(status.Err()).NotTo(HaveOccurred())
+		Expect(status.Val()).To(ContainSubstring("running:"))
+
+		Expect(client.Do(ctx, "reshard", "migrate", "-1", "0").Err()).To(HaveOccurred())
+		Expect(client.Do(ctx, "reshard", "unknown").Err()).To(HaveOccurred())
+	})
+
 	It("Cmd Shutdown", func() {
 		Expect(client.Shutdown(ctx).Err()).NotTo(HaveOccurred())
 
@@ -147,6 +194,18 @@ var _ = Describe("Admin", Ordered, func() {
 		res = client.ConfigGet(ctx, "time*")
 		Expect(res.Err()).NotTo(HaveOccurred())
 		Expect(res.Val()).To(Equal(map[string]string{"timeout": "60"}))
+
+		// the shared block cache is resized at runtime, the other table options need a restart
+		resSet = client.ConfigSet(ctx, "rocksdb-block-cache-size", "268435456")
+		Expect(resSet.Err()).NotTo(HaveOccurred())
+		Expect(resSet.Val()).To(Equal("OK"))
+
+		res = client.ConfigGet(ctx, "rocksdb-block-cache-size")
+		Expect(res.Err()).NotTo(HaveOccurred())
+		Expect(res.Val()).To(Equal(map[string]string{"rocksdb-block-cache-size": "268435456"}))
+
+		resSet = client.ConfigSet(ctx, "rocksdb-block-size", "16384")
+		Expect(resSet.Err()).To(MatchError("ERR Invalid Argument"))
 	})
 
 	It("PING", func() {
@@ -387,4 +387,29 @@ var _ = Describe("Hash", Ordered, func() {
 		Expect(cursor).To(Equal(uint64(0)))
 		Expect(keys).To(ConsistOf([]string{"key1", "value1", "key2", "value2", "key3", "value3"}))
 	})
+
+	It("should HScan with cursors", func() {
+		fields := make(map[string]bool)
+		for i := 0; i < 20; i++ {
+			field := fmt.Sprintf("hScanCursorField%02d", i)
+			Expect(client.HSet(ctx, "hScanCursorTest", field, "value").Err()).NotTo(HaveOccurred())
+			fields[field] = true
+		}
+
+		scanned := make(map[string]bool)
+		var cursor uint64
+		for {
+			hScan := client.HScan(ctx, "hScanCursorTest", cursor, "*", 3)
+			Expect(hScan.Err()).NotTo(HaveOccurred())
+			keys, next := hScan.Val()
+			for i := 0; i < len(keys); i += 2 {
+				scanned[keys[i]] = true
+			}
+			if next == 0 {
+				break
+			}
+			cursor = next
+		}
+		Expect(scanned).To(Equal(fields))
+	})
 })
@@ -279,6 +279,19 @@ var _ = Describe("Set", Ordered, func() {
 		Expect(sIsMember.Val()).To(Equal(true))
 	})
 
+	It("should SMIsMember", func() {
+		sAdd := client.SAdd(ctx, "set", "one", "two")
+		Expect(sAdd.Err()).NotTo(HaveOccurred())
+
+		sMIsMember := client.SMIsMember(ctx, "set", "one", "three", "two")
+		Expect(sMIsMember.Err()).NotTo(HaveOccurred())
+		Expect(sMIsMember.Val()).To(Equal([]bool{true, false, true}))
+
+		sMIsMember = client.SMIsMember(ctx, "nonexistent_set", "one")
+		Expect(sMIsMember.Err()).NotTo(HaveOccurred())
+		Expect(sMIsMember.Val()).To(Equal([]bool{false}))
+	})
+
 	It("should SRem", func() {
 		sAdd := client.SAdd(ctx, "set", "one")
 		Expect(sAdd.Err()).NotTo(HaveOccurred())
@@ -326,6 +339,10 @@ var _ = Describe("Set", Ordered, func() {
 		sMembers := client.SMembers(ctx, "setSMembers")
 		Expect(sMembers.Err()).NotTo(HaveOccurred())
 		Expect(sMembers.Val()).To(ConsistOf([]string{"Hello", "World"}))
+
+		sMembers = client.SMembers(ctx, "setSMembersNotExist")
+		Expect(sMembers.Err()).NotTo(HaveOccurred())
+		Expect(sMembers.Val()).To(BeEmpty())
 	})
 
 	It("should SDiff", func() {
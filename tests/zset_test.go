@@ -460,6 +460,15 @@ var _ = Describe("Zset", Ordered, func() {
 		Expect(rem).To(Equal(float64(6)))
 	})
 
+	It("should ZMScore", func() {
+		err := client.ZAdd(ctx, "zmscore", redis.Z{Score: 1, Member: "one"}, redis.Z{Score: 2.5, Member: "two"}).Err()
+		Expect(err).NotTo(HaveOccurred())
+
+		scores, err := client.ZMScore(ctx, "zmscore", "two", "one").Result()
+		Expect(err).NotTo(HaveOccurred())
+		Expect(scores).To(Equal([]float64{2.5, 1}))
+	})
+
 	It("should ZRemRangeByScore", func() {
 		err := client.ZAdd(ctx, "zset", redis.Z{Score: 1, Member: "one"}).Err()
 		Expect(err).NotTo(HaveOccurred())